@@ -0,0 +1,26 @@
+#version 450
+
+// Nothing is read from vertex buffers. Each instance draws one row of tiles, six vertices per tile.
+uniform layout(location = 5) mat4x4 transform;
+uniform layout(location = 14) float tileWidth;
+uniform layout(location = 16) vec4 tileColour1;
+uniform layout(location = 17) vec4 tileColour2;
+#include "include/vertexOutputs.glsl"
+
+// The corners of a tile's two triangles, relative to its centre, wound like generateChessboard()'s
+const vec2 corners[6] = vec2[6](
+    vec2(-0.5, -0.5), vec2(0.5, 0.5), vec2(0.5, -0.5),
+    vec2(-0.5, -0.5), vec2(-0.5, 0.5), vec2(0.5, 0.5)
+);
+
+void main()
+{
+    int x = gl_VertexID / 6;
+    int y = gl_InstanceID;
+    vec2 corner = (vec2(x, y) + corners[gl_VertexID % 6]) * tileWidth;
+
+    vec4 temp = transform * vec4(corner.x, 0.0, corner.y, 1.0);
+    gl_Position = temp;
+    pos = temp;
+    colour2 = ((x ^ y) & 1) == 1 ? tileColour1 : tileColour2;
+}
@@ -0,0 +1,62 @@
+// Point lights, looked up through the cluster grid of ClusteredLighting (see clusteredLighting.hpp)
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 colourIntensity;
+};
+
+layout(std430, binding = 2) readonly buffer Lights {
+    PointLight lights[];
+};
+
+// Per cluster, the offset and length of its run of clusterLights
+layout(std430, binding = 3) readonly buffer Clusters {
+    uvec2 clusters[];
+};
+
+layout(std430, binding = 4) readonly buffer ClusterLights {
+    uint clusterLights[];
+};
+
+// Tiles across, tiles down and slices
+uniform layout(location = 19) uvec3 clusterCounts;
+uniform layout(location = 20) vec2 viewportSize;
+// Near plane, far plane, and the scale and bias turning log(depth) into a slice
+uniform layout(location = 21) vec4 clusterDepth;
+uniform layout(location = 22) vec3 ambientLight;
+
+uint clusterIndex()
+{
+    // The distance from the camera, undoing the perspective projection of the depth
+    float nearPlane = clusterDepth.x;
+    float farPlane = clusterDepth.y;
+    float depth = 2.0 * nearPlane * farPlane / (farPlane + nearPlane - (2.0 * gl_FragCoord.z - 1.0) * (farPlane - nearPlane));
+
+    uint slice = uint(clamp(log(depth) * clusterDepth.z + clusterDepth.w, 0.0, float(clusterCounts.z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / viewportSize * vec2(clusterCounts.xy)), clusterCounts.xy - 1);
+    return (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x;
+}
+
+// The light reaching a surface, with a normal of zero length standing for the surface's face normal
+vec3 clusteredLighting(vec3 position, vec3 normal)
+{
+    // Derivatives are only defined outside of branches, so the face normal is always worked out
+    vec3 faceNormal = normalize(cross(dFdx(position), dFdy(position)));
+    normal = dot(normal, normal) > 1e-6 ? normalize(normal) : faceNormal;
+
+    vec3 light = ambientLight;
+    uvec2 cluster = clusters[clusterIndex()];
+    for (uint i = cluster.x; i < cluster.x + cluster.y; i++) {
+        PointLight pointLight = lights[clusterLights[i]];
+        vec3 toLight = pointLight.positionRadius.xyz - position;
+        float distanceSquared = dot(toLight, toLight);
+        float radiusSquared = pointLight.positionRadius.w * pointLight.positionRadius.w;
+        if (distanceSquared < radiusSquared) {
+            // Smoothly down to nothing at the radius
+            float falloff = 1.0 - distanceSquared / radiusSquared;
+            float diffuse = max(dot(normal, toLight * inversesqrt(distanceSquared)), 0.0);
+            light += pointLight.colourIntensity.rgb * (pointLight.colourIntensity.w * falloff * falloff * diffuse);
+        }
+    }
+    return light;
+}
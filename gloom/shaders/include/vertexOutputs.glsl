@@ -0,0 +1,3 @@
+// What every vertex shader paired with simple.frag hands on to it
+out layout(location = 2) vec4 pos;
+out layout(location = 3) vec4 colour2;
@@ -0,0 +1,95 @@
+#version 450
+// Every way a mesh is transformed, picked at compile time by one of these defines (see shaderVariants.hpp):
+//   none       a single transformation in a uniform
+//   INSTANCED  one transformation per instance, starting at the batch's base instance
+//   INDIRECT   one transformation per draw of a multi-draw, starting at drawOffset
+//   SKINNED    one transformation per bone per instance, picked by each vertex's bone index
+// and independently of those:
+//   LIT        hands the world space position and normal on to simple.frag, to be lit by ClusteredLighting.
+//              The model and normal matrices come from the same place as the transformation: the uniforms at
+//              locations 31 and 32, or the storage buffer at binding 8 at the same index as the transformation.
+//              The normal matrix is the inverse transpose of the model matrix's upper 3x3 (see normalMatrix()).
+//   TEXTURED   hands the texture coordinates on to simple.frag, to be multiplied by the texture's colour
+#if (defined(INSTANCED) || defined(INDIRECT)) && !defined(SKINNED)
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+in layout(location=1) vec4 position;
+in layout(location=4) vec4 colour;
+#include "include/vertexOutputs.glsl"
+
+#if defined(LIT)
+in layout(location=5) vec3 normal;
+out layout(location = 4) vec3 worldPosition;
+out layout(location = 5) vec3 worldNormal;
+
+#if defined(SKINNED) || defined(INSTANCED) || defined(INDIRECT)
+struct ObjectSpace {
+    mat4x4 model;
+    mat4x4 normalMatrix;
+};
+
+layout(std430, binding = 8) readonly buffer ObjectSpaces {
+    ObjectSpace objectSpaces[];
+};
+#else
+uniform layout(location = 31) mat4x4 model;
+uniform layout(location = 32) mat4x4 normalMatrix;
+#endif
+#endif
+
+#if defined(TEXTURED)
+in layout(location=2) vec2 textureCoordinate;
+out layout(location = 6) vec2 textureCoordinate2;
+#endif
+
+#if defined(SKINNED)
+in layout(location=6) uint boneIndex;
+uniform layout(location = 11) uint boneCount;
+
+// The transformation matrices of every bone of every instance, boneCount matrices per instance
+layout(std430, binding = 1) readonly buffer BonePalette {
+    mat4x4 bones[];
+};
+#elif defined(INSTANCED) || defined(INDIRECT)
+#if defined(INDIRECT)
+uniform layout(location = 10) uint drawOffset;
+#endif
+
+// The transformation matrices of the frame
+layout(std430, binding = 0) readonly buffer Transforms {
+    mat4x4 transforms[];
+};
+#else
+uniform layout(location = 5) mat4x4 transform;
+#endif
+
+void main()
+{
+#if defined(SKINNED)
+    uint matrixIndex = gl_InstanceID * boneCount + boneIndex;
+    mat4x4 modelViewProjection = bones[matrixIndex];
+#elif defined(INDIRECT)
+    uint matrixIndex = drawOffset + gl_DrawIDARB;
+    mat4x4 modelViewProjection = transforms[matrixIndex];
+#elif defined(INSTANCED)
+    uint matrixIndex = gl_BaseInstanceARB + gl_InstanceID;
+    mat4x4 modelViewProjection = transforms[matrixIndex];
+#else
+    mat4x4 modelViewProjection = transform;
+#endif
+#if defined(LIT) && (defined(SKINNED) || defined(INSTANCED) || defined(INDIRECT))
+    worldPosition = (objectSpaces[matrixIndex].model * position).xyz;
+    worldNormal = mat3(objectSpaces[matrixIndex].normalMatrix) * normal;
+#elif defined(LIT)
+    worldPosition = (model * position).xyz;
+    worldNormal = mat3(normalMatrix) * normal;
+#endif
+    vec4 temp = modelViewProjection * position;
+    gl_Position = temp;
+    pos = temp;
+    colour2 = colour;
+#if defined(TEXTURED)
+    textureCoordinate2 = textureCoordinate;
+#endif
+}
@@ -4,8 +4,29 @@ in layout(location=2) vec4 pos;
 in layout(location=3) vec4 colour;
 out vec4 color;
 
+#if defined(LIT)
+#include "include/clusteredLighting.glsl"
+
+in layout(location=4) vec3 worldPosition;
+in layout(location=5) vec3 worldNormal;
+#endif
+
+#if defined(TEXTURED)
+// A texture of its own or an atlas page; atlased meshes' texture coordinates already point into their image
+layout(binding = 0) uniform sampler2D colourTexture;
+in layout(location=6) vec2 textureCoordinate;
+#endif
+
 void main()
 {
-    color = colour;
-
-}
\ No newline at end of file
+#if defined(TEXTURED)
+    vec4 baseColour = colour * texture(colourTexture, textureCoordinate);
+#else
+    vec4 baseColour = colour;
+#endif
+#if defined(LIT)
+    color = vec4(baseColour.rgb * clusteredLighting(worldPosition, worldNormal), baseColour.a);
+#else
+    color = baseColour;
+#endif
+}
@@ -0,0 +1,14 @@
+#version 450
+
+in layout(location=2) vec4 pos;
+uniform layout(location = 14) float tileWidth;
+uniform layout(location = 16) vec4 tileColour1;
+uniform layout(location = 17) vec4 tileColour2;
+out vec4 color;
+
+void main()
+{
+    // The same tiles as generateChessboard(), whatever level of detail the chunk is drawn at
+    ivec2 tile = ivec2(floor(pos.xz / tileWidth + 0.5));
+    color = ((tile.x ^ tile.y) & 1) == 1 ? tileColour1 : tileColour2;
+}
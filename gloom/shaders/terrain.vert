@@ -0,0 +1,19 @@
+#version 450
+
+// Only the height of each vertex is stored, its place on the board follows from its index within the chunk
+in layout(location=1) float height;
+uniform layout(location = 5) mat4x4 transform;
+uniform layout(location = 12) ivec2 chunkOrigin;
+uniform layout(location = 13) int verticesPerSide;
+uniform layout(location = 14) float tileWidth;
+uniform layout(location = 15) ivec2 boardSize;
+out layout(location = 2) vec4 pos;
+
+void main()
+{
+    // Chunks sticking out past the edge of the board fold their extra vertices onto the edge
+    ivec2 corner = min(chunkOrigin + ivec2(gl_VertexID % verticesPerSide, gl_VertexID / verticesPerSide), boardSize);
+    vec2 horizontal = (vec2(corner) - 0.5) * tileWidth;
+    pos = vec4(horizontal.x, height, horizontal.y, 1.0);
+    gl_Position = transform * pos;
+}
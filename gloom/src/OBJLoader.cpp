@@ -22,6 +22,7 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 	std::ifstream objFile(srcFile);
 	std::vector<float4> vertices;
 	std::vector<float3> normals;
+	std::vector<float2> textureCoordinates;
 
 	if (objFile.is_open()) {
 		std::string line;
@@ -45,6 +46,11 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 					   std::stof(parts.at(2)),
 					   std::stof(parts.at(3))
 				   );
+			   } else if (parts.at(0) == "vt" && parts.size() >= 3) {
+				   textureCoordinates.emplace_back(
+					   std::stof(parts.at(1)),
+					   std::stof(parts.at(2))
+				   );
 			   } else if (parts.at(0) == "f" && parts.size() >= 4) {
 				   if (meshes.size() == 0) {
 					   if (!quiet) {
@@ -74,8 +80,11 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 					}
 
 					mesh.hasNormals = parts1.size() >= 3;
+					// Faces written as v//vn have normals but no texture coordinates
+					bool hasTextureCoordinates = parts1.size() >= 2 && !parts1.at(1).empty();
 					
 					size_t n1_index, n2_index, n3_index, n4_index;
+					size_t t1_index = 0, t2_index = 0, t3_index = 0, t4_index = 0;
 					size_t v4_index;
 					size_t v1_index = std::stoi(parts1.at(0)) - 1;
 					size_t v2_index = std::stoi(parts2.at(0)) - 1;
@@ -120,7 +129,35 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 						}
 					}
 
+					if (hasTextureCoordinates) {
+						t1_index = std::stoi(parts1.at(1)) - 1;
+						t2_index = std::stoi(parts2.at(1)) - 1;
+						t3_index = std::stoi(parts3.at(1)) - 1;
+						if (quadruple) {
+							t4_index = std::stoi(parts4.at(1)) - 1;
+						}
+						if (t1_index >= textureCoordinates.size() ||
+							t2_index >= textureCoordinates.size() ||
+							t3_index >= textureCoordinates.size() ||
+							(quadruple && t4_index >= textureCoordinates.size())) {
+									if (!quiet) {
+										std::cout << "[WARNING] Mesh " << mesh.name << " faces texture coordinates(" << t1_index << ", " << t2_index << ", " << t3_index;
+										if (quadruple)
+											std::cout << ", " << t4_index;
+										std::cout << ") do not exist!" << std::endl;
+									}
+									continue;
+						}
+						// Faces read before the first one with texture coordinates get zeros
+						mesh.textureCoordinates.resize(mesh.vertices.size());
+					}
+
 					if (quadruple) {
+						if (hasTextureCoordinates) {
+							mesh.textureCoordinates.push_back(textureCoordinates.at(t1_index));
+							mesh.textureCoordinates.push_back(textureCoordinates.at(t3_index));
+							mesh.textureCoordinates.push_back(textureCoordinates.at(t4_index));
+						}
 						mesh.vertices.push_back(vertices.at(v1_index));
 						mesh.vertices.push_back(vertices.at(v3_index));
 						mesh.vertices.push_back(vertices.at(v4_index));
@@ -138,6 +175,11 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 						mesh.indices.push_back(unsigned(mesh.indices.size()));
 					}
 
+					if (hasTextureCoordinates) {
+						mesh.textureCoordinates.push_back(textureCoordinates.at(t1_index));
+						mesh.textureCoordinates.push_back(textureCoordinates.at(t2_index));
+						mesh.textureCoordinates.push_back(textureCoordinates.at(t3_index));
+					}
 					mesh.vertices.push_back(vertices.at(v1_index));
 					mesh.vertices.push_back(vertices.at(v2_index));
 					mesh.vertices.push_back(vertices.at(v3_index));
@@ -148,6 +190,10 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 					} else {
 						mesh.normals.insert(mesh.normals.end(), { 0.0f, 0.0f, 0.0f });
 					}
+					// And faces without them in a mesh which has some, too
+					if (!mesh.textureCoordinates.empty()) {
+						mesh.textureCoordinates.resize(mesh.vertices.size());
+					}
 
 					mesh.indices.push_back(unsigned(mesh.indices.size()));
 					mesh.indices.push_back(unsigned(mesh.indices.size()));
@@ -165,18 +211,18 @@ std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet)
 // This function assumes a mesh with rectangular sides (pairs of triangles), and assigns each side random colours.
 // It also assumes vertices have been duplicated, which is done by the loadWavefront function.
 
-void colourFaces(Mesh &mesh) {
+void colourFaces(Mesh &mesh, Random &random) {
 	int sides = mesh.faceCount() / 2;
 
 	// Allocate capacity
 	mesh.colours.resize(mesh.vertices.size(), 0);
 
-	for(int side = 0; side < sides; side++) {
-		float rand_red = randomUniformFloat();
-		float rand_green = randomUniformFloat();
-		float rand_blue = randomUniformFloat();
+	// Red, green and blue of every side, generated all at once
+	std::vector<float> channels(3 * size_t(std::max(sides, 0)));
+	random.fillUniform(channels.data(), channels.size());
 
-		float4 randomColour(rand_red, rand_green, rand_blue, 1.0);
+	for(int side = 0; side < sides; side++) {
+		float4 randomColour(channels[3 * side + 0], channels[3 * side + 1], channels[3 * side + 2], 1.0);
 
 		mesh.colours.at(side * 6 + 0) = randomColour;
 		mesh.colours.at(side * 6 + 1) = randomColour;
@@ -187,15 +233,16 @@ void colourFaces(Mesh &mesh) {
 	}
 }
 
-MinecraftCharacter loadMinecraftCharacterModel(std::string const srcFile) {
+MinecraftCharacter loadMinecraftCharacterModel(std::string const srcFile, uint64_t colourStream) {
 	std::vector<Mesh> fileContents = loadWavefront(srcFile, true);
+	Random random = randomStream(colourStream);
 
 	MinecraftCharacter out;
 
 	for(Mesh mesh : fileContents) {
 	    // Applying some colour to the different parts
         // Feel free to replace this with something more decorative
-        colourFaces(mesh);
+        colourFaces(mesh, random);
 
 		// You usually want to use enums for a situation like this.
 		// It will do the job for us, though.
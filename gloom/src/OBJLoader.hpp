@@ -9,6 +9,7 @@
 #include <limits>
 #include "floats.hpp"
 #include "mesh.hpp"
+#include "random.hpp"
 
 struct MinecraftCharacter {
 	Mesh leftLeg = Mesh("<missing>");
@@ -19,6 +20,11 @@ struct MinecraftCharacter {
 	Mesh head = Mesh("<missing>");
 };
 
-MinecraftCharacter loadMinecraftCharacterModel(std::string const srcFile); 
+// The parts are coloured by colourFaces() with the given stream of the master seed, so the same stream
+// gives the same colours every run
+MinecraftCharacter loadMinecraftCharacterModel(std::string const srcFile, uint64_t colourStream = 0);
 
-std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet = true);
\ No newline at end of file
+std::vector<Mesh> loadWavefront(std::string const srcFile, bool quiet = true);
+
+// Gives each rectangular side of a mesh loaded by loadWavefront() a random colour
+void colourFaces(Mesh &mesh, Random &random);
\ No newline at end of file
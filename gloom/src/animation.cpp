@@ -0,0 +1,345 @@
+#include "animation.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_USE_SSE 1
+#endif
+
+// Instances are handed to the thread pool in runs of at most this many
+static const unsigned int maximumBatchSize = 256;
+
+AnimationClip::AnimationClip(std::string const &name, float duration, bool isLooping, float sampleRate)
+    : name(name), duration(std::max(duration, 1e-3f)), isLooping(isLooping) {
+    intervalCount = unsigned(std::max(1.0f, std::round(this->duration * sampleRate)));
+    this->sampleRate = float(intervalCount) / this->duration;
+}
+
+// Linear interpolation between the keyframes around time, holding the first and last values
+static float3 interpolateKeyframes(std::vector<Keyframe> const &keyframes, float time) {
+    if (time <= keyframes.front().time) {
+        return keyframes.front().value;
+    }
+    for (size_t i = 1; i < keyframes.size(); i++) {
+        if (time <= keyframes[i].time) {
+            Keyframe const &previous = keyframes[i - 1];
+            Keyframe const &next = keyframes[i];
+            float span = next.time - previous.time;
+            float t = span > 0.0f ? (time - previous.time) / span : 1.0f;
+            return previous.value + (next.value - previous.value) * t;
+        }
+    }
+    return keyframes.back().value;
+}
+
+void AnimationClip::addChannel(unsigned int target, AnimationProperty property, std::vector<Keyframe> const &keyframes) {
+    if (keyframes.empty()) {
+        fprintf(stderr, "Animation clip \"%s\": ignoring channel without keyframes\n", name.c_str());
+        return;
+    }
+
+    AnimationChannel channel;
+    channel.target = target;
+    channel.property = property;
+    for (unsigned int sample = 0; sample <= intervalCount; sample++) {
+        float3 value = interpolateKeyframes(keyframes, float(sample) / sampleRate);
+        channel.x.push_back(value.x);
+        channel.y.push_back(value.y);
+        channel.z.push_back(value.z);
+    }
+    channels.push_back(channel);
+}
+
+bool AnimationClip::hasSameChannels(AnimationClip const &other) const {
+    if (channels.size() != other.channels.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i].target != other.channels[i].target || channels[i].property != other.channels[i].property) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Animator::Animator(ThreadPool &pool) : pool(pool) {}
+
+unsigned int Animator::addClip(AnimationClip const &clip) {
+    clips.push_back(clip);
+    return unsigned(clips.size() - 1);
+}
+
+unsigned int Animator::addInstance(std::vector<SceneNode*> const &instanceTargets) {
+    clipIDs.push_back(-1);
+    blendClipIDs.push_back(-1);
+    times.push_back(0.0f);
+    blendTimes.push_back(0.0f);
+    speeds.push_back(1.0f);
+    blendWeights.push_back(0.0f);
+    blendRates.push_back(0.0f);
+
+    targetOffsets.push_back(unsigned(targets.size()));
+    targetCounts.push_back(unsigned(instanceTargets.size()));
+    targets.insert(targets.end(), instanceTargets.begin(), instanceTargets.end());
+
+    areBatchesOutdated = true;
+    return unsigned(times.size() - 1);
+}
+
+void Animator::play(unsigned int instance, unsigned int clip, float time, float speed) {
+    for (AnimationChannel const &channel : clips.at(clip).getChannels()) {
+        if (channel.target >= targetCounts.at(instance)) {
+            fprintf(stderr, "Animation clip \"%s\" animates target %u, but instance %u only has %u targets\n",
+                    clips.at(clip).getName().c_str(), channel.target, instance, targetCounts.at(instance));
+            return;
+        }
+    }
+
+    clipIDs.at(instance) = int(clip);
+    blendClipIDs.at(instance) = -1;
+    times.at(instance) = time;
+    speeds.at(instance) = speed;
+    blendWeights.at(instance) = 0.0f;
+    blendRates.at(instance) = 0.0f;
+    areBatchesOutdated = true;
+}
+
+void Animator::setSpeed(unsigned int instance, float speed) {
+    speeds.at(instance) = speed;
+}
+
+bool Animator::canBlend(unsigned int instance, unsigned int clip) const {
+    int playing = clipIDs.at(instance);
+    if (playing == -1 || !clips.at(unsigned(playing)).hasSameChannels(clips.at(clip))) {
+        fprintf(stderr, "Cannot blend animation clip \"%s\" into instance %u: its channels differ from the playing clip\n",
+                clips.at(clip).getName().c_str(), instance);
+        return false;
+    }
+    return true;
+}
+
+void Animator::setBlend(unsigned int instance, unsigned int clip, float weight) {
+    if (!canBlend(instance, clip)) {
+        return;
+    }
+    if (blendClipIDs.at(instance) != int(clip)) {
+        blendTimes.at(instance) = 0.0f;
+    }
+    blendClipIDs.at(instance) = int(clip);
+    blendWeights.at(instance) = std::min(std::max(weight, 0.0f), 1.0f);
+    blendRates.at(instance) = 0.0f;
+    areBatchesOutdated = true;
+}
+
+void Animator::crossFade(unsigned int instance, unsigned int clip, float fadeSeconds) {
+    if (fadeSeconds <= 0.0f || !canBlend(instance, clip)) {
+        play(instance, clip, 0.0f, speeds.at(instance));
+        return;
+    }
+    blendClipIDs.at(instance) = int(clip);
+    blendTimes.at(instance) = 0.0f;
+    blendWeights.at(instance) = 0.0f;
+    blendRates.at(instance) = 1.0f / fadeSeconds;
+    areBatchesOutdated = true;
+}
+
+void Animator::rebuildBatches() {
+    evaluationOrder.clear();
+    for (unsigned int i = 0; i < clipIDs.size(); i++) {
+        if (clipIDs[i] != -1) {
+            evaluationOrder.push_back(i);
+        }
+    }
+    std::stable_sort(evaluationOrder.begin(), evaluationOrder.end(), [this](unsigned int a, unsigned int b) {
+        return clipIDs[a] != clipIDs[b] ? clipIDs[a] < clipIDs[b] : blendClipIDs[a] < blendClipIDs[b];
+    });
+
+    batches.clear();
+    unsigned int first = 0;
+    while (first < evaluationOrder.size()) {
+        unsigned int instance = evaluationOrder[first];
+        Batch batch;
+        batch.first = first;
+        batch.count = 1;
+        batch.clip = clipIDs[instance];
+        batch.blendClip = blendClipIDs[instance];
+        while (first + batch.count < evaluationOrder.size() && batch.count < maximumBatchSize
+               && clipIDs[evaluationOrder[first + batch.count]] == batch.clip
+               && blendClipIDs[evaluationOrder[first + batch.count]] == batch.blendClip) {
+            batch.count++;
+        }
+        batches.push_back(batch);
+        first += batch.count;
+    }
+    areBatchesOutdated = false;
+}
+
+void Animator::update(float deltaSeconds) {
+    for (size_t i = 0; i < times.size(); i++) {
+        times[i] += deltaSeconds * speeds[i];
+        blendTimes[i] += deltaSeconds * speeds[i];
+
+        // A finished cross-fade leaves only the new clip playing
+        if (blendRates[i] != 0.0f) {
+            blendWeights[i] += deltaSeconds * blendRates[i];
+            if (blendWeights[i] >= 1.0f) {
+                clipIDs[i] = blendClipIDs[i];
+                times[i] = blendTimes[i];
+                blendClipIDs[i] = -1;
+                blendWeights[i] = 0.0f;
+                blendRates[i] = 0.0f;
+                areBatchesOutdated = true;
+            }
+        }
+    }
+
+    if (areBatchesOutdated) {
+        rebuildBatches();
+    }
+    pool.parallelFor(batches.size(), [this](size_t index, unsigned int) {
+        PROFILE_SCOPE("evaluateBatch");
+        evaluateBatch(batches[index]);
+    });
+}
+
+// Everything below works on four instances ("lanes") at a time
+
+#ifdef ANIMATION_USE_SSE
+// _mm_floor_ps needs SSE4.1; truncating and correcting for negative values only needs SSE2
+static __m128 floorLanes(__m128 values) {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(values));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, values), _mm_set1_ps(1.0f)));
+}
+#endif
+
+// Turns the playback times into the index of the sample before each time and the fraction
+// of the way to the next one. Looping clips wrap the times, others clamp them to the clip;
+// the times are written back that way, so they never grow large enough to lose precision.
+static void findSamples(AnimationClip const &clip, float times[4], int sampleIndices[4], float fractions[4]) {
+    float lastIndex = float(clip.getIntervalCount() - 1);
+#ifdef ANIMATION_USE_SSE
+    __m128 time = _mm_loadu_ps(times);
+    __m128 duration = _mm_set1_ps(clip.getDuration());
+    if (clip.getIsLooping()) {
+        __m128 cycles = floorLanes(_mm_mul_ps(time, _mm_set1_ps(1.0f / clip.getDuration())));
+        time = _mm_sub_ps(time, _mm_mul_ps(cycles, duration));
+    }
+    time = _mm_min_ps(_mm_max_ps(time, _mm_setzero_ps()), duration);
+    _mm_storeu_ps(times, time);
+
+    __m128 position = _mm_mul_ps(time, _mm_set1_ps(clip.getSampleRate()));
+    __m128 index = _mm_min_ps(floorLanes(position), _mm_set1_ps(lastIndex));
+    _mm_storeu_ps(fractions, _mm_sub_ps(position, index));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sampleIndices), _mm_cvttps_epi32(index));
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        float time = times[lane];
+        if (clip.getIsLooping()) {
+            time -= std::floor(time / clip.getDuration()) * clip.getDuration();
+        }
+        time = std::min(std::max(time, 0.0f), clip.getDuration());
+        times[lane] = time;
+
+        float position = time * clip.getSampleRate();
+        float index = std::min(std::floor(position), lastIndex);
+        fractions[lane] = position - index;
+        sampleIndices[lane] = int(index);
+    }
+#endif
+}
+
+// result[lane] = the samples interpolated at sampleIndices[lane] + fractions[lane]
+static void interpolateSamples(std::vector<float> const &samples, int const sampleIndices[4], float const fractions[4], float result[4]) {
+#ifdef ANIMATION_USE_SSE
+    __m128 before = _mm_set_ps(samples[sampleIndices[3]], samples[sampleIndices[2]], samples[sampleIndices[1]], samples[sampleIndices[0]]);
+    __m128 after = _mm_set_ps(samples[sampleIndices[3] + 1], samples[sampleIndices[2] + 1], samples[sampleIndices[1] + 1], samples[sampleIndices[0] + 1]);
+    __m128 fraction = _mm_loadu_ps(fractions);
+    _mm_storeu_ps(result, _mm_add_ps(before, _mm_mul_ps(fraction, _mm_sub_ps(after, before))));
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        float before = samples[sampleIndices[lane]];
+        float after = samples[sampleIndices[lane] + 1];
+        result[lane] = before + fractions[lane] * (after - before);
+    }
+#endif
+}
+
+// values[lane] = values[lane] blended towards blendValues[lane] by weights[lane]
+static void blendLanes(float values[4], float const blendValues[4], float const weights[4]) {
+#ifdef ANIMATION_USE_SSE
+    __m128 value = _mm_loadu_ps(values);
+    __m128 blendValue = _mm_loadu_ps(blendValues);
+    _mm_storeu_ps(values, _mm_add_ps(value, _mm_mul_ps(_mm_loadu_ps(weights), _mm_sub_ps(blendValue, value))));
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        values[lane] += weights[lane] * (blendValues[lane] - values[lane]);
+    }
+#endif
+}
+
+static float3 &animatedProperty(SceneNode* node, AnimationProperty property) {
+    switch (property) {
+        case AnimationProperty::Position: return node->position;
+        case AnimationProperty::Rotation: return node->rotation;
+        default: return node->scale;
+    }
+}
+
+void Animator::evaluateBatch(Batch const &batch) {
+    AnimationClip const &clip = clips[unsigned(batch.clip)];
+    AnimationClip const* blendClip = batch.blendClip == -1 ? nullptr : &clips[unsigned(batch.blendClip)];
+    std::vector<AnimationChannel> const &channels = clip.getChannels();
+
+    for (unsigned int first = 0; first < batch.count; first += 4) {
+        // A partial group repeats its last instance in the unused lanes, and only writes back the used ones
+        unsigned int laneCount = std::min(4u, batch.count - first);
+        unsigned int instances[4];
+        float laneTimes[4], laneBlendTimes[4], laneWeights[4];
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            instances[lane] = evaluationOrder[batch.first + first + std::min(lane, laneCount - 1)];
+            laneTimes[lane] = times[instances[lane]];
+            laneBlendTimes[lane] = blendTimes[instances[lane]];
+            laneWeights[lane] = blendWeights[instances[lane]];
+        }
+
+        int sampleIndices[4], blendSampleIndices[4];
+        float fractions[4], blendFractions[4];
+        findSamples(clip, laneTimes, sampleIndices, fractions);
+        if (blendClip != nullptr) {
+            findSamples(*blendClip, laneBlendTimes, blendSampleIndices, blendFractions);
+        }
+        for (unsigned int lane = 0; lane < laneCount; lane++) {
+            times[instances[lane]] = laneTimes[lane];
+            blendTimes[instances[lane]] = laneBlendTimes[lane];
+        }
+
+        for (size_t c = 0; c < channels.size(); c++) {
+            AnimationChannel const &channel = channels[c];
+            float values[3][4];
+            interpolateSamples(channel.x, sampleIndices, fractions, values[0]);
+            interpolateSamples(channel.y, sampleIndices, fractions, values[1]);
+            interpolateSamples(channel.z, sampleIndices, fractions, values[2]);
+
+            if (blendClip != nullptr) {
+                AnimationChannel const &blendChannel = blendClip->getChannels()[c];
+                float blendValues[3][4];
+                interpolateSamples(blendChannel.x, blendSampleIndices, blendFractions, blendValues[0]);
+                interpolateSamples(blendChannel.y, blendSampleIndices, blendFractions, blendValues[1]);
+                interpolateSamples(blendChannel.z, blendSampleIndices, blendFractions, blendValues[2]);
+                for (int component = 0; component < 3; component++) {
+                    blendLanes(values[component], blendValues[component], laneWeights);
+                }
+            }
+
+            for (unsigned int lane = 0; lane < laneCount; lane++) {
+                unsigned int instance = instances[lane];
+                float3 &property = animatedProperty(targets[targetOffsets[instance] + channel.target], channel.property);
+                property = float3(values[0][lane], values[1][lane], values[2][lane]);
+            }
+        }
+    }
+}
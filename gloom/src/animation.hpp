@@ -0,0 +1,134 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "floats.hpp"
+#include "sceneGraph.hpp"
+#include "threadPool.hpp"
+
+// The property of a scene node an animation channel drives
+enum class AnimationProperty {
+    Position,
+    Rotation,
+    Scale
+};
+
+// The value of a channel at a point in time, in seconds from the start of the clip.
+// Rotations are Euler angles in degrees, like SceneNode::rotation.
+struct Keyframe {
+    float time;
+    float3 value;
+};
+
+// One animated property of one node. target indexes the list of nodes an instance was created with.
+// The values are stored resampled at the clip's fixed sample rate, one array per component,
+// so evaluating a channel is a multiply and two lookups rather than a search through keyframes.
+struct AnimationChannel {
+    unsigned int target;
+    AnimationProperty property;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+};
+
+// A set of channels played together, such as a walk cycle.
+class AnimationClip {
+public:
+    // The sample rate is rounded so that a whole number of samples fits in the clip's duration.
+    AnimationClip(std::string const &name, float duration, bool isLooping = true, float sampleRate = 60.0f);
+
+    // Adds a channel, sampling the (linearly interpolated) keyframes at the clip's sample rate.
+    // Keyframes must be sorted by time; before the first and after the last one the value is held.
+    void addChannel(unsigned int target, AnimationProperty property, std::vector<Keyframe> const &keyframes);
+
+    // True if both clips animate the same properties of the same targets, in the same order,
+    // which is required to blend between them.
+    bool hasSameChannels(AnimationClip const &other) const;
+
+    std::string const &getName() const { return name; }
+    float getDuration() const { return duration; }
+    bool getIsLooping() const { return isLooping; }
+    float getSampleRate() const { return sampleRate; }
+    // Every channel has one more sample than there are intervals, so the last interval can be interpolated
+    unsigned int getIntervalCount() const { return intervalCount; }
+    std::vector<AnimationChannel> const &getChannels() const { return channels; }
+
+private:
+    std::string name;
+    float duration;
+    bool isLooping;
+    float sampleRate;
+    unsigned int intervalCount;
+    std::vector<AnimationChannel> channels;
+};
+
+// Plays clips on any number of instances (for instance one per character) and writes the results
+// into their scene nodes. Playback state is stored per instance in flat arrays, and instances playing
+// the same clips are evaluated together, four at a time with SSE, spread over the thread pool.
+class Animator {
+public:
+    explicit Animator(ThreadPool &pool);
+
+    // Returns the ID to play the clip by
+    unsigned int addClip(AnimationClip const &clip);
+
+    // Returns the ID of a new instance animating the given nodes. The target of a channel indexes this list,
+    // so every clip played on the instance must only use targets within it.
+    unsigned int addInstance(std::vector<SceneNode*> const &targets);
+
+    // Starts playing a clip from the given time, cancelling any blend
+    void play(unsigned int instance, unsigned int clip, float time = 0.0f, float speed = 1.0f);
+
+    // Playback speed, applied to both clips when blending. Negative speeds play backwards.
+    void setSpeed(unsigned int instance, float speed);
+
+    // Blends in a second clip at a fixed weight (0 is only the playing clip, 1 is only the new one),
+    // until play() or crossFade() is called. Both clips must have the same channels.
+    void setBlend(unsigned int instance, unsigned int clip, float weight);
+
+    // Blends from the playing clip to another one over fadeSeconds, after which only the new one plays.
+    void crossFade(unsigned int instance, unsigned int clip, float fadeSeconds);
+
+    // Advances every instance by deltaSeconds and writes the animated properties into the target nodes.
+    void update(float deltaSeconds);
+
+    unsigned int getInstanceCount() const { return unsigned(times.size()); }
+    float getTime(unsigned int instance) const { return times.at(instance); }
+
+private:
+    // A run of instances (in evaluation order) playing the same pair of clips
+    struct Batch {
+        unsigned int first;
+        unsigned int count;
+        int clip;
+        int blendClip;
+    };
+
+    void rebuildBatches();
+    void evaluateBatch(Batch const &batch);
+    bool canBlend(unsigned int instance, unsigned int clip) const;
+
+    ThreadPool &pool;
+    std::vector<AnimationClip> clips;
+
+    // Per-instance playback state. clipIDs is -1 for instances which play nothing,
+    // blendClipIDs is -1 for instances which are not blending.
+    std::vector<int> clipIDs;
+    std::vector<int> blendClipIDs;
+    std::vector<float> times;
+    std::vector<float> blendTimes;
+    std::vector<float> speeds;
+    std::vector<float> blendWeights;
+    // Change of the blend weight per second while cross-fading, 0 for a fixed blend
+    std::vector<float> blendRates;
+
+    // The target nodes of instance i are targets[targetOffsets[i]] onwards
+    std::vector<SceneNode*> targets;
+    std::vector<unsigned int> targetOffsets;
+    std::vector<unsigned int> targetCounts;
+
+    // Instances sorted by their clips, rebuilt whenever an instance changes clips
+    std::vector<unsigned int> evaluationOrder;
+    std::vector<Batch> batches;
+    bool areBatchesOutdated = true;
+};
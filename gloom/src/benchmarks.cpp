@@ -0,0 +1,1500 @@
+#include "benchmarks.hpp"
+#include "gloom/gloom.hpp"
+#include "gloom/shader.hpp"
+#include "shaderVariants.hpp"
+#include "character.hpp"
+#include "renderQueue.hpp"
+#include "threadPool.hpp"
+#include "transform.hpp"
+#include "sceneFile.hpp"
+#include "animation.hpp"
+#include "crowd.hpp"
+#include "pathfinder.hpp"
+#include "skinnedMesh.hpp"
+#include "transformRing.hpp"
+#include "proceduralChessboard.hpp"
+#include "program.hpp"
+#include "toolbox.hpp"
+#include "clusteredLighting.hpp"
+#include "occlusionCuller.hpp"
+#include "gpuResources.hpp"
+#include "geometryArena.hpp"
+#include "gpuCuller.hpp"
+#include "spatialHash.hpp"
+#include "random.hpp"
+#include "terrain.hpp"
+#include "textures.hpp"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+// Set while running without a window, in which case there are no GLFW events to poll or swap interval to set
+static bool isHeadless = false;
+
+// Runs frame() frameCount times and returns the average time per frame in milliseconds.
+// glFinish() makes sure the GPU work of each frame is included in the measurement.
+static double timeFrames(unsigned int frameCount, std::function<void()> const &frame) {
+    // One frame to get buffer allocations and shader compilation out of the way
+    frame();
+    glFinish();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < frameCount; i++) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        frame();
+        glFinish();
+        if (!isHeadless) {
+            glfwPollEvents();
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / frameCount;
+}
+
+// A camera looking down on a square grid of characters from far enough away to see all of them
+static glm::mat4 gridCameraView(float gridWidth) {
+    return glm::lookAt(glm::vec3(0.5f * gridWidth, 0.8f * gridWidth, 1.5f * gridWidth),
+                       glm::vec3(0.5f * gridWidth, 0.0f, 0.5f * gridWidth),
+                       glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+static glm::mat4 gridCameraProjection(float gridWidth) {
+    return glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 10.0f * gridWidth);
+}
+
+static glm::mat4 gridCameraTransform(float gridWidth) {
+    return gridCameraProjection(gridWidth) * gridCameraView(gridWidth);
+}
+
+// Draws 10 000 Steves (60 000 parts) through the render queue, once with one draw call per part
+// and once with the parts batched into one instanced draw call per VAO.
+// Then draws them once more as a single skinned mesh, one instanced draw call for all characters.
+static int benchmarkInstancing() {
+    const unsigned int gridSize = 100;
+    const float spacing = 20.0f;
+    const unsigned int frameCount = 100;
+
+    GpuResourceManager resources;
+    MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+    std::vector<GpuMesh> characterMeshes;
+    CharacterModel model = uploadCharacterModel(character, resources, characterMeshes);
+
+    GpuSkinnedMesh skinnedModel;
+    uploadSkinnedMesh(mergeCharacterParts(character), characterPartCount, resources, skinnedModel);
+
+    // The skinned characters get a tree of their own, whose nodes have no meshes and only provide bone matrices
+    SceneNode* rootNode = createSceneNode();
+    SceneNode* skinnedRootNode = createSceneNode();
+    std::vector<std::vector<SceneNode*>> skinnedBones;
+    for (unsigned int x = 0; x < gridSize; x++) {
+        for (unsigned int z = 0; z < gridSize; z++) {
+            CharacterNodes steve = createCharacterNodes(model);
+            CharacterNodes skinnedSteve = createCharacterNodes(CharacterModel());
+            for (CharacterNodes* nodes : {&steve, &skinnedSteve}) {
+                nodes->torso->position = float3(float(x) * spacing, 0.0f, float(z) * spacing);
+                nodes->leftArm->rotation.x = 20.0f;
+                nodes->rightArm->rotation.x = -20.0f;
+            }
+            addChild(rootNode, steve.torso);
+            addChild(skinnedRootNode, skinnedSteve.torso);
+            skinnedBones.push_back(characterAnimationTargets(skinnedSteve));
+        }
+    }
+
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint shader = meshShaders.get(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    if (!isHeadless) {
+        glfwSwapInterval(0);
+    }
+
+    ThreadPool threadPool;
+    RenderQueue renderQueue(threadPool, 10.0f * gridSize * spacing);
+    renderQueue.setInstancedVariant(shader, meshShaders.get(MESH_INSTANCED));
+    glm::mat4 transform = gridCameraTransform(gridSize * spacing);
+
+    double separateMs = timeFrames(frameCount, [&] {
+        renderQueue.record(rootNode, transform, shader);
+        renderQueue.sort();
+        renderQueue.submit();
+    });
+    unsigned int separateDrawCalls = renderQueue.getStats().drawCalls;
+
+    double instancedMs = timeFrames(frameCount, [&] {
+        renderQueue.record(rootNode, transform, shader);
+        renderQueue.sort();
+        renderQueue.submitInstanced();
+    });
+    unsigned int instancedDrawCalls = renderQueue.getStats().drawCalls;
+
+    SkinnedRenderer skinnedRenderer(threadPool, skinnedModel.vao);
+    for (std::vector<SceneNode*> const &bones : skinnedBones) {
+        skinnedRenderer.addInstance(bones);
+    }
+    TransformRing boneRing(gridSize * gridSize * characterPartCount);
+    skinnedRenderer.setTransformRing(&boneRing);
+    // Compiled here, so the timing below does not include it
+    GLuint skinnedShader = meshShaders.get(MESH_SKINNED);
+    double skinnedMs = timeFrames(frameCount, [&] {
+        renderQueue.record(skinnedRootNode, transform, shader);
+        skinnedRenderer.submit(skinnedShader);
+    });
+
+    printf("instancing: %u characters, %u frames\n", gridSize * gridSize, frameCount);
+    printf("  separate:  %8.3f ms/frame, %6u draw calls\n", separateMs, separateDrawCalls);
+    printf("  instanced: %8.3f ms/frame, %6u draw calls\n", instancedMs, instancedDrawCalls);
+    printf("  skinned:   %8.3f ms/frame, %6u draw calls\n", skinnedMs, 1u);
+    printf("  speedup:   %8.2fx instanced, %.2fx skinned\n", separateMs / instancedMs, separateMs / skinnedMs);
+
+    return EXIT_SUCCESS;
+}
+
+// The node transformation as it was originally written: three translations and three Euler rotations,
+// multiplied together with the parent's transformation as seven full 4x4 matrix products
+static glm::mat4 composeWithEulerMatrices(glm::mat4 const &parent, float3 position, float3 rotation, float3 referencePoint) {
+    glm::mat4x4 translationBack = glm::translate(glm::mat4(), glm::vec3(referencePoint.x, referencePoint.y, referencePoint.z));
+    glm::mat4x4 translationOriginPoint = glm::translate(glm::mat4(), glm::vec3(-referencePoint.x, -referencePoint.y, -referencePoint.z));
+    glm::mat4x4 translation = glm::translate(glm::mat4(), glm::vec3(position.x, position.y, position.z));
+
+    glm::mat4x4 x_rotation = glm::rotate(glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::mat4x4 y_rotation = glm::rotate(glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4x4 z_rotation = glm::rotate(glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    return parent * translation * translationBack * z_rotation * y_rotation * x_rotation * translationOriginPoint;
+}
+
+// Composes one million node transformations with the original Euler matrix code and with
+// the quaternion/affine path used by updateNodeTransform(), and checks that both agree.
+static int benchmarkTransforms() {
+    const size_t nodeCount = 1000000;
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+    std::uniform_real_distribution<float> offset(-50.0f, 50.0f);
+
+    std::vector<float3> positions(nodeCount);
+    std::vector<float3> rotations(nodeCount);
+    std::vector<float3> referencePoints(nodeCount);
+    for (size_t i = 0; i < nodeCount; i++) {
+        positions[i] = float3(offset(generator), offset(generator), offset(generator));
+        rotations[i] = float3(angle(generator), angle(generator), angle(generator));
+        referencePoints[i] = float3(offset(generator), offset(generator), offset(generator));
+    }
+
+    glm::mat4 parent = gridCameraTransform(100.0f);
+    std::vector<glm::mat4> eulerResults(nodeCount);
+    std::vector<glm::mat4> affineResults(nodeCount);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nodeCount; i++) {
+        eulerResults[i] = composeWithEulerMatrices(parent, positions[i], rotations[i], referencePoints[i]);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nodeCount; i++) {
+        Affine3x4 local = composeAffine(positions[i], quaternionFromEulerDegrees(rotations[i]), referencePoints[i]);
+        affineResults[i] = multiplyMatrixAffine(parent, local);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    float maximumDifference = 0.0f;
+    for (size_t i = 0; i < nodeCount; i++) {
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                maximumDifference = std::max(maximumDifference, std::abs(eulerResults[i][column][row] - affineResults[i][column][row]));
+            }
+        }
+    }
+
+    double eulerSeconds = std::chrono::duration<double>(middle - start).count();
+    double affineSeconds = std::chrono::duration<double>(end - middle).count();
+    printf("transforms: %zu node transformations\n", nodeCount);
+    printf("  euler mat4:       %8.2f M matrices/s\n", nodeCount / eulerSeconds / 1e6);
+    printf("  quaternion 3x4:   %8.2f M matrices/s\n", nodeCount / affineSeconds / 1e6);
+    printf("  speedup:          %8.2fx\n", eulerSeconds / affineSeconds);
+    printf("  max difference:   %g\n", maximumDifference);
+    return EXIT_SUCCESS;
+}
+
+// Writes a scene of about 100 000 nodes (Steves on a grid) to a scene file and loads it back,
+// comparing the load time against building the same graph with createSceneNode()/addChild().
+static int benchmarkSceneLoad() {
+    const unsigned int gridSize = 130;
+    const unsigned int loadCount = 10;
+    const std::string filePath = "./scene_benchmark.gscene";
+
+    GpuResourceManager resources;
+    MeshCache meshCache(resources);
+    std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+    CharacterModel model = loadCharacterModel("./gloom/src/steve.obj", meshCache);
+    std::chrono::steady_clock::time_point meshesLoaded = std::chrono::steady_clock::now();
+
+    SceneNode* rootNode = createSceneNode();
+    for (unsigned int x = 0; x < gridSize; x++) {
+        for (unsigned int z = 0; z < gridSize; z++) {
+            CharacterNodes steve = createCharacterNodes(model);
+            steve.torso->position = float3(float(x) * 20.0f, 0.0f, float(z) * 20.0f);
+            addChild(rootNode, steve.torso);
+        }
+    }
+    std::chrono::steady_clock::time_point buildEnd = std::chrono::steady_clock::now();
+
+    if (!writeSceneFile(filePath, rootNode, meshCache)) {
+        return EXIT_FAILURE;
+    }
+    std::chrono::steady_clock::time_point writeEnd = std::chrono::steady_clock::now();
+
+    LoadedScene scene;
+    double totalLoadMs = 0.0;
+    double fastestLoadMs = 0.0;
+    for (unsigned int i = 0; i < loadCount; i++) {
+        std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+        if (!loadSceneFile(filePath, meshCache, scene)) {
+            return EXIT_FAILURE;
+        }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+        totalLoadMs += loadMs;
+        fastestLoadMs = i == 0 ? loadMs : std::min(fastestLoadMs, loadMs);
+    }
+    std::remove(filePath.c_str());
+
+    printf("scene-load: %zu nodes\n", scene.nodes.size());
+    printf("  mesh loading:            %8.3f ms (once, cached afterwards)\n",
+           std::chrono::duration<double, std::milli>(meshesLoaded - buildStart).count());
+    printf("  build graph in code:     %8.3f ms\n", std::chrono::duration<double, std::milli>(buildEnd - meshesLoaded).count());
+    printf("  write scene file:        %8.3f ms\n", std::chrono::duration<double, std::milli>(writeEnd - buildEnd).count());
+    printf("  load scene file:         %8.3f ms average, %.3f ms fastest over %u loads\n",
+           totalLoadMs / loadCount, fastestLoadMs, loadCount);
+    return EXIT_SUCCESS;
+}
+
+// Animates 20 000 Steves with the walk cycle clip, half of them cross-fading into a faster run
+// and back, and compares the cost of Animator::update() with evaluating the walk cycle by hand
+// (one sin() per limb per character, as the render loop used to).
+static int benchmarkAnimation() {
+    const unsigned int characterCount = 20000;
+    const unsigned int frameCount = 200;
+    const float frameSeconds = 1.0f / 60.0f;
+
+    CharacterModel model;
+    std::vector<CharacterNodes> characters;
+    for (unsigned int i = 0; i < characterCount; i++) {
+        characters.push_back(createCharacterNodes(model));
+    }
+
+    // The run has the same channels as the walk, so the two can be blended
+    AnimationClip walk = createWalkCycleClip();
+    AnimationClip run("run", 0.4f);
+    std::vector<Keyframe> forwards, backwards;
+    for (unsigned int i = 0; i <= 16; i++) {
+        float time = 0.4f * float(i) / 16.0f;
+        float angle = 35.0f * std::sin(2.0f * 3.1415926f * time / 0.4f);
+        forwards.push_back(Keyframe{ time, float3(angle, 0.0f, 0.0f) });
+        backwards.push_back(Keyframe{ time, float3(-angle, 0.0f, 0.0f) });
+    }
+    run.addChannel(characterLeftArm, AnimationProperty::Rotation, forwards);
+    run.addChannel(characterRightArm, AnimationProperty::Rotation, backwards);
+    run.addChannel(characterLeftLeg, AnimationProperty::Rotation, backwards);
+    run.addChannel(characterRightLeg, AnimationProperty::Rotation, forwards);
+
+    ThreadPool pool;
+    Animator animator(pool);
+    unsigned int walkClip = animator.addClip(walk);
+    unsigned int runClip = animator.addClip(run);
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> startTime(0.0f, 1.0f);
+    std::uniform_real_distribution<float> speed(0.8f, 1.2f);
+    for (CharacterNodes const &character : characters) {
+        unsigned int instance = animator.addInstance(characterAnimationTargets(character));
+        animator.play(instance, walkClip, startTime(generator), speed(generator));
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < frameCount; frame++) {
+        // Every 50 frames, half of the characters start changing their pace
+        if (frame % 50 == 0) {
+            for (unsigned int i = 0; i < characterCount; i += 2) {
+                animator.crossFade(i, (frame / 50) % 2 == 0 ? runClip : walkClip, 0.25f);
+            }
+        }
+        animator.update(frameSeconds);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+
+    float time = 0.0f;
+    for (unsigned int frame = 0; frame < frameCount; frame++) {
+        time += 10.0f * frameSeconds;
+        for (CharacterNodes const &character : characters) {
+            float angle = 20.0f * std::sin(time);
+            character.leftArm->rotation.x = angle;
+            character.rightArm->rotation.x = -angle;
+            character.leftLeg->rotation.x = -angle;
+            character.rightLeg->rotation.x = angle;
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double animatorMs = std::chrono::duration<double, std::milli>(middle - start).count() / frameCount;
+    double handWrittenMs = std::chrono::duration<double, std::milli>(end - middle).count() / frameCount;
+    printf("animation: %u characters, %u threads\n", characterCount, pool.threadCount());
+    printf("  animator update:        %8.3f ms/frame (%.0f characters/ms, half of them blending at times)\n",
+           animatorMs, characterCount / animatorMs);
+    printf("  hand-written sin():     %8.3f ms/frame (single thread, no blending)\n", handWrittenMs);
+    return EXIT_SUCCESS;
+}
+
+// Moves 50 000 agents along the three chessboard paths for 10 simulated seconds, once with the crowd
+// and once with one Path per agent and the code the render loop used to move Steve with.
+static int benchmarkCrowd() {
+    const unsigned int agentCount = 50000;
+    const unsigned int frameCount = 600;
+    const float frameSeconds = 1.0f / 60.0f;
+    const float tileWidth = 20.0f;
+    const char* pathFiles[] = {
+        "./gloom/src/pathFiles/coordinates_0.txt",
+        "./gloom/src/pathFiles/coordinates_1.txt",
+        "./gloom/src/pathFiles/coordinates_2.txt",
+    };
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> offset(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> speed(8.0f, 12.0f);
+
+    ThreadPool pool;
+    Crowd crowd(pool, tileWidth);
+    std::vector<Path> paths;
+    for (char const* pathFile : pathFiles) {
+        paths.push_back(Path(pathFile));
+        if (crowd.addPath(paths.back()) == -1) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<SceneNode> crowdNodes(agentCount);
+    std::vector<SceneNode> referenceNodes(agentCount);
+    std::vector<Path> referencePaths;
+    std::vector<float> referenceSpeeds;
+    for (unsigned int i = 0; i < agentCount; i++) {
+        crowdNodes[i].position = float3(offset(generator), 0.0f, offset(generator));
+        referenceNodes[i].position = crowdNodes[i].position;
+        referenceSpeeds.push_back(speed(generator));
+        referencePaths.push_back(paths[i % paths.size()]);
+        crowd.addAgent(&crowdNodes[i], i % unsigned(paths.size()), referenceSpeeds.back());
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < frameCount; frame++) {
+        crowd.update(frameSeconds);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < frameCount; frame++) {
+        for (unsigned int i = 0; i < agentCount; i++) {
+            SceneNode &node = referenceNodes[i];
+            glm::vec2 position = glm::vec2(node.position.x, node.position.z);
+            float2 floatWaypoint = referencePaths[i].getCurrentWaypoint(tileWidth);
+            glm::vec2 deltaVector = glm::normalize(glm::vec2(floatWaypoint.x, floatWaypoint.y) - position);
+            node.rotation.y = -90 + glm::degrees(-std::atan2(deltaVector.y, deltaVector.x));
+            deltaVector *= referenceSpeeds[i] * frameSeconds;
+            node.position.x += deltaVector.x;
+            node.position.z += deltaVector.y;
+            if (referencePaths[i].hasWaypointBeenReached(float2(position.x, position.y), tileWidth)) {
+                referencePaths[i].advanceToNextWaypoint();
+            }
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double crowdMs = std::chrono::duration<double, std::milli>(middle - start).count() / frameCount;
+    double referenceMs = std::chrono::duration<double, std::milli>(end - middle).count() / frameCount;
+    printf("crowd: %u agents, %u threads\n", agentCount, pool.threadCount());
+    printf("  crowd update:         %8.3f ms/frame, %8.0f agents/ms (%s the 16.7 ms of a 60 Hz frame)\n",
+           crowdMs, agentCount / crowdMs, crowdMs < 1000.0 / 60.0 ? "within" : "over");
+    printf("  one Path per agent:   %8.3f ms/frame, %8.0f agents/ms\n", referenceMs, agentCount / referenceMs);
+    printf("  heading error:        %8.5f degrees at most\n", Crowd::measureHeadingError());
+    return EXIT_SUCCESS;
+}
+
+// Walks 100 000 agents along the chessboard paths, sorting them into a spatial hash and finding every pair
+// standing too close each frame. Checks the hash's answers against comparing every pair on a smaller crowd first.
+static int benchmarkSpatialHash() {
+    const unsigned int agentCount = 100000;
+    const unsigned int checkedCount = 10000;
+    const unsigned int queryCount = 100000;
+    const unsigned int frameCount = 60;
+    const float frameSeconds = 1.0f / 60.0f;
+    const float tileWidth = 20.0f;
+    const float spread = 600.0f;
+    // About the width of a character, so closer agents walk through each other
+    const float agentDiameter = 4.0f;
+    const char* pathFiles[] = {
+        "./gloom/src/pathFiles/coordinates_0.txt",
+        "./gloom/src/pathFiles/coordinates_1.txt",
+        "./gloom/src/pathFiles/coordinates_2.txt",
+    };
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> offset(-spread, spread);
+    std::uniform_real_distribution<float> speed(8.0f, 12.0f);
+
+    ThreadPool pool;
+    Crowd crowd(pool, tileWidth);
+    unsigned int pathCount = 0;
+    for (char const* pathFile : pathFiles) {
+        if (crowd.addPath(Path(pathFile)) == -1) {
+            return EXIT_FAILURE;
+        }
+        pathCount++;
+    }
+    std::vector<SceneNode> nodes(agentCount);
+    for (unsigned int i = 0; i < agentCount; i++) {
+        nodes[i].position = float3(offset(generator), 0.0f, offset(generator));
+        crowd.addAgent(&nodes[i], i % pathCount, speed(generator));
+    }
+
+    // The chessboard, and the crowd spread around it. Agents walking off the plane still land in its edge cells.
+    float2 minimum(-spread, -spread);
+    float2 maximum(8.0f * tileWidth + spread, 8.0f * tileWidth + spread);
+    SpatialHash hash(pool, minimum, maximum, agentDiameter);
+
+    // Every pair, every radius and the nearest points of a smaller crowd, by brute force
+    unsigned int mismatchCount = 0;
+    {
+        std::vector<float> x(crowd.getPositionsX(), crowd.getPositionsX() + checkedCount);
+        std::vector<float> z(crowd.getPositionsZ(), crowd.getPositionsZ() + checkedCount);
+        hash.build(x.data(), z.data(), checkedCount);
+        std::vector<std::pair<unsigned int, unsigned int>> pairs;
+        hash.findOverlaps(agentDiameter, pairs);
+        std::vector<std::pair<unsigned int, unsigned int>> expectedPairs;
+        for (unsigned int i = 0; i < checkedCount; i++) {
+            for (unsigned int j = i + 1; j < checkedCount; j++) {
+                float dx = x[j] - x[i];
+                float dz = z[j] - z[i];
+                if (dx * dx + dz * dz < agentDiameter * agentDiameter) {
+                    expectedPairs.push_back(std::make_pair(i, j));
+                }
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+        mismatchCount += pairs != expectedPairs ? 1 : 0;
+
+        std::uniform_real_distribution<float> queryPosition(-spread - 50.0f, 8.0f * tileWidth + spread + 50.0f);
+        std::vector<unsigned int> found;
+        std::vector<std::pair<float, unsigned int>> distances(checkedCount);
+        for (unsigned int query = 0; query < 200; query++) {
+            float2 center(queryPosition(generator), queryPosition(generator));
+            for (unsigned int i = 0; i < checkedCount; i++) {
+                float dx = x[i] - center.x;
+                float dz = z[i] - center.y;
+                distances[i] = std::make_pair(dx * dx + dz * dz, i);
+            }
+            std::sort(distances.begin(), distances.end());
+
+            float radius = 30.0f;
+            found.clear();
+            hash.queryRadius(center, radius, found);
+            std::sort(found.begin(), found.end());
+            std::vector<unsigned int> expected;
+            for (unsigned int i = 0; i < checkedCount && distances[i].first <= radius * radius; i++) {
+                expected.push_back(distances[i].second);
+            }
+            std::sort(expected.begin(), expected.end());
+            mismatchCount += found != expected ? 1 : 0;
+
+            hash.queryNearest(center, 8, 1e30f, found);
+            expected.clear();
+            for (unsigned int i = 0; i < 8; i++) {
+                expected.push_back(distances[i].second);
+            }
+            mismatchCount += found != expected ? 1 : 0;
+        }
+    }
+
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+    double updateMs = 0.0;
+    double buildMs = 0.0;
+    double overlapMs = 0.0;
+    size_t pairCount = 0;
+    for (unsigned int frame = 0; frame < frameCount; frame++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        crowd.update(frameSeconds);
+        std::chrono::steady_clock::time_point updated = std::chrono::steady_clock::now();
+        hash.build(crowd.getPositionsX(), crowd.getPositionsZ(), agentCount);
+        std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+        hash.findOverlaps(agentDiameter, pairs);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        updateMs += std::chrono::duration<double, std::milli>(updated - start).count() / frameCount;
+        buildMs += std::chrono::duration<double, std::milli>(built - updated).count() / frameCount;
+        overlapMs += std::chrono::duration<double, std::milli>(end - built).count() / frameCount;
+        pairCount += pairs.size();
+    }
+    SpatialHashStats stats = hash.getStats();
+
+    // The neighbours of every agent, as avoidance would look for them
+    std::vector<std::vector<unsigned int>> threadResults(pool.threadCount());
+    std::vector<size_t> threadFoundCounts(pool.threadCount(), 0);
+    const unsigned int queriesPerJob = 1024;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.parallelFor((queryCount + queriesPerJob - 1) / queriesPerJob, [&](size_t job, unsigned int threadIndex) {
+        std::vector<unsigned int> &found = threadResults[threadIndex];
+        unsigned int end = std::min(queryCount, unsigned(job + 1) * queriesPerJob);
+        for (unsigned int agent = unsigned(job) * queriesPerJob; agent < end; agent++) {
+            hash.queryNearest(crowd.getPosition(agent), 8, 4.0f * agentDiameter, found);
+            threadFoundCounts[threadIndex] += found.size();
+        }
+    });
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    pool.parallelFor((queryCount + queriesPerJob - 1) / queriesPerJob, [&](size_t job, unsigned int threadIndex) {
+        std::vector<unsigned int> &found = threadResults[threadIndex];
+        unsigned int end = std::min(queryCount, unsigned(job + 1) * queriesPerJob);
+        for (unsigned int agent = unsigned(job) * queriesPerJob; agent < end; agent++) {
+            found.clear();
+            hash.queryRadius(crowd.getPosition(agent), 2.0f * agentDiameter, found);
+        }
+    });
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double nearestMs = std::chrono::duration<double, std::milli>(middle - start).count();
+    double radiusMs = std::chrono::duration<double, std::milli>(end - middle).count();
+
+    // The build should take about twice as long for twice the agents
+    printf("spatial-hash: %u agents, %u cells of %.0f units, %u threads\n", agentCount, hash.getCellCount(), agentDiameter, pool.threadCount());
+    for (unsigned int count = agentCount / 4; count <= agentCount; count *= 2) {
+        hash.build(crowd.getPositionsX(), crowd.getPositionsZ(), count);
+        double milliseconds = hash.getStats().buildMilliseconds;
+        for (unsigned int repeat = 1; repeat < 10; repeat++) {
+            hash.build(crowd.getPositionsX(), crowd.getPositionsZ(), count);
+            milliseconds = std::min(milliseconds, hash.getStats().buildMilliseconds);
+        }
+        printf("  build, %6u agents:  %8.3f ms\n", count, milliseconds);
+    }
+    printf("  crowd update:         %8.3f ms/frame\n", updateMs);
+    printf("  build:                %8.3f ms/frame, %u occupied cells, at most %u agents in one\n",
+           buildMs, stats.occupiedCellCount, stats.largestCellCount);
+    printf("  overlapping pairs:    %8.3f ms/frame, %zu pairs per frame\n", overlapMs, pairCount / frameCount);
+    size_t foundCount = 0;
+    for (size_t count : threadFoundCounts) {
+        foundCount += count;
+    }
+    printf("  8 nearest of each:    %8.3f ms for %u queries, %.1f neighbours each\n", nearestMs, queryCount, double(foundCount) / queryCount);
+    printf("  radius of each:       %8.3f ms for %u queries\n", radiusMs, queryCount);
+    printf("  brute force checks:   %s\n", mismatchCount == 0 ? "all match" : "MISMATCH");
+    return mismatchCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Times random queries on a 1024x1024 grid crossed by walls: the hierarchical search (HPA*) with
+// an empty cache, the same queries again from the cache, and plain JPS over the whole grid.
+static int benchmarkPathfinding() {
+    const unsigned int gridSize = 1024;
+    const unsigned int wallCount = 1500;
+    const unsigned int queryCount = 20000;
+    const unsigned int flatQueryCount = 300;
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> coordinate(0, int(gridSize) - 1);
+    std::uniform_int_distribution<int> wallLength(8, 64);
+
+    TileGrid grid(gridSize, gridSize);
+    for (unsigned int i = 0; i < wallCount; i++) {
+        int x = coordinate(generator);
+        int y = coordinate(generator);
+        int length = wallLength(generator);
+        bool isHorizontal = i % 2 == 0;
+        for (int j = 0; j < length; j++) {
+            grid.setWalkable(isHorizontal ? x + j : x, isHorizontal ? y : y + j, false);
+        }
+    }
+
+    std::vector<PathQuery> queries(queryCount);
+    for (PathQuery &query : queries) {
+        do {
+            query.start = int2{ coordinate(generator), coordinate(generator) };
+        } while (!grid.isWalkable(query.start.x, query.start.y));
+        do {
+            query.goal = int2{ coordinate(generator), coordinate(generator) };
+        } while (!grid.isWalkable(query.goal.x, query.goal.y));
+    }
+
+    ThreadPool pool;
+    Pathfinder hierarchical(grid, pool, 32);
+    Pathfinder flat(grid, pool);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    hierarchical.findPaths(queries);
+    std::chrono::steady_clock::time_point cold = std::chrono::steady_clock::now();
+    hierarchical.findPaths(queries);
+    std::chrono::steady_clock::time_point cached = std::chrono::steady_clock::now();
+    std::vector<PathQuery> flatQueries(queries.begin(), queries.begin() + flatQueryCount);
+    flat.findPaths(flatQueries);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    // Compare path lengths on the queries both answered
+    auto pathLength = [](std::vector<int2> const &waypoints) {
+        double length = 0.0;
+        for (size_t i = 1; i < waypoints.size(); i++) {
+            int dx = std::abs(waypoints[i].x - waypoints[i - 1].x);
+            int dy = std::abs(waypoints[i].y - waypoints[i - 1].y);
+            length += std::max(dx, dy) - std::min(dx, dy) + std::sqrt(2.0) * std::min(dx, dy);
+        }
+        return length;
+    };
+    double hierarchicalLength = 0.0, flatLength = 0.0;
+    unsigned int foundCount = 0;
+    for (unsigned int i = 0; i < flatQueryCount; i++) {
+        if (queries[i].isFound && flatQueries[i].isFound) {
+            hierarchicalLength += pathLength(queries[i].waypoints);
+            flatLength += pathLength(flatQueries[i].waypoints);
+            foundCount++;
+        }
+    }
+
+    double coldSeconds = std::chrono::duration<double>(cold - start).count();
+    double cachedSeconds = std::chrono::duration<double>(cached - cold).count();
+    double flatSeconds = std::chrono::duration<double>(end - cached).count();
+    PathfinderStats stats = hierarchical.getStats();
+    printf("pathfinding: %ux%u grid, %u walls, %u threads\n", gridSize, gridSize, wallCount, pool.threadCount());
+    printf("  HPA* build:       %8.1f ms, %zu entrances, %zu edges (32x32 clusters)\n",
+           stats.buildMilliseconds, stats.abstractNodeCount, stats.abstractEdgeCount);
+    printf("  HPA* queries:     %8.0f queries/s (%u queries)\n", queryCount / coldSeconds, queryCount);
+    printf("  cached queries:   %8.0f queries/s (%zu cache hits)\n", queryCount / cachedSeconds, stats.cacheHitCount);
+    printf("  JPS queries:      %8.0f queries/s (%u queries over the whole grid)\n", flatQueryCount / flatSeconds, flatQueryCount);
+    printf("  HPA* path length: %8.3fx the shortest, over %u paths\n", foundCount > 0 ? hierarchicalLength / flatLength : 0.0, foundCount);
+    return EXIT_SUCCESS;
+}
+
+// Builds boards of increasing size with generateChessboard() and uploads them, then draws them
+// next to boards of the same size which ProceduralChessboard draws without vertex data
+static int benchmarkChessboard() {
+    const unsigned int boardSizes[] = {256, 1024, 2048};
+    const float tileWidth = 20.0f;
+    const unsigned int frameCount = 20;
+    const float4 tileColour1(0.0f, 0.0f, 0.0f, 1.0f);
+    const float4 tileColour2(1.0f, 1.0f, 1.0f, 1.0f);
+
+    GpuResourceManager resources;
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint meshShader = meshShaders.get(0);
+    Gloom::Shader chessboardShader;
+    chessboardShader.makeBasicShader("./gloom/shaders/chessboard.vert", "./gloom/shaders/simple.frag");
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    if (!isHeadless) {
+        glfwSwapInterval(0);
+    }
+
+    printf("chessboard: %u frames per board\n", frameCount);
+    for (unsigned int boardSize : boardSizes) {
+        glm::mat4 transform = gridCameraTransform(float(boardSize) * tileWidth);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Mesh board = generateChessboard(boardSize, boardSize, tileWidth, tileColour1, tileColour2);
+        std::chrono::steady_clock::time_point generated = std::chrono::steady_clock::now();
+        GpuMesh boardMesh;
+        uploadMesh(board, resources, boardMesh);
+        glFinish();
+        std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
+        size_t meshBytes = board.vertices.size() * sizeof(float4) + board.colours.size() * sizeof(float4)
+                         + board.indices.size() * sizeof(unsigned int);
+        board = Mesh("");
+
+        double meshMs = timeFrames(frameCount, [&] {
+            glUseProgram(meshShader);
+            glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(transform));
+            glBindVertexArray(boardMesh.vertexArray.get());
+            glDrawElements(GL_TRIANGLES, GLsizei(boardMesh.vao.indexCount), GL_UNSIGNED_INT, nullptr);
+            glBindVertexArray(0);
+        });
+        boardMesh = GpuMesh();
+
+        ProceduralChessboard proceduralBoard(boardSize, boardSize, tileWidth, tileColour1, tileColour2);
+        double proceduralMs = timeFrames(frameCount, [&] {
+            proceduralBoard.draw(chessboardShader.get(), transform);
+        });
+
+        printf("  %4ux%-4u tiles:\n", boardSize, boardSize);
+        printf("    mesh:       %8.1f MB, %8.1f ms to generate, %8.1f ms to upload, %8.3f ms/frame\n",
+               double(meshBytes) / (1024.0 * 1024.0),
+               std::chrono::duration<double, std::milli>(generated - start).count(),
+               std::chrono::duration<double, std::milli>(uploaded - generated).count(), meshMs);
+        printf("    procedural: %8.1f MB, %8.1f ms to generate, %8.1f ms to upload, %8.3f ms/frame\n",
+               0.0, 0.0, 0.0, proceduralMs);
+    }
+
+    chessboardShader.destroy();
+    return EXIT_SUCCESS;
+}
+
+// Lights a board with a crowd of characters on it by an increasing number of point lights, scattered over the board.
+// Each count is drawn with the lights assigned to the default cluster grid, and then, up to bruteForceLightLimit,
+// with a grid of one cluster, so every fragment loops over every visible light.
+static int benchmarkLighting() {
+    const unsigned int lightCounts[] = {16, 64, 256, 1024, 4096};
+    const unsigned int bruteForceLightLimit = 256;
+    const unsigned int boardSize = 32;
+    const float tileWidth = 20.0f;
+    const unsigned int charactersPerSide = 8;
+    const float lightRadius = 40.0f;
+    const unsigned int frameCount = 20;
+    const float boardWidth = float(boardSize) * tileWidth;
+
+    GpuResourceManager resources;
+    GpuMesh board;
+    uploadMesh(generateChessboard(boardSize, boardSize, tileWidth, float4(0.4f, 0.4f, 0.4f, 1.0f), float4(1.0f, 1.0f, 1.0f, 1.0f)),
+               resources, board);
+    MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+    GpuSkinnedMesh characterMesh;
+    uploadSkinnedMesh(mergeCharacterParts(character), characterPartCount, resources, characterMesh);
+
+    ThreadPool threadPool;
+    SkinnedRenderer skinnedRenderer(threadPool, characterMesh.vao);
+    SceneNode* rootNode = createSceneNode();
+    float spacing = boardWidth / float(charactersPerSide);
+    for (unsigned int x = 0; x < charactersPerSide; x++) {
+        for (unsigned int z = 0; z < charactersPerSide; z++) {
+            CharacterNodes steve = createCharacterNodes(CharacterModel());
+            steve.torso->position = float3((float(x) + 0.5f) * spacing, 0.0f, (float(z) + 0.5f) * spacing);
+            addChild(rootNode, steve.torso);
+            skinnedRenderer.addInstance(characterAnimationTargets(steve));
+        }
+    }
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint boardProgram = meshShaders.get(MESH_LIT);
+    GLuint characterProgram = meshShaders.get(MESH_SKINNED | MESH_LIT);
+
+    // Only used to update the characters' bone matrices, since their nodes have nothing to draw.
+    // Recording with a lit program makes it update their model matrices as well.
+    RenderQueue renderQueue(threadPool, 10.0f * boardWidth);
+    renderQueue.setLitProgram(boardProgram);
+    skinnedRenderer.setLitProgram(characterProgram);
+    const glm::mat4 identity(1.0f);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    if (!isHeadless) {
+        glfwSwapInterval(0);
+    }
+
+    glm::mat4 view = gridCameraView(boardWidth);
+    glm::mat4 projection = gridCameraProjection(boardWidth);
+    glm::mat4 transform = projection * view;
+    auto drawFrame = [&](ClusteredLighting &lighting) {
+        lighting.update(view, projection, windowWidth, windowHeight);
+        lighting.bind(boardProgram);
+        glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(transform));
+        // The board is modelled in world space, so its normals need no transformation either
+        glUniformMatrix4fv(31, 1, GL_FALSE, glm::value_ptr(identity));
+        glUniformMatrix4fv(32, 1, GL_FALSE, glm::value_ptr(identity));
+        glBindVertexArray(board.vertexArray.get());
+        glDrawElements(GL_TRIANGLES, GLsizei(board.vao.indexCount), GL_UNSIGNED_INT, nullptr);
+
+        renderQueue.record(rootNode, transform, boardProgram);
+        lighting.bind(characterProgram);
+        skinnedRenderer.submit(characterProgram);
+    };
+
+    // The camera is about one board width from the board's centre
+    ClusterGridSettings clusterSettings;
+    clusterSettings.firstSliceDepth = 0.5f * boardWidth;
+    clusterSettings.lastSliceDepth = 3.0f * boardWidth;
+    ClusterGridSettings bruteForceSettings;
+    bruteForceSettings.tilesX = 1;
+    bruteForceSettings.tilesY = 1;
+    bruteForceSettings.slices = 1;
+    ClusteredLighting clusteredLighting(threadPool, clusterSettings);
+    ClusteredLighting bruteForceLighting(threadPool, bruteForceSettings);
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> boardPosition(0.0f, boardWidth);
+    std::uniform_real_distribution<float> height(5.0f, 40.0f);
+    std::uniform_real_distribution<float> channel(0.2f, 1.0f);
+
+    printf("lighting: %u characters on %ux%u tiles, %.0f unit light radius, %u frames\n",
+           charactersPerSide * charactersPerSide, boardSize, boardSize, lightRadius, frameCount);
+    for (unsigned int lightCount : lightCounts) {
+        // The more lights overlap, the dimmer each one, so the scene stays equally bright
+        std::vector<PointLight> lights(lightCount);
+        for (PointLight &light : lights) {
+            light.position = float3(boardPosition(generator), height(generator), boardPosition(generator));
+            light.radius = lightRadius;
+            light.colour = float3(channel(generator), channel(generator), channel(generator));
+            light.intensity = std::min(1.0f, 128.0f / float(lightCount));
+        }
+        clusteredLighting.setLights(lights);
+        bruteForceLighting.setLights(lights);
+
+        double clusteredMs = timeFrames(frameCount, [&] { drawFrame(clusteredLighting); });
+        ClusteredLightingStats stats = clusteredLighting.getStats();
+        printf("  %5u lights: clustered %9.3f ms/frame, %6.3f ms assigning, %5u visible, %5.1f lights per occupied cluster, %4u at most\n",
+               lightCount, clusteredMs, stats.assignMilliseconds, stats.visibleLightCount,
+               stats.occupiedClusterCount == 0 ? 0.0 : double(stats.lightReferenceCount) / stats.occupiedClusterCount,
+               stats.maximumClusterLightCount);
+        if (lightCount <= bruteForceLightLimit) {
+            double bruteForceMs = timeFrames(frameCount, [&] { drawFrame(bruteForceLighting); });
+            printf("  %5u lights: all lights %8.3f ms/frame, %.2fx slower\n", lightCount, bruteForceMs, bruteForceMs / clusteredMs);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Draws a dense grid of characters seen from eye level at one end, where the nearest rows hide most of the others,
+// once as it is and once with the characters' parts rasterized as occluders into an OcclusionCuller first
+static int benchmarkOcclusion() {
+    const unsigned int gridSize = 64;
+    const float spacing = 12.0f;
+    const unsigned int frameCount = 50;
+    const float gridWidth = float(gridSize) * spacing;
+
+    GpuResourceManager resources;
+    MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+    std::vector<GpuMesh> characterMeshes;
+    CharacterModel model = uploadCharacterModel(character, resources, characterMeshes);
+
+    SceneNode* rootNode = createSceneNode();
+    for (unsigned int x = 0; x < gridSize; x++) {
+        for (unsigned int z = 0; z < gridSize; z++) {
+            CharacterNodes steve = createCharacterNodes(model);
+            steve.torso->position = float3(float(x) * spacing, 0.0f, float(z) * spacing);
+            steve.leftArm->rotation.x = 20.0f;
+            steve.rightArm->rotation.x = -20.0f;
+            addChild(rootNode, steve.torso);
+        }
+    }
+
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint shader = meshShaders.get(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    if (!isHeadless) {
+        glfwSwapInterval(0);
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.5f * gridWidth, 28.0f, -120.0f),
+                                 glm::vec3(0.5f * gridWidth, 16.0f, gridWidth),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 transform = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 2.0f * gridWidth) * view;
+
+    ThreadPool threadPool;
+    RenderQueue renderQueue(threadPool, 2.0f * gridWidth);
+    auto drawFrame = [&] {
+        renderQueue.record(rootNode, transform, shader);
+        renderQueue.sort();
+        renderQueue.submit();
+    };
+
+    double unculledMs = timeFrames(frameCount, drawFrame);
+    RenderQueueStats unculledStats = renderQueue.getStats();
+
+    OcclusionCuller culler(threadPool);
+    renderQueue.setOcclusionCuller(&culler);
+    double culledMs = timeFrames(frameCount, drawFrame);
+    RenderQueueStats culledStats = renderQueue.getStats();
+    OcclusionCullerStats cullerStats = culler.getStats();
+
+    printf("occlusion: %u characters (%u parts), %ux%u depth buffer, %u frames\n", gridSize * gridSize,
+           gridSize * gridSize * characterPartCount, culler.getWidth(), culler.getHeight(), frameCount);
+    printf("  without culling: %8.3f ms/frame, %6u draw calls\n", unculledMs, unculledStats.drawCalls);
+    printf("  with culling:    %8.3f ms/frame, %6u draw calls, %6u parts occluded\n",
+           culledMs, culledStats.drawCalls, culledStats.occludedNodeCount);
+    printf("  occluders:       %u of %u rasterized, %u triangles, %.3f ms rasterizing and building the pyramid\n",
+           cullerStats.occluderCount, cullerStats.candidateCount, cullerStats.triangleCount, cullerStats.rasterizeMilliseconds);
+    printf("  speedup:         %8.2fx\n", unculledMs / culledMs);
+
+    return EXIT_SUCCESS;
+}
+
+// Uploads and frees the parts of many characters, one VAO per part and then sub-allocated from a geometry arena,
+// checking that every byte is given back. Then streams terrain under a vertex budget shared with a large mesh,
+// which makes the terrain give up the chunks it keeps beyond its load radius.
+static int benchmarkResources() {
+    const unsigned int characterCount = 2000;
+    const size_t vertexBudget = size_t(1) << 20;
+
+    MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+    Mesh const* parts[] = {&character.head, &character.torso, &character.leftArm,
+                           &character.rightArm, &character.leftLeg, &character.rightLeg};
+    size_t partVertexCount = 0;
+    size_t partIndexCount = 0;
+    for (Mesh const* part : parts) {
+        partVertexCount += part->vertices.size();
+        partIndexCount += part->indices.size();
+    }
+
+    printf("resources: %u characters (%u meshes)\n", characterCount, characterCount * characterPartCount);
+    {
+        GpuResourceManager resources;
+        std::vector<GpuMesh> meshes(characterCount * characterPartCount);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            uploadMesh(*parts[i % characterPartCount], resources, meshes[i]);
+        }
+        glFinish();
+        std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
+        GpuMemoryStats uploadedStats = resources.getStats();
+        meshes.clear();
+        glFinish();
+        std::chrono::steady_clock::time_point freed = std::chrono::steady_clock::now();
+
+        size_t residentBytes = 0;
+        for (size_t bytes : resources.getStats().residentBytes) {
+            residentBytes += bytes;
+        }
+        printf("  separate: %8.1f ms to upload, %8.1f ms to free, %6u buffers, %6zu bytes and %u buffers left after freeing\n",
+               std::chrono::duration<double, std::milli>(uploaded - start).count(),
+               std::chrono::duration<double, std::milli>(freed - uploaded).count(),
+               uploadedStats.bufferCount, residentBytes, resources.getStats().bufferCount);
+    }
+    {
+        GpuResourceManager resources;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GeometryArena arena(resources, unsigned(partVertexCount * characterCount), unsigned(partIndexCount * characterCount));
+        std::vector<int> meshIDs(characterCount * characterPartCount);
+        for (size_t i = 0; i < meshIDs.size(); i++) {
+            meshIDs[i] = arena.upload(*parts[i % characterPartCount]).arenaMeshID;
+        }
+        glFinish();
+        std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
+        unsigned int bufferCount = resources.getStats().bufferCount;
+        for (int meshID : meshIDs) {
+            arena.remove(meshID);
+        }
+        std::chrono::steady_clock::time_point freed = std::chrono::steady_clock::now();
+        printf("  arena:    %8.1f ms to upload, %8.1f ms to free, %6u buffers, %u of %zu meshes placed\n",
+               std::chrono::duration<double, std::milli>(uploaded - start).count(),
+               std::chrono::duration<double, std::milli>(freed - uploaded).count(), bufferCount,
+               unsigned(std::count_if(meshIDs.begin(), meshIDs.end(), [](int meshID) { return meshID != -1; })), meshIDs.size());
+    }
+
+    GpuResourceManager resources;
+    resources.setBudget(gpuMemoryVertices, vertexBudget);
+    ThreadPool threadPool;
+    TerrainSettings terrainSettings;
+    terrainSettings.boardWidth = 1024;
+    terrainSettings.boardHeight = 1024;
+    terrainSettings.loadRadius = 4000.0f;
+    terrainSettings.maximumChunksPerUpdate = 256;
+    Terrain terrain(threadPool, terrainSettings, &resources);
+    // Crossing the board leaves a trail of chunks between the load radius and the eviction distance behind
+    float boardWidth = float(terrainSettings.boardWidth) * terrainSettings.tileWidth;
+    for (unsigned int step = 0; step <= 16; step++) {
+        terrain.update(glm::vec3(boardWidth * float(step) / 16.0f, 100.0f, 0.5f * boardWidth));
+    }
+    TerrainStats streamedStats = terrain.getStats();
+    printf("  terrain under a %.1f MB vertex budget: %u chunks (%.2f MB) resident, %u deferred in the last update\n",
+           double(vertexBudget) / (1024.0 * 1024.0), streamedStats.residentChunkCount,
+           double(streamedStats.residentBytes) / (1024.0 * 1024.0), streamedStats.deferredChunkCount);
+
+    GpuMesh board;
+    Mesh boardMesh = generateChessboard(64, 64, 20.0f, float4(0.0f, 0.0f, 0.0f, 1.0f), float4(1.0f, 1.0f, 1.0f, 1.0f));
+    bool isBoardUploaded = uploadMesh(boardMesh, resources, board);
+    printf("  a %.2f MB board %s, after evicting %u chunks (%.2f MB)\n",
+           double(boardMesh.vertices.size() * 2 * sizeof(float4) + boardMesh.normals.size() * sizeof(float3)) / (1024.0 * 1024.0),
+           isBoardUploaded ? "fits" : "does not fit", terrain.getStats().totalEvictedChunkCount - streamedStats.totalEvictedChunkCount,
+           double(resources.getStats().evictedBytes) / (1024.0 * 1024.0));
+    GpuMesh largeBoard;
+    bool isLargeBoardUploaded = uploadMesh(generateChessboard(256, 256, 20.0f, float4(0.0f, 0.0f, 0.0f, 1.0f), float4(1.0f, 1.0f, 1.0f, 1.0f)),
+                                           resources, largeBoard);
+    printf("  a board of 256x256 tiles %s, %u buffers deferred in total\n",
+           isLargeBoardUploaded ? "fits" : "is deferred", resources.getStats().deferredBufferCount);
+    resources.printUsage();
+
+    return EXIT_SUCCESS;
+}
+
+// Draws a large grid of characters from its middle, where most of it lies outside the view, once recorded by the
+// render queue every frame (with the arena's multi-draws, but drawing everything) and once culled by a GpuCuller,
+// which keeps the characters' matrices on the GPU and draws what is left with one indirect multi-draw
+static int benchmarkGpuCulling() {
+    const unsigned int gridSize = 128;
+    const float spacing = 12.0f;
+    const unsigned int frameCount = 50;
+    const float gridWidth = float(gridSize) * spacing;
+    const unsigned int instanceCount = gridSize * gridSize * characterPartCount;
+
+    GpuResourceManager resources;
+    GeometryArena arena(resources, 1 << 16, 1 << 16);
+    MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+    CharacterModel model = uploadCharacterModel(character, arena);
+
+    SceneNode* rootNode = createSceneNode();
+    for (unsigned int x = 0; x < gridSize; x++) {
+        for (unsigned int z = 0; z < gridSize; z++) {
+            CharacterNodes steve = createCharacterNodes(model);
+            steve.torso->position = float3(float(x) * spacing, 0.0f, float(z) * spacing);
+            steve.leftArm->rotation.x = 20.0f;
+            steve.rightArm->rotation.x = -20.0f;
+            addChild(rootNode, steve.torso);
+        }
+    }
+
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint shader = meshShaders.get(0);
+    GLuint instancedShader = meshShaders.get(MESH_INSTANCED);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    if (!isHeadless) {
+        glfwSwapInterval(0);
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.5f * gridWidth, 30.0f, 0.5f * gridWidth),
+                                 glm::vec3(gridWidth, 10.0f, 0.6f * gridWidth),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 transform = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 2.0f * gridWidth) * view;
+
+    ThreadPool threadPool;
+    RenderQueue renderQueue(threadPool, 2.0f * gridWidth);
+    renderQueue.setGeometryArena(&arena);
+    renderQueue.setInstancedVariant(shader, instancedShader);
+    renderQueue.setIndirectVariant(shader, meshShaders.get(MESH_INDIRECT));
+    double queueMs = timeFrames(frameCount, [&] {
+        renderQueue.record(rootNode, transform, shader);
+        renderQueue.sort();
+        renderQueue.submitInstanced();
+    });
+    RenderQueueStats queueStats = renderQueue.getStats();
+
+    GpuCuller culler(arena, resources, instanceCount);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned int addedCount = culler.addSubtree(rootNode, 0);
+    double addMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double culledMs = timeFrames(frameCount, [&] {
+        culler.cull(transform);
+        glUseProgram(instancedShader);
+        culler.draw(0);
+    });
+    unsigned int visibleCount = culler.readVisibleCount();
+
+    // Every character moves each frame, so every matrix is uploaded again before culling
+    float offset = 0.0f;
+    double movingMs = timeFrames(frameCount, [&] {
+        offset = offset == 0.0f ? 0.5f : 0.0f;
+        glm::mat4 shift = glm::translate(glm::vec3(offset, 0.0f, 0.0f));
+        unsigned int instance = 0;
+        for (SceneNode* torso : rootNode->children) {
+            updateNodeTransform(torso, shift);
+            culler.setModel(instance++, torso->currentTransformationMatrix);
+            for (SceneNode* child : torso->children) {
+                updateNodeTransform(child, torso->currentTransformationMatrix);
+                culler.setModel(instance++, child->currentTransformationMatrix);
+            }
+        }
+        culler.cull(transform);
+        glUseProgram(instancedShader);
+        culler.draw(0);
+    });
+
+    printf("gpu-culling: %u characters (%u parts), %u frames\n", gridSize * gridSize, instanceCount, frameCount);
+    printf("  render queue:     %8.3f ms/frame, %6u packets, %u multi-draws\n", queueMs, queueStats.packetCount, queueStats.multiDrawCalls);
+    printf("  culled on GPU:    %8.3f ms/frame, %6u of %u instances visible, %u draw commands in one multi-draw (%.1f ms to add them once)\n",
+           culledMs, visibleCount, addedCount, culler.getCommandCount(), addMs);
+    printf("  moving every one: %8.3f ms/frame\n", movingMs);
+    printf("  speedup:          %8.2fx\n", queueMs / culledMs);
+
+    return EXIT_SUCCESS;
+}
+
+// An image of rings around a random point in random colours, with some noise so it does not compress too well
+static std::vector<uint8_t> generateImage(unsigned int width, unsigned int height, std::mt19937 &generator) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> noise(-12, 12);
+    float centreX = unit(generator) * float(width);
+    float centreY = unit(generator) * float(height);
+    float ringWidth = 2.0f + 0.1f * unit(generator) * float(width);
+    uint8_t colours[2][3];
+    for (unsigned int channel = 0; channel < 6; channel++) {
+        colours[channel / 3][channel % 3] = uint8_t(unit(generator) * 255.0f);
+    }
+
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            float distance = std::sqrt((float(x) - centreX) * (float(x) - centreX) + (float(y) - centreY) * (float(y) - centreY));
+            uint8_t const* colour = colours[unsigned(distance / ringWidth) % 2];
+            uint8_t* pixel = &pixels[(size_t(y) * width + x) * 4];
+            for (unsigned int channel = 0; channel < 3; channel++) {
+                pixel[channel] = uint8_t(std::min(std::max(int(colour[channel]) + noise(generator), 0), 255));
+            }
+            pixel[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+// Writes a few hundred generated images and loads them through TextureLoaders: first decoding them, then from the
+// cache the first load wrote. Then draws a grid of quads using them, once with a texture for every image, and once
+// with the small images packed into atlas pages, where the quads of all images on a page need one texture bind.
+static int benchmarkTextures() {
+    const unsigned int smallSizes[] = {32, 64, 128, 256};
+    const unsigned int smallImageCount = 192;
+    const unsigned int largeImageCount = 8;
+    const unsigned int largeSize = 1024;
+    const unsigned int quadsPerSide = 64;
+    const unsigned int frameCount = 50;
+
+    std::mt19937 generator(42);
+    std::vector<std::string> files;
+    for (unsigned int i = 0; i < smallImageCount + largeImageCount; i++) {
+        unsigned int width = i < smallImageCount ? smallSizes[i % 4] : largeSize;
+        unsigned int height = i < smallImageCount ? smallSizes[(i / 4) % 4] : largeSize;
+        files.push_back("./texture_benchmark_" + std::to_string(i) + ".png");
+        std::vector<uint8_t> pixels = generateImage(width, height, generator);
+        if (stbi_write_png(files.back().c_str(), int(width), int(height), 4, pixels.data(), int(width * 4)) == 0) {
+            fprintf(stderr, "Could not write the image \"%s\"\n", files.back().c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    ThreadPool threadPool;
+    GpuResourceManager resources;
+    TextureLoaderSettings settings;
+    settings.cacheDirectory = ".";
+    // Nothing is atlased, so every image gets a texture of its own
+    TextureLoaderSettings separateSettings = settings;
+    separateSettings.maximumAtlasedSize = 0;
+    TextureLoader loader(threadPool, resources, settings);
+    TextureLoader cachedLoader(threadPool, resources, settings);
+    TextureLoader separateLoader(threadPool, resources, separateSettings);
+    // Left behind by an earlier run, which would turn the first load into a cached one
+    for (std::string const &file : files) {
+        std::remove(loader.getCachePath(file).c_str());
+    }
+
+    printf("textures: %u images of %u to %u texels a side, %u of %ux%u, on %u threads\n",
+           smallImageCount, smallSizes[0], smallSizes[3], largeImageCount, largeSize, largeSize, threadPool.threadCount());
+    TextureImage image;
+    image.width = largeSize;
+    image.height = largeSize;
+    image.levels.push_back(generateImage(largeSize, largeSize, generator));
+    for (MipmapFilter filter : {mipmapFilterBox, mipmapFilterKaiser}) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        generateMipmaps(image, filter);
+        printf("  %-6s mipmaps of one %ux%u image: %8.2f ms\n", filter == mipmapFilterBox ? "box" : "Kaiser", largeSize, largeSize,
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::vector<TextureRegion> atlasRegions;
+    std::vector<TextureRegion> separateRegions;
+    for (TextureLoader* textureLoader : {&loader, &cachedLoader, &separateLoader}) {
+        std::vector<TextureRegion> regions = textureLoader->load(files);
+        glFinish();
+        TextureLoaderStats const &stats = textureLoader->getStats();
+        printf("  %-9s %8.1f ms loading (%3u decoded, %3u from the cache, %u failed), %6.1f ms packing, %6.1f ms uploading, "
+               "%3u atlased into %u pages, %3u textures of their own\n",
+               textureLoader == &loader ? "decoded:" : textureLoader == &cachedLoader ? "cached:" : "separate:",
+               stats.decodeMilliseconds, stats.decodedCount, stats.cachedCount, stats.failedCount, stats.packMilliseconds,
+               stats.uploadMilliseconds, stats.atlasedCount, stats.atlasPageCount, stats.separateTextureCount);
+        if (textureLoader == &loader) {
+            atlasRegions = regions;
+        } else if (textureLoader == &separateLoader) {
+            separateRegions = regions;
+        }
+    }
+    resources.printUsage();
+
+    // A unit quad for every image, with its texture coordinates moved into the image's region
+    auto uploadQuads = [&resources](std::vector<TextureRegion> const &regions, std::vector<GpuMesh> &quads) {
+        quads.resize(regions.size());
+        for (size_t i = 0; i < regions.size(); i++) {
+            Mesh quad("quad");
+            quad.vertices = {float4(0.0f, 0.0f, 0.0f, 1.0f), float4(1.0f, 0.0f, 0.0f, 1.0f),
+                             float4(1.0f, 1.0f, 0.0f, 1.0f), float4(0.0f, 1.0f, 0.0f, 1.0f)};
+            quad.colours.assign(4, float4(1.0f, 1.0f, 1.0f, 1.0f));
+            quad.textureCoordinates = {float2(0.0f, 0.0f), float2(1.0f, 0.0f), float2(1.0f, 1.0f), float2(0.0f, 1.0f)};
+            quad.indices = {0, 1, 2, 0, 2, 3};
+            mapTextureCoordinates(quad, regions[i]);
+            uploadMesh(quad, resources, quads[i]);
+        }
+    };
+    std::vector<GpuMesh> atlasQuads;
+    std::vector<GpuMesh> separateQuads;
+    uploadQuads(atlasRegions, atlasQuads);
+    uploadQuads(separateRegions, separateQuads);
+
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint program = meshShaders.get(MESH_TEXTURED);
+    glEnable(GL_CULL_FACE);
+    if (!isHeadless) {
+        glfwSwapInterval(0);
+    }
+
+    // Each grid cell shows image (cell index % image count). Cells are drawn sorted by texture, and then by image.
+    glm::mat4 projection = glm::ortho(0.0f, float(quadsPerSide), 0.0f, float(quadsPerSide), -1.0f, 1.0f);
+    unsigned int bindCount = 0;
+    auto drawGrid = [&](std::vector<TextureRegion> const &regions, std::vector<GpuMesh> const &quads) {
+        std::vector<size_t> images(regions.size());
+        for (size_t i = 0; i < images.size(); i++) {
+            images[i] = i;
+        }
+        std::sort(images.begin(), images.end(), [&regions](size_t a, size_t b) {
+            return regions[a].texture != regions[b].texture ? regions[a].texture < regions[b].texture : a < b;
+        });
+
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        GLuint boundTexture = 0;
+        bindCount = 0;
+        for (size_t image : images) {
+            if (regions[image].texture != boundTexture) {
+                boundTexture = regions[image].texture;
+                glBindTexture(GL_TEXTURE_2D, boundTexture);
+                bindCount++;
+            }
+            glBindVertexArray(quads[image].vertexArray.get());
+            for (size_t cell = image; cell < quadsPerSide * quadsPerSide; cell += regions.size()) {
+                glm::mat4 transform = projection * glm::translate(glm::vec3(float(cell % quadsPerSide), float(cell / quadsPerSide), 0.0f));
+                glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(transform));
+                glDrawElements(GL_TRIANGLES, GLsizei(quads[image].vao.indexCount), GL_UNSIGNED_INT, nullptr);
+            }
+        }
+    };
+    double separateMs = timeFrames(frameCount, [&] { drawGrid(separateRegions, separateQuads); });
+    printf("  %u quads, textures of their own: %8.3f ms/frame, %3u texture binds\n", quadsPerSide * quadsPerSide, separateMs, bindCount);
+    double atlasMs = timeFrames(frameCount, [&] { drawGrid(atlasRegions, atlasQuads); });
+    printf("  %u quads, atlas pages:           %8.3f ms/frame, %3u texture binds\n", quadsPerSide * quadsPerSide, atlasMs, bindCount);
+
+    for (std::string const &file : files) {
+        std::remove(loader.getCachePath(file).c_str());
+        std::remove(file.c_str());
+    }
+    return EXIT_SUCCESS;
+}
+
+// Generates 16 million floats between 0 and 1: the way randomUniformFloat() used to with rand(), one at a time from
+// a Random, in bulk with fillUniform(), and in bulk on every thread, one stream per job. Checks that the parallel
+// results do not depend on the threads, and that fillUniform() gives the same numbers with and without SSE.
+static int benchmarkRandom() {
+    const size_t valueCount = size_t(1) << 24;
+    const size_t valuesPerJob = size_t(1) << 18;
+    const unsigned int binCount = 16;
+
+    std::vector<float> values(valueCount);
+    srand(42);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < valueCount; i++) {
+        values[i] = static_cast <float> (rand()) / static_cast <float>(RAND_MAX);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double randMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    Random generator = randomStream(0);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < valueCount; i++) {
+        values[i] = generator.nextFloat();
+    }
+    end = std::chrono::steady_clock::now();
+    double nextFloatMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::steady_clock::now();
+    generator.fillUniform(values.data(), valueCount);
+    end = std::chrono::steady_clock::now();
+    double fillMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    ThreadPool pool;
+    size_t jobCount = (valueCount + valuesPerJob - 1) / valuesPerJob;
+    start = std::chrono::steady_clock::now();
+    pool.parallelFor(jobCount, [&](size_t job, unsigned int) {
+        Random jobGenerator = randomStream(job);
+        size_t first = job * valuesPerJob;
+        jobGenerator.fillUniform(&values[first], std::min(valuesPerJob, valueCount - first));
+    });
+    end = std::chrono::steady_clock::now();
+    double parallelMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // The same jobs one after another on this thread must give the same numbers
+    bool isDeterministic = true;
+    std::vector<float> jobValues(valuesPerJob);
+    for (size_t job = 0; job < jobCount; job++) {
+        Random jobGenerator = randomStream(job);
+        size_t first = job * valuesPerJob;
+        size_t count = std::min(valuesPerJob, valueCount - first);
+        jobGenerator.fillUniform(jobValues.data(), count);
+        isDeterministic = isDeterministic && std::equal(jobValues.begin(), jobValues.begin() + count, values.begin() + first);
+    }
+
+    // Three values are too few for a single SSE step, so they come from the scalar code, and must match the vector code's
+    bool isScalarMatching = true;
+    for (uint64_t stream = 0; stream < 100; stream++) {
+        float scalar[3];
+        float vector[4];
+        Random scalarGenerator = randomStream(stream);
+        Random vectorGenerator = randomStream(stream);
+        scalarGenerator.fillUniform(scalar, 3, -2.0f, 5.0f);
+        vectorGenerator.fillUniform(vector, 4, -2.0f, 5.0f);
+        isScalarMatching = isScalarMatching && std::equal(scalar, scalar + 3, vector);
+    }
+
+    // How evenly the parallel values fill the range: chi-squared over equal bins, which should be about binCount - 1
+    std::vector<size_t> bins(binCount, 0);
+    double sum = 0.0;
+    bool isInRange = true;
+    for (float value : values) {
+        isInRange = isInRange && value >= 0.0f && value < 1.0f;
+        bins[std::min(unsigned(value * binCount), binCount - 1)]++;
+        sum += value;
+    }
+    double expected = double(valueCount) / binCount;
+    double chiSquared = 0.0;
+    for (size_t count : bins) {
+        chiSquared += (double(count) - expected) * (double(count) - expected) / expected;
+    }
+
+    printf("random: %zu floats, %u threads, seed %llu\n", valueCount, pool.threadCount(), (unsigned long long) getRandomSeed());
+    printf("  rand() / RAND_MAX:     %8.3f ms\n", randMs);
+    printf("  Random::nextFloat():   %8.3f ms (%.1fx)\n", nextFloatMs, randMs / nextFloatMs);
+    printf("  fillUniform():         %8.3f ms (%.1fx)\n", fillMs, randMs / fillMs);
+    printf("  fillUniform(), jobs:   %8.3f ms (%.1fx)\n", parallelMs, randMs / parallelMs);
+    printf("  mean %.5f, chi-squared %.1f over %u bins\n", sum / double(valueCount), chiSquared, binCount);
+    printf("  in [0, 1): %s, jobs deterministic: %s, scalar matches SSE: %s\n",
+           isInRange ? "yes" : "NO", isDeterministic ? "yes" : "NO", isScalarMatching ? "yes" : "NO");
+    return isInRange && isDeterministic && isScalarMatching ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Reads a positive number, for the option called name
+static bool parseCount(char const* text, char const* name, unsigned int &count) {
+    char* end = nullptr;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || value == 0) {
+        fprintf(stderr, "%s expects a positive number, not \"%s\"\n", name, text);
+        return false;
+    }
+    count = unsigned(value);
+    return true;
+}
+
+bool parseBenchmarkOptions(int argc, char* argv[], BenchmarkOptions &options) {
+    for (int i = 0; i < argc; i++) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--headless") {
+            options.isHeadless = true;
+        } else if (option == "--characters" && hasValue) {
+            if (!parseCount(argv[++i], "--characters", options.characterCount)) {
+                return false;
+            }
+        } else if (option == "--frames" && hasValue) {
+            if (!parseCount(argv[++i], "--frames", options.frameCount)) {
+                return false;
+            }
+        } else if (option == "--board" && hasValue) {
+            unsigned int width, height;
+            char separator;
+            if (sscanf(argv[++i], "%u%c%u", &width, &separator, &height) != 3 || separator != 'x' || width == 0 || height == 0) {
+                fprintf(stderr, "--board expects a size like 32x32, not \"%s\"\n", argv[i]);
+                return false;
+            }
+            options.boardWidth = width;
+            options.boardHeight = height;
+        } else if (option == "--seed" && hasValue) {
+            char* end = nullptr;
+            options.seed = strtoull(argv[++i], &end, 0);
+            if (end == argv[i] || *end != '\0') {
+                fprintf(stderr, "--seed expects a number, not \"%s\"\n", argv[i]);
+                return false;
+            }
+        } else if (option == "--output" && hasValue) {
+            options.outputFile = argv[++i];
+        } else if (option == "--capture" && hasValue) {
+            options.capturePath = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown or incomplete benchmark option \"%s\". Available options:\n"
+                            "    --headless\n"
+                            "    --characters <count>\n"
+                            "    --board <width>x<height>\n"
+                            "    --frames <count>\n"
+                            "    --seed <number>\n"
+                            "    --output <file>\n"
+                            "    --capture <path>\n", option.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+int runBenchmark(std::string const &name, GLFWwindow* window, BenchmarkOptions const &options) {
+    isHeadless = window == nullptr;
+    setRandomSeed(options.seed);
+
+    if (name == "scene") {
+        return runSceneBenchmark(window, options);
+    }
+    if (name == "instancing") {
+        return benchmarkInstancing();
+    }
+    if (name == "transforms") {
+        return benchmarkTransforms();
+    }
+    if (name == "scene-load") {
+        return benchmarkSceneLoad();
+    }
+    if (name == "animation") {
+        return benchmarkAnimation();
+    }
+    if (name == "crowd") {
+        return benchmarkCrowd();
+    }
+    if (name == "spatial-hash") {
+        return benchmarkSpatialHash();
+    }
+    if (name == "random") {
+        return benchmarkRandom();
+    }
+    if (name == "pathfinding") {
+        return benchmarkPathfinding();
+    }
+    if (name == "chessboard") {
+        return benchmarkChessboard();
+    }
+    if (name == "lighting") {
+        return benchmarkLighting();
+    }
+    if (name == "occlusion") {
+        return benchmarkOcclusion();
+    }
+    if (name == "resources") {
+        return benchmarkResources();
+    }
+    if (name == "textures") {
+        return benchmarkTextures();
+    }
+    if (name == "gpu-culling") {
+        return benchmarkGpuCulling();
+    }
+
+    fprintf(stderr, "Unknown benchmark \"%s\". Available benchmarks:\n"
+                    "    scene\n"
+                    "    instancing\n"
+                    "    transforms\n"
+                    "    scene-load\n"
+                    "    animation\n"
+                    "    crowd\n"
+                    "    spatial-hash\n"
+                    "    random\n"
+                    "    pathfinding\n"
+                    "    chessboard\n"
+                    "    lighting\n"
+                    "    occlusion\n"
+                    "    resources\n"
+                    "    textures\n"
+                    "    gpu-culling\n", name.c_str());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <string>
+#include "random.hpp"
+
+// Settings for the benchmarks which take any, given after the benchmark's name:
+//
+//     gloom --benchmark scene --headless --characters 5000 --board 64x64 --frames 1000 --seed 7 --output scene.json
+struct BenchmarkOptions {
+    // Render into an offscreen framebuffer of a surfaceless context instead of a window (see headless.hpp)
+    bool isHeadless = false;
+    unsigned int characterCount = 1000;
+    unsigned int boardWidth = 32;
+    unsigned int boardHeight = 32;
+    unsigned int frameCount = 600;
+    // The master seed of everything random (see random.hpp)
+    uint64_t seed = defaultRandomSeed;
+    // Results are also written to this file, if given
+    std::string outputFile;
+    // Rendered frames are recorded here, if given (see FrameCapture)
+    std::string capturePath;
+};
+
+// Parses the options following the benchmark's name. Prints what is wrong and returns false on bad options.
+bool parseBenchmarkOptions(int argc, char* argv[], BenchmarkOptions &options);
+
+// Runs one of the built-in benchmarks, selected by name on the command line:
+//
+//     gloom --benchmark <name> [options]
+//
+// Results are printed to stdout. Returns the process exit code.
+// The window is null when running headless.
+int runBenchmark(std::string const &name, GLFWwindow* window, BenchmarkOptions const &options = BenchmarkOptions());
+
+// Draws a board (streamed in as terrain chunks, see terrain.hpp) with walking characters, seen from a camera
+// circling around it, for a fixed number of frames.
+// Everything advances by a fixed step per frame, so every run draws the same frames. Prints the frame time
+// percentiles and the time spent in each CPU and GPU phase as JSON.
+int runSceneBenchmark(GLFWwindow* window, BenchmarkOptions const &options);
@@ -0,0 +1,142 @@
+#include "character.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+static MeshVAO uploadPart(Mesh const &part, GpuResourceManager &resources, std::vector<GpuMesh> &meshes) {
+    GpuMesh gpuMesh;
+    if (!uploadMesh(part, resources, gpuMesh)) {
+        fprintf(stderr, "Character part \"%s\" does not fit into the GPU memory budget, it will not be drawn\n", part.name.c_str());
+        MeshVAO empty;
+        setMeshBounds(empty, part);
+        return empty;
+    }
+    meshes.push_back(std::move(gpuMesh));
+    return meshes.back().vao;
+}
+
+CharacterModel uploadCharacterModel(MinecraftCharacter const &character, GpuResourceManager &resources, std::vector<GpuMesh> &meshes) {
+    CharacterModel model;
+    model.head = uploadPart(character.head, resources, meshes);
+    model.torso = uploadPart(character.torso, resources, meshes);
+    model.leftArm = uploadPart(character.leftArm, resources, meshes);
+    model.rightArm = uploadPart(character.rightArm, resources, meshes);
+    model.leftLeg = uploadPart(character.leftLeg, resources, meshes);
+    model.rightLeg = uploadPart(character.rightLeg, resources, meshes);
+    return model;
+}
+
+CharacterModel uploadCharacterModel(MinecraftCharacter const &character, GeometryArena &arena) {
+    CharacterModel model;
+    model.head = uploadMesh(character.head, arena);
+    model.torso = uploadMesh(character.torso, arena);
+    model.leftArm = uploadMesh(character.leftArm, arena);
+    model.rightArm = uploadMesh(character.rightArm, arena);
+    model.leftLeg = uploadMesh(character.leftLeg, arena);
+    model.rightLeg = uploadMesh(character.rightLeg, arena);
+    return model;
+}
+
+CharacterModel loadCharacterModel(std::string const &objFile, MeshCache &meshCache) {
+    CharacterModel model;
+    model.head = meshCache.get(objFile + "#head");
+    model.torso = meshCache.get(objFile + "#torso");
+    model.leftArm = meshCache.get(objFile + "#left_arm");
+    model.rightArm = meshCache.get(objFile + "#right_arm");
+    model.leftLeg = meshCache.get(objFile + "#left_leg");
+    model.rightLeg = meshCache.get(objFile + "#right_leg");
+    return model;
+}
+
+static SceneNode* createPartNode(MeshVAO const &vao, float3 referencePoint) {
+    SceneNode* node = createSceneNode();
+    node->vertexArrayObjectID = vao.vertexArrayObjectID;
+    node->arenaMeshID = vao.arenaMeshID;
+    node->VAOIndexCount = vao.indexCount;
+    node->boundsMin = vao.boundsMin;
+    node->boundsMax = vao.boundsMax;
+    // The parts are solid boxes, so they hide whatever is behind their bounds (see OcclusionCuller)
+    node->isOccluder = true;
+    node->referencePoint = referencePoint;
+    return node;
+}
+
+CharacterNodes createCharacterNodes(CharacterModel const &model) {
+    CharacterNodes nodes;
+
+    // Reference points are the joints (neck, shoulders, hips) in the model's coordinate space
+    nodes.torso = createPartNode(model.torso, float3(-4.0f, 24.0f, 0.0f));
+    nodes.head = createPartNode(model.head, float3(-4.0f, 24.0f, 0.0f));
+    nodes.leftArm = createPartNode(model.leftArm, float3(0.0f, 24.0f, 0.0f));
+    nodes.rightArm = createPartNode(model.rightArm, float3(-8.0f, 24.0f, 0.0f));
+    nodes.leftLeg = createPartNode(model.leftLeg, float3(-2.0f, 12.0f, 0.0f));
+    nodes.rightLeg = createPartNode(model.rightLeg, float3(-6.0f, 12.0f, 0.0f));
+
+    addChild(nodes.torso, nodes.head);
+    addChild(nodes.torso, nodes.leftArm);
+    addChild(nodes.torso, nodes.rightArm);
+    addChild(nodes.torso, nodes.leftLeg);
+    addChild(nodes.torso, nodes.rightLeg);
+
+    return nodes;
+}
+
+std::vector<SceneNode*> characterAnimationTargets(CharacterNodes const &nodes) {
+    std::vector<SceneNode*> targets(characterPartCount);
+    targets[characterTorso] = nodes.torso;
+    targets[characterHead] = nodes.head;
+    targets[characterLeftArm] = nodes.leftArm;
+    targets[characterRightArm] = nodes.rightArm;
+    targets[characterLeftLeg] = nodes.leftLeg;
+    targets[characterRightLeg] = nodes.rightLeg;
+    return targets;
+}
+
+static void appendPart(Mesh &merged, Mesh const &part, CharacterPart bone) {
+    unsigned int firstVertex = unsigned(merged.vertices.size());
+    merged.vertices.insert(merged.vertices.end(), part.vertices.begin(), part.vertices.end());
+    merged.colours.insert(merged.colours.end(), part.colours.begin(), part.colours.end());
+    merged.normals.insert(merged.normals.end(), part.normals.begin(), part.normals.end());
+    merged.boneIndices.insert(merged.boneIndices.end(), part.vertices.size(), unsigned(bone));
+    for (unsigned int index : part.indices) {
+        merged.indices.push_back(firstVertex + index);
+    }
+}
+
+Mesh mergeCharacterParts(MinecraftCharacter const &character) {
+    Mesh merged("character");
+    appendPart(merged, character.torso, characterTorso);
+    appendPart(merged, character.head, characterHead);
+    appendPart(merged, character.leftArm, characterLeftArm);
+    appendPart(merged, character.rightArm, characterRightArm);
+    appendPart(merged, character.leftLeg, characterLeftLeg);
+    appendPart(merged, character.rightLeg, characterRightLeg);
+    merged.hasNormals = character.torso.hasNormals && character.head.hasNormals && character.leftArm.hasNormals
+                     && character.rightArm.hasNormals && character.leftLeg.hasNormals && character.rightLeg.hasNormals;
+    return merged;
+}
+
+AnimationClip createWalkCycleClip() {
+    const float duration = 2.0f * 3.1415926f / 10.0f;
+    const unsigned int keyframeCount = 32;
+
+    // Sampling the sine densely is plenty, the clip interpolates linearly between keyframes
+    std::vector<Keyframe> forwards(keyframeCount + 1);
+    std::vector<Keyframe> backwards(keyframeCount + 1);
+    for (unsigned int i = 0; i <= keyframeCount; i++) {
+        float time = duration * float(i) / float(keyframeCount);
+        float angle = 20.0f * std::sin(10.0f * time);
+        forwards[i].time = time;
+        forwards[i].value = float3(angle, 0.0f, 0.0f);
+        backwards[i].time = time;
+        backwards[i].value = float3(-angle, 0.0f, 0.0f);
+    }
+
+    AnimationClip clip("walk", duration);
+    clip.addChannel(characterLeftArm, AnimationProperty::Rotation, forwards);
+    clip.addChannel(characterRightArm, AnimationProperty::Rotation, backwards);
+    clip.addChannel(characterLeftLeg, AnimationProperty::Rotation, backwards);
+    clip.addChannel(characterRightLeg, AnimationProperty::Rotation, forwards);
+    return clip;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "OBJLoader.hpp"
+#include "animation.hpp"
+#include "geometryArena.hpp"
+#include "meshCache.hpp"
+#include "program.hpp"
+#include "sceneGraph.hpp"
+
+// The uploaded parts of a MinecraftCharacter.
+// These are created once and shared by every character node tree in the scene.
+struct CharacterModel {
+    MeshVAO head;
+    MeshVAO torso;
+    MeshVAO leftArm;
+    MeshVAO rightArm;
+    MeshVAO leftLeg;
+    MeshVAO rightLeg;
+};
+
+// The scene nodes making up one character. The torso is the root of the character's subtree,
+// all other parts are its children, so moving the torso moves the whole character.
+struct CharacterNodes {
+    SceneNode* torso;
+    SceneNode* head;
+    SceneNode* leftArm;
+    SceneNode* rightArm;
+    SceneNode* leftLeg;
+    SceneNode* rightLeg;
+};
+
+// Uploads all parts of a character into buffers created by the resource manager, one GpuMesh per part,
+// which are appended to meshes and deleted along with them. Parts which do not fit into the budgets draw nothing.
+CharacterModel uploadCharacterModel(MinecraftCharacter const &character, GpuResourceManager &resources, std::vector<GpuMesh> &meshes);
+
+// Uploads all parts of a character into the geometry arena, or into meshes kept by the arena if it is full.
+CharacterModel uploadCharacterModel(MinecraftCharacter const &character, GeometryArena &arena);
+
+// Gets all parts of the character in the given Wavefront file from the mesh cache,
+// so they can be referred to by name (for instance when writing scene files).
+CharacterModel loadCharacterModel(std::string const &objFile, MeshCache &meshCache);
+
+// Creates a new character subtree using the given model, with each limb rotating around its joint.
+CharacterNodes createCharacterNodes(CharacterModel const &model);
+
+// The order of the parts in the list returned by characterAnimationTargets(),
+// which the channels of character animation clips refer to
+enum CharacterPart {
+    characterTorso,
+    characterHead,
+    characterLeftArm,
+    characterRightArm,
+    characterLeftLeg,
+    characterRightLeg
+};
+
+const unsigned int characterPartCount = 6;
+
+// The nodes of a character in CharacterPart order, for Animator::addInstance() and SkinnedRenderer::addInstance()
+std::vector<SceneNode*> characterAnimationTargets(CharacterNodes const &nodes);
+
+// Merges all parts of a character into one mesh, with each vertex following the bone of its part
+// in CharacterPart order, so a whole character can be drawn with one SkinnedRenderer draw.
+Mesh mergeCharacterParts(MinecraftCharacter const &character);
+
+// One step of each foot: the arms and legs swing 20 degrees forwards and back around the shoulders and hips,
+// each arm opposite to the leg on its side, once every 2 pi / 10 seconds.
+AnimationClip createWalkCycleClip();
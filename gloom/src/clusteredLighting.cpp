@@ -0,0 +1,195 @@
+#include "clusteredLighting.hpp"
+#include "profiler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// The tile a projected coordinate (-1 to 1 across the screen) falls in. Coordinates off the screen,
+// which can be huge for lights right next to the camera, are clamped before converting to an integer.
+static int tileIndex(float coordinate, unsigned int tileCount) {
+    float clamped = std::min(std::max(coordinate, -2.0f), 2.0f);
+    return int(std::floor((clamped * 0.5f + 0.5f) * float(tileCount)));
+}
+
+ClusteredLighting::ClusteredLighting(ThreadPool &pool, ClusterGridSettings const &settings)
+    : pool(pool), settings(settings) {
+    this->settings.tilesX = std::max(this->settings.tilesX, 1u);
+    this->settings.tilesY = std::max(this->settings.tilesY, 1u);
+    this->settings.slices = std::max(this->settings.slices, 1u);
+    sliceLists.resize(this->settings.slices);
+
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+    lightBuffer = buffers[0];
+    clusterBuffer = buffers[1];
+    clusterLightBuffer = buffers[2];
+}
+
+ClusteredLighting::~ClusteredLighting() {
+    GLuint buffers[3] = {lightBuffer, clusterBuffer, clusterLightBuffer};
+    glDeleteBuffers(3, buffers);
+}
+
+void ClusteredLighting::setLights(std::vector<PointLight> const &lights) {
+    this->lights = lights;
+    areLightsChanged = true;
+}
+
+void ClusteredLighting::update(glm::mat4 const &view, glm::mat4 const &projection, int viewportWidth, int viewportHeight) {
+    PROFILE_SCOPE("assign lights");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    this->viewportWidth = std::max(viewportWidth, 1);
+    this->viewportHeight = std::max(viewportHeight, 1);
+    // Recovered from the matrix glm::perspective() builds
+    nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    firstSliceDepth = settings.firstSliceDepth > nearPlane ? settings.firstSliceDepth : nearPlane;
+    lastSliceDepth = settings.lastSliceDepth > firstSliceDepth && settings.lastSliceDepth < farPlane ? settings.lastSliceDepth : farPlane;
+    xScale = projection[0][0];
+    yScale = projection[1][1];
+
+    // Radii are scaled into view space along with the positions
+    float viewScale = glm::length(glm::vec3(view[0].x, view[0].y, view[0].z));
+
+    viewLights.clear();
+    for (unsigned int i = 0; i < lights.size(); i++) {
+        PointLight const &light = lights[i];
+        glm::vec4 centre = view * glm::vec4(light.position.x, light.position.y, light.position.z, 1.0f);
+        float radius = light.radius * viewScale;
+        // The camera looks down negative z
+        float depth = -centre.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane) {
+            continue;
+        }
+        ViewLight viewLight = {i, centre.x, centre.y, depth, radius};
+        viewLights.push_back(viewLight);
+    }
+
+    pool.parallelFor(settings.slices, [this](size_t slice, unsigned int) {
+        assignSlice(unsigned(slice));
+    });
+
+    // Join the slices' lists into one, making each cluster's offset global
+    unsigned int tileCount = settings.tilesX * settings.tilesY;
+    clusterRanges.resize(2 * size_t(tileCount) * settings.slices);
+    clusterLightIndices.clear();
+    stats = ClusteredLightingStats();
+    stats.lightCount = unsigned(lights.size());
+    std::vector<bool> isLightVisible(lights.size(), false);
+    for (unsigned int slice = 0; slice < settings.slices; slice++) {
+        SliceLists const &lists = sliceLists[slice];
+        unsigned int base = unsigned(clusterLightIndices.size());
+        for (unsigned int tile = 0; tile < tileCount; tile++) {
+            size_t cluster = size_t(slice) * tileCount + tile;
+            clusterRanges[2 * cluster] = base + lists.clusterOffsets[tile];
+            clusterRanges[2 * cluster + 1] = lists.clusterCounts[tile];
+            if (lists.clusterCounts[tile] > 0) {
+                stats.occupiedClusterCount++;
+                stats.maximumClusterLightCount = std::max(stats.maximumClusterLightCount, lists.clusterCounts[tile]);
+            }
+        }
+        for (ViewLight const* light : lists.candidates) {
+            isLightVisible[light->index] = true;
+        }
+        clusterLightIndices.insert(clusterLightIndices.end(), lists.lightIndices.begin(), lists.lightIndices.end());
+    }
+    stats.visibleLightCount = unsigned(std::count(isLightVisible.begin(), isLightVisible.end(), true));
+    stats.lightReferenceCount = unsigned(clusterLightIndices.size());
+
+    // Empty buffers can't be bound, so each one holds at least one element
+    if (areLightsChanged) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(lights.size(), 1) * sizeof(PointLight), lights.data(), GL_STATIC_DRAW);
+        areLightsChanged = false;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, clusterRanges.size() * sizeof(unsigned int), clusterRanges.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterLightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(clusterLightIndices.size(), 1) * sizeof(unsigned int),
+                 clusterLightIndices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    stats.assignMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Lists the lights overlapping each cluster of one slice. Only touches that slice's lists, so slices can run in parallel.
+void ClusteredLighting::assignSlice(unsigned int slice) {
+    SliceLists &lists = sliceLists[slice];
+    unsigned int tileCount = settings.tilesX * settings.tilesY;
+    float depthRatio = lastSliceDepth / firstSliceDepth;
+    float sliceNear = slice == 0 ? nearPlane : firstSliceDepth * std::pow(depthRatio, float(slice) / float(settings.slices));
+    float sliceFar = slice + 1 == settings.slices ? farPlane : firstSliceDepth * std::pow(depthRatio, float(slice + 1) / float(settings.slices));
+
+    lists.clusterCounts.assign(tileCount, 0);
+    lists.clusterOffsets.resize(tileCount);
+    lists.candidates.clear();
+    lists.tileRanges.clear();
+
+    for (ViewLight const &light : viewLights) {
+        float nearest = std::max(sliceNear, light.depth - light.radius);
+        float furthest = std::min(sliceFar, light.depth + light.radius);
+        if (nearest > furthest) {
+            continue;
+        }
+        // Project the part of the light's bounding box inside the slice. Dividing by the depth,
+        // the box's sides end up furthest out at either its nearest or its furthest depth.
+        float left = light.x - light.radius;
+        float right = light.x + light.radius;
+        float bottom = light.y - light.radius;
+        float top = light.y + light.radius;
+        int firstX = std::max(0, tileIndex(xScale * std::min(left / nearest, left / furthest), settings.tilesX));
+        int lastX = std::min(int(settings.tilesX) - 1, tileIndex(xScale * std::max(right / nearest, right / furthest), settings.tilesX));
+        int firstY = std::max(0, tileIndex(yScale * std::min(bottom / nearest, bottom / furthest), settings.tilesY));
+        int lastY = std::min(int(settings.tilesY) - 1, tileIndex(yScale * std::max(top / nearest, top / furthest), settings.tilesY));
+        if (firstX > lastX || firstY > lastY) {
+            continue;
+        }
+
+        lists.candidates.push_back(&light);
+        lists.tileRanges.insert(lists.tileRanges.end(), {firstX, lastX, firstY, lastY});
+        for (int y = firstY; y <= lastY; y++) {
+            for (int x = firstX; x <= lastX; x++) {
+                lists.clusterCounts[y * settings.tilesX + x]++;
+            }
+        }
+    }
+
+    unsigned int total = 0;
+    for (unsigned int tile = 0; tile < tileCount; tile++) {
+        lists.clusterOffsets[tile] = total;
+        total += lists.clusterCounts[tile];
+    }
+    lists.lightIndices.resize(total);
+
+    // The counts are rebuilt while filling, ending up where they started
+    std::fill(lists.clusterCounts.begin(), lists.clusterCounts.end(), 0);
+    for (size_t i = 0; i < lists.candidates.size(); i++) {
+        int const* range = &lists.tileRanges[4 * i];
+        for (int y = range[2]; y <= range[3]; y++) {
+            for (int x = range[0]; x <= range[1]; x++) {
+                unsigned int tile = y * settings.tilesX + x;
+                lists.lightIndices[lists.clusterOffsets[tile] + lists.clusterCounts[tile]++] = lists.candidates[i]->index;
+            }
+        }
+    }
+}
+
+void ClusteredLighting::bind(GLuint program) {
+    // Slice = log(depth / first) / log(last / first) * slices, split into a scale and a bias of log(depth)
+    float sliceScale = float(settings.slices) / std::log(lastSliceDepth / firstSliceDepth);
+    float sliceBias = -std::log(firstSliceDepth) * sliceScale;
+
+    glUseProgram(program);
+    glUniform3ui(19, settings.tilesX, settings.tilesY, settings.slices);
+    glUniform2f(20, float(viewportWidth), float(viewportHeight));
+    glUniform4f(21, nearPlane, farPlane, sliceScale, sliceBias);
+    glUniform3f(22, settings.ambientLight.x, settings.ambientLight.y, settings.ambientLight.z);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, clusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, clusterLightBuffer);
+}
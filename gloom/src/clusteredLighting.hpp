@@ -0,0 +1,126 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include "floats.hpp"
+#include "threadPool.hpp"
+
+// A light shining equally in every direction, fading out completely at its radius.
+// Laid out like PointLight in clusteredLighting.glsl, so the lights are uploaded as they are.
+struct PointLight {
+    float3 position;
+    float radius;
+    float3 colour;
+    float intensity;
+};
+static_assert(sizeof(PointLight) == 32, "PointLight has to match its std430 layout in clusteredLighting.glsl");
+
+// How the view frustum is divided into clusters
+struct ClusterGridSettings {
+    // Tiles across and down the screen
+    unsigned int tilesX = 16;
+    unsigned int tilesY = 9;
+    // Slices between the near and far plane. Each is thicker than the one in front of it by the same factor,
+    // so clusters stay roughly cube shaped however far away they are.
+    unsigned int slices = 24;
+    // The depths the first slice starts and the last slice ends at, zero meaning the near and the far plane.
+    // Anything nearer is counted as part of the first slice, and anything further as part of the last,
+    // so the slices can be spent on the depths the scene actually covers.
+    float firstSliceDepth = 0.0f;
+    float lastSliceDepth = 0.0f;
+    float3 ambientLight = float3(0.1f, 0.1f, 0.1f);
+};
+
+// Counters describing the last update()
+struct ClusteredLightingStats {
+    unsigned int lightCount = 0;
+    // Lights touching at least one cluster, i.e. inside the view frustum
+    unsigned int visibleLightCount = 0;
+    unsigned int occupiedClusterCount = 0;
+    // Entries in the light lists of all clusters together, and of the most crowded cluster
+    unsigned int lightReferenceCount = 0;
+    unsigned int maximumClusterLightCount = 0;
+    double assignMilliseconds = 0.0;
+};
+
+// Forward shading with many point lights, where each fragment only considers the lights which can reach it.
+//
+// The view frustum is split into a grid of clusters: screen tiles, each cut into slices along the depth.
+// Every frame, update() works out which lights overlap which clusters on the thread pool, one slice per job,
+// and uploads a list of lights per cluster. Programs compiled with MESH_LIT find their fragment's cluster
+// from its window position and depth, and only loop over that cluster's lights.
+//
+// Buffers are bound to storage buffer bindings 2 (lights), 3 (each cluster's range of the light list) and 4 (light list).
+class ClusteredLighting {
+public:
+    ClusteredLighting(ThreadPool &pool, ClusterGridSettings const &settings = ClusterGridSettings());
+    ~ClusteredLighting();
+
+    void setLights(std::vector<PointLight> const &lights);
+    std::vector<PointLight> const &getLights() const { return lights; }
+
+    // Assigns the lights to the clusters of this camera, and uploads the result.
+    // The projection has to be a symmetric perspective projection, like glm::perspective() makes.
+    // The view may scale the world, as long as it does so equally along every axis.
+    void update(glm::mat4 const &view, glm::mat4 const &projection, int viewportWidth, int viewportHeight);
+
+    // Binds the light buffers, and sets the lighting uniforms of a program compiled with MESH_LIT.
+    // Leaves the program in use. Draws with the program also need their model and normal matrices,
+    // which RenderQueue and SkinnedRenderer provide for programs registered with their setLitProgram().
+    void bind(GLuint program);
+
+    ClusteredLightingStats const &getStats() const { return stats; }
+
+private:
+    // Where a visible light lies in view space, with depth increasing away from the camera
+    struct ViewLight {
+        unsigned int index;
+        float x;
+        float y;
+        float depth;
+        float radius;
+    };
+
+    // The light lists of the clusters of one slice, filled by that slice's job
+    struct SliceLists {
+        std::vector<unsigned int> clusterCounts;
+        std::vector<unsigned int> clusterOffsets;
+        std::vector<unsigned int> lightIndices;
+        // Each overlapping light's tile range, kept between counting and filling
+        std::vector<ViewLight const*> candidates;
+        std::vector<int> tileRanges;
+    };
+
+    void assignSlice(unsigned int slice);
+
+    ThreadPool &pool;
+    ClusterGridSettings settings;
+    std::vector<PointLight> lights;
+    bool areLightsChanged = true;
+
+    // The camera of the last update()
+    float nearPlane = 1.0f;
+    float farPlane = 100.0f;
+    float firstSliceDepth = 1.0f;
+    float lastSliceDepth = 100.0f;
+    float xScale = 1.0f;
+    float yScale = 1.0f;
+    int viewportWidth = 1;
+    int viewportHeight = 1;
+
+    std::vector<ViewLight> viewLights;
+    std::vector<SliceLists> sliceLists;
+    std::vector<unsigned int> clusterRanges;
+    std::vector<unsigned int> clusterLightIndices;
+
+    GLuint lightBuffer = 0;
+    GLuint clusterBuffer = 0;
+    GLuint clusterLightBuffer = 0;
+
+    ClusteredLightingStats stats;
+
+    ClusteredLighting(ClusteredLighting const &) = delete;
+    ClusteredLighting & operator =(ClusteredLighting const &) = delete;
+};
@@ -0,0 +1,192 @@
+#include "crowd.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CROWD_USE_SSE 1
+#endif
+
+// Agents are handed to the thread pool in chunks of this many; a multiple of 4
+static const unsigned int agentsPerJob = 2048;
+
+static const float pi = 3.1415926f;
+
+Crowd::Crowd(ThreadPool &pool, float tileWidth) : pool(pool), tileWidth(tileWidth) {}
+
+int Crowd::addPath(Path const &path) {
+    std::vector<int2> const &waypoints = path.getWaypoints();
+    if (waypoints.empty()) {
+        fprintf(stderr, "Crowd: ignoring a path without waypoints\n");
+        return -1;
+    }
+
+    pathOffsets.push_back(unsigned(waypointX.size()));
+    pathLengths.push_back(unsigned(waypoints.size()));
+    for (int2 const &waypoint : waypoints) {
+        waypointX.push_back(float(waypoint.x) * tileWidth);
+        waypointZ.push_back(float(waypoint.y) * tileWidth);
+    }
+    return int(pathOffsets.size() - 1);
+}
+
+unsigned int Crowd::addAgent(SceneNode* node, unsigned int path, float speed, unsigned int startWaypoint) {
+    positionX.push_back(node->position.x);
+    positionZ.push_back(node->position.z);
+    headings.push_back(node->rotation.y);
+    speeds.push_back(speed);
+    paths.push_back(path);
+    waypointIndices.push_back(startWaypoint % pathLengths.at(path));
+    nodes.push_back(node);
+    return unsigned(nodes.size() - 1);
+}
+
+void Crowd::update(float deltaSeconds) {
+    unsigned int agentCount = getAgentCount();
+    unsigned int jobCount = (agentCount + agentsPerJob - 1) / agentsPerJob;
+    pool.parallelFor(jobCount, [this, agentCount, deltaSeconds](size_t job, unsigned int) {
+        PROFILE_SCOPE("updateAgents");
+        unsigned int first = unsigned(job) * agentsPerJob;
+        updateAgents(first, std::min(agentsPerJob, agentCount - first), deltaSeconds);
+    });
+}
+
+// The heading (rotation around Y, in degrees) of a character walking in direction (dx, dz).
+// Models face along +Z, and rotation.y turns them counterclockwise when seen from above.
+static float headingDegrees(float dx, float dz) {
+    return -90.0f - std::atan2(dz, dx) * (180.0f / pi);
+}
+
+#ifdef CROWD_USE_SSE
+// atan2() for four lanes at a time: a polynomial for atan() on [0, 1], unfolded to all four quadrants.
+// Within about 1e-4 degrees (2e-6 radians) of std::atan2(), as measureHeadingError() reports,
+// far below what anyone could see in a character's heading.
+static __m128 atan2Lanes(__m128 y, __m128 x) {
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 absoluteX = _mm_andnot_ps(signMask, x);
+    __m128 absoluteY = _mm_andnot_ps(signMask, y);
+
+    // atan(y / x) for |y| <= |x|, pi/2 - atan(x / y) otherwise, so the polynomial's argument stays in [0, 1]
+    __m128 isSteep = _mm_cmpgt_ps(absoluteY, absoluteX);
+    __m128 numerator = _mm_or_ps(_mm_and_ps(isSteep, absoluteX), _mm_andnot_ps(isSteep, absoluteY));
+    __m128 denominator = _mm_or_ps(_mm_and_ps(isSteep, absoluteY), _mm_andnot_ps(isSteep, absoluteX));
+    denominator = _mm_max_ps(denominator, _mm_set1_ps(1e-30f));
+    __m128 t = _mm_div_ps(numerator, denominator);
+    __m128 t2 = _mm_mul_ps(t, t);
+
+    __m128 polynomial = _mm_set1_ps(-0.0117212f);
+    polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(0.05265332f));
+    polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(-0.11643287f));
+    polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(0.19354346f));
+    polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(-0.33262347f));
+    polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(0.99997726f));
+    __m128 angle = _mm_mul_ps(polynomial, t);
+
+    angle = _mm_or_ps(_mm_and_ps(isSteep, _mm_sub_ps(_mm_set1_ps(0.5f * pi), angle)), _mm_andnot_ps(isSteep, angle));
+    // Mirror into the left half-plane, then copy the sign of y
+    __m128 isLeft = _mm_cmplt_ps(x, _mm_setzero_ps());
+    angle = _mm_or_ps(_mm_and_ps(isLeft, _mm_sub_ps(_mm_set1_ps(pi), angle)), _mm_andnot_ps(isLeft, angle));
+    return _mm_or_ps(angle, _mm_and_ps(signMask, y));
+}
+#endif
+
+float Crowd::measureHeadingError() {
+    float maximumError = 0.0f;
+#ifdef CROWD_USE_SSE
+    for (unsigned int i = 0; i < 3600; i += 4) {
+        float dx[4], dz[4], headings[4];
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            float angle = float(i + lane) * (pi / 1800.0f);
+            dx[lane] = 3.0f * std::cos(angle);
+            dz[lane] = 3.0f * std::sin(angle);
+        }
+        __m128 angle = atan2Lanes(_mm_loadu_ps(dz), _mm_loadu_ps(dx));
+        _mm_storeu_ps(headings, _mm_sub_ps(_mm_set1_ps(-90.0f), _mm_mul_ps(angle, _mm_set1_ps(180.0f / pi))));
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            float difference = std::abs(headings[lane] - headingDegrees(dx[lane], dz[lane]));
+            maximumError = std::max(maximumError, std::min(difference, 360.0f - difference));
+        }
+    }
+#endif
+    return maximumError;
+}
+
+void Crowd::updateAgents(unsigned int first, unsigned int count, float deltaSeconds) {
+    float reachedDistance = tileWidth / 10.0f;
+    unsigned int end = first + count;
+    unsigned int agent = first;
+
+#ifdef CROWD_USE_SSE
+    __m128 reachedDistanceSquared = _mm_set1_ps(reachedDistance * reachedDistance);
+    __m128 minimumDistanceSquared = _mm_set1_ps(1e-12f);
+    __m128 elapsed = _mm_set1_ps(deltaSeconds);
+
+    for (; agent + 4 <= end; agent += 4) {
+        float targetX[4], targetZ[4];
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            unsigned int waypoint = pathOffsets[paths[agent + lane]] + waypointIndices[agent + lane];
+            targetX[lane] = waypointX[waypoint];
+            targetZ[lane] = waypointZ[waypoint];
+        }
+
+        __m128 x = _mm_loadu_ps(&positionX[agent]);
+        __m128 z = _mm_loadu_ps(&positionZ[agent]);
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(targetX), x);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(targetZ), z);
+        __m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+        __m128 isMoving = _mm_cmpgt_ps(distanceSquared, minimumDistanceSquared);
+
+        // Step towards the waypoint without overshooting it. Agents standing on their waypoint don't move or turn.
+        __m128 distance = _mm_sqrt_ps(distanceSquared);
+        __m128 step = _mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&speeds[agent]), elapsed), distance);
+        __m128 scale = _mm_and_ps(isMoving, _mm_div_ps(step, _mm_max_ps(distance, minimumDistanceSquared)));
+        x = _mm_add_ps(x, _mm_mul_ps(dx, scale));
+        z = _mm_add_ps(z, _mm_mul_ps(dz, scale));
+        _mm_storeu_ps(&positionX[agent], x);
+        _mm_storeu_ps(&positionZ[agent], z);
+
+        __m128 heading = _mm_sub_ps(_mm_set1_ps(-90.0f), _mm_mul_ps(atan2Lanes(dz, dx), _mm_set1_ps(180.0f / pi)));
+        heading = _mm_or_ps(_mm_and_ps(isMoving, heading), _mm_andnot_ps(isMoving, _mm_loadu_ps(&headings[agent])));
+        _mm_storeu_ps(&headings[agent], heading);
+
+        // Like Path::hasWaypointBeenReached(), this looks at the position before the step, and compares squared
+        // distances so no square root is needed for the check
+        int reachedLanes = _mm_movemask_ps(_mm_cmplt_ps(distanceSquared, reachedDistanceSquared));
+
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            unsigned int i = agent + lane;
+            if ((reachedLanes >> lane) & 1) {
+                waypointIndices[i] = (waypointIndices[i] + 1) % pathLengths[paths[i]];
+            }
+            nodes[i]->position.x = positionX[i];
+            nodes[i]->position.z = positionZ[i];
+            nodes[i]->rotation.y = headings[i];
+        }
+    }
+#endif
+
+    // The same, one agent at a time, for the last few agents (or all of them without SSE)
+    for (; agent < end; agent++) {
+        unsigned int waypoint = pathOffsets[paths[agent]] + waypointIndices[agent];
+        float dx = waypointX[waypoint] - positionX[agent];
+        float dz = waypointZ[waypoint] - positionZ[agent];
+        float distanceSquared = dx * dx + dz * dz;
+        if (distanceSquared > 1e-12f) {
+            float distance = std::sqrt(distanceSquared);
+            float step = std::min(speeds[agent] * deltaSeconds, distance);
+            positionX[agent] += dx * step / distance;
+            positionZ[agent] += dz * step / distance;
+            headings[agent] = headingDegrees(dx, dz);
+        }
+
+        if (distanceSquared < reachedDistance * reachedDistance) {
+            waypointIndices[agent] = (waypointIndices[agent] + 1) % pathLengths[paths[agent]];
+        }
+        nodes[agent]->position.x = positionX[agent];
+        nodes[agent]->position.z = positionZ[agent];
+        nodes[agent]->rotation.y = headings[agent];
+    }
+}
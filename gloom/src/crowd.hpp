@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include "floats.hpp"
+#include "sceneGraph.hpp"
+#include "threadPool.hpp"
+#include "toolbox.hpp"
+
+// Moves any number of characters ("agents") along Paths, the way the render loop used to move Steve:
+// straight towards the current waypoint at a constant speed, facing where they walk, moving on to the
+// next waypoint after a step which started within a tenth of a tile of it (checked before moving, like Path).
+//
+// Agent state is stored as one array per field, so the update can process four agents at a time with SSE
+// (one agent per lane), and is split into chunks spread over the thread pool. The results are written into
+// each agent's scene node: position.x and position.z, and rotation.y for the heading.
+class Crowd {
+public:
+    Crowd(ThreadPool &pool, float tileWidth);
+
+    // Copies the waypoints of a path, returning the ID agents can follow it by.
+    // Paths without waypoints cannot be followed and are rejected with -1.
+    int addPath(Path const &path);
+
+    // Adds an agent starting at its node's current position, walking at speed units per second.
+    // Returns the agent's index.
+    unsigned int addAgent(SceneNode* node, unsigned int path, float speed, unsigned int startWaypoint = 0);
+
+    // Moves every agent deltaSeconds further along its path
+    void update(float deltaSeconds);
+
+    unsigned int getAgentCount() const { return unsigned(positionX.size()); }
+    float2 getPosition(unsigned int agent) const { return float2(positionX.at(agent), positionZ.at(agent)); }
+    unsigned int getWaypointIndex(unsigned int agent) const { return waypointIndices.at(agent); }
+    // Every agent's position, one array per axis, such as SpatialHash::build() takes them
+    float const* getPositionsX() const { return positionX.data(); }
+    float const* getPositionsZ() const { return positionZ.data(); }
+
+    // The largest difference in heading, in degrees, between the SIMD atan2() approximation and std::atan2()
+    static float measureHeadingError();
+
+private:
+    void updateAgents(unsigned int first, unsigned int count, float deltaSeconds);
+
+    ThreadPool &pool;
+    float tileWidth;
+
+    // The waypoints of path p are waypointX/Z[pathOffsets[p]] onwards, in world coordinates
+    std::vector<float> waypointX;
+    std::vector<float> waypointZ;
+    std::vector<unsigned int> pathOffsets;
+    std::vector<unsigned int> pathLengths;
+
+    // Per-agent state. The scene nodes are only ever written to.
+    std::vector<float> positionX;
+    std::vector<float> positionZ;
+    std::vector<float> headings;
+    std::vector<float> speeds;
+    std::vector<unsigned int> paths;
+    std::vector<unsigned int> waypointIndices;
+    std::vector<SceneNode*> nodes;
+};
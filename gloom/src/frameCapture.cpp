@@ -0,0 +1,180 @@
+#include "frameCapture.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <stb_image_write.h>
+
+static bool hasSuffix(std::string const &text, std::string const &suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+FrameCapture::FrameCapture(std::string const &path, int width, int height, unsigned int bufferCount, unsigned int encoderCount)
+    : width(width), height(height), frameSize(size_t(width) * size_t(height) * 4), path(path),
+      isRawStream(hasSuffix(path, ".raw")), writtenFrameCount(0), failedFrameCount(0) {
+    if (isRawStream) {
+        rawFile = fopen(path.c_str(), "wb");
+        if (rawFile == nullptr) {
+            fprintf(stderr, "Could not open \"%s\" to write captured frames\n", path.c_str());
+            isValid = false;
+            return;
+        }
+        // Frames have to reach the stream in order, which one encoder guarantees
+        encoderCount = 1;
+    }
+    // OpenGL's rows start at the bottom, PNG's at the top
+    stbi_flip_vertically_on_write(1);
+
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    pixelBuffers.resize(std::max(bufferCount, 2u));
+    for (std::unique_ptr<PixelBuffer> &pixelBuffer : pixelBuffers) {
+        pixelBuffer.reset(new PixelBuffer());
+        glGenBuffers(1, &pixelBuffer->buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer->buffer);
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, flags);
+        pixelBuffer->pixels = static_cast<unsigned char const*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, flags));
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (unsigned int i = 0; i < std::max(encoderCount, 1u); i++) {
+        encoders.push_back(std::thread(&FrameCapture::encoderLoop, this));
+    }
+}
+
+FrameCapture::~FrameCapture() {
+    finish();
+    for (std::unique_ptr<PixelBuffer> &pixelBuffer : pixelBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer->buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glDeleteBuffers(1, &pixelBuffer->buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (rawFile != nullptr) {
+        fclose(rawFile);
+    }
+}
+
+void FrameCapture::finish() {
+    if (isFinished) {
+        return;
+    }
+    isFinished = true;
+
+    collectCompletedReads(true);
+    {
+        std::lock_guard<std::mutex> lock(encodeQueueMutex);
+        isShuttingDown = true;
+    }
+    encodeQueueChanged.notify_all();
+    for (std::thread &encoder : encoders) {
+        encoder.join();
+    }
+    encoders.clear();
+}
+
+void FrameCapture::capture(GLuint framebuffer) {
+    if (!isValid || isFinished) {
+        return;
+    }
+    PROFILE_SCOPE("capture");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    collectCompletedReads(false);
+
+    PixelBuffer* freeBuffer = nullptr;
+    for (std::unique_ptr<PixelBuffer> &pixelBuffer : pixelBuffers) {
+        if (pixelBuffer->fence == nullptr && !pixelBuffer->isEncoding.load(std::memory_order_acquire)) {
+            freeBuffer = pixelBuffer.get();
+            break;
+        }
+    }
+
+    // Dropped frames keep their number, so gaps show up in the file names
+    unsigned int frameIndex = nextFrameIndex++;
+    if (freeBuffer == nullptr) {
+        stats.droppedFrameCount++;
+    } else {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, freeBuffer->buffer);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        freeBuffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        freeBuffer->frameIndex = frameIndex;
+        pendingReads.push_back(freeBuffer);
+        stats.capturedFrameCount++;
+    }
+
+    stats.lastCaptureMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.totalCaptureMilliseconds += stats.lastCaptureMilliseconds;
+    stats.maximumCaptureMilliseconds = std::max(stats.maximumCaptureMilliseconds, stats.lastCaptureMilliseconds);
+}
+
+// Hands the buffers whose reads have completed to the encoders, in the order they were read.
+// Without shouldWait, stops at the first read which is still in progress.
+void FrameCapture::collectCompletedReads(bool shouldWait) {
+    while (!pendingReads.empty()) {
+        PixelBuffer* pixelBuffer = pendingReads.front();
+        GLenum result;
+        do {
+            result = glClientWaitSync(pixelBuffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT, shouldWait ? 1000000 : 0);
+        } while (shouldWait && result == GL_TIMEOUT_EXPIRED);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            return;
+        }
+
+        glDeleteSync(pixelBuffer->fence);
+        pixelBuffer->fence = nullptr;
+        pixelBuffer->isEncoding.store(true, std::memory_order_relaxed);
+        pendingReads.pop_front();
+        {
+            std::lock_guard<std::mutex> lock(encodeQueueMutex);
+            encodeQueue.push_back(pixelBuffer);
+        }
+        encodeQueueChanged.notify_one();
+    }
+}
+
+void FrameCapture::encoderLoop() {
+    setProfilerThreadName("frame encoder");
+    while (true) {
+        PixelBuffer* pixelBuffer;
+        {
+            std::unique_lock<std::mutex> lock(encodeQueueMutex);
+            encodeQueueChanged.wait(lock, [this]() { return isShuttingDown || !encodeQueue.empty(); });
+            // Shutting down only ends the loop once the queue is drained
+            if (encodeQueue.empty()) {
+                return;
+            }
+            pixelBuffer = encodeQueue.front();
+            encodeQueue.pop_front();
+        }
+
+        if (writeFrame(*pixelBuffer)) {
+            writtenFrameCount.fetch_add(1, std::memory_order_relaxed);
+        } else if (failedFrameCount.fetch_add(1, std::memory_order_relaxed) == 0) {
+            fprintf(stderr, "Could not write captured frame %u to \"%s\"\n", pixelBuffer->frameIndex, path.c_str());
+        }
+        pixelBuffer->isEncoding.store(false, std::memory_order_release);
+    }
+}
+
+bool FrameCapture::writeFrame(PixelBuffer const &pixelBuffer) {
+    PROFILE_SCOPE("encode frame");
+    if (isRawStream) {
+        return fwrite(pixelBuffer.pixels, 1, frameSize, rawFile) == frameSize;
+    }
+
+    char number[16];
+    snprintf(number, sizeof(number), "%06u.png", pixelBuffer.frameIndex);
+    return stbi_write_png((path + number).c_str(), width, height, 4, pixelBuffer.pixels, width * 4) != 0;
+}
+
+FrameCaptureStats FrameCapture::getStats() const {
+    FrameCaptureStats currentStats = stats;
+    currentStats.writtenFrameCount = writtenFrameCount.load(std::memory_order_relaxed);
+    currentStats.failedFrameCount = failedFrameCount.load(std::memory_order_relaxed);
+    return currentStats;
+}
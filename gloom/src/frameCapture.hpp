@@ -0,0 +1,105 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counters describing how capturing went
+struct FrameCaptureStats {
+    // Frames whose pixels were read back, and frames which were skipped because every pixel buffer
+    // was still waiting on the GPU or on an encoder
+    unsigned int capturedFrameCount = 0;
+    unsigned int droppedFrameCount = 0;
+    // Frames which made it to disk, and frames which could not be written
+    unsigned int writtenFrameCount = 0;
+    unsigned int failedFrameCount = 0;
+
+    // Time capture() took on the render thread
+    double lastCaptureMilliseconds = 0.0;
+    double totalCaptureMilliseconds = 0.0;
+    double maximumCaptureMilliseconds = 0.0;
+};
+
+// Records rendered frames to disk without stalling the render loop.
+//
+// glReadPixels() into client memory makes the CPU wait until the GPU has finished the frame.
+// Instead, each frame is read into one of a ring of pixel buffer objects, which only queues the copy,
+// and a fence is placed behind it. Later frames check the fences without waiting, and hand the buffers
+// whose copies have completed to encoder threads, which read the pixels straight out of the
+// persistently mapped buffer. A buffer returns to the ring once it has been written to disk.
+//
+// If no buffer is free when a frame is captured, the frame is dropped rather than waited for.
+//
+// A path ending in ".raw" is written as a single stream of RGBA frames, bottom row first, which e.g.
+// "ffmpeg -f rawvideo -pixel_format rgba -video_size <width>x<height> -i <path> -vf vflip" turns into a video.
+// Any other path is a prefix for numbered PNG files: "captures/frame" writes captures/frame000000.png and onwards.
+class FrameCapture {
+public:
+    FrameCapture(std::string const &path, int width, int height, unsigned int bufferCount = 4, unsigned int encoderCount = 2);
+    // Calls finish(). The GL context has to be current.
+    ~FrameCapture();
+
+    // Queues the read of the current contents of the given framebuffer (0 being the window's back buffer),
+    // so call it after the frame's last draw and before swapping buffers
+    void capture(GLuint framebuffer = 0);
+
+    // Waits for the frames still being read or encoded to be written, and stops the encoders.
+    // Later frames are not captured.
+    void finish();
+
+    // False if the output file could not be opened
+    bool isOpen() const { return isValid; }
+
+    FrameCaptureStats getStats() const;
+
+private:
+    struct PixelBuffer {
+        GLuint buffer = 0;
+        unsigned char const* pixels = nullptr;
+        GLsync fence = nullptr;
+        unsigned int frameIndex = 0;
+        // Set by the render thread when handing the buffer to an encoder, cleared by the encoder when done
+        std::atomic<bool> isEncoding;
+
+        PixelBuffer() : isEncoding(false) {}
+    };
+
+    void collectCompletedReads(bool shouldWait);
+    void encoderLoop();
+    bool writeFrame(PixelBuffer const &pixelBuffer);
+
+    int width;
+    int height;
+    size_t frameSize;
+    std::string path;
+    bool isRawStream;
+    bool isValid = true;
+    FILE* rawFile = nullptr;
+
+    std::vector<std::unique_ptr<PixelBuffer>> pixelBuffers;
+    // Buffers with a read in flight, oldest first
+    std::deque<PixelBuffer*> pendingReads;
+    unsigned int nextFrameIndex = 0;
+
+    std::vector<std::thread> encoders;
+    std::deque<PixelBuffer*> encodeQueue;
+    std::mutex encodeQueueMutex;
+    std::condition_variable encodeQueueChanged;
+    bool isShuttingDown = false;
+    bool isFinished = false;
+
+    FrameCaptureStats stats;
+    std::atomic<unsigned int> writtenFrameCount;
+    std::atomic<unsigned int> failedFrameCount;
+
+    FrameCapture(FrameCapture const &) = delete;
+    FrameCapture & operator =(FrameCapture const &) = delete;
+};
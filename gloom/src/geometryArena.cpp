@@ -0,0 +1,150 @@
+#include "geometryArena.hpp"
+
+#include <cstdio>
+
+// Interleaved vertex as stored in the arena's vertex buffer
+struct ArenaVertex {
+    float4 position;
+    float4 colour;
+    // Zero for meshes without normals, which lit programs take as "use the face's normal"
+    float3 normal;
+    // Zero for meshes without texture coordinates
+    float2 textureCoordinate;
+};
+
+GeometryArena::GeometryArena(GpuResourceManager &resources, unsigned int vertexCapacity, unsigned int indexCapacity)
+    : resources(resources), vertexAllocator(vertexCapacity), indexAllocator(indexCapacity) {
+    vertexArray = resources.createVertexArray();
+    glBindVertexArray(vertexArray.get());
+
+    // Meshes are written into the buffers as they come and go, rather than once
+    vertexBuffer = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, vertexCapacity * sizeof(ArenaVertex), nullptr, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*) 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*) sizeof(float4));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*) (2 * sizeof(float4)));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*) (2 * sizeof(float4) + sizeof(float3)));
+    glEnableVertexAttribArray(2);
+
+    indexBuffer = resources.createBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMemoryIndices, indexCapacity * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+
+    glBindVertexArray(0);
+
+    // An arena which does not fit into the budgets has no room, so every mesh falls back to a VAO of its own
+    if (vertexBuffer.isEmpty() || indexBuffer.isEmpty()) {
+        fprintf(stderr, "The geometry arena does not fit into the GPU memory budget, meshes will not share buffers\n");
+        vertexBuffer.reset();
+        indexBuffer.reset();
+        vertexAllocator = RangeAllocator(0);
+        indexAllocator = RangeAllocator(0);
+    }
+
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    commandBuffer.reset(buffer);
+}
+
+MeshVAO GeometryArena::upload(Mesh const &mesh) {
+    MeshVAO handle;
+    handle.indexCount = unsigned(mesh.indices.size());
+    setMeshBounds(handle, mesh);
+
+    size_t firstVertex;
+    size_t firstIndex;
+    if (!vertexAllocator.allocate(mesh.vertices.size(), firstVertex)) {
+        return handle;
+    }
+    if (!indexAllocator.allocate(mesh.indices.size(), firstIndex)) {
+        vertexAllocator.free(firstVertex, mesh.vertices.size());
+        return handle;
+    }
+
+    std::vector<ArenaVertex> vertices(mesh.vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        vertices[i].position = mesh.vertices[i];
+        vertices[i].colour = i < mesh.colours.size() ? mesh.colours[i] : float4(1.0f, 1.0f, 1.0f, 1.0f);
+        vertices[i].normal = i < mesh.normals.size() ? mesh.normals[i] : float3(0.0f, 0.0f, 0.0f);
+        vertices[i].textureCoordinate = i < mesh.textureCoordinates.size() ? mesh.textureCoordinates[i] : float2(0.0f, 0.0f);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+    glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(ArenaVertex), vertices.size() * sizeof(ArenaVertex), vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer.get());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(unsigned int), mesh.indices.size() * sizeof(unsigned int), mesh.indices.data());
+
+    ArenaMesh arenaMesh;
+    arenaMesh.firstVertex = unsigned(firstVertex);
+    arenaMesh.vertexCount = unsigned(mesh.vertices.size());
+    arenaMesh.firstIndex = unsigned(firstIndex);
+    arenaMesh.indexCount = unsigned(mesh.indices.size());
+    arenaMesh.isAllocated = true;
+
+    if (unusedMeshIDs.empty()) {
+        handle.arenaMeshID = int(meshes.size());
+        meshes.push_back(arenaMesh);
+    } else {
+        handle.arenaMeshID = unusedMeshIDs.back();
+        unusedMeshIDs.pop_back();
+        meshes.at(handle.arenaMeshID) = arenaMesh;
+    }
+    return handle;
+}
+
+MeshVAO GeometryArena::uploadSeparately(Mesh const &mesh) {
+    GpuMesh gpuMesh;
+    if (!uploadMesh(mesh, resources, gpuMesh)) {
+        fprintf(stderr, "Mesh \"%s\" fits neither into the geometry arena nor into the GPU memory budget, it will not be drawn\n",
+                mesh.name.c_str());
+        MeshVAO handle;
+        setMeshBounds(handle, mesh);
+        return handle;
+    }
+    separateMeshes.push_back(std::move(gpuMesh));
+    return separateMeshes.back().vao;
+}
+
+void GeometryArena::remove(int arenaMeshID) {
+    ArenaMesh &mesh = meshes.at(arenaMeshID);
+    if (!mesh.isAllocated) {
+        return;
+    }
+    vertexAllocator.free(mesh.firstVertex, mesh.vertexCount);
+    indexAllocator.free(mesh.firstIndex, mesh.indexCount);
+    mesh = ArenaMesh();
+    unusedMeshIDs.push_back(arenaMeshID);
+}
+
+void GeometryArena::draw(int arenaMeshID) {
+    ArenaMesh const &mesh = meshes.at(arenaMeshID);
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+                             (void*) (mesh.firstIndex * sizeof(unsigned int)), GLint(mesh.firstVertex));
+}
+
+void GeometryArena::multiDraw(DrawPacket const* packets, size_t count, unsigned int drawOffset) {
+    commands.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        ArenaMesh const &mesh = meshes.at(packets[i].arenaMeshID);
+        DrawElementsIndirectCommand &command = commands[i];
+        command.count = mesh.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = mesh.firstIndex;
+        command.baseVertex = GLint(mesh.firstVertex);
+        command.baseInstance = 0;
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.get());
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+
+    glUniform1ui(10, drawOffset);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, GLsizei(count), 0);
+}
+
+MeshVAO uploadMesh(Mesh const &mesh, GeometryArena &arena) {
+    MeshVAO handle = arena.upload(mesh);
+    if (handle.arenaMeshID != -1) {
+        return handle;
+    }
+    return arena.uploadSeparately(mesh);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+#include "gpuResources.hpp"
+#include "mesh.hpp"
+#include "program.hpp"
+#include "rangeAllocator.hpp"
+#include "renderQueue.hpp"
+
+// Where a mesh lives inside the arena's shared vertex and index buffers
+struct ArenaMesh {
+    unsigned int firstVertex = 0;
+    unsigned int vertexCount = 0;
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+    bool isAllocated = false;
+};
+
+// The layout glMultiDrawElementsIndirect() expects for each draw in the command buffer
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Stores many meshes in one large vertex buffer and one large index buffer, sharing a single VAO.
+// Since every mesh in the arena uses the same VAO, a whole list of them can be drawn with
+// a single glMultiDrawElementsIndirect() call instead of a bind and a draw call per mesh.
+//
+// Vertices are interleaved (position at attribute 1, colour at attribute 4, matching uploadMesh()).
+// Indices stay relative to their own mesh; each draw command adds the mesh's first vertex as base vertex.
+//
+// The buffers are created at their full capacity by the resource manager, and count against its budgets
+// whether or not they are full, so the space meshes take inside them is only tracked by the arena's allocators.
+class GeometryArena {
+public:
+    GeometryArena(GpuResourceManager &resources, unsigned int vertexCapacity, unsigned int indexCapacity);
+
+    // Copies the mesh into the arena. If there is not enough room left,
+    // the returned MeshVAO has an arenaMeshID of -1 and the caller should fall back to uploadSeparately().
+    MeshVAO upload(Mesh const &mesh);
+
+    // Uploads a mesh which does not fit into the arena into a VAO of its own, in buffers created by the arena's
+    // resource manager which are deleted along with the arena. Gives an empty MeshVAO, which draws nothing,
+    // if they do not fit into the manager's budgets either.
+    MeshVAO uploadSeparately(Mesh const &mesh);
+
+    // Releases the mesh's space in the arena so it can be reused
+    void remove(int arenaMeshID);
+
+    ArenaMesh const &getMesh(int arenaMeshID) const { return meshes.at(arenaMeshID); }
+    GLuint getVertexArray() const { return vertexArray.get(); }
+
+    // Draws one arena mesh with a regular draw call. The arena's VAO must be bound.
+    void draw(int arenaMeshID);
+
+    // Draws the meshes of count packets with a single glMultiDrawElementsIndirect() call.
+    // The arena's VAO and a program like mesh.vert with MESH_INDIRECT must be bound. That shader fetches the matrix
+    // for draw i from index (drawOffset + gl_DrawID) of the transformation buffer at binding 0.
+    void multiDraw(DrawPacket const* packets, size_t count, unsigned int drawOffset);
+
+private:
+    GpuResourceManager &resources;
+    GpuVertexArray vertexArray;
+    GpuBuffer vertexBuffer;
+    GpuBuffer indexBuffer;
+    // Respecified with every multi-draw, so its size is not worth tracking
+    GLName<deleteGLBuffer> commandBuffer;
+
+    RangeAllocator vertexAllocator;
+    RangeAllocator indexAllocator;
+
+    std::vector<ArenaMesh> meshes;
+    std::vector<int> unusedMeshIDs;
+    std::vector<DrawElementsIndirectCommand> commands;
+    // Meshes given to uploadSeparately()
+    std::vector<GpuMesh> separateMeshes;
+
+    GeometryArena(GeometryArena const &) = delete;
+    GeometryArena & operator =(GeometryArena const &) = delete;
+};
+
+// Uploads the mesh into the arena if it has enough room left, and with GeometryArena::uploadSeparately() otherwise
+MeshVAO uploadMesh(Mesh const &mesh, GeometryArena &arena);
@@ -0,0 +1,305 @@
+#include "glInstrumentation.hpp"
+
+#ifdef GLOOM_GL_INSTRUMENTATION
+
+#include <atomic>
+#include <cstdio>
+
+// Drivers can repeat the same warning every frame, so only the first messages are printed, the rest only counted
+static const unsigned int maximumPrintedMessages = 50;
+
+// All counted calls come from the thread owning the context, but debug messages may arrive on a driver thread
+static GLCallCounters frameCounters;
+static GLCallCounters lastFrameCounters;
+static GLCallCounters totalCounters;
+static unsigned int frameCount = 0;
+static std::atomic<unsigned int> debugErrorCount(0);
+static std::atomic<unsigned int> debugWarningCount(0);
+static std::atomic<unsigned int> printedMessageCount(0);
+
+static char const* debugTypeName(GLenum type) {
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behaviour";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability warning";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance warning";
+        default: return "message";
+    }
+}
+
+static char const* debugSeverityName(GLenum severity) {
+    switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH: return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW: return "low";
+        default: return "notification";
+    }
+}
+
+static void APIENTRY debugMessageCallback(GLenum, GLenum type, GLuint id, GLenum severity, GLsizei, GLchar const* message, void const*) {
+    if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) {
+        return;
+    }
+    if (type == GL_DEBUG_TYPE_ERROR) {
+        debugErrorCount.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        debugWarningCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    unsigned int printedCount = printedMessageCount.fetch_add(1, std::memory_order_relaxed);
+    if (printedCount < maximumPrintedMessages) {
+        fprintf(stderr, "OpenGL %s (%s severity, ID %u): %s\n", debugTypeName(type), debugSeverityName(severity), id, message);
+    } else if (printedCount == maximumPrintedMessages) {
+        fprintf(stderr, "Further OpenGL debug messages are counted, but not printed\n");
+    }
+}
+
+static void countDraw(GLenum mode, GLsizei count, GLsizei instanceCount) {
+    frameCounters.drawCalls++;
+    uint64_t trianglesPerInstance = 0;
+    if (mode == GL_TRIANGLES) {
+        trianglesPerInstance = uint64_t(count / 3);
+    } else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count >= 3) {
+        trianglesPerInstance = uint64_t(count - 2);
+    }
+    frameCounters.triangles += trianglesPerInstance * uint64_t(instanceCount);
+}
+
+// The real entry points, as loaded by glad
+static PFNGLDRAWARRAYSPROC originalDrawArrays;
+static PFNGLDRAWARRAYSINSTANCEDPROC originalDrawArraysInstanced;
+static PFNGLDRAWELEMENTSPROC originalDrawElements;
+static PFNGLDRAWELEMENTSBASEVERTEXPROC originalDrawElementsBaseVertex;
+static PFNGLDRAWELEMENTSINSTANCEDPROC originalDrawElementsInstanced;
+static PFNGLDRAWELEMENTSINSTANCEDBASEINSTANCEPROC originalDrawElementsInstancedBaseInstance;
+static PFNGLDRAWELEMENTSINDIRECTPROC originalDrawElementsIndirect;
+static PFNGLMULTIDRAWELEMENTSINDIRECTPROC originalMultiDrawElementsIndirect;
+static PFNGLUSEPROGRAMPROC originalUseProgram;
+static PFNGLBINDVERTEXARRAYPROC originalBindVertexArray;
+static PFNGLBINDBUFFERPROC originalBindBuffer;
+static PFNGLBINDBUFFERBASEPROC originalBindBufferBase;
+static PFNGLBINDBUFFERRANGEPROC originalBindBufferRange;
+static PFNGLBUFFERDATAPROC originalBufferData;
+static PFNGLBUFFERSUBDATAPROC originalBufferSubData;
+static PFNGLUNIFORM1IPROC originalUniform1i;
+static PFNGLUNIFORM1UIPROC originalUniform1ui;
+static PFNGLUNIFORM1FPROC originalUniform1f;
+static PFNGLUNIFORM2FPROC originalUniform2f;
+static PFNGLUNIFORM2IPROC originalUniform2i;
+static PFNGLUNIFORM3FPROC originalUniform3f;
+static PFNGLUNIFORM3UIPROC originalUniform3ui;
+static PFNGLUNIFORM4FPROC originalUniform4f;
+static PFNGLUNIFORM4FVPROC originalUniform4fv;
+static PFNGLUNIFORMMATRIX4FVPROC originalUniformMatrix4fv;
+
+static void APIENTRY countedDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    countDraw(mode, count, 1);
+    originalDrawArrays(mode, first, count);
+}
+
+static void APIENTRY countedDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount) {
+    countDraw(mode, count, instanceCount);
+    originalDrawArraysInstanced(mode, first, count, instanceCount);
+}
+
+static void APIENTRY countedDrawElements(GLenum mode, GLsizei count, GLenum type, void const* indices) {
+    countDraw(mode, count, 1);
+    originalDrawElements(mode, count, type, indices);
+}
+
+static void APIENTRY countedDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, void const* indices, GLint baseVertex) {
+    countDraw(mode, count, 1);
+    originalDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+}
+
+static void APIENTRY countedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, void const* indices, GLsizei instanceCount) {
+    countDraw(mode, count, instanceCount);
+    originalDrawElementsInstanced(mode, count, type, indices, instanceCount);
+}
+
+static void APIENTRY countedDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, void const* indices,
+                                                              GLsizei instanceCount, GLuint baseInstance) {
+    countDraw(mode, count, instanceCount);
+    originalDrawElementsInstancedBaseInstance(mode, count, type, indices, instanceCount, baseInstance);
+}
+
+static void APIENTRY countedDrawElementsIndirect(GLenum mode, GLenum type, void const* indirect) {
+    frameCounters.drawCalls++;
+    frameCounters.indirectDrawCalls++;
+    originalDrawElementsIndirect(mode, type, indirect);
+}
+
+static void APIENTRY countedMultiDrawElementsIndirect(GLenum mode, GLenum type, void const* indirect, GLsizei drawCount, GLsizei stride) {
+    frameCounters.drawCalls += unsigned(drawCount);
+    frameCounters.indirectDrawCalls += unsigned(drawCount);
+    originalMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+}
+
+static void APIENTRY countedUseProgram(GLuint program) {
+    frameCounters.programBinds++;
+    originalUseProgram(program);
+}
+
+static void APIENTRY countedBindVertexArray(GLuint array) {
+    frameCounters.vertexArrayBinds++;
+    originalBindVertexArray(array);
+}
+
+static void APIENTRY countedBindBuffer(GLenum target, GLuint buffer) {
+    frameCounters.bufferBinds++;
+    originalBindBuffer(target, buffer);
+}
+
+static void APIENTRY countedBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    frameCounters.bufferBinds++;
+    originalBindBufferBase(target, index, buffer);
+}
+
+static void APIENTRY countedBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    frameCounters.bufferBinds++;
+    originalBindBufferRange(target, index, buffer, offset, size);
+}
+
+static void APIENTRY countedBufferData(GLenum target, GLsizeiptr size, void const* data, GLenum usage) {
+    // Without data, the buffer is only allocated (or orphaned) and nothing is uploaded
+    if (data != nullptr) {
+        frameCounters.bufferBytesUploaded += uint64_t(size);
+    }
+    originalBufferData(target, size, data, usage);
+}
+
+static void APIENTRY countedBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void const* data) {
+    frameCounters.bufferBytesUploaded += uint64_t(size);
+    originalBufferSubData(target, offset, size, data);
+}
+
+static void APIENTRY countedUniform1i(GLint location, GLint v0) {
+    frameCounters.uniformUpdates++;
+    originalUniform1i(location, v0);
+}
+
+static void APIENTRY countedUniform1ui(GLint location, GLuint v0) {
+    frameCounters.uniformUpdates++;
+    originalUniform1ui(location, v0);
+}
+
+static void APIENTRY countedUniform1f(GLint location, GLfloat v0) {
+    frameCounters.uniformUpdates++;
+    originalUniform1f(location, v0);
+}
+
+static void APIENTRY countedUniform2f(GLint location, GLfloat v0, GLfloat v1) {
+    frameCounters.uniformUpdates++;
+    originalUniform2f(location, v0, v1);
+}
+
+static void APIENTRY countedUniform2i(GLint location, GLint v0, GLint v1) {
+    frameCounters.uniformUpdates++;
+    originalUniform2i(location, v0, v1);
+}
+
+static void APIENTRY countedUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+    frameCounters.uniformUpdates++;
+    originalUniform3f(location, v0, v1, v2);
+}
+
+static void APIENTRY countedUniform3ui(GLint location, GLuint v0, GLuint v1, GLuint v2) {
+    frameCounters.uniformUpdates++;
+    originalUniform3ui(location, v0, v1, v2);
+}
+
+static void APIENTRY countedUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) {
+    frameCounters.uniformUpdates++;
+    originalUniform4f(location, v0, v1, v2, v3);
+}
+
+static void APIENTRY countedUniform4fv(GLint location, GLsizei count, GLfloat const* value) {
+    frameCounters.uniformUpdates++;
+    originalUniform4fv(location, count, value);
+}
+
+static void APIENTRY countedUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, GLfloat const* value) {
+    frameCounters.uniformUpdates++;
+    originalUniformMatrix4fv(location, count, transpose, value);
+}
+
+// Swaps glad's pointer for the counting version, keeping the real one. Entry points the driver lacks stay null.
+#define INSTRUMENT_ENTRY_POINT(name, counted, original) \
+    if (glad_##name != nullptr && glad_##name != counted) { \
+        original = glad_##name; \
+        glad_##name = counted; \
+    }
+
+void installGLInstrumentation() {
+    if (GLAD_GL_KHR_debug || GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3)) {
+        // Asynchronous output, so the driver need not stop after every call to report what it found
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(debugMessageCallback, nullptr);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+    } else {
+        fprintf(stderr, "KHR_debug is not supported, OpenGL errors will not be reported\n");
+    }
+
+    INSTRUMENT_ENTRY_POINT(glDrawArrays, countedDrawArrays, originalDrawArrays);
+    INSTRUMENT_ENTRY_POINT(glDrawArraysInstanced, countedDrawArraysInstanced, originalDrawArraysInstanced);
+    INSTRUMENT_ENTRY_POINT(glDrawElements, countedDrawElements, originalDrawElements);
+    INSTRUMENT_ENTRY_POINT(glDrawElementsBaseVertex, countedDrawElementsBaseVertex, originalDrawElementsBaseVertex);
+    INSTRUMENT_ENTRY_POINT(glDrawElementsInstanced, countedDrawElementsInstanced, originalDrawElementsInstanced);
+    INSTRUMENT_ENTRY_POINT(glDrawElementsInstancedBaseInstance, countedDrawElementsInstancedBaseInstance, originalDrawElementsInstancedBaseInstance);
+    INSTRUMENT_ENTRY_POINT(glDrawElementsIndirect, countedDrawElementsIndirect, originalDrawElementsIndirect);
+    INSTRUMENT_ENTRY_POINT(glMultiDrawElementsIndirect, countedMultiDrawElementsIndirect, originalMultiDrawElementsIndirect);
+    INSTRUMENT_ENTRY_POINT(glUseProgram, countedUseProgram, originalUseProgram);
+    INSTRUMENT_ENTRY_POINT(glBindVertexArray, countedBindVertexArray, originalBindVertexArray);
+    INSTRUMENT_ENTRY_POINT(glBindBuffer, countedBindBuffer, originalBindBuffer);
+    INSTRUMENT_ENTRY_POINT(glBindBufferBase, countedBindBufferBase, originalBindBufferBase);
+    INSTRUMENT_ENTRY_POINT(glBindBufferRange, countedBindBufferRange, originalBindBufferRange);
+    INSTRUMENT_ENTRY_POINT(glBufferData, countedBufferData, originalBufferData);
+    INSTRUMENT_ENTRY_POINT(glBufferSubData, countedBufferSubData, originalBufferSubData);
+    INSTRUMENT_ENTRY_POINT(glUniform1i, countedUniform1i, originalUniform1i);
+    INSTRUMENT_ENTRY_POINT(glUniform1ui, countedUniform1ui, originalUniform1ui);
+    INSTRUMENT_ENTRY_POINT(glUniform1f, countedUniform1f, originalUniform1f);
+    INSTRUMENT_ENTRY_POINT(glUniform2f, countedUniform2f, originalUniform2f);
+    INSTRUMENT_ENTRY_POINT(glUniform2i, countedUniform2i, originalUniform2i);
+    INSTRUMENT_ENTRY_POINT(glUniform3f, countedUniform3f, originalUniform3f);
+    INSTRUMENT_ENTRY_POINT(glUniform3ui, countedUniform3ui, originalUniform3ui);
+    INSTRUMENT_ENTRY_POINT(glUniform4f, countedUniform4f, originalUniform4f);
+    INSTRUMENT_ENTRY_POINT(glUniform4fv, countedUniform4fv, originalUniform4fv);
+    INSTRUMENT_ENTRY_POINT(glUniformMatrix4fv, countedUniformMatrix4fv, originalUniformMatrix4fv);
+}
+
+#undef INSTRUMENT_ENTRY_POINT
+
+void endGLInstrumentationFrame() {
+    frameCounters.debugErrors = debugErrorCount.exchange(0, std::memory_order_relaxed);
+    frameCounters.debugWarnings = debugWarningCount.exchange(0, std::memory_order_relaxed);
+
+    lastFrameCounters = frameCounters;
+    totalCounters.drawCalls += frameCounters.drawCalls;
+    totalCounters.indirectDrawCalls += frameCounters.indirectDrawCalls;
+    totalCounters.triangles += frameCounters.triangles;
+    totalCounters.bufferBytesUploaded += frameCounters.bufferBytesUploaded;
+    totalCounters.programBinds += frameCounters.programBinds;
+    totalCounters.vertexArrayBinds += frameCounters.vertexArrayBinds;
+    totalCounters.bufferBinds += frameCounters.bufferBinds;
+    totalCounters.uniformUpdates += frameCounters.uniformUpdates;
+    totalCounters.debugErrors += frameCounters.debugErrors;
+    totalCounters.debugWarnings += frameCounters.debugWarnings;
+    frameCount++;
+
+    frameCounters = GLCallCounters();
+}
+
+GLCallCounters getGLFrameCounters() {
+    return lastFrameCounters;
+}
+
+GLCallCounters getGLTotalCounters() {
+    return totalCounters;
+}
+
+unsigned int getGLInstrumentedFrameCount() {
+    return frameCount;
+}
+
+#endif
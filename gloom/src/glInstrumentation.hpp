@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+
+// Instrumentation is compiled into debug builds only. Release builds (NDEBUG) call GL directly,
+// and the functions below do nothing.
+#if !defined(NDEBUG) && !defined(GLOOM_DISABLE_GL_INSTRUMENTATION)
+#define GLOOM_GL_INSTRUMENTATION 1
+#endif
+
+// What was submitted to GL during one frame
+struct GLCallCounters {
+    unsigned int drawCalls = 0;
+    // Draws from an indirect buffer, which are included in drawCalls but not in the triangle count,
+    // since their parameters live in GPU memory
+    unsigned int indirectDrawCalls = 0;
+    uint64_t triangles = 0;
+    // Bytes passed to glBufferData() and glBufferSubData(). Writes into mapped buffers (such as TransformRing's) aren't seen.
+    uint64_t bufferBytesUploaded = 0;
+    unsigned int programBinds = 0;
+    unsigned int vertexArrayBinds = 0;
+    unsigned int bufferBinds = 0;
+    unsigned int uniformUpdates = 0;
+    // Messages reported through KHR_debug, by severity
+    unsigned int debugErrors = 0;
+    unsigned int debugWarnings = 0;
+};
+
+#ifdef GLOOM_GL_INSTRUMENTATION
+
+// Call once the context is current and glad has been loaded.
+// Installs a KHR_debug callback, which reports errors and performance warnings as the driver finds them,
+// instead of polling glGetError(), which stalls the pipeline. Then replaces the glad entry points
+// of draw, bind, upload and uniform calls with versions which count their calls before forwarding them.
+void installGLInstrumentation();
+
+// Moves the counts of the frame which just ended into getGLFrameCounters() and starts counting the next one
+void endGLInstrumentationFrame();
+
+// The counts of the last complete frame, and their sums over all frames so far
+GLCallCounters getGLFrameCounters();
+GLCallCounters getGLTotalCounters();
+unsigned int getGLInstrumentedFrameCount();
+
+#else
+
+inline void installGLInstrumentation() {}
+inline void endGLInstrumentationFrame() {}
+inline GLCallCounters getGLFrameCounters() { return GLCallCounters(); }
+inline GLCallCounters getGLTotalCounters() { return GLCallCounters(); }
+inline unsigned int getGLInstrumentedFrameCount() { return 0; }
+
+#endif
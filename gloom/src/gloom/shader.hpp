@@ -24,21 +24,30 @@ namespace Gloom
         GLuint get()        { return mProgram; }
         void   destroy()    { glDeleteProgram(mProgram); }
 
-        /* Attach a shader to the current shader program */
-        void attach(std::string const &filename)
+        /* Attach a shader to the current shader program. Any #include "file"
+           lines are replaced by that file, relative to the including one, and
+           the given defines are inserted right after the #version line */
+        void attach(std::string const &filename, std::string const &defines = "")
         {
             // Load GLSL Shader from source
-            std::ifstream fd(filename.c_str());
-            if (fd.fail())
+            std::string src;
+            if (!load(filename, src, 0))
             {
-                fprintf(stderr,
-                    "Something went wrong when attaching the Shader file at \"%s\".\n"
-                    "The file may not exist or is currently inaccessible.\n",
-                    filename.c_str());
                 return;
             }
-            auto src = std::string(std::istreambuf_iterator<char>(fd),
-                                  (std::istreambuf_iterator<char>()));
+            if (!defines.empty())
+            {
+                // #version has to stay first, and #line keeps error messages pointing at the file's own lines
+                auto versionEnd = src.compare(0, 8, "#version") == 0 ? src.find('\n') : std::string::npos;
+                if (versionEnd == std::string::npos)
+                {
+                    src = defines + "#line 1\n" + src;
+                }
+                else
+                {
+                    src.insert(versionEnd + 1, defines + "#line 2\n");
+                }
+            }
 
             // Create shader object
             const char * source = src.c_str();
@@ -115,6 +124,48 @@ namespace Gloom
         }
 
 
+        /* Reads a GLSL file into src, expanding its #include directives.
+           Prints an error and returns false if a file can't be read. */
+        static bool load(std::string const &filename, std::string &src, int depth)
+        {
+            std::ifstream fd(filename.c_str());
+            if (fd.fail() || depth > 16)
+            {
+                fprintf(stderr,
+                    "Something went wrong when attaching the Shader file at \"%s\".\n"
+                    "The file may not exist, is currently inaccessible, or includes itself.\n",
+                    filename.c_str());
+                return false;
+            }
+
+            auto slash = filename.rfind('/');
+            auto directory = slash == std::string::npos ? std::string() : filename.substr(0, slash + 1);
+            std::string line;
+            int lineNumber = 0;
+            while (std::getline(fd, line))
+            {
+                lineNumber++;
+                auto start = line.find_first_not_of(" \t");
+                auto open = line.find('"');
+                auto close = line.rfind('"');
+                if (start == std::string::npos || line.compare(start, 8, "#include") != 0
+                    || open == std::string::npos || open == close)
+                {
+                    src += line + "\n";
+                    continue;
+                }
+                src += "#line 1\n";
+                if (!load(directory + line.substr(open + 1, close - open - 1), src, depth + 1))
+                {
+                    fprintf(stderr, "Included from \"%s\", line %d.\n", filename.c_str(), lineNumber);
+                    return false;
+                }
+                src += "#line " + std::to_string(lineNumber + 1) + "\n";
+            }
+            return true;
+        }
+
+
         /* Helper function for creating shaders */
         GLuint create(std::string const &filename)
         {
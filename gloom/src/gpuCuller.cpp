@@ -0,0 +1,189 @@
+#include "gpuCuller.hpp"
+#include "gloom/shader.hpp"
+#include "profiler.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+static_assert(sizeof(GpuCullInstance) == 96, "GpuCullInstance must match the std430 layout of Instance in cullInstances.comp");
+
+// Instances tested by one work group; matches local_size_x in cullInstances.comp
+static const unsigned int cullGroupSize = 64;
+
+GpuCuller::GpuCuller(GeometryArena &arena, GpuResourceManager &resources, unsigned int capacity, std::string const &shaderFile)
+    : arena(arena), resources(resources), capacity(capacity) {
+    Gloom::Shader shader;
+    shader.attach(shaderFile);
+    shader.link();
+    program = GpuProgram(shader.get());
+
+    instanceBuffer = resources.createBuffer(GL_SHADER_STORAGE_BUFFER, gpuMemoryStorage, capacity * sizeof(GpuCullInstance), nullptr, GL_DYNAMIC_DRAW);
+    transformBuffer = resources.createBuffer(GL_SHADER_STORAGE_BUFFER, gpuMemoryStorage, capacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    GLuint zero = 0;
+    visibleCountBuffer = resources.createBuffer(GL_SHADER_STORAGE_BUFFER, gpuMemoryStorage, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+    if (instanceBuffer.isEmpty() || transformBuffer.isEmpty() || visibleCountBuffer.isEmpty()) {
+        fprintf(stderr, "The buffers for %u GPU culled instances do not fit into the storage budget\n", capacity);
+        this->capacity = 0;
+    }
+}
+
+int GpuCuller::addInstance(int arenaMeshID, unsigned int material, glm::mat4 const &model, float3 const &boundsMin, float3 const &boundsMax) {
+    if (instances.size() >= capacity) {
+        return -1;
+    }
+    GpuCullInstance instance;
+    instance.model = model;
+    instance.boundsMin = boundsMin;
+    instance.command = 0;
+    instance.boundsMax = boundsMax;
+    instance.padding = 0;
+    instances.push_back(instance);
+    instanceMeshIDs.push_back(arenaMeshID);
+    instanceMaterials.push_back(material);
+    areCommandsOutdated = true;
+    return int(instances.size() - 1);
+}
+
+unsigned int GpuCuller::addSubtree(SceneNode* node, unsigned int material, glm::mat4 const &parentTransform) {
+    updateNodeTransform(node, parentTransform);
+    unsigned int addedCount = 0;
+    if (node->arenaMeshID != -1 &&
+        addInstance(node->arenaMeshID, material, node->currentTransformationMatrix, node->boundsMin, node->boundsMax) != -1) {
+        addedCount++;
+    }
+    for (SceneNode* child : node->children) {
+        addedCount += addSubtree(child, material, node->currentTransformationMatrix);
+    }
+    return addedCount;
+}
+
+void GpuCuller::setModel(unsigned int instance, glm::mat4 const &model) {
+    instances.at(instance).model = model;
+    if (firstMovedInstance == endMovedInstance) {
+        firstMovedInstance = instance;
+        endMovedInstance = instance + 1;
+    } else {
+        firstMovedInstance = std::min(firstMovedInstance, size_t(instance));
+        endMovedInstance = std::max(endMovedInstance, size_t(instance) + 1);
+    }
+}
+
+void GpuCuller::clear() {
+    instances.clear();
+    instanceMeshIDs.clear();
+    instanceMaterials.clear();
+    materialCommandCounts.clear();
+    areCommandsOutdated = true;
+}
+
+void GpuCuller::rebuildCommands() {
+    std::vector<unsigned int> order(instances.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = unsigned(i);
+    }
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+        return instanceMaterials[a] != instanceMaterials[b] ? instanceMaterials[a] < instanceMaterials[b] : instanceMeshIDs[a] < instanceMeshIDs[b];
+    });
+
+    commands.clear();
+    materialFirstCommands.clear();
+    materialCommandCounts.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+        unsigned int instance = order[i];
+        unsigned int material = instanceMaterials[instance];
+        if (i == 0 || material != instanceMaterials[order[i - 1]] || instanceMeshIDs[instance] != instanceMeshIDs[order[i - 1]]) {
+            ArenaMesh const &mesh = arena.getMesh(instanceMeshIDs[instance]);
+            DrawElementsIndirectCommand command;
+            command.count = mesh.indexCount;
+            command.instanceCount = 0;
+            command.firstIndex = mesh.firstIndex;
+            command.baseVertex = GLint(mesh.firstVertex);
+            // Each command's range of the transformation buffer has room for all of its instances
+            command.baseInstance = GLuint(i);
+            commands.push_back(command);
+
+            if (material >= materialFirstCommands.size()) {
+                materialFirstCommands.resize(material + 1, unsigned(commands.size() - 1));
+                materialCommandCounts.resize(material + 1, 0);
+            }
+            materialCommandCounts[material]++;
+        }
+        instances[instance].command = GLuint(commands.size() - 1);
+    }
+
+    size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+    if (commandBuffer.getSize() < commandBytes) {
+        commandBuffer = resources.createBuffer(GL_SHADER_STORAGE_BUFFER, gpuMemoryStorage, commandBytes, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer.get());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GLsizeiptr(instances.size() * sizeof(GpuCullInstance)), instances.data());
+    areCommandsOutdated = false;
+}
+
+void GpuCuller::cull(glm::mat4 const &viewProjection) {
+    PROFILE_SCOPE("cull instances on the GPU");
+    if (areCommandsOutdated) {
+        rebuildCommands();
+    } else if (firstMovedInstance < endMovedInstance) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer.get());
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(firstMovedInstance * sizeof(GpuCullInstance)),
+                        GLsizeiptr((endMovedInstance - firstMovedInstance) * sizeof(GpuCullInstance)), &instances[firstMovedInstance]);
+    }
+    firstMovedInstance = 0;
+    endMovedInstance = 0;
+    if (instances.empty() || commandBuffer.isEmpty()) {
+        return;
+    }
+
+    // Every command starts out without instances
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer.get());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GLsizeiptr(commands.size() * sizeof(DrawElementsIndirectCommand)), commands.data());
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleCountBuffer.get());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+
+    // The frustum's planes (Gribb and Hartmann), pointing inwards. They don't need to be normalised,
+    // since the shader only looks at which side of each plane a box lies on.
+    glm::vec4 planes[6];
+    for (unsigned int axis = 0; axis < 3; axis++) {
+        for (unsigned int side = 0; side < 2; side++) {
+            glm::vec4 &plane = planes[2 * axis + side];
+            for (unsigned int column = 0; column < 4; column++) {
+                plane[column] = viewProjection[column][3] + (side == 0 ? 1.0f : -1.0f) * viewProjection[column][axis];
+            }
+        }
+    }
+
+    glUseProgram(program.get());
+    glUniformMatrix4fv(23, 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform1ui(24, GLuint(instances.size()));
+    glUniform4fv(25, 6, glm::value_ptr(planes[0]));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, instanceBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, commandBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, visibleCountBuffer.get());
+    glDispatchCompute(GLuint((instances.size() + cullGroupSize - 1) / cullGroupSize), 1, 1);
+
+    // The draws read the commands as commands and the transformations as storage, and readVisibleCount() reads the count
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void GpuCuller::draw(unsigned int material) {
+    if (material >= materialCommandCounts.size() || materialCommandCounts[material] == 0 || commandBuffer.isEmpty()) {
+        return;
+    }
+    glBindVertexArray(arena.getVertexArray());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformBuffer.get());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.get());
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*) (materialFirstCommands[material] * sizeof(DrawElementsIndirectCommand)),
+                                GLsizei(materialCommandCounts[material]), 0);
+}
+
+unsigned int GpuCuller::readVisibleCount() {
+    GLuint visibleCount = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleCountBuffer.get());
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &visibleCount);
+    return visibleCount;
+}
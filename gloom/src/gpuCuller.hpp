@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include <string>
+#include <vector>
+#include "floats.hpp"
+#include "geometryArena.hpp"
+#include "gpuResources.hpp"
+#include "sceneGraph.hpp"
+
+// One instance as cullInstances.comp reads it from the storage buffer (std430 layout)
+struct GpuCullInstance {
+    glm::mat4 model;
+    float3 boundsMin;
+    // The draw command of the instance's material and mesh
+    GLuint command;
+    float3 boundsMax;
+    GLuint padding;
+};
+
+// Frustum culls instances of geometry arena meshes on the GPU, and writes the draw commands for the ones left.
+//
+// The instances' world matrices and bounding boxes stay in a storage buffer, so the CPU does no work per instance
+// each frame, unless it moves some. There is one DrawElementsIndirectCommand per material and mesh, each owning
+// a range of the transformation buffer as large as its number of instances. cull() runs a compute shader which tests
+// every instance's box against the frustum, and appends the transformations of those inside to their command's
+// range, counting them in its instance count. draw() then draws all meshes of a material with a single
+// glMultiDrawElementsIndirect(), without the CPU ever learning what survived.
+//
+// Needs the buffers at bindings 0 and 5 to 7 and the uniforms at locations 23 to 30 for the compute shader.
+class GpuCuller {
+public:
+    // Room for capacity instances, whose buffers are created by the resource manager
+    GpuCuller(GeometryArena &arena, GpuResourceManager &resources, unsigned int capacity,
+              std::string const &shaderFile = "./gloom/shaders/cullInstances.comp");
+
+    // Adds an instance of an arena mesh, drawn by draw(material). Instances with an empty box (boundsMin above boundsMax)
+    // are never culled. Returns the instance's index, or -1 if the culler is full.
+    int addInstance(int arenaMeshID, unsigned int material, glm::mat4 const &model, float3 const &boundsMin, float3 const &boundsMax);
+
+    // Adds every node of the subtree which has an arena mesh, and returns how many that were.
+    // Updates the nodes' currentTransformationMatrix to their world transformation on the way.
+    // Nodes with a VAO of their own are left out, and still have to be drawn some other way.
+    unsigned int addSubtree(SceneNode* node, unsigned int material, glm::mat4 const &parentTransform = glm::mat4(1.0f));
+
+    // Moves an instance. The new matrix is uploaded by the next cull().
+    void setModel(unsigned int instance, glm::mat4 const &model);
+
+    void clear();
+
+    // Culls every instance against the frustum of viewProjection, and fills in the draw commands.
+    // Leaves the compute shader's program bound.
+    void cull(glm::mat4 const &viewProjection);
+
+    // Draws the instances of the material which survived the last cull(). A program like mesh.vert with MESH_INSTANCED
+    // must be bound, which reads the transformations from binding 0 at gl_BaseInstance + gl_InstanceID.
+    void draw(unsigned int material);
+
+    // The number of instances which survived the last cull(). Waits for the GPU to finish it, so it is for statistics only.
+    unsigned int readVisibleCount();
+
+    unsigned int getInstanceCount() const { return unsigned(instances.size()); }
+    unsigned int getCapacity() const { return capacity; }
+    unsigned int getCommandCount() const { return unsigned(commands.size()); }
+
+private:
+    // Groups the instances by material and mesh into commands, and uploads all of them
+    void rebuildCommands();
+
+    GeometryArena &arena;
+    GpuResourceManager &resources;
+    unsigned int capacity;
+    GpuProgram program;
+
+    GpuBuffer instanceBuffer;
+    GpuBuffer transformBuffer;
+    GpuBuffer commandBuffer;
+    GpuBuffer visibleCountBuffer;
+
+    std::vector<GpuCullInstance> instances;
+    std::vector<int> instanceMeshIDs;
+    std::vector<unsigned int> instanceMaterials;
+    // With no instances counted yet, as they are copied into the command buffer before every cull
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<unsigned int> materialFirstCommands;
+    std::vector<unsigned int> materialCommandCounts;
+
+    // Set when instances were added, since that changes the commands. Otherwise only the moved instances are uploaded.
+    bool areCommandsOutdated = false;
+    size_t firstMovedInstance = 0;
+    size_t endMovedInstance = 0;
+
+    GpuCuller(GpuCuller const &) = delete;
+    GpuCuller & operator =(GpuCuller const &) = delete;
+};
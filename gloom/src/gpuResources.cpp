@@ -0,0 +1,149 @@
+#include "gpuResources.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+char const* gpuMemoryCategoryName(GpuMemoryCategory category) {
+    switch (category) {
+        case gpuMemoryVertices: return "vertices";
+        case gpuMemoryIndices: return "indices";
+        case gpuMemoryStorage: return "storage";
+        case gpuMemoryTextures: return "textures";
+    }
+    return "unknown";
+}
+
+void deleteGLBuffer(GLuint name) {
+    glDeleteBuffers(1, &name);
+}
+
+void deleteGLVertexArray(GLuint name) {
+    glDeleteVertexArrays(1, &name);
+}
+
+void deleteGLProgram(GLuint name) {
+    glDeleteProgram(name);
+}
+
+void deleteGLTexture(GLuint name) {
+    glDeleteTextures(1, &name);
+}
+
+GpuResourceManager::~GpuResourceManager() {
+    if (stats.bufferCount > 0 || stats.textureCount > 0) {
+        fprintf(stderr, "%u GPU buffers and %u textures outlive their resource manager\n", stats.bufferCount, stats.textureCount);
+    }
+}
+
+void GpuResourceManager::setBudget(GpuMemoryCategory category, size_t bytes) {
+    budgets[category] = bytes;
+}
+
+bool GpuResourceManager::reserve(GpuMemoryCategory category, size_t bytes) {
+    size_t budget = budgets[category];
+    if (budget == 0) {
+        return true;
+    }
+    if (bytes > budget) {
+        return false;
+    }
+
+    for (auto const &evictor : evictors) {
+        size_t resident = stats.residentBytes[category];
+        if (resident + bytes <= budget) {
+            break;
+        }
+        stats.evictedBytes += evictor.second(category, resident + bytes - budget);
+    }
+    return stats.residentBytes[category] + bytes <= budget;
+}
+
+void GpuResourceManager::add(GpuMemoryCategory category, size_t bytes) {
+    stats.residentBytes[category] += bytes;
+    stats.peakBytes[category] = std::max(stats.peakBytes[category], stats.residentBytes[category]);
+    if (category == gpuMemoryTextures) {
+        stats.textureCount++;
+        stats.createdTextureCount++;
+    } else {
+        stats.bufferCount++;
+        stats.createdBufferCount++;
+    }
+}
+
+void GpuResourceManager::release(GpuMemoryCategory category, size_t bytes) {
+    stats.residentBytes[category] -= bytes;
+    if (category == gpuMemoryTextures) {
+        stats.textureCount--;
+    } else {
+        stats.bufferCount--;
+    }
+}
+
+GpuBuffer GpuResourceManager::createBuffer(GLenum target, GpuMemoryCategory category, size_t bytes, void const* data, GLenum usage) {
+    if (!reserve(category, bytes)) {
+        stats.deferredBufferCount++;
+        return GpuBuffer();
+    }
+    GLuint name;
+    glGenBuffers(1, &name);
+    glBindBuffer(target, name);
+    glBufferData(target, GLsizeiptr(bytes), data, usage);
+    return track<deleteGLBuffer>(name, category, bytes);
+}
+
+GpuBuffer GpuResourceManager::createStorage(GLenum target, GpuMemoryCategory category, size_t bytes, void const* data, GLbitfield flags) {
+    if (!reserve(category, bytes)) {
+        stats.deferredBufferCount++;
+        return GpuBuffer();
+    }
+    GLuint name;
+    glGenBuffers(1, &name);
+    glBindBuffer(target, name);
+    glBufferStorage(target, GLsizeiptr(bytes), data, flags);
+    return track<deleteGLBuffer>(name, category, bytes);
+}
+
+GpuTexture GpuResourceManager::createTexture(GLenum internalFormat, size_t texelBytes, unsigned int width, unsigned int height, unsigned int levelCount) {
+    size_t bytes = 0;
+    for (unsigned int level = 0; level < levelCount; level++) {
+        bytes += size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * texelBytes;
+    }
+    if (!reserve(gpuMemoryTextures, bytes)) {
+        stats.deferredTextureCount++;
+        return GpuTexture();
+    }
+    GLuint name;
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_2D, name);
+    glTexStorage2D(GL_TEXTURE_2D, GLsizei(levelCount), internalFormat, GLsizei(width), GLsizei(height));
+    return track<deleteGLTexture>(name, gpuMemoryTextures, bytes);
+}
+
+GpuVertexArray GpuResourceManager::createVertexArray() {
+    GLuint name;
+    glGenVertexArrays(1, &name);
+    return GpuVertexArray(name);
+}
+
+unsigned int GpuResourceManager::addEvictor(Evictor const &evictor) {
+    evictors.push_back(std::make_pair(nextEvictorID, evictor));
+    return nextEvictorID++;
+}
+
+void GpuResourceManager::removeEvictor(unsigned int evictorID) {
+    evictors.erase(std::remove_if(evictors.begin(), evictors.end(),
+                                  [evictorID](std::pair<unsigned int, Evictor> const &evictor) { return evictor.first == evictorID; }),
+                   evictors.end());
+}
+
+void GpuResourceManager::printUsage() const {
+    for (unsigned int i = 0; i < gpuMemoryCategoryCount; i++) {
+        GpuMemoryCategory category = GpuMemoryCategory(i);
+        printf("  %-9s %9.2f MB resident, %9.2f MB at most", gpuMemoryCategoryName(category),
+               double(stats.residentBytes[i]) / (1024.0 * 1024.0), double(stats.peakBytes[i]) / (1024.0 * 1024.0));
+        if (budgets[i] != 0) {
+            printf(", %9.2f MB budget", double(budgets[i]) / (1024.0 * 1024.0));
+        }
+        printf("\n");
+    }
+}
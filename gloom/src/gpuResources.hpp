@@ -0,0 +1,233 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// What GPU memory is spent on, each tracked against a budget of its own
+enum GpuMemoryCategory {
+    gpuMemoryVertices,
+    gpuMemoryIndices,
+    gpuMemoryStorage,
+    gpuMemoryTextures
+};
+
+const unsigned int gpuMemoryCategoryCount = 4;
+
+char const* gpuMemoryCategoryName(GpuMemoryCategory category);
+
+void deleteGLBuffer(GLuint name);
+void deleteGLVertexArray(GLuint name);
+void deleteGLProgram(GLuint name);
+void deleteGLTexture(GLuint name);
+
+// Owns one GL object name, and deletes it with deleteName when destroyed or reset.
+// Can be moved but not copied, so every object has exactly one owner.
+template <void (*deleteName)(GLuint)>
+class GLName {
+public:
+    GLName() = default;
+    explicit GLName(GLuint name) : name(name) {}
+    GLName(GLName &&other) : name(other.name) { other.name = 0; }
+    GLName & operator =(GLName &&other) {
+        if (this != &other) {
+            reset(other.name);
+            other.name = 0;
+        }
+        return *this;
+    }
+    ~GLName() { reset(); }
+
+    GLuint get() const { return name; }
+    bool isEmpty() const { return name == 0; }
+
+    // Deletes the current object, and takes ownership of the given one
+    void reset(GLuint newName = 0) {
+        if (name != 0) {
+            deleteName(name);
+        }
+        name = newName;
+    }
+
+    // Gives up ownership without deleting the object
+    GLuint release() {
+        GLuint released = name;
+        name = 0;
+        return released;
+    }
+
+private:
+    GLuint name = 0;
+
+    GLName(GLName const &) = delete;
+    GLName & operator =(GLName const &) = delete;
+};
+
+// Vertex arrays and programs take no memory worth counting, so their handles only delete them
+typedef GLName<deleteGLVertexArray> GpuVertexArray;
+typedef GLName<deleteGLProgram> GpuProgram;
+
+class GpuResourceManager;
+
+// A buffer or texture created by a GpuResourceManager. Its bytes count as resident until it is destroyed or reset.
+template <void (*deleteName)(GLuint)>
+class GpuAllocation {
+public:
+    GpuAllocation() = default;
+    GpuAllocation(GpuAllocation &&other);
+    GpuAllocation & operator =(GpuAllocation &&other);
+    ~GpuAllocation() { reset(); }
+
+    GLuint get() const { return name.get(); }
+    bool isEmpty() const { return name.isEmpty(); }
+    size_t getSize() const { return size; }
+    GpuMemoryCategory getCategory() const { return category; }
+
+    // Deletes the object, returning its bytes to the manager's budget
+    void reset();
+
+private:
+    friend class GpuResourceManager;
+
+    GLName<deleteName> name;
+    GpuResourceManager* manager = nullptr;
+    size_t size = 0;
+    GpuMemoryCategory category = gpuMemoryVertices;
+
+    GpuAllocation(GpuAllocation const &) = delete;
+    GpuAllocation & operator =(GpuAllocation const &) = delete;
+};
+
+typedef GpuAllocation<deleteGLBuffer> GpuBuffer;
+typedef GpuAllocation<deleteGLTexture> GpuTexture;
+
+// Resident bytes per category, and what the budgets have cost
+struct GpuMemoryStats {
+    size_t residentBytes[gpuMemoryCategoryCount] = {};
+    size_t peakBytes[gpuMemoryCategoryCount] = {};
+    unsigned int bufferCount = 0;
+    unsigned int textureCount = 0;
+    // Buffers created, and refused because they did not fit their budget even after asking the evictors
+    unsigned int createdBufferCount = 0;
+    unsigned int deferredBufferCount = 0;
+    // The same for textures
+    unsigned int createdTextureCount = 0;
+    unsigned int deferredTextureCount = 0;
+    // Bytes the evictors freed to make room for new buffers
+    size_t evictedBytes = 0;
+};
+
+// Creates buffers and textures, and keeps track of how many bytes of each category are resident on the GPU.
+//
+// Each category can be given a budget. A buffer which would not fit into its category's budget is first made room for
+// by the evictors, owners of memory which can be given back and loaded again later (such as streamed terrain).
+// If they can't free enough, the buffer is not created and its owner has to defer the upload, and try again later.
+//
+// Buffers and textures hold a pointer to their manager, so the manager has to outlive them.
+class GpuResourceManager {
+public:
+    // Frees bytesNeeded bytes (or as many as it can) of the given category, and returns how many it freed.
+    // Evictors free memory by destroying GpuBuffers, and must not add or remove evictors while doing so.
+    typedef std::function<size_t(GpuMemoryCategory category, size_t bytesNeeded)> Evictor;
+
+    GpuResourceManager() = default;
+    ~GpuResourceManager();
+
+    // A budget of zero, the default, means any number of bytes
+    void setBudget(GpuMemoryCategory category, size_t bytes);
+    size_t getBudget(GpuMemoryCategory category) const { return budgets[category]; }
+    size_t getResidentBytes(GpuMemoryCategory category) const { return stats.residentBytes[category]; }
+
+    // Whether bytes more bytes of the category fit into its budget, asking the evictors to make room if needed
+    bool reserve(GpuMemoryCategory category, size_t bytes);
+
+    // Creates a buffer of the given size, bound to target, and fills it with data unless that is null.
+    // Returns an empty buffer if it does not fit into the budget.
+    GpuBuffer createBuffer(GLenum target, GpuMemoryCategory category, size_t bytes, void const* data, GLenum usage = GL_STATIC_DRAW);
+
+    // Like createBuffer(), but with immutable storage (glBufferStorage()), for mapping persistently
+    GpuBuffer createStorage(GLenum target, GpuMemoryCategory category, size_t bytes, void const* data, GLbitfield flags);
+
+    // Creates a 2D texture with immutable storage for levelCount mip levels of the given format, bound to GL_TEXTURE_2D.
+    // texelBytes is the size of one texel of the format, to count the texture against the textures budget.
+    // Returns an empty texture if it does not fit into the budget.
+    GpuTexture createTexture(GLenum internalFormat, size_t texelBytes, unsigned int width, unsigned int height, unsigned int levelCount);
+
+    GpuVertexArray createVertexArray();
+
+    // Evictors are asked in the order they were added. The returned ID removes the evictor again.
+    unsigned int addEvictor(Evictor const &evictor);
+    void removeEvictor(unsigned int evictorID);
+
+    GpuMemoryStats const &getStats() const { return stats; }
+
+    // Prints the resident bytes of every category, and its budget
+    void printUsage() const;
+
+private:
+    template <void (*deleteName)(GLuint)>
+    friend class GpuAllocation;
+
+    template <void (*deleteName)(GLuint)>
+    GpuAllocation<deleteName> track(GLuint name, GpuMemoryCategory category, size_t bytes);
+    // Counts the bytes of a buffer (or a texture, in gpuMemoryTextures) as resident, or no longer so
+    void add(GpuMemoryCategory category, size_t bytes);
+    void release(GpuMemoryCategory category, size_t bytes);
+
+    size_t budgets[gpuMemoryCategoryCount] = {};
+    std::vector<std::pair<unsigned int, Evictor>> evictors;
+    unsigned int nextEvictorID = 0;
+
+    GpuMemoryStats stats;
+
+    GpuResourceManager(GpuResourceManager const &) = delete;
+    GpuResourceManager & operator =(GpuResourceManager const &) = delete;
+};
+
+template <void (*deleteName)(GLuint)>
+GpuAllocation<deleteName>::GpuAllocation(GpuAllocation &&other)
+    : name(std::move(other.name)), manager(other.manager), size(other.size), category(other.category) {
+    other.manager = nullptr;
+    other.size = 0;
+}
+
+template <void (*deleteName)(GLuint)>
+GpuAllocation<deleteName> & GpuAllocation<deleteName>::operator =(GpuAllocation &&other) {
+    if (this != &other) {
+        reset();
+        name = std::move(other.name);
+        manager = other.manager;
+        size = other.size;
+        category = other.category;
+        other.manager = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+template <void (*deleteName)(GLuint)>
+void GpuAllocation<deleteName>::reset() {
+    if (name.isEmpty()) {
+        return;
+    }
+    name.reset();
+    if (manager != nullptr) {
+        manager->release(category, size);
+    }
+    manager = nullptr;
+    size = 0;
+}
+
+template <void (*deleteName)(GLuint)>
+GpuAllocation<deleteName> GpuResourceManager::track(GLuint name, GpuMemoryCategory category, size_t bytes) {
+    GpuAllocation<deleteName> allocation;
+    allocation.name.reset(name);
+    allocation.manager = this;
+    allocation.size = bytes;
+    allocation.category = category;
+    add(category, bytes);
+    return allocation;
+}
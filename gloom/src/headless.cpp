@@ -0,0 +1,163 @@
+#include "headless.hpp"
+#include "glInstrumentation.hpp"
+
+#include <GLFW/glfw3.h>
+#include <cstdio>
+
+#ifdef GLOOM_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+#endif
+
+static GLFWwindow* hiddenWindow = nullptr;
+static GLuint framebuffer = 0;
+static GLuint renderbuffers[2] = {0, 0};
+
+#ifdef GLOOM_HAVE_EGL
+static bool createEGLContext() {
+    // The surfaceless platform is an extension; without it, the default display may still do
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay != nullptr) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        fprintf(stderr, "Could not initialise an EGL display\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "EGL %d.%d does not support desktop OpenGL\n", major, minor);
+        eglTerminate(display);
+        return false;
+    }
+
+    EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef GLOOM_GL_INSTRUMENTATION
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    context = eglCreateContext(display, configCount > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "Could not create a surfaceless OpenGL 4.5 context (EGL error 0x%x)\n", eglGetError());
+        if (context != EGL_NO_CONTEXT) {
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+    return true;
+}
+#endif
+
+static bool createHiddenWindowContext() {
+    if (!glfwInit()) {
+        fprintf(stderr, "Could not start GLFW\n");
+        return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLOOM_GL_INSTRUMENTATION
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
+
+    hiddenWindow = glfwCreateWindow(64, 64, "gloom", nullptr, nullptr);
+    if (hiddenWindow == nullptr) {
+        fprintf(stderr, "Could not open a hidden GLFW window\n");
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(hiddenWindow);
+    gladLoadGL();
+    return true;
+}
+
+bool createHeadlessContext(int width, int height) {
+    bool isCreated = false;
+#ifdef GLOOM_HAVE_EGL
+    isCreated = createEGLContext();
+#endif
+    if (!isCreated && !createHiddenWindowContext()) {
+        return false;
+    }
+
+    printf("%s: %s (headless)\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
+    printf("OpenGL\t %s\n\n", glGetString(GL_VERSION));
+    installGLInstrumentation();
+
+    // There is no default framebuffer to draw into, so make one
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "The headless framebuffer is incomplete\n");
+        destroyHeadlessContext();
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void destroyHeadlessContext() {
+    if (framebuffer != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        framebuffer = 0;
+    }
+
+#ifdef GLOOM_HAVE_EGL
+    if (context != EGL_NO_CONTEXT) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        context = EGL_NO_CONTEXT;
+        display = EGL_NO_DISPLAY;
+    }
+#endif
+    if (hiddenWindow != nullptr) {
+        glfwTerminate();
+        hiddenWindow = nullptr;
+    }
+}
+
+GLuint getHeadlessFramebuffer() {
+    return framebuffer;
+}
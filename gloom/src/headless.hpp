@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Creates an OpenGL 4.5 core context without a window, and makes it current with a framebuffer object
+// of the given size bound in place of the default framebuffer.
+//
+// When built with EGL (GLOOM_HAVE_EGL), the context comes from Mesa's surfaceless platform,
+// which needs neither a display server nor a GPU: on machines without one, Mesa renders with llvmpipe.
+// Otherwise a hidden GLFW window provides the context, which still needs a display.
+bool createHeadlessContext(int width, int height);
+void destroyHeadlessContext();
+
+// The framebuffer object headless rendering goes to, 0 if there is no headless context
+GLuint getHeadlessFramebuffer();
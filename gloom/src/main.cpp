@@ -1,6 +1,10 @@
 // Local headers
 #include "gloom/gloom.hpp"
 #include "program.hpp"
+#include "benchmarks.hpp"
+#include "headless.hpp"
+#include "glInstrumentation.hpp"
+#include "random.hpp"
 
 // System headers
 #include <glad/glad.h>
@@ -8,6 +12,7 @@
 
 // Standard headers
 #include <cstdlib>
+#include <string>
 
 
 // A callback which allows GLFW to report errors whenever they occur
@@ -27,8 +32,9 @@ GLFWwindow* initialise()
     }
 
     // Set core window options (adjust version numbers if needed)
+    // 4.5 matches the shaders' #version, and provides persistently mapped buffers (glBufferStorage)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Enable the GLFW runtime error callback function defined previously.
@@ -37,6 +43,10 @@ GLFWwindow* initialise()
     // Set additional window options
     glfwWindowHint(GLFW_RESIZABLE, windowResizable);
     glfwWindowHint(GLFW_SAMPLES, windowSamples);  // MSAA
+#ifdef GLOOM_GL_INSTRUMENTATION
+    // Debug contexts report more through KHR_debug, at some cost, which is why release builds don't ask for one
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
 
     // Create window using GLFW
     GLFWwindow* window = glfwCreateWindow(windowWidth,
@@ -63,17 +73,69 @@ GLFWwindow* initialise()
     printf("OpenGL\t %s\n", glGetString(GL_VERSION));
     printf("GLSL\t %s\n\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+    // Counts GL calls and reports driver messages in debug builds
+    installGLInstrumentation();
+
     return window;
 }
 
 
 int main(int argc, char* argb[])
 {
+    // "gloom --benchmark <name> [options]" runs a benchmark instead of the interactive program
+    if (argc >= 3 && std::string(argb[1]) == "--benchmark")
+    {
+        BenchmarkOptions options;
+        if (!parseBenchmarkOptions(argc - 3, argb + 3, options))
+        {
+            return EXIT_FAILURE;
+        }
+
+        // Headless benchmarks render offscreen, without ever opening a window
+        if (options.isHeadless)
+        {
+            if (!createHeadlessContext(windowWidth, windowHeight))
+            {
+                return EXIT_FAILURE;
+            }
+            int exitCode = runBenchmark(argb[2], nullptr, options);
+            destroyHeadlessContext();
+            return exitCode;
+        }
+
+        GLFWwindow* window = initialise();
+        int exitCode = runBenchmark(argb[2], window, options);
+        glfwTerminate();
+        return exitCode;
+    }
+
     // Initialise window using GLFW
     GLFWwindow* window = initialise();
 
+    // "gloom --trace <file>" writes a Chrome trace of the first frames to the file,
+    // "gloom --capture <path>" records the frames (see frameCapture.hpp),
+    // "gloom --seed <number>" picks the master seed of everything random (see random.hpp)
+    std::string traceFile;
+    std::string capturePath;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option = argb[i];
+        if (option == "--trace")
+        {
+            traceFile = argb[i + 1];
+        }
+        else if (option == "--capture")
+        {
+            capturePath = argb[i + 1];
+        }
+        else if (option == "--seed")
+        {
+            setRandomSeed(strtoull(argb[i + 1], nullptr, 0));
+        }
+    }
+
     // Run an OpenGL application using this window
-    runProgram(window);
+    runProgram(window, traceFile, capturePath);
 
     // Terminate GLFW (no need to call glfwDestroyWindow)
     glfwTerminate();
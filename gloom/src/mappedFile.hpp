@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A read-only view of a whole file, mapped into memory by the operating system.
+// Pages are only read from disk when they are touched, and no copy of the file is made.
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    // Maps the file at the given path, unmapping any previously mapped file. Returns false on failure.
+    bool open(std::string const &filePath);
+    void close();
+
+    unsigned char const* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+
+private:
+    unsigned char const* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile & operator =(MappedFile const &) = delete;
+};
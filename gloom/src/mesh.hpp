@@ -13,6 +13,11 @@ public:
 	std::vector<float4> colours;
 	std::vector<float3> normals;
 	std::vector<unsigned int> indices;
+	// One per vertex, for textured meshes (attribute 2, see uploadMesh()). Empty otherwise.
+	std::vector<float2> textureCoordinates;
+
+	// For skinned meshes, the bone each vertex follows (see uploadSkinnedMesh()). Empty otherwise.
+	std::vector<unsigned int> boneIndices;
 
 	Mesh(std::string vname) : name(vname) {}
 
@@ -0,0 +1,114 @@
+#include "meshCache.hpp"
+#include "OBJLoader.hpp"
+#include "toolbox.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+
+MeshCache::MeshCache(GpuResourceManager &resources, GeometryArena* arena) : resources(resources), arena(arena) {}
+
+void MeshCache::add(std::string const &reference, MeshVAO const &mesh) {
+    meshes[reference] = mesh;
+    references[std::make_pair(mesh.vertexArrayObjectID, mesh.arenaMeshID)] = reference;
+}
+
+void MeshCache::loadWavefrontFile(std::string const &filePath) {
+    std::vector<Mesh> objects;
+    try {
+        objects = loadWavefront(filePath, true);
+    } catch (std::runtime_error const &error) {
+        fprintf(stderr, "Could not load meshes from \"%s\": %s\n", filePath.c_str(), error.what());
+        return;
+    }
+
+    // Stream 0, like loadMinecraftCharacterModel(), so a file's objects get the same colours every run
+    Random random = randomStream(0);
+    for (Mesh &object : objects) {
+        // Every object takes its colours from the stream, even those skipped below,
+        // so the objects after them get the same colours as on the first load of the file
+        colourFaces(object, random);
+        // Objects uploaded or deferred by an earlier load of the file
+        std::string reference = filePath + "#" + object.name;
+        if (meshes.find(reference) != meshes.end() || deferredMeshes.count(reference) != 0) {
+            continue;
+        }
+        if (!upload(reference, object)) {
+            deferredMeshes.insert(std::make_pair(reference, std::move(object)));
+        }
+    }
+}
+
+void MeshCache::loadChessboard(std::string const &reference) {
+    unsigned int width;
+    unsigned int height;
+    float tileWidth;
+    if (sscanf(reference.c_str(), "chessboard:%u:%u:%f", &width, &height, &tileWidth) != 3) {
+        return;
+    }
+
+    float4 black(0.0f, 0.0f, 0.0f, 1.0f);
+    float4 white(1.0f, 1.0f, 1.0f, 1.0f);
+    Mesh chessboard = generateChessboard(width, height, tileWidth, black, white);
+    if (!upload(reference, chessboard)) {
+        deferredMeshes.insert(std::make_pair(reference, std::move(chessboard)));
+    }
+}
+
+bool MeshCache::upload(std::string const &reference, Mesh const &mesh) {
+    if (arena != nullptr) {
+        MeshVAO handle = arena->upload(mesh);
+        if (handle.arenaMeshID != -1) {
+            add(reference, handle);
+            return true;
+        }
+    }
+    GpuMesh gpuMesh;
+    if (!uploadMesh(mesh, resources, gpuMesh)) {
+        return false;
+    }
+    add(reference, gpuMesh.vao);
+    ownedMeshes.push_back(std::move(gpuMesh));
+    return true;
+}
+
+MeshVAO MeshCache::get(std::string const &reference) {
+    std::unordered_map<std::string, MeshVAO>::const_iterator cached = meshes.find(reference);
+    if (cached != meshes.end()) {
+        return cached->second;
+    }
+
+    std::unordered_map<std::string, Mesh>::iterator deferred = deferredMeshes.find(reference);
+    size_t separator = reference.find('#');
+    if (deferred != deferredMeshes.end()) {
+        // Loaded by an earlier get(), so only the upload is tried again
+        if (upload(reference, deferred->second)) {
+            deferredMeshes.erase(deferred);
+        }
+    } else if (separator != std::string::npos) {
+        loadWavefrontFile(reference.substr(0, separator));
+    } else if (reference.compare(0, 11, "chessboard:") == 0) {
+        loadChessboard(reference);
+    }
+
+    cached = meshes.find(reference);
+    if (cached == meshes.end() && deferredMeshes.count(reference) != 0) {
+        fprintf(stderr, "Mesh \"%s\" does not fit into the GPU memory budget, deferring it\n", reference.c_str());
+        return MeshVAO();
+    }
+    if (cached == meshes.end()) {
+        fprintf(stderr, "Unknown mesh reference \"%s\"\n", reference.c_str());
+        // Remember the failure too, so it is only reported once
+        meshes[reference] = MeshVAO();
+        return MeshVAO();
+    }
+    return cached->second;
+}
+
+std::string const* MeshCache::findReference(SceneNode const* node) const {
+    if (node->vertexArrayObjectID == -1 && node->arenaMeshID == -1) {
+        return nullptr;
+    }
+    std::map<std::pair<int, int>, std::string>::const_iterator found =
+        references.find(std::make_pair(node->vertexArrayObjectID, node->arenaMeshID));
+    return found == references.end() ? nullptr : &found->second;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "geometryArena.hpp"
+#include "gpuResources.hpp"
+#include "program.hpp"
+#include "sceneGraph.hpp"
+
+// Uploads every mesh at most once, and remembers the name ("reference") it was requested by.
+// References name where a mesh comes from, so that scene files can point at meshes without storing them:
+//
+//     <path to .obj file>#<object name>         an object from a Wavefront file
+//     chessboard:<width>:<height>:<tile width>  a black and white chessboard from generateChessboard()
+//
+// Requesting one object of a Wavefront file loads and uploads all objects in it.
+class MeshCache {
+public:
+    // Meshes are uploaded into the arena if one is given and has room, like uploadMesh() does.
+    // The other meshes are uploaded into buffers the resource manager tracks, owned by the cache,
+    // which are deleted along with it.
+    explicit MeshCache(GpuResourceManager &resources, GeometryArena* arena = nullptr);
+
+    // Returns the mesh with the given reference, loading it first if needed.
+    // References which cannot be resolved give an empty MeshVAO, which draws nothing.
+    // So do meshes which did not fit into the resource manager's budgets, but those are kept and tried again on the next get().
+    MeshVAO get(std::string const &reference);
+
+    // Registers a mesh which was uploaded elsewhere under the given reference
+    void add(std::string const &reference, MeshVAO const &mesh);
+
+    // Returns the reference of the mesh the node draws, or nullptr if it draws nothing known to the cache
+    std::string const* findReference(SceneNode const* node) const;
+
+private:
+    void loadWavefrontFile(std::string const &filePath);
+    void loadChessboard(std::string const &reference);
+    // False if the mesh did not fit into the budgets, and was not uploaded
+    bool upload(std::string const &reference, Mesh const &mesh);
+
+    GpuResourceManager &resources;
+    GeometryArena* arena;
+    std::unordered_map<std::string, MeshVAO> meshes;
+    std::vector<GpuMesh> ownedMeshes;
+    // Meshes which were loaded, but did not fit into the budgets yet, so they are not loaded again
+    std::unordered_map<std::string, Mesh> deferredMeshes;
+
+    // Reverse lookup, keyed by (VAO ID, arena mesh ID)
+    std::map<std::pair<int, int>, std::string> references;
+};
@@ -0,0 +1,381 @@
+#include "occlusionCuller.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_USE_SSE 1
+#endif
+
+// Rows of the depth buffer rasterized by one job
+static const unsigned int rowsPerJob = 16;
+
+// The corners of a box's six faces, with bit 0, 1 and 2 of a corner's number choosing the maximum x, y and z
+static const unsigned int boxFaces[6][4] = {
+    {0, 2, 6, 4}, {1, 3, 7, 5},
+    {0, 1, 5, 4}, {2, 3, 7, 6},
+    {0, 1, 3, 2}, {4, 5, 7, 6},
+};
+
+static glm::vec4 boxCorner(glm::mat4 const &transform, float3 const &boxMin, float3 const &boxMax, unsigned int corner) {
+    return transform * glm::vec4((corner & 1) ? boxMax.x : boxMin.x,
+                                 (corner & 2) ? boxMax.y : boxMin.y,
+                                 (corner & 4) ? boxMax.z : boxMin.z, 1.0f);
+}
+
+OcclusionCuller::OcclusionCuller(ThreadPool &pool, unsigned int width, unsigned int height, unsigned int maximumOccluderCount)
+    : pool(pool), width((std::max(width, 1u) + 3) & ~3u), height(std::max(height, 1u)), maximumOccluderCount(maximumOccluderCount) {
+    unsigned int levelWidth = this->width;
+    unsigned int levelHeight = this->height;
+    while (true) {
+        PyramidLevel level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.maxDepths.assign(size_t(levelWidth) * levelHeight, 1.0f);
+        if (!levels.empty()) {
+            level.minDepths.assign(size_t(levelWidth) * levelHeight, 1.0f);
+        }
+        levels.push_back(level);
+        if (levelWidth == 1 && levelHeight == 1) {
+            break;
+        }
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+}
+
+void OcclusionCuller::beginFrame() {
+    occluders.clear();
+    hasRasterized = false;
+}
+
+void OcclusionCuller::addOccluder(glm::mat4 const &modelViewProjection, float3 const &boxMin, float3 const &boxMax) {
+    if (boxMin.x > boxMax.x || boxMin.y > boxMax.y || boxMin.z > boxMax.z) {
+        return;
+    }
+    // Boxes entirely outside one of the frustum's planes cannot hide anything on the screen
+    unsigned int outsideCounts[6] = {};
+    float minX = 1.0f;
+    float maxX = -1.0f;
+    float minY = 1.0f;
+    float maxY = -1.0f;
+    bool isCrossingCameraPlane = false;
+    for (unsigned int corner = 0; corner < 8; corner++) {
+        glm::vec4 position = boxCorner(modelViewProjection, boxMin, boxMax, corner);
+        outsideCounts[0] += position.x < -position.w;
+        outsideCounts[1] += position.x > position.w;
+        outsideCounts[2] += position.y < -position.w;
+        outsideCounts[3] += position.y > position.w;
+        outsideCounts[4] += position.z < -position.w;
+        outsideCounts[5] += position.z > position.w;
+        if (position.w < 1e-5f) {
+            isCrossingCameraPlane = true;
+            continue;
+        }
+        minX = std::min(minX, position.x / position.w);
+        maxX = std::max(maxX, position.x / position.w);
+        minY = std::min(minY, position.y / position.w);
+        maxY = std::max(maxY, position.y / position.w);
+    }
+    for (unsigned int outsideCount : outsideCounts) {
+        if (outsideCount == 8) {
+            return;
+        }
+    }
+
+    Occluder occluder;
+    occluder.modelViewProjection = modelViewProjection;
+    occluder.boxMin = boxMin;
+    occluder.boxMax = boxMax;
+    // Boxes reaching behind the camera are treated as covering the whole screen
+    if (isCrossingCameraPlane) {
+        occluder.screenArea = 4.0f;
+    } else {
+        occluder.screenArea = (std::min(maxX, 1.0f) - std::max(minX, -1.0f)) * (std::min(maxY, 1.0f) - std::max(minY, -1.0f));
+    }
+    occluders.push_back(occluder);
+}
+
+void OcclusionCuller::rasterize() {
+    PROFILE_SCOPE("occlusion rasterize");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    stats = OcclusionCullerStats();
+    stats.candidateCount = unsigned(occluders.size());
+    // The boxes covering the most of the screen are the ones most likely to hide something
+    if (occluders.size() > maximumOccluderCount) {
+        std::nth_element(occluders.begin(), occluders.begin() + maximumOccluderCount, occluders.end(),
+                         [](Occluder const &a, Occluder const &b) { return a.screenArea > b.screenArea; });
+        occluders.resize(maximumOccluderCount);
+    }
+    stats.occluderCount = unsigned(occluders.size());
+
+    triangles.clear();
+    for (Occluder const &occluder : occluders) {
+        setUpBox(occluder);
+    }
+    stats.triangleCount = unsigned(triangles.size());
+
+    std::fill(levels.front().maxDepths.begin(), levels.front().maxDepths.end(), 1.0f);
+    size_t jobCount = (height + rowsPerJob - 1) / rowsPerJob;
+    pool.parallelFor(jobCount, [this](size_t job, unsigned int) {
+        unsigned int firstRow = unsigned(job) * rowsPerJob;
+        rasterizeRows(firstRow, std::min(firstRow + rowsPerJob, height));
+    });
+    buildPyramid();
+    hasRasterized = true;
+
+    stats.rasterizeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionCuller::setUpBox(Occluder const &occluder) {
+    glm::vec4 corners[8];
+    for (unsigned int corner = 0; corner < 8; corner++) {
+        corners[corner] = boxCorner(occluder.modelViewProjection, occluder.boxMin, occluder.boxMax, corner);
+    }
+    // Both triangles of every face are rasterized, since keeping the nearest depth leaves only the front faces anyway
+    for (unsigned int const* face : boxFaces) {
+        setUpTriangle(corners[face[0]], corners[face[1]], corners[face[2]]);
+        setUpTriangle(corners[face[0]], corners[face[2]], corners[face[3]]);
+    }
+}
+
+// Clips a clip space triangle against the near plane, and adds what is left as screen triangles
+void OcclusionCuller::setUpTriangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c) {
+    glm::vec4 const* input[3] = {&a, &b, &c};
+    glm::vec4 polygon[4];
+    unsigned int vertexCount = 0;
+    for (unsigned int i = 0; i < 3; i++) {
+        glm::vec4 const &current = *input[i];
+        glm::vec4 const &next = *input[(i + 1) % 3];
+        // Positive in front of the near plane
+        float currentDistance = current.z + current.w;
+        float nextDistance = next.z + next.w;
+        if (currentDistance >= 0.0f) {
+            polygon[vertexCount++] = current;
+        }
+        if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) {
+            float t = currentDistance / (currentDistance - nextDistance);
+            polygon[vertexCount++] = current + (next - current) * t;
+        }
+    }
+    if (vertexCount < 3) {
+        return;
+    }
+
+    float x[4];
+    float y[4];
+    float depth[4];
+    for (unsigned int i = 0; i < vertexCount; i++) {
+        float inverseW = 1.0f / polygon[i].w;
+        x[i] = (polygon[i].x * inverseW * 0.5f + 0.5f) * float(width);
+        y[i] = (polygon[i].y * inverseW * 0.5f + 0.5f) * float(height);
+        depth[i] = polygon[i].z * inverseW * 0.5f + 0.5f;
+    }
+
+    for (unsigned int i = 1; i + 1 < vertexCount; i++) {
+        unsigned int corners[3] = {0, i, i + 1};
+        float area = (x[corners[1]] - x[0]) * (y[corners[2]] - y[0]) - (x[corners[2]] - x[0]) * (y[corners[1]] - y[0]);
+        if (std::abs(area) < 1e-6f) {
+            continue;
+        }
+        // Flip clockwise triangles, so the inside is where all edge functions are positive
+        if (area < 0.0f) {
+            std::swap(corners[1], corners[2]);
+            area = -area;
+        }
+
+        ScreenTriangle triangle;
+        for (unsigned int j = 0; j < 3; j++) {
+            triangle.x[j] = x[corners[j]];
+            triangle.y[j] = y[corners[j]];
+        }
+        float depth0 = depth[corners[0]];
+        float depth1 = depth[corners[1]];
+        float depth2 = depth[corners[2]];
+        if (depth0 > 1.0f && depth1 > 1.0f && depth2 > 1.0f) {
+            continue;
+        }
+        // Depth divided by w is linear across the screen
+        triangle.depthPerX = ((depth1 - depth0) * (triangle.y[2] - triangle.y[0]) - (depth2 - depth0) * (triangle.y[1] - triangle.y[0])) / area;
+        triangle.depthPerY = ((depth2 - depth0) * (triangle.x[1] - triangle.x[0]) - (depth1 - depth0) * (triangle.x[2] - triangle.x[0])) / area;
+        triangle.depth = depth0 - triangle.depthPerX * triangle.x[0] - triangle.depthPerY * triangle.y[0];
+
+        float minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+        float maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+        float minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+        float maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+        if (maxX < 0.0f || maxY < 0.0f || minX > float(width) || minY > float(height)) {
+            continue;
+        }
+        triangle.minX = std::max(0, int(minX));
+        triangle.maxX = std::min(int(width) - 1, int(maxX));
+        triangle.minY = std::max(0, int(minY));
+        triangle.maxY = std::min(int(height) - 1, int(maxY));
+        triangles.push_back(triangle);
+    }
+}
+
+// Keeps the nearest depth of every pixel lying entirely inside a triangle, for the rows of one job.
+// Each pixel gets the triangle's furthest depth over its square, so the buffer never claims more is hidden than is.
+void OcclusionCuller::rasterizeRows(unsigned int firstRow, unsigned int endRow) {
+    std::vector<float> &depths = levels.front().maxDepths;
+    for (ScreenTriangle const &triangle : triangles) {
+        int firstY = std::max(triangle.minY, int(firstRow));
+        int lastY = std::min(triangle.maxY, int(endRow) - 1);
+        if (firstY > lastY) {
+            continue;
+        }
+
+        // Edge function i is positive on the inside of the edge from corner i to the next corner,
+        // and falls by edgeSlopes[i] per pixel to the right
+        // The edge functions are tested at pixel centres, less the most they fall towards any corner of the pixel,
+        // so a pixel only passes when all four corners are inside
+        float edgeSlopes[3];
+        float cornerMargins[3];
+        for (unsigned int i = 0; i < 3; i++) {
+            unsigned int next = (i + 1) % 3;
+            edgeSlopes[i] = triangle.y[next] - triangle.y[i];
+            cornerMargins[i] = 0.5f * (std::abs(edgeSlopes[i]) + std::abs(triangle.x[next] - triangle.x[i]));
+        }
+        // Depth is linear too, so its furthest point over a pixel is at a corner, this far behind the centre
+        float depthMargin = 0.5f * (std::abs(triangle.depthPerX) + std::abs(triangle.depthPerY));
+        // Whole blocks of four pixels are visited, so the first pixel is rounded down to a multiple of 4
+        int firstX = triangle.minX & ~3;
+
+        for (int y = firstY; y <= lastY; y++) {
+            float pixelY = float(y) + 0.5f;
+            float* row = &depths[size_t(y) * width];
+            // The edge functions and the depth at x = 0 on this row
+            float edges[3];
+            for (unsigned int i = 0; i < 3; i++) {
+                unsigned int next = (i + 1) % 3;
+                edges[i] = (triangle.x[next] - triangle.x[i]) * (pixelY - triangle.y[i]) + edgeSlopes[i] * triangle.x[i] - cornerMargins[i];
+            }
+            float rowDepth = triangle.depth + triangle.depthPerY * pixelY + depthMargin;
+
+#ifdef OCCLUSION_USE_SSE
+            __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 zero = _mm_setzero_ps();
+            for (int x = firstX; x <= triangle.maxX; x += 4) {
+                __m128 pixelX = _mm_add_ps(_mm_set1_ps(float(x)), pixelOffsets);
+                __m128 edge0 = _mm_sub_ps(_mm_set1_ps(edges[0]), _mm_mul_ps(_mm_set1_ps(edgeSlopes[0]), pixelX));
+                __m128 edge1 = _mm_sub_ps(_mm_set1_ps(edges[1]), _mm_mul_ps(_mm_set1_ps(edgeSlopes[1]), pixelX));
+                __m128 edge2 = _mm_sub_ps(_mm_set1_ps(edges[2]), _mm_mul_ps(_mm_set1_ps(edgeSlopes[2]), pixelX));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                __m128 depth = _mm_max_ps(_mm_add_ps(_mm_set1_ps(rowDepth), _mm_mul_ps(_mm_set1_ps(triangle.depthPerX), pixelX)), zero);
+                __m128 previous = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(previous, depth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+            }
+#else
+            for (int x = firstX; x <= triangle.maxX; x++) {
+                float pixelX = float(x) + 0.5f;
+                if (edges[0] - edgeSlopes[0] * pixelX >= 0.0f && edges[1] - edgeSlopes[1] * pixelX >= 0.0f
+                    && edges[2] - edgeSlopes[2] * pixelX >= 0.0f) {
+                    float depth = std::max(rowDepth + triangle.depthPerX * pixelX, 0.0f);
+                    row[x] = std::min(row[x], depth);
+                }
+            }
+#endif
+        }
+    }
+}
+
+void OcclusionCuller::buildPyramid() {
+    for (size_t level = 1; level < levels.size(); level++) {
+        PyramidLevel const &below = levels[level - 1];
+        PyramidLevel &current = levels[level];
+        // The depth buffer's nearest and furthest depths are the same
+        std::vector<float> const &belowMin = level == 1 ? below.maxDepths : below.minDepths;
+        for (unsigned int y = 0; y < current.height; y++) {
+            unsigned int y0 = 2 * y;
+            unsigned int y1 = std::min(2 * y + 1, below.height - 1);
+            for (unsigned int x = 0; x < current.width; x++) {
+                unsigned int x0 = 2 * x;
+                unsigned int x1 = std::min(2 * x + 1, below.width - 1);
+                size_t i00 = size_t(y0) * below.width + x0;
+                size_t i01 = size_t(y0) * below.width + x1;
+                size_t i10 = size_t(y1) * below.width + x0;
+                size_t i11 = size_t(y1) * below.width + x1;
+                size_t i = size_t(y) * current.width + x;
+                current.minDepths[i] = std::min(std::min(belowMin[i00], belowMin[i01]), std::min(belowMin[i10], belowMin[i11]));
+                current.maxDepths[i] = std::max(std::max(below.maxDepths[i00], below.maxDepths[i01]),
+                                                std::max(below.maxDepths[i10], below.maxDepths[i11]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(glm::mat4 const &modelViewProjection, float3 const &boxMin, float3 const &boxMax) const {
+    if (!hasRasterized || stats.triangleCount == 0 || boxMin.x > boxMax.x || boxMin.y > boxMax.y || boxMin.z > boxMax.z) {
+        return false;
+    }
+
+    float minX = float(width);
+    float maxX = 0.0f;
+    float minY = float(height);
+    float maxY = 0.0f;
+    float nearestDepth = 1.0f;
+    for (unsigned int corner = 0; corner < 8; corner++) {
+        glm::vec4 position = boxCorner(modelViewProjection, boxMin, boxMax, corner);
+        // Behind the camera, or so close to its plane that the projection is meaningless
+        if (position.w < 1e-5f) {
+            return false;
+        }
+        float inverseW = 1.0f / position.w;
+        float x = (position.x * inverseW * 0.5f + 0.5f) * float(width);
+        float y = (position.y * inverseW * 0.5f + 0.5f) * float(height);
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearestDepth = std::min(nearestDepth, position.z * inverseW * 0.5f + 0.5f);
+    }
+    if (maxX < 0.0f || maxY < 0.0f || minX >= float(width) || minY >= float(height)) {
+        return false;
+    }
+
+    int x0 = std::max(0, int(minX));
+    int x1 = std::min(int(width) - 1, int(maxX));
+    int y0 = std::max(0, int(minY));
+    int y1 = std::min(int(height) - 1, int(maxY));
+    // Start where the rectangle covers at most 2x2 texels
+    unsigned int level = 0;
+    while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+    return isRectangleOccluded(level, x0, y0, x1, y1, nearestDepth);
+}
+
+// Whether every texel of the level covering the rectangle (given in depth buffer pixels) hides nearestDepth
+bool OcclusionCuller::isRectangleOccluded(unsigned int level, int x0, int y0, int x1, int y1, float nearestDepth) const {
+    PyramidLevel const &texels = levels[level];
+    for (int y = y0 >> level; y <= y1 >> level; y++) {
+        for (int x = x0 >> level; x <= x1 >> level; x++) {
+            size_t i = size_t(y) * texels.width + x;
+            if (nearestDepth > texels.maxDepths[i]) {
+                continue;
+            }
+            if (level == 0 || nearestDepth <= texels.minDepths[i]) {
+                return false;
+            }
+            // Somewhere in between, so look at the part of the rectangle inside this texel one level down
+            int texelX0 = x << level;
+            int texelY0 = y << level;
+            int texelX1 = ((x + 1) << level) - 1;
+            int texelY1 = ((y + 1) << level) - 1;
+            if (!isRectangleOccluded(level - 1, std::max(x0, texelX0), std::max(y0, texelY0),
+                                     std::min(x1, texelX1), std::min(y1, texelY1), nearestDepth)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include "floats.hpp"
+#include "threadPool.hpp"
+
+// Counters describing the last rasterize()
+struct OcclusionCullerStats {
+    // Occluders offered with addOccluder() which were at least partly inside the view frustum,
+    // and the largest of those on the screen, which were rasterized
+    unsigned int candidateCount = 0;
+    unsigned int occluderCount = 0;
+    // Triangles left after clipping which covered at least part of the screen
+    unsigned int triangleCount = 0;
+    // Rasterizing and building the depth pyramid
+    double rasterizeMilliseconds = 0.0;
+};
+
+// Hides objects behind a few large occluders without asking the GPU.
+//
+// Each frame, the occluders covering the most of the screen are rasterized on the CPU into a small depth buffer, split into bands
+// of rows which are rasterized in parallel, four pixels at a time where SSE is available. Rasterizing is conservative:
+// only pixels an occluder covers entirely are written, with the occluder's furthest depth over the pixel. The buffer is then
+// reduced into a pyramid holding the nearest and the furthest depth of every 2x2 block of the level below.
+//
+// isOccluded() projects a bounding box, and walks down the pyramid from the level where the box covers
+// at most 2x2 texels: texels whose furthest depth is nearer than the box's nearest point hide it,
+// texels whose nearest depth is further away show it, and only texels in between are looked at more closely.
+//
+// Occluders are boxes, so they have to be solid: the mesh of a node used as an occluder must fill its bounding box,
+// like the parts of a Minecraft character or a flat board do. Anything else would hide objects that are visible.
+class OcclusionCuller {
+public:
+    // The depth buffer's width is rounded up to a multiple of 4
+    OcclusionCuller(ThreadPool &pool, unsigned int width = 256, unsigned int height = 192, unsigned int maximumOccluderCount = 64);
+
+    // Forgets the previous frame's occluders
+    void beginFrame();
+
+    // Offers the box between boxMin and boxMax, in the space modelViewProjection transforms into clip space,
+    // as an occluder. Only the maximumOccluderCount boxes covering the most of the screen are rasterized.
+    void addOccluder(glm::mat4 const &modelViewProjection, float3 const &boxMin, float3 const &boxMax);
+
+    // Rasterizes the largest occluders and builds the depth pyramid which isOccluded() tests against
+    void rasterize();
+
+    // True if the box is certainly hidden behind this frame's occluders. Boxes which cross the camera's plane,
+    // are off the screen or are empty (boxMin above boxMax) are never reported as hidden.
+    // Only reads, so any number of threads can test boxes at once.
+    bool isOccluded(glm::mat4 const &modelViewProjection, float3 const &boxMin, float3 const &boxMax) const;
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+    // The rasterized depths (0 at the near plane and 1 at the far plane), bottom row first
+    std::vector<float> const &getDepthBuffer() const { return levels.front().maxDepths; }
+    OcclusionCullerStats const &getStats() const { return stats; }
+
+private:
+    struct Occluder {
+        glm::mat4 modelViewProjection;
+        float3 boxMin;
+        float3 boxMax;
+        // The part of the screen covered by the box's projected bounds, in normalised device coordinates
+        float screenArea;
+    };
+
+    // A triangle in depth buffer coordinates, counter-clockwise, with its depth as a plane over the screen
+    struct ScreenTriangle {
+        float x[3];
+        float y[3];
+        float depth;
+        float depthPerX;
+        float depthPerY;
+        int minX;
+        int maxX;
+        int minY;
+        int maxY;
+    };
+
+    struct PyramidLevel {
+        unsigned int width;
+        unsigned int height;
+        std::vector<float> minDepths;
+        std::vector<float> maxDepths;
+    };
+
+    void setUpBox(Occluder const &occluder);
+    void setUpTriangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c);
+    void rasterizeRows(unsigned int firstRow, unsigned int endRow);
+    void buildPyramid();
+    bool isRectangleOccluded(unsigned int level, int x0, int y0, int x1, int y1, float nearestDepth) const;
+
+    ThreadPool &pool;
+    unsigned int width;
+    unsigned int height;
+    unsigned int maximumOccluderCount;
+
+    std::vector<Occluder> occluders;
+    std::vector<ScreenTriangle> triangles;
+    // Level 0 is the depth buffer itself, whose nearest and furthest depths are the same, so it only has maxDepths
+    std::vector<PyramidLevel> levels;
+    bool hasRasterized = false;
+
+    OcclusionCullerStats stats;
+};
@@ -0,0 +1,668 @@
+#include "pathfinder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+static const float diagonalCost = 1.41421356f;
+
+// The length of the shortest path between two tiles if nothing is in the way
+static float octileDistance(int2 a, int2 b) {
+    int dx = std::abs(a.x - b.x);
+    int dy = std::abs(a.y - b.y);
+    return float(std::max(dx, dy) - std::min(dx, dy)) + diagonalCost * float(std::min(dx, dy));
+}
+
+static bool isSameTile(int2 a, int2 b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+static int sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+TileGrid::TileGrid(unsigned int width, unsigned int height)
+    : width(width), height(height), walkable(size_t(width) * height, 1) {}
+
+void TileGrid::setWalkable(int x, int y, bool isTileWalkable) {
+    if (x >= 0 && y >= 0 && unsigned(x) < width && unsigned(y) < height) {
+        walkable[unsigned(y) * width + unsigned(x)] = isTileWalkable ? 1 : 0;
+    }
+}
+
+void Pathfinder::SearchScratch::begin(size_t nodeCount) {
+    if (costs.size() < nodeCount) {
+        costs.resize(nodeCount);
+        parents.resize(nodeCount);
+        openStamps.resize(nodeCount, 0);
+        closedStamps.resize(nodeCount, 0);
+    }
+    open.clear();
+
+    stamp++;
+    if (stamp == 0) {
+        std::fill(openStamps.begin(), openStamps.end(), 0);
+        std::fill(closedStamps.begin(), closedStamps.end(), 0);
+        stamp = 1;
+    }
+}
+
+Pathfinder::Pathfinder(TileGrid const &grid, ThreadPool &pool, unsigned int clusterSize, size_t cacheCapacity)
+    : grid(grid), pool(pool), clusterSize(clusterSize), cacheCapacity(cacheCapacity),
+      cacheShards(new CacheShard[cacheShardCount]), queryCount(0), cacheHitCount(0) {
+    threadScratch.resize(pool.threadCount());
+
+    // The cache's keys hold 16 bits per coordinate, so larger grids search every time instead
+    if (grid.getWidth() > 0x10000 || grid.getHeight() > 0x10000) {
+        this->cacheCapacity = 0;
+    }
+
+    if (clusterSize > 0) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        buildAbstractGraph();
+        buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+unsigned int Pathfinder::clusterIndex(int2 tile) const {
+    unsigned int clustersPerRow = (grid.getWidth() + clusterSize - 1) / clusterSize;
+    return (unsigned(tile.y) / clusterSize) * clustersPerRow + unsigned(tile.x) / clusterSize;
+}
+
+Pathfinder::Window Pathfinder::clusterWindow(int2 tile) const {
+    Window window;
+    window.x0 = int(unsigned(tile.x) / clusterSize * clusterSize);
+    window.y0 = int(unsigned(tile.y) / clusterSize * clusterSize);
+    window.x1 = std::min(window.x0 + int(clusterSize), int(grid.getWidth()));
+    window.y1 = std::min(window.y0 + int(clusterSize), int(grid.getHeight()));
+    return window;
+}
+
+// --- Jump point search ---
+
+// Moves (x, y) in direction (dx, dy) until reaching a jump point: the goal (or any entrance, when searching for those),
+// or a tile past which the shortest paths may turn because of an obstacle. Returns false if it runs into a wall first.
+// Moving diagonally also looks for jump points along both straight directions at every step.
+bool Pathfinder::jump(Window const &window, int2 goal, bool isSearchingEntrances, int &x, int &y, int dx, int dy) const {
+    while (true) {
+        if (!isWalkable(window, x, y)) {
+            return false;
+        }
+        if ((x == goal.x && y == goal.y) || (isSearchingEntrances && isEntrance(x, y))) {
+            return true;
+        }
+
+        if (dx != 0 && dy != 0) {
+            int horizontalX = x + dx, horizontalY = y;
+            int verticalX = x, verticalY = y + dy;
+            if (jump(window, goal, isSearchingEntrances, horizontalX, horizontalY, dx, 0)
+                    || jump(window, goal, isSearchingEntrances, verticalX, verticalY, 0, dy)) {
+                return true;
+            }
+        } else if (dx != 0) {
+            // A wall behind us ending next to this tile forces a turn
+            if ((isWalkable(window, x, y - 1) && !isWalkable(window, x - dx, y - 1))
+                    || (isWalkable(window, x, y + 1) && !isWalkable(window, x - dx, y + 1))) {
+                return true;
+            }
+        } else {
+            if ((isWalkable(window, x - 1, y) && !isWalkable(window, x - 1, y - dy))
+                    || (isWalkable(window, x + 1, y) && !isWalkable(window, x + 1, y - dy))) {
+                return true;
+            }
+        }
+
+        // Diagonal steps may not cut corners
+        if (!isWalkable(window, x + dx, y) || !isWalkable(window, x, y + dy)) {
+            return false;
+        }
+        x += dx;
+        y += dy;
+    }
+}
+
+// Finds the shortest path from start to goal without leaving the window.
+// Given a list of entrances instead, finds the cost of the shortest paths to every entrance of
+// the cluster (which must be the window) in one go, ignoring goal.
+bool Pathfinder::searchTiles(Window const &window, int2 start, int2 goal, SearchScratch &scratch, std::vector<int2>* path, float* cost,
+                             std::vector<AbstractEdge>* entrances) const {
+    bool isSearchingEntrances = entrances != nullptr;
+    if (isSearchingEntrances) {
+        entrances->clear();
+        goal = int2{ -1, -1 };
+    }
+    if (!isWalkable(window, start.x, start.y) || (!isSearchingEntrances && !isWalkable(window, goal.x, goal.y))) {
+        return false;
+    }
+    size_t entranceCount = isSearchingEntrances ? clusterNodes[clusterIndex(start)].size() : 0;
+
+    int windowWidth = window.x1 - window.x0;
+    scratch.begin(size_t(windowWidth) * size_t(window.y1 - window.y0));
+    auto localIndex = [&window, windowWidth](int x, int y) {
+        return int32_t((y - window.y0) * windowWidth + (x - window.x0));
+    };
+
+    int32_t startNode = localIndex(start.x, start.y);
+    int32_t goalNode = isSearchingEntrances ? -1 : localIndex(goal.x, goal.y);
+    // Without a goal to head for, this is Dijkstra's algorithm
+    auto estimate = [isSearchingEntrances, goal](int2 tile) {
+        return isSearchingEntrances ? 0.0f : octileDistance(tile, goal);
+    };
+    scratch.costs[startNode] = 0.0f;
+    scratch.parents[startNode] = -1;
+    scratch.openStamps[startNode] = scratch.stamp;
+    scratch.open.push_back(OpenEntry{ estimate(start), startNode });
+
+    while (!scratch.open.empty()) {
+        std::pop_heap(scratch.open.begin(), scratch.open.end(), std::greater<OpenEntry>());
+        int32_t node = scratch.open.back().node;
+        scratch.open.pop_back();
+
+        // Nodes are pushed again when a cheaper way to them is found, rather than updated in the heap
+        if (scratch.closedStamps[node] == scratch.stamp) {
+            continue;
+        }
+        scratch.closedStamps[node] = scratch.stamp;
+
+        if (node == goalNode) {
+            if (cost != nullptr) {
+                *cost = scratch.costs[goalNode];
+            }
+            if (path != nullptr) {
+                path->clear();
+                for (int32_t step = goalNode; step != -1; step = scratch.parents[step]) {
+                    path->push_back(int2{ window.x0 + step % windowWidth, window.y0 + step / windowWidth });
+                }
+                std::reverse(path->begin(), path->end());
+            }
+            return true;
+        }
+
+        int x = window.x0 + node % windowWidth;
+        int y = window.y0 + node / windowWidth;
+
+        if (isSearchingEntrances && isEntrance(x, y)) {
+            entrances->push_back(AbstractEdge{ unsigned(abstractNodeOfTile[size_t(y) * grid.getWidth() + size_t(x)]), scratch.costs[node], 0, 0 });
+            if (entrances->size() == entranceCount) {
+                return true;
+            }
+        }
+
+        // Only the directions in which the shortest paths through this tile can continue need exploring,
+        // given the direction we arrived from. The start tile explores all of them.
+        int directions[8][2];
+        int directionCount = 0;
+        auto addDirection = [&directions, &directionCount](int dx, int dy) {
+            directions[directionCount][0] = dx;
+            directions[directionCount][1] = dy;
+            directionCount++;
+        };
+
+        int32_t parent = scratch.parents[node];
+        if (parent == -1) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    bool isDiagonal = dx != 0 && dy != 0;
+                    if ((dx != 0 || dy != 0) && isWalkable(window, x + dx, y + dy)
+                            && (!isDiagonal || (isWalkable(window, x + dx, y) && isWalkable(window, x, y + dy)))) {
+                        addDirection(dx, dy);
+                    }
+                }
+            }
+        } else {
+            int dx = sign(x - (window.x0 + parent % windowWidth));
+            int dy = sign(y - (window.y0 + parent / windowWidth));
+            if (dx != 0 && dy != 0) {
+                bool canMoveX = isWalkable(window, x + dx, y);
+                bool canMoveY = isWalkable(window, x, y + dy);
+                if (canMoveY) {
+                    addDirection(0, dy);
+                }
+                if (canMoveX) {
+                    addDirection(dx, 0);
+                }
+                if (canMoveX && canMoveY) {
+                    addDirection(dx, dy);
+                }
+            } else if (dx != 0) {
+                bool canMoveOn = isWalkable(window, x + dx, y);
+                bool canMoveUp = isWalkable(window, x, y + 1);
+                bool canMoveDown = isWalkable(window, x, y - 1);
+                if (canMoveOn) {
+                    addDirection(dx, 0);
+                    if (canMoveUp) {
+                        addDirection(dx, 1);
+                    }
+                    if (canMoveDown) {
+                        addDirection(dx, -1);
+                    }
+                }
+                if (canMoveUp) {
+                    addDirection(0, 1);
+                }
+                if (canMoveDown) {
+                    addDirection(0, -1);
+                }
+            } else {
+                bool canMoveOn = isWalkable(window, x, y + dy);
+                bool canMoveRight = isWalkable(window, x + 1, y);
+                bool canMoveLeft = isWalkable(window, x - 1, y);
+                if (canMoveOn) {
+                    addDirection(0, dy);
+                    if (canMoveRight) {
+                        addDirection(1, dy);
+                    }
+                    if (canMoveLeft) {
+                        addDirection(-1, dy);
+                    }
+                }
+                if (canMoveRight) {
+                    addDirection(1, 0);
+                }
+                if (canMoveLeft) {
+                    addDirection(-1, 0);
+                }
+            }
+        }
+
+        for (int i = 0; i < directionCount; i++) {
+            int jumpX = x + directions[i][0];
+            int jumpY = y + directions[i][1];
+            if (!jump(window, goal, isSearchingEntrances, jumpX, jumpY, directions[i][0], directions[i][1])) {
+                continue;
+            }
+            int32_t successor = localIndex(jumpX, jumpY);
+            if (scratch.closedStamps[successor] == scratch.stamp) {
+                continue;
+            }
+
+            float successorCost = scratch.costs[node] + octileDistance(int2{ x, y }, int2{ jumpX, jumpY });
+            if (scratch.openStamps[successor] != scratch.stamp || successorCost < scratch.costs[successor]) {
+                scratch.openStamps[successor] = scratch.stamp;
+                scratch.costs[successor] = successorCost;
+                scratch.parents[successor] = node;
+                scratch.open.push_back(OpenEntry{ successorCost + estimate(int2{ jumpX, jumpY }), successor });
+                std::push_heap(scratch.open.begin(), scratch.open.end(), std::greater<OpenEntry>());
+            }
+        }
+    }
+    return isSearchingEntrances && !entrances->empty();
+}
+
+// --- Hierarchical search ---
+
+unsigned int Pathfinder::addAbstractNode(int2 tile, std::vector<std::vector<AbstractEdge>> &edges) {
+    int32_t &existing = abstractNodeOfTile[size_t(tile.y) * grid.getWidth() + size_t(tile.x)];
+    if (existing == -1) {
+        AbstractNode node;
+        node.tile = tile;
+        node.firstEdge = 0;
+        node.edgeCount = 0;
+        existing = int32_t(abstractNodes.size());
+        abstractNodes.push_back(node);
+        edges.emplace_back();
+        clusterNodes[clusterIndex(tile)].push_back(unsigned(existing));
+    }
+    return unsigned(existing);
+}
+
+// Walks along one side of the border between two clusters, from first in direction step, where the tiles
+// across the border are at tile + across. Every stretch of tiles which are walkable on both sides becomes
+// an entrance: short ones get one crossing in the middle, longer ones one at either end.
+void Pathfinder::addEntrances(int2 first, int2 step, int2 across, unsigned int length, std::vector<std::vector<AbstractEdge>> &edges) {
+    const unsigned int longEntranceLength = 6;
+
+    unsigned int entranceStart = 0;
+    bool isInEntrance = false;
+    for (unsigned int i = 0; i <= length; i++) {
+        int2 tile = int2{ first.x + step.x * int(i), first.y + step.y * int(i) };
+        bool isOpen = i < length && grid.isWalkable(tile.x, tile.y) && grid.isWalkable(tile.x + across.x, tile.y + across.y);
+
+        if (isOpen && !isInEntrance) {
+            entranceStart = i;
+            isInEntrance = true;
+        } else if (!isOpen && isInEntrance) {
+            isInEntrance = false;
+            unsigned int entranceLength = i - entranceStart;
+            unsigned int crossings[2] = { entranceStart + entranceLength / 2, 0 };
+            unsigned int crossingCount = 1;
+            if (entranceLength >= longEntranceLength) {
+                crossings[0] = entranceStart;
+                crossings[1] = i - 1;
+                crossingCount = 2;
+            }
+
+            for (unsigned int c = 0; c < crossingCount; c++) {
+                int2 inside = int2{ first.x + step.x * int(crossings[c]), first.y + step.y * int(crossings[c]) };
+                int2 outside = int2{ inside.x + across.x, inside.y + across.y };
+                unsigned int a = addAbstractNode(inside, edges);
+                unsigned int b = addAbstractNode(outside, edges);
+                edges[a].push_back(AbstractEdge{ b, 1.0f, 0, 0 });
+                edges[b].push_back(AbstractEdge{ a, 1.0f, 0, 0 });
+            }
+        }
+    }
+}
+
+void Pathfinder::buildAbstractGraph() {
+    unsigned int width = grid.getWidth();
+    unsigned int height = grid.getHeight();
+    unsigned int clustersPerRow = (width + clusterSize - 1) / clusterSize;
+    unsigned int clustersPerColumn = (height + clusterSize - 1) / clusterSize;
+
+    clusterNodes.assign(size_t(clustersPerRow) * clustersPerColumn, std::vector<unsigned int>());
+    abstractNodeOfTile.assign(size_t(width) * height, -1);
+    std::vector<std::vector<AbstractEdge>> edges;
+
+    for (unsigned int clusterY = 0; clusterY < clustersPerColumn; clusterY++) {
+        for (unsigned int clusterX = 0; clusterX < clustersPerRow; clusterX++) {
+            int x0 = int(clusterX * clusterSize);
+            int y0 = int(clusterY * clusterSize);
+            // The border with the cluster to the left, and the one with the cluster below
+            if (clusterX > 0) {
+                addEntrances(int2{ x0 - 1, y0 }, int2{ 0, 1 }, int2{ 1, 0 }, std::min(clusterSize, height - unsigned(y0)), edges);
+            }
+            if (clusterY > 0) {
+                addEntrances(int2{ x0, y0 - 1 }, int2{ 1, 0 }, int2{ 0, 1 }, std::min(clusterSize, width - unsigned(x0)), edges);
+            }
+        }
+    }
+
+    // Connect the entrances of each cluster with each other, if a path inside the cluster connects them.
+    // Each cluster collects its edges and their paths separately, with path offsets relative to its own list.
+    struct ClusterEdges {
+        std::vector<std::pair<unsigned int, AbstractEdge>> edges;
+        std::vector<int2> paths;
+    };
+    std::vector<ClusterEdges> clusterEdges(clusterNodes.size());
+    pool.parallelFor(clusterNodes.size(), [this, &clusterEdges](size_t cluster, unsigned int threadIndex) {
+        std::vector<unsigned int> const &nodes = clusterNodes[cluster];
+        if (nodes.empty()) {
+            return;
+        }
+        Window window = clusterWindow(abstractNodes[nodes.front()].tile);
+        ClusterEdges &output = clusterEdges[cluster];
+        std::vector<int2> &path = threadScratch[threadIndex].segment;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            for (size_t j = i + 1; j < nodes.size(); j++) {
+                float cost;
+                if (!searchTiles(window, abstractNodes[nodes[i]].tile, abstractNodes[nodes[j]].tile, threadScratch[threadIndex].tiles, &path, &cost)) {
+                    continue;
+                }
+                unsigned int pathLength = unsigned(path.size());
+                output.edges.push_back(std::make_pair(nodes[i], AbstractEdge{ nodes[j], cost, unsigned(output.paths.size()), pathLength }));
+                output.paths.insert(output.paths.end(), path.begin(), path.end());
+                output.edges.push_back(std::make_pair(nodes[j], AbstractEdge{ nodes[i], cost, unsigned(output.paths.size()), pathLength }));
+                output.paths.insert(output.paths.end(), path.rbegin(), path.rend());
+            }
+        }
+    });
+    edgePaths.clear();
+    for (ClusterEdges const &cluster : clusterEdges) {
+        unsigned int pathBase = unsigned(edgePaths.size());
+        edgePaths.insert(edgePaths.end(), cluster.paths.begin(), cluster.paths.end());
+        for (std::pair<unsigned int, AbstractEdge> edge : cluster.edges) {
+            edge.second.pathOffset += pathBase;
+            edges[edge.first].push_back(edge.second);
+        }
+    }
+
+    // One array of edges, each node pointing at its own range
+    abstractEdges.clear();
+    for (size_t i = 0; i < abstractNodes.size(); i++) {
+        abstractNodes[i].firstEdge = unsigned(abstractEdges.size());
+        abstractNodes[i].edgeCount = unsigned(edges[i].size());
+        abstractEdges.insert(abstractEdges.end(), edges[i].begin(), edges[i].end());
+    }
+}
+
+bool Pathfinder::searchAbstract(int2 start, int2 goal, std::vector<int2> &path, ThreadScratch &scratch) const {
+    Window startWindow = clusterWindow(start);
+    Window goalWindow = clusterWindow(goal);
+    unsigned int startCluster = clusterIndex(start);
+    unsigned int goalCluster = clusterIndex(goal);
+
+    // A path which stays inside one cluster needs no abstract search at all
+    if (startCluster == goalCluster && searchTiles(startWindow, start, goal, scratch.tiles, &path, nullptr)) {
+        return true;
+    }
+
+    // Connect the start and goal to the entrances of their clusters, for this query only.
+    // Paths are the same both ways, so the goal's edges are found searching from the goal.
+    if (!searchTiles(startWindow, start, start, scratch.tiles, nullptr, nullptr, &scratch.startEdges)
+            || !searchTiles(goalWindow, goal, goal, scratch.tiles, nullptr, nullptr, &scratch.goalEdges)) {
+        return false;
+    }
+
+    // A* over the entrances, with the start and goal as two extra nodes at the end
+    const int32_t startNode = int32_t(abstractNodes.size());
+    const int32_t goalNode = startNode + 1;
+    auto nodeTile = [&](int32_t node) {
+        return node == startNode ? start : node == goalNode ? goal : abstractNodes[size_t(node)].tile;
+    };
+
+    SearchScratch &search = scratch.abstract;
+    search.begin(abstractNodes.size() + 2);
+    search.costs[startNode] = 0.0f;
+    search.parents[startNode] = -1;
+    search.openStamps[startNode] = search.stamp;
+    search.open.push_back(OpenEntry{ octileDistance(start, goal), startNode });
+
+    auto relax = [&](int32_t node, int32_t successor, float edgeCost) {
+        if (search.closedStamps[successor] == search.stamp) {
+            return;
+        }
+        float successorCost = search.costs[node] + edgeCost;
+        if (search.openStamps[successor] != search.stamp || successorCost < search.costs[successor]) {
+            search.openStamps[successor] = search.stamp;
+            search.costs[successor] = successorCost;
+            search.parents[successor] = node;
+            search.open.push_back(OpenEntry{ successorCost + octileDistance(nodeTile(successor), goal), successor });
+            std::push_heap(search.open.begin(), search.open.end(), std::greater<OpenEntry>());
+        }
+    };
+
+    bool isFound = false;
+    while (!search.open.empty()) {
+        std::pop_heap(search.open.begin(), search.open.end(), std::greater<OpenEntry>());
+        int32_t node = search.open.back().node;
+        search.open.pop_back();
+        if (search.closedStamps[node] == search.stamp) {
+            continue;
+        }
+        search.closedStamps[node] = search.stamp;
+
+        if (node == goalNode) {
+            isFound = true;
+            break;
+        }
+        if (node == startNode) {
+            for (AbstractEdge const &edge : scratch.startEdges) {
+                relax(node, int32_t(edge.target), edge.cost);
+            }
+            continue;
+        }
+        AbstractNode const &abstractNode = abstractNodes[size_t(node)];
+        for (unsigned int i = 0; i < abstractNode.edgeCount; i++) {
+            AbstractEdge const &edge = abstractEdges[abstractNode.firstEdge + i];
+            relax(node, int32_t(edge.target), edge.cost);
+        }
+        for (AbstractEdge const &edge : scratch.goalEdges) {
+            if (int32_t(edge.target) == node) {
+                relax(node, goalNode, edge.cost);
+            }
+        }
+    }
+    if (!isFound) {
+        return false;
+    }
+
+    scratch.route.clear();
+    for (int32_t node = goalNode; node != -1; node = search.parents[node]) {
+        scratch.route.push_back(unsigned(node));
+    }
+    std::reverse(scratch.route.begin(), scratch.route.end());
+
+    // Turn the route into tiles. Edges between entrances know their paths;
+    // only the first and last legs, from the start and to the goal, are searched again.
+    path.clear();
+    path.push_back(start);
+    for (size_t i = 1; i < scratch.route.size(); i++) {
+        int32_t from = int32_t(scratch.route[i - 1]);
+        int32_t to = int32_t(scratch.route[i]);
+        if (from == startNode || to == goalNode) {
+            int2 fromTile = nodeTile(from);
+            if (!searchTiles(clusterWindow(fromTile), fromTile, nodeTile(to), scratch.tiles, &scratch.segment, nullptr)) {
+                return false;
+            }
+            path.insert(path.end(), scratch.segment.begin() + 1, scratch.segment.end());
+            continue;
+        }
+
+        AbstractNode const &fromNode = abstractNodes[size_t(from)];
+        for (unsigned int e = 0; e < fromNode.edgeCount; e++) {
+            AbstractEdge const &edge = abstractEdges[fromNode.firstEdge + e];
+            if (int32_t(edge.target) != to) {
+                continue;
+            }
+            if (edge.pathLength == 0) {
+                path.push_back(nodeTile(to));
+            } else {
+                path.insert(path.end(), edgePaths.begin() + edge.pathOffset + 1, edgePaths.begin() + edge.pathOffset + edge.pathLength);
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+// Keeps only the tiles at which the path changes direction, plus both ends
+static void removeStraightWaypoints(std::vector<int2> &waypoints) {
+    if (waypoints.size() < 3) {
+        return;
+    }
+    size_t kept = 1;
+    for (size_t i = 1; i + 1 < waypoints.size(); i++) {
+        int2 previous = waypoints[kept - 1];
+        int2 current = waypoints[i];
+        int2 next = waypoints[i + 1];
+        bool isStraight = sign(current.x - previous.x) == sign(next.x - current.x)
+                       && sign(current.y - previous.y) == sign(next.y - current.y);
+        if (!isStraight && !isSameTile(previous, current)) {
+            waypoints[kept++] = current;
+        }
+    }
+    waypoints[kept++] = waypoints.back();
+    waypoints.resize(kept);
+}
+
+bool Pathfinder::findPathUncached(int2 start, int2 goal, std::vector<int2> &waypoints, ThreadScratch &scratch) const {
+    waypoints.clear();
+    if (!grid.isWalkable(start.x, start.y) || !grid.isWalkable(goal.x, goal.y)) {
+        return false;
+    }
+
+    bool isFound;
+    if (clusterSize == 0) {
+        Window everything = Window{ 0, 0, int(grid.getWidth()), int(grid.getHeight()) };
+        isFound = searchTiles(everything, start, goal, scratch.tiles, &waypoints, nullptr);
+    } else {
+        isFound = searchAbstract(start, goal, waypoints, scratch);
+    }
+    if (!isFound) {
+        waypoints.clear();
+        return false;
+    }
+    removeStraightWaypoints(waypoints);
+    return true;
+}
+
+bool Pathfinder::findPathCached(int2 start, int2 goal, std::vector<int2> &waypoints, ThreadScratch &scratch) {
+    queryCount++;
+    if (cacheCapacity == 0) {
+        return findPathUncached(start, goal, waypoints, scratch);
+    }
+
+    // Tiles are packed 16 bits per coordinate, which the constructor made sure is enough for the grid
+    uint64_t key = (uint64_t(uint16_t(start.x)) << 48) | (uint64_t(uint16_t(start.y)) << 32)
+                 | (uint64_t(uint16_t(goal.x)) << 16) | uint64_t(uint16_t(goal.y));
+    CacheShard &shard = cacheShards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::unordered_map<uint64_t, std::vector<int2>>::const_iterator cached = shard.paths.find(key);
+        if (cached != shard.paths.end()) {
+            cacheHitCount++;
+            waypoints = cached->second;
+            return !waypoints.empty();
+        }
+    }
+
+    // Failed searches are cached too (as an empty path), they are usually the most expensive ones
+    bool isFound = findPathUncached(start, goal, waypoints, scratch);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.paths.size() >= std::max<size_t>(cacheCapacity / cacheShardCount, 1)) {
+            shard.paths.clear();
+        }
+        shard.paths[key] = waypoints;
+    }
+    return isFound;
+}
+
+bool Pathfinder::findPath(int2 start, int2 goal, std::vector<int2> &waypoints) {
+    return findPathCached(start, goal, waypoints, threadScratch.at(0));
+}
+
+void Pathfinder::findPaths(std::vector<PathQuery> &queries) {
+    pool.parallelFor(queries.size(), [this, &queries](size_t index, unsigned int threadIndex) {
+        PathQuery &query = queries[index];
+        query.isFound = findPathCached(query.start, query.goal, query.waypoints, threadScratch[threadIndex]);
+    });
+}
+
+bool Pathfinder::findRoute(std::vector<int2> const &stops, std::vector<int2> &waypoints) {
+    waypoints.clear();
+    if (stops.empty()) {
+        return false;
+    }
+
+    std::vector<PathQuery> legs(stops.size());
+    for (size_t i = 0; i < stops.size(); i++) {
+        legs[i].start = stops[i];
+        legs[i].goal = stops[(i + 1) % stops.size()];
+    }
+    findPaths(legs);
+
+    for (PathQuery const &leg : legs) {
+        if (!leg.isFound) {
+            fprintf(stderr, "No path from tile (%i, %i) to tile (%i, %i)\n", leg.start.x, leg.start.y, leg.goal.x, leg.goal.y);
+            waypoints.clear();
+            return false;
+        }
+        // The last waypoint of each leg is the first of the next one, and Paths return to their first waypoint by themselves
+        waypoints.insert(waypoints.end(), leg.waypoints.begin(), leg.waypoints.end() - 1);
+    }
+    if (waypoints.empty()) {
+        waypoints.push_back(stops.front());
+    }
+    return true;
+}
+
+void Pathfinder::clearCache() {
+    for (unsigned int i = 0; i < cacheShardCount; i++) {
+        std::lock_guard<std::mutex> lock(cacheShards[i].mutex);
+        cacheShards[i].paths.clear();
+    }
+}
+
+PathfinderStats Pathfinder::getStats() const {
+    PathfinderStats stats;
+    stats.queryCount = queryCount.load();
+    stats.cacheHitCount = cacheHitCount.load();
+    stats.abstractNodeCount = abstractNodes.size();
+    stats.abstractEdgeCount = abstractEdges.size();
+    stats.buildMilliseconds = buildMilliseconds;
+    return stats;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "floats.hpp"
+#include "threadPool.hpp"
+#include "toolbox.hpp"
+
+// Which tiles of a grid can be walked on, such as the tiles of a chessboard from generateChessboard().
+// Tile (x, y) lies at (x * tileWidth, y * tileWidth) in the XZ plane, like the waypoints of a Path.
+class TileGrid {
+public:
+    // Creates a grid on which every tile is walkable
+    TileGrid(unsigned int width, unsigned int height);
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+
+    // Tiles outside the grid are never walkable
+    bool isWalkable(int x, int y) const {
+        return x >= 0 && y >= 0 && unsigned(x) < width && unsigned(y) < height && walkable[unsigned(y) * width + unsigned(x)] != 0;
+    }
+    void setWalkable(int x, int y, bool isTileWalkable);
+
+private:
+    unsigned int width;
+    unsigned int height;
+    std::vector<uint8_t> walkable;
+};
+
+// A request for a path from start to goal, and its result
+struct PathQuery {
+    int2 start;
+    int2 goal;
+    // The tiles at which the path changes direction, from start to goal inclusive
+    std::vector<int2> waypoints;
+    bool isFound = false;
+};
+
+struct PathfinderStats {
+    size_t queryCount = 0;
+    size_t cacheHitCount = 0;
+    size_t abstractNodeCount = 0;
+    size_t abstractEdgeCount = 0;
+    double buildMilliseconds = 0.0;
+};
+
+// Finds paths on a TileGrid. Characters may move to any of the eight surrounding tiles,
+// but not diagonally past the corner of an unwalkable tile. Steps cost 1, diagonal ones sqrt(2).
+//
+// Searches use A* with jump point search (JPS), which skips over the many equally good paths
+// across open areas instead of putting every tile on them in the open list.
+// Given a cluster size, the grid is also split into clusters of that many tiles square, and a graph of
+// the points at which paths can cross between clusters is built up front (HPA*). Queries then search
+// that small graph and only search the tiles of the clusters the path passes through. The paths found
+// this way are usually a few percent longer than the shortest ones, in exchange for being much faster
+// to find on large grids.
+//
+// Results are cached by start and goal. The grid must not change while the pathfinder exists.
+class Pathfinder {
+public:
+    // A cluster size of 0 always searches the whole grid.
+    // Once the cache holds cacheCapacity paths, it is emptied out to make room. A capacity of 0 turns the cache off,
+    // as do grids wider or higher than 65536 tiles.
+    Pathfinder(TileGrid const &grid, ThreadPool &pool, unsigned int clusterSize = 0, size_t cacheCapacity = 65536);
+
+    // Finds a single path. Only the thread which owns the pool may call this.
+    bool findPath(int2 start, int2 goal, std::vector<int2> &waypoints);
+
+    // Answers all queries, spread over the thread pool.
+    void findPaths(std::vector<PathQuery> &queries);
+
+    // Finds a round trip visiting each of the stops in turn and returning to the first one,
+    // as the waypoints for a Path. Fails if any of the legs cannot be walked.
+    bool findRoute(std::vector<int2> const &stops, std::vector<int2> &waypoints);
+
+    void clearCache();
+    PathfinderStats getStats() const;
+
+private:
+    // A part of the grid searches are confined to, from (x0, y0) up to but excluding (x1, y1)
+    struct Window {
+        int x0, y0, x1, y1;
+    };
+
+    struct OpenEntry {
+        float estimate;
+        int32_t node;
+        bool operator >(OpenEntry const &other) const { return estimate > other.estimate; }
+    };
+
+    // Per-thread search state. Nodes count as unvisited unless their stamp matches the current one,
+    // so nothing needs to be cleared between searches.
+    struct SearchScratch {
+        std::vector<float> costs;
+        std::vector<int32_t> parents;
+        std::vector<uint32_t> openStamps;
+        std::vector<uint32_t> closedStamps;
+        std::vector<OpenEntry> open;
+        uint32_t stamp = 0;
+
+        void begin(size_t nodeCount);
+    };
+
+    // A tile at which paths cross from one cluster into the next
+    struct AbstractNode {
+        int2 tile;
+        unsigned int firstEdge;
+        unsigned int edgeCount;
+    };
+
+    // Edges within a cluster keep the path they stand for (its turning points, both ends included)
+    // in edgePaths, so routes need not be searched again. Crossings between clusters are a single step.
+    struct AbstractEdge {
+        unsigned int target;
+        float cost;
+        unsigned int pathOffset;
+        unsigned int pathLength;
+    };
+
+    struct ThreadScratch {
+        SearchScratch tiles;
+        SearchScratch abstract;
+        std::vector<int2> segment;
+        // Edges from the start of a query to the entrances of its cluster, and from those of the goal's cluster to the goal
+        std::vector<AbstractEdge> startEdges;
+        std::vector<AbstractEdge> goalEdges;
+        std::vector<unsigned int> route;
+    };
+
+    struct CacheShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::vector<int2>> paths;
+    };
+
+    bool findPathCached(int2 start, int2 goal, std::vector<int2> &waypoints, ThreadScratch &scratch);
+    bool findPathUncached(int2 start, int2 goal, std::vector<int2> &waypoints, ThreadScratch &scratch) const;
+    bool searchTiles(Window const &window, int2 start, int2 goal, SearchScratch &scratch, std::vector<int2>* path, float* cost,
+                     std::vector<AbstractEdge>* entrances = nullptr) const;
+    bool jump(Window const &window, int2 goal, bool isSearchingEntrances, int &x, int &y, int dx, int dy) const;
+    bool isEntrance(int x, int y) const { return abstractNodeOfTile[size_t(y) * grid.getWidth() + size_t(x)] != -1; }
+    bool searchAbstract(int2 start, int2 goal, std::vector<int2> &path, ThreadScratch &scratch) const;
+
+    bool isWalkable(Window const &window, int x, int y) const {
+        return x >= window.x0 && y >= window.y0 && x < window.x1 && y < window.y1 && grid.isWalkable(x, y);
+    }
+    Window clusterWindow(int2 tile) const;
+    unsigned int clusterIndex(int2 tile) const;
+
+    void buildAbstractGraph();
+    void addEntrances(int2 first, int2 step, int2 across, unsigned int length, std::vector<std::vector<AbstractEdge>> &edges);
+    unsigned int addAbstractNode(int2 tile, std::vector<std::vector<AbstractEdge>> &edges);
+
+    TileGrid const &grid;
+    ThreadPool &pool;
+    unsigned int clusterSize;
+    size_t cacheCapacity;
+
+    std::vector<AbstractNode> abstractNodes;
+    std::vector<AbstractEdge> abstractEdges;
+    std::vector<int2> edgePaths;
+    std::vector<int32_t> abstractNodeOfTile;
+    std::vector<std::vector<unsigned int>> clusterNodes;
+
+    std::vector<ThreadScratch> threadScratch;
+    static const unsigned int cacheShardCount = 16;
+    std::unique_ptr<CacheShard[]> cacheShards;
+
+    std::atomic<size_t> queryCount;
+    std::atomic<size_t> cacheHitCount;
+    double buildMilliseconds = 0.0;
+};
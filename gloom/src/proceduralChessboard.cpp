@@ -0,0 +1,24 @@
+#include "proceduralChessboard.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+ProceduralChessboard::ProceduralChessboard(unsigned int width, unsigned int height, float tileWidth, float4 tileColour1, float4 tileColour2)
+    : width(width), height(height), tileWidth(tileWidth), tileColour1(tileColour1), tileColour2(tileColour2) {
+    glGenVertexArrays(1, &emptyVertexArray);
+}
+
+ProceduralChessboard::~ProceduralChessboard() {
+    glDeleteVertexArrays(1, &emptyVertexArray);
+}
+
+void ProceduralChessboard::draw(GLuint program, glm::mat4 const &transform) {
+    glUseProgram(program);
+    glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(transform));
+    glUniform1f(14, tileWidth);
+    glUniform4f(16, tileColour1.x, tileColour1.y, tileColour1.z, tileColour1.w);
+    glUniform4f(17, tileColour2.x, tileColour2.y, tileColour2.z, tileColour2.w);
+
+    glBindVertexArray(emptyVertexArray);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, GLsizei(6 * width), GLsizei(height));
+    glBindVertexArray(0);
+}
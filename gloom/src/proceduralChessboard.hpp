@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include "floats.hpp"
+
+// The same board as generateChessboard() builds, drawn without any vertex or index data.
+// Every tile is two triangles whose corners and colour chessboard.vert computes from gl_VertexID
+// (the tile within its row) and gl_InstanceID (the row), so the board costs no memory and no upload,
+// whatever its size. A generated mesh takes 152 bytes per tile, in four positions, four colours and six indices.
+class ProceduralChessboard {
+public:
+    ProceduralChessboard(unsigned int width, unsigned int height, float tileWidth, float4 tileColour1, float4 tileColour2);
+    ~ProceduralChessboard();
+
+    // Draws the board with a program made from chessboard.vert and simple.frag.
+    // The transformation is the board's complete model-view-projection matrix.
+    void draw(GLuint program, glm::mat4 const &transform);
+
+    unsigned int getTriangleCount() const { return 2 * width * height; }
+
+private:
+    unsigned int width;
+    unsigned int height;
+    float tileWidth;
+    float4 tileColour1;
+    float4 tileColour2;
+    // Core profiles draw nothing without a vertex array object bound, even if no attribute is read
+    GLuint emptyVertexArray = 0;
+
+    ProceduralChessboard(ProceduralChessboard const &) = delete;
+    ProceduralChessboard & operator =(ProceduralChessboard const &) = delete;
+};
@@ -0,0 +1,370 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+// Events each thread can record between two FrameProfiler::endFrame() calls; a power of two
+static const size_t ringCapacity = 8192;
+
+// GPU results are normally read back two or three frames after they were issued.
+// Results still missing after this many frames are waited for, so the queries don't pile up.
+static const unsigned int maximumGpuLatency = 8;
+
+// The events recorded by one thread. Only that thread writes events and only the profiler reads them,
+// so the two indices are all the synchronisation needed.
+struct ProfileEventRing {
+    std::unique_ptr<ProfileEvent[]> events;
+    std::atomic<size_t> writeIndex{0};
+    std::atomic<size_t> readIndex{0};
+    std::atomic<size_t> droppedEventCount{0};
+    std::string name;
+};
+
+static std::atomic<bool> isProfilerActive(false);
+
+// Rings are created the first time a thread records a scope and kept until the program exits,
+// since the profiler may still read a ring after its thread has finished
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ProfileEventRing>> rings;
+static thread_local ProfileEventRing* threadRing = nullptr;
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static ProfileEventRing* currentThreadRing() {
+    if (threadRing == nullptr) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        std::unique_ptr<ProfileEventRing> ring(new ProfileEventRing());
+        ring->events.reset(new ProfileEvent[ringCapacity]);
+        ring->name = "thread " + std::to_string(rings.size());
+        threadRing = ring.get();
+        rings.push_back(std::move(ring));
+    }
+    return threadRing;
+}
+
+void setProfilerThreadName(std::string const &name) {
+    ProfileEventRing* ring = currentThreadRing();
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    ring->name = name;
+}
+
+CpuProfileScope::CpuProfileScope(const char* name) : name(nullptr), startNanoseconds(0) {
+    if (isProfilerActive.load(std::memory_order_relaxed)) {
+        this->name = name;
+        startNanoseconds = nowNanoseconds();
+    }
+}
+
+CpuProfileScope::~CpuProfileScope() {
+    if (name == nullptr) {
+        return;
+    }
+    int64_t endNanoseconds = nowNanoseconds();
+
+    ProfileEventRing* ring = currentThreadRing();
+    size_t write = ring->writeIndex.load(std::memory_order_relaxed);
+    if (write - ring->readIndex.load(std::memory_order_acquire) >= ringCapacity) {
+        ring->droppedEventCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ProfileEvent &event = ring->events[write & (ringCapacity - 1)];
+    event.name = name;
+    event.startNanoseconds = startNanoseconds;
+    event.endNanoseconds = endNanoseconds;
+    ring->writeIndex.store(write + 1, std::memory_order_release);
+}
+
+FrameProfiler::FrameProfiler(unsigned int historyFrameCount)
+    : historyFrameCount(std::max(historyFrameCount, 1u)), startNanoseconds(nowNanoseconds()) {
+    if (isProfilerActive.exchange(true)) {
+        fprintf(stderr, "FrameProfiler: another profiler already exists, scopes will be recorded by both\n");
+    }
+    setProfilerThreadName("main");
+}
+
+FrameProfiler::~FrameProfiler() {
+    isProfilerActive.store(false);
+
+    for (size_t i = firstPendingGpuScope; i < pendingGpuScopes.size(); i++) {
+        freeQueries.push_back(pendingGpuScopes[i].query);
+    }
+    if (!freeQueries.empty()) {
+        glDeleteQueries(GLsizei(freeQueries.size()), freeQueries.data());
+    }
+}
+
+FrameProfiler::ScopeHistory &FrameProfiler::scope(const char* name, bool isGpu) {
+    std::unordered_map<const char*, unsigned int>::const_iterator byPointer = scopeOfPointer[isGpu].find(name);
+    if (byPointer != scopeOfPointer[isGpu].end()) {
+        return scopes[byPointer->second];
+    }
+
+    // A new pointer, which may still name a scope seen before (the same literal in another file, say)
+    std::string key(name);
+    unsigned int index;
+    std::unordered_map<std::string, unsigned int>::const_iterator byName = scopeOfName[isGpu].find(key);
+    if (byName != scopeOfName[isGpu].end()) {
+        index = byName->second;
+    } else {
+        index = unsigned(scopes.size());
+        scopes.emplace_back();
+        scopes.back().name = key;
+        scopes.back().isGpu = isGpu;
+        scopes.back().samples.resize(historyFrameCount);
+        scopeOfName[isGpu][key] = index;
+    }
+    scopeOfPointer[isGpu][name] = index;
+    return scopes[index];
+}
+
+void FrameProfiler::addSample(ScopeHistory &history, double milliseconds) {
+    history.samples[history.nextSample] = milliseconds;
+    history.nextSample = (history.nextSample + 1) % historyFrameCount;
+    history.sampleCount = std::min(history.sampleCount + 1, historyFrameCount);
+    history.lastMilliseconds = milliseconds;
+    history.lastCallCount = history.frameCallCount;
+    history.frameMilliseconds = 0.0;
+    history.frameCallCount = 0;
+}
+
+void FrameProfiler::beginGpuScope(const char* name) {
+    gpuScopeDepth++;
+    if (gpuScopeDepth > 1 || !isProfilerActive.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    GLuint query;
+    if (freeQueries.empty()) {
+        glGenQueries(1, &query);
+    } else {
+        query = freeQueries.back();
+        freeQueries.pop_back();
+    }
+
+    PendingGpuScope pending;
+    pending.name = name;
+    pending.query = query;
+    pending.frame = frameCount;
+    pending.startNanoseconds = nowNanoseconds();
+    pendingGpuScopes.push_back(pending);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void FrameProfiler::endGpuScope() {
+    gpuScopeDepth--;
+    if (gpuScopeDepth == 0 && isProfilerActive.load(std::memory_order_relaxed)) {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+}
+
+// Turns the summed up GPU times of gpuResultFrame into samples
+void FrameProfiler::finishGpuFrame() {
+    for (ScopeHistory &history : scopes) {
+        if (history.isGpu && history.frameCallCount > 0) {
+            addSample(history, history.frameMilliseconds);
+        }
+    }
+}
+
+void FrameProfiler::collectGpuScopes() {
+    // Queries finish in the order they were issued, so collecting stops at the first unfinished one
+    while (firstPendingGpuScope < pendingGpuScopes.size()) {
+        PendingGpuScope const &pending = pendingGpuScopes[firstPendingGpuScope];
+        GLint isAvailable = 0;
+        glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable && frameCount - pending.frame < maximumGpuLatency) {
+            break;
+        }
+
+        if (pending.frame != gpuResultFrame) {
+            finishGpuFrame();
+            gpuResultFrame = pending.frame;
+        }
+
+        GLuint64 elapsedNanoseconds = 0;
+        glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &elapsedNanoseconds);
+        ScopeHistory &history = scope(pending.name, true);
+        history.frameMilliseconds += double(elapsedNanoseconds) / 1e6;
+        history.frameCallCount++;
+
+        // Elapsed time queries don't say when the GPU started, so the trace shows the work as starting
+        // when it was submitted. Take the position of GPU scopes in the trace with a grain of salt.
+        if (isTracingFrame(pending.frame)) {
+            TraceEvent event;
+            event.name = pending.name;
+            event.startNanoseconds = pending.startNanoseconds;
+            event.endNanoseconds = pending.startNanoseconds + int64_t(elapsedNanoseconds);
+            event.thread = -1;
+            traceEvents.push_back(event);
+        }
+
+        freeQueries.push_back(pending.query);
+        firstPendingGpuScope++;
+    }
+
+    if (firstPendingGpuScope == pendingGpuScopes.size()) {
+        // Everything up to the frame which just ended is in, so its results are complete
+        finishGpuFrame();
+        pendingGpuScopes.clear();
+        firstPendingGpuScope = 0;
+    } else if (firstPendingGpuScope >= 256) {
+        // With the GPU always a frame or two behind, the list never empties out, so drop the collected front now and then
+        pendingGpuScopes.erase(pendingGpuScopes.begin(), pendingGpuScopes.begin() + firstPendingGpuScope);
+        firstPendingGpuScope = 0;
+    }
+}
+
+void FrameProfiler::endFrame() {
+    bool isTracingThisFrame = isTracingFrame(frameCount);
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (size_t thread = 0; thread < rings.size(); thread++) {
+            ProfileEventRing &ring = *rings[thread];
+            size_t read = ring.readIndex.load(std::memory_order_relaxed);
+            size_t write = ring.writeIndex.load(std::memory_order_acquire);
+            for (; read != write; read++) {
+                ProfileEvent const &event = ring.events[read & (ringCapacity - 1)];
+                ScopeHistory &history = scope(event.name, false);
+                history.frameMilliseconds += double(event.endNanoseconds - event.startNanoseconds) / 1e6;
+                history.frameCallCount++;
+
+                if (isTracingThisFrame) {
+                    TraceEvent traceEvent;
+                    traceEvent.name = event.name;
+                    traceEvent.startNanoseconds = event.startNanoseconds;
+                    traceEvent.endNanoseconds = event.endNanoseconds;
+                    traceEvent.thread = int(thread);
+                    traceEvents.push_back(traceEvent);
+                }
+            }
+            ring.readIndex.store(write, std::memory_order_release);
+        }
+    }
+
+    for (ScopeHistory &history : scopes) {
+        if (!history.isGpu && history.frameCallCount > 0) {
+            addSample(history, history.frameMilliseconds);
+        }
+    }
+
+    collectGpuScopes();
+    frameCount++;
+}
+
+void FrameProfiler::startTrace(unsigned int frameCount) {
+    traceEvents.clear();
+    traceFirstFrame = this->frameCount;
+    traceFrameCount = frameCount;
+}
+
+void writeJsonString(FILE* file, std::string const &text) {
+    fputc('"', file);
+    for (char character : text) {
+        if (character == '"' || character == '\\') {
+            fputc('\\', file);
+            fputc(character, file);
+        } else if (static_cast<unsigned char>(character) < 0x20) {
+            fprintf(file, "\\u%04x", unsigned(character));
+        } else {
+            fputc(character, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool FrameProfiler::writeChromeTrace(std::string const &filename) const {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open \"%s\" to write the trace\n", filename.c_str());
+        return false;
+    }
+
+    std::vector<std::string> threadNames;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (std::unique_ptr<ProfileEventRing> const &ring : rings) {
+            threadNames.push_back(ring->name);
+        }
+    }
+    // The GPU gets a row of its own, after all threads
+    int gpuThread = int(threadNames.size());
+    threadNames.push_back("GPU");
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"gloom\"}}");
+    for (size_t thread = 0; thread < threadNames.size(); thread++) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", thread);
+        writeJsonString(file, threadNames[thread]);
+        fprintf(file, "}}");
+    }
+
+    for (TraceEvent const &event : traceEvents) {
+        fprintf(file, ",\n{\"name\":");
+        writeJsonString(file, event.name);
+        // Timestamps are in microseconds
+        fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                event.thread == -1 ? "gpu" : "cpu", event.thread == -1 ? gpuThread : event.thread,
+                double(event.startNanoseconds - startNanoseconds) / 1e3,
+                double(event.endNanoseconds - event.startNanoseconds) / 1e3);
+    }
+    fprintf(file, "\n]}\n");
+
+    bool isWritten = ferror(file) == 0;
+    fclose(file);
+    if (!isWritten) {
+        fprintf(stderr, "Could not write the trace to \"%s\"\n", filename.c_str());
+    }
+    return isWritten;
+}
+
+std::vector<ProfileScopeStats> FrameProfiler::getStats() const {
+    std::vector<ProfileScopeStats> stats;
+    for (ScopeHistory const &history : scopes) {
+        ProfileScopeStats scopeStats;
+        scopeStats.name = history.name;
+        scopeStats.isGpu = history.isGpu;
+        scopeStats.lastMilliseconds = history.lastMilliseconds;
+        scopeStats.lastCallCount = history.lastCallCount;
+        scopeStats.sampleCount = history.sampleCount;
+
+        if (history.sampleCount > 0) {
+            double sum = 0.0;
+            scopeStats.minimumMilliseconds = history.samples[0];
+            scopeStats.maximumMilliseconds = history.samples[0];
+            for (unsigned int i = 0; i < history.sampleCount; i++) {
+                sum += history.samples[i];
+                scopeStats.minimumMilliseconds = std::min(scopeStats.minimumMilliseconds, history.samples[i]);
+                scopeStats.maximumMilliseconds = std::max(scopeStats.maximumMilliseconds, history.samples[i]);
+            }
+            scopeStats.averageMilliseconds = sum / history.sampleCount;
+        }
+        stats.push_back(scopeStats);
+    }
+    return stats;
+}
+
+size_t FrameProfiler::getDroppedEventCount() const {
+    size_t droppedEventCount = 0;
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (std::unique_ptr<ProfileEventRing> const &ring : rings) {
+        droppedEventCount += ring->droppedEventCount.load(std::memory_order_relaxed);
+    }
+    return droppedEventCount;
+}
+
+void FrameProfiler::printReport(FILE* output) const {
+    fprintf(output, "Profile of the last %u frames (milliseconds per frame):\n", std::min(frameCount, historyFrameCount));
+    fprintf(output, "  %-24s %4s %9s %9s %9s %6s\n", "scope", "", "average", "minimum", "maximum", "calls");
+    for (ProfileScopeStats const &stats : getStats()) {
+        fprintf(output, "  %-24s %4s %9.3f %9.3f %9.3f %6u\n", stats.name.c_str(), stats.isGpu ? "GPU" : "CPU",
+                stats.averageMilliseconds, stats.minimumMilliseconds, stats.maximumMilliseconds, stats.lastCallCount);
+    }
+
+    size_t droppedEventCount = getDroppedEventCount();
+    if (droppedEventCount > 0) {
+        fprintf(output, "  %zu events were dropped because a thread's ring buffer was full\n", droppedEventCount);
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Marks the rest of the enclosing block as a CPU scope of the frame profiler:
+//
+//     {
+//         PROFILE_SCOPE("animation");
+//         animator.update(deltaSeconds);
+//     }
+//
+// Names must be string literals (or otherwise outlive the profiler), since only the pointer is stored.
+#define PROFILE_SCOPE_CONCAT2(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) CpuProfileScope PROFILE_SCOPE_CONCAT(profileScope, __LINE__)(name)
+
+// One finished scope, as recorded by the thread which ran it
+struct ProfileEvent {
+    const char* name;
+    int64_t startNanoseconds;
+    int64_t endNanoseconds;
+};
+
+// Records the time from its construction to its destruction, if a FrameProfiler exists.
+// Each thread writes into a ring buffer of its own, so recording takes no locks
+// and costs little more than reading the clock twice.
+class CpuProfileScope {
+public:
+    explicit CpuProfileScope(const char* name);
+    ~CpuProfileScope();
+
+private:
+    const char* name;
+    int64_t startNanoseconds;
+
+    CpuProfileScope(CpuProfileScope const &) = delete;
+    CpuProfileScope & operator =(CpuProfileScope const &) = delete;
+};
+
+// Writes text as a quoted JSON string, escaping quotes, backslashes and control characters
+void writeJsonString(FILE* file, std::string const &text);
+
+// Names the calling thread in exported traces. Threads which don't call this are called "thread <n>".
+void setProfilerThreadName(std::string const &name);
+
+// The statistics of one scope over the last frames the profiler keeps (see FrameProfiler)
+struct ProfileScopeStats {
+    std::string name;
+    bool isGpu = false;
+    // Time spent in the scope per frame (summed over all calls and threads), in milliseconds
+    double lastMilliseconds = 0.0;
+    double averageMilliseconds = 0.0;
+    double minimumMilliseconds = 0.0;
+    double maximumMilliseconds = 0.0;
+    unsigned int lastCallCount = 0;
+    unsigned int sampleCount = 0;
+};
+
+// Collects the CPU scopes recorded by every thread, and times GPU scopes with GL_TIME_ELAPSED queries.
+// Query results are read back without waiting, a few frames after they were issued, once the GPU is done with them.
+// For every scope it keeps the time spent per frame over the last historyFrameCount frames.
+// Frames can also be captured into a trace, which is written in Chrome's trace event format
+// (open it in chrome://tracing or ui.perfetto.dev).
+//
+// Only one profiler can exist at a time. Its methods must be called from the thread owning the GL context.
+class FrameProfiler {
+public:
+    explicit FrameProfiler(unsigned int historyFrameCount = 120);
+    ~FrameProfiler();
+
+    // GL_TIME_ELAPSED queries cannot nest, so a GPU scope started inside another one is ignored
+    void beginGpuScope(const char* name);
+    void endGpuScope();
+
+    // Gathers everything recorded since the last call into the statistics (and the trace, while capturing).
+    // Call once per frame, after swapping buffers.
+    void endFrame();
+
+    // Captures the next frameCount frames into the trace, discarding any earlier capture
+    void startTrace(unsigned int frameCount);
+    bool isTracing() const { return frameCount < traceFirstFrame + traceFrameCount; }
+    bool writeChromeTrace(std::string const &filename) const;
+
+    // Scopes are listed in the order they were first seen
+    std::vector<ProfileScopeStats> getStats() const;
+    void printReport(FILE* output = stdout) const;
+
+    unsigned int getFrameCount() const { return frameCount; }
+    // Events lost because a thread recorded more than its ring buffer holds between two endFrame() calls
+    size_t getDroppedEventCount() const;
+
+private:
+    struct ScopeHistory {
+        std::string name;
+        bool isGpu;
+        std::vector<double> samples;
+        unsigned int nextSample = 0;
+        unsigned int sampleCount = 0;
+        double frameMilliseconds = 0.0;
+        unsigned int frameCallCount = 0;
+        double lastMilliseconds = 0.0;
+        unsigned int lastCallCount = 0;
+    };
+
+    struct PendingGpuScope {
+        const char* name;
+        GLuint query;
+        unsigned int frame;
+        int64_t startNanoseconds;
+    };
+
+    struct TraceEvent {
+        const char* name;
+        int64_t startNanoseconds;
+        int64_t endNanoseconds;
+        // The index of the recording thread, or -1 for the GPU
+        int thread;
+    };
+
+    bool isTracingFrame(unsigned int frame) const { return frame >= traceFirstFrame && frame < traceFirstFrame + traceFrameCount; }
+    ScopeHistory &scope(const char* name, bool isGpu);
+    void addSample(ScopeHistory &history, double milliseconds);
+    void collectGpuScopes();
+    void finishGpuFrame();
+
+    unsigned int historyFrameCount;
+    unsigned int frameCount = 0;
+
+    std::vector<ScopeHistory> scopes;
+    // Names are usually the same literal every frame, so they are looked up by pointer first
+    std::unordered_map<const char*, unsigned int> scopeOfPointer[2];
+    std::unordered_map<std::string, unsigned int> scopeOfName[2];
+
+    std::vector<GLuint> freeQueries;
+    std::vector<PendingGpuScope> pendingGpuScopes;
+    size_t firstPendingGpuScope = 0;
+    unsigned int gpuScopeDepth = 0;
+    // The frame whose GPU results are currently being summed up
+    unsigned int gpuResultFrame = 0;
+
+    unsigned int traceFirstFrame = 0;
+    unsigned int traceFrameCount = 0;
+    std::vector<TraceEvent> traceEvents;
+    int64_t startNanoseconds;
+
+    FrameProfiler(FrameProfiler const &) = delete;
+    FrameProfiler & operator =(FrameProfiler const &) = delete;
+};
+
+// Times the rest of the enclosing block on the GPU
+class GpuProfileScope {
+public:
+    GpuProfileScope(FrameProfiler &profiler, const char* name) : profiler(profiler) { profiler.beginGpuScope(name); }
+    ~GpuProfileScope() { profiler.endGpuScope(); }
+
+private:
+    FrameProfiler &profiler;
+
+    GpuProfileScope(GpuProfileScope const &) = delete;
+    GpuProfileScope & operator =(GpuProfileScope const &) = delete;
+};
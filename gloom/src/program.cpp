@@ -1,9 +1,24 @@
 ﻿// Local headers
 #include "program.hpp"
 #include "gloom/gloom.hpp"
-#include "gloom/shader.hpp"
+#include "shaderVariants.hpp"
 #include "OBJLoader.hpp"
 #include "sceneGraph.hpp"
+#include "renderQueue.hpp"
+#include "threadPool.hpp"
+#include "character.hpp"
+#include "animation.hpp"
+#include "crowd.hpp"
+#include "pathfinder.hpp"
+#include "geometryArena.hpp"
+#include "transformRing.hpp"
+#include "skinnedMesh.hpp"
+#include "profiler.hpp"
+#include "glInstrumentation.hpp"
+#include "frameCapture.hpp"
+#include "simulation.hpp"
+#include "meshCache.hpp"
+#include "clusteredLighting.hpp"
 #include "toolbox.hpp"
 #include <iostream>
 #include <string>
@@ -11,7 +26,10 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <thread>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp> // glm::value_ptr
@@ -29,93 +47,73 @@ float rotationZ = 0.0f;
 float xCoordinate = -60.0f;
 float yCoordinate = -30.0f;
 float zCoordinate = -180.0f;
-float tCurrent = 0;
 
-unsigned int vertexArrayObject(std::vector<float4> vertices, size_t verticesLength, std::vector<unsigned int> indices, size_t indicesLength, std::vector<float4> colours, size_t coloursLength)
+void setMeshBounds(MeshVAO &vao, Mesh const &mesh)
 {
-	// create a Vertex Array Object
-	unsigned int arrayID = 0;
-	int count = 1;
-	glGenVertexArrays(count,&arrayID);
-	// binding a Vertex Array Object
-	glBindVertexArray(arrayID);
-
-	// create a Vertex Buﬀer Object
-	unsigned int bufferID;
-	glGenBuffers(count, &bufferID);
-	// binding a Vertex Buﬀer Object
-	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
-	//  transfer the data to the GPU
-	glBufferData(GL_ARRAY_BUFFER, verticesLength, vertices.data(), GL_STATIC_DRAW);
-	/*for (int i = 0; i<vertices.size(); i++)
-	{cout << "verticesData"; cout << i; cout <<" : "; cout << vertices.data()[i]; cout << "/n";}
-	printGLError();*/
-	
-	// If you specify x, y and z cooordinates, size is 3
-	int size = 4;
-	// setting the Vertex Attribute Pointer
-	unsigned int index = 1;
-	glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, 0, (void*) 0);
-	// enable the Vertex Buﬀer Objects
-	glEnableVertexAttribArray(index);
-
-	// create an index Buﬀer
-	unsigned int indexBuffer;
-	// create a buﬀer
-	glGenBuffers(count, &indexBuffer);
-	// binding the buﬀer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	//  transfer the data to the GPU
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesLength, indices.data(), GL_STATIC_DRAW);
-	printGLError();
-
-	// create a colour Buﬀer
-	unsigned int colourBuffer;
-	// create a buﬀer
-	glGenBuffers(1, &colourBuffer);
-	// binding the buﬀer
-	glBindBuffer(GL_ARRAY_BUFFER, colourBuffer);
-	//  transfer the data to the GPU
-	glBufferData(GL_ARRAY_BUFFER, coloursLength, colours.data(), GL_STATIC_DRAW);
-	printGLError();
-
-	// If you specify r, g, b, a cooordinates, size is 4
-	int sizeColour = 4;
-	// setting the Vertex Attribute Pointer
-	unsigned int indexColour = 4;
-	glVertexAttribPointer(indexColour, sizeColour, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	// enable the Vertex Buﬀer Objects
-	glEnableVertexAttribArray(indexColour);
-	
-	return arrayID;
+	if (mesh.vertices.empty()) {
+		return;
+	}
+	vao.boundsMin = float3(mesh.vertices[0].x, mesh.vertices[0].y, mesh.vertices[0].z);
+	vao.boundsMax = vao.boundsMin;
+	for (float4 const &vertex : mesh.vertices) {
+		vao.boundsMin = float3(std::min(vao.boundsMin.x, vertex.x), std::min(vao.boundsMin.y, vertex.y), std::min(vao.boundsMin.z, vertex.z));
+		vao.boundsMax = float3(std::max(vao.boundsMax.x, vertex.x), std::max(vao.boundsMax.y, vertex.y), std::max(vao.boundsMax.z, vertex.z));
+	}
 }
 
+bool uploadMesh(Mesh const &mesh, GpuResourceManager &resources, GpuMesh &gpuMesh)
+{
+	gpuMesh = GpuMesh();
+	gpuMesh.vertexArray = resources.createVertexArray();
+	glBindVertexArray(gpuMesh.vertexArray.get());
+
+	gpuMesh.positions = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.vertices.size() * sizeof(float4), mesh.vertices.data());
+	if (!gpuMesh.positions.isEmpty()) {
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+		glEnableVertexAttribArray(1);
+		gpuMesh.colours = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.colours.size() * sizeof(float4), mesh.colours.data());
+	}
+	if (!gpuMesh.colours.isEmpty()) {
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+		glEnableVertexAttribArray(4);
+		// Bound while the VAO is, so the VAO remembers it
+		gpuMesh.indices = resources.createBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMemoryIndices, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data());
+	}
+	if (gpuMesh.indices.isEmpty()) {
+		glBindVertexArray(0);
+		gpuMesh = GpuMesh();
+		return false;
+	}
 
-void visitSceneNode(SceneNode* node, glm::mat4 transformationThusFar) {
-	// Do transformations here
-	glm::mat4x4 translationBack = glm::translate(glm::mat4(), glm::vec3(node->referencePoint.x, node->referencePoint.y, node->referencePoint.z));
-	glm::mat4x4 translationOriginPoint = glm::translate(glm::mat4(), glm::vec3(-node->referencePoint.x, -node->referencePoint.y, -node->referencePoint.z));
-	glm::mat4x4 translation = glm::translate(glm::mat4(), glm::vec3(node->position.x, node->position.y, node->position.z));
-
-	glm::mat4x4 x_rotation = glm::rotate(glm::radians(node->rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-	glm::mat4x4 y_rotation = glm::rotate(glm::radians(node->rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4x4 z_rotation = glm::rotate(glm::radians(node->rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-	node->currentTransformationMatrix = transformationThusFar*translation*translationBack*z_rotation*y_rotation*x_rotation*translationOriginPoint;
-	glm::mat4x4 combinedTransformation = node->currentTransformationMatrix;
-	// send the uniform variable to the Vertex Shader
-	glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(combinedTransformation));
-	if (node->vertexArrayObjectID != -1) {
-		glBindVertexArray(node->vertexArrayObjectID);
-		glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, 0);
+	// Meshes without normals are lit using their faces' normals, so they are not worth deferring the mesh for
+	if (!mesh.normals.empty() && mesh.normals.size() == mesh.vertices.size()) {
+		gpuMesh.normals = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.normals.size() * sizeof(float3), mesh.normals.data());
+		if (!gpuMesh.normals.isEmpty()) {
+			glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+			glEnableVertexAttribArray(5);
+		}
 	}
-	// Do rendering here
-	for (SceneNode* child : node->children) {
-		visitSceneNode(child, combinedTransformation);
+	// Textured programs read texture coordinates from attribute 2, which a textured mesh can't be drawn without
+	if (!mesh.textureCoordinates.empty() && mesh.textureCoordinates.size() == mesh.vertices.size()) {
+		gpuMesh.textureCoordinates = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.textureCoordinates.size() * sizeof(float2), mesh.textureCoordinates.data());
+		if (gpuMesh.textureCoordinates.isEmpty()) {
+			glBindVertexArray(0);
+			gpuMesh = GpuMesh();
+			return false;
+		}
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+		glEnableVertexAttribArray(2);
 	}
+	glBindVertexArray(0);
+
+	gpuMesh.vao.vertexArrayObjectID = int(gpuMesh.vertexArray.get());
+	gpuMesh.vao.indexCount = unsigned(mesh.indices.size());
+	setMeshBounds(gpuMesh.vao, mesh);
+	return true;
 }
 
-void runProgram(GLFWwindow* window)
+
+void runProgram(GLFWwindow* window, std::string const &traceFile, std::string const &capturePath)
 {
     // Enable depth (Z) buffer (accept "closest" fragment)
     glEnable(GL_DEPTH_TEST);
@@ -135,72 +133,135 @@ void runProgram(GLFWwindow* window)
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Set up your scene here (create Vertex Array Objects, etc.)
-	float4 tileColour1 = float4(0.0f, 0.0f, 0.0f, 1.0f);
-	float4 tileColour2 = float4(1.0f, 1.0f, 1.0f, 1.0f);
-	Mesh chess = generateChessboard(7, 5, 20.0f, tileColour1, tileColour2); 
-	MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");  
-	unsigned int vaoChess = vertexArrayObject(chess.vertices, chess.vertices.size() * 4 * sizeof(float), chess.indices, chess.indices.size() * sizeof(unsigned int), chess.colours, chess.colours.size() * 4 * sizeof(float));
-	unsigned int vaoHead = vertexArrayObject(character.head.vertices, character.head.vertices.size() * 4 * sizeof(float), character.head.indices, character.head.indices.size() * sizeof(unsigned int), character.head.colours, character.head.colours.size() * 4 * sizeof(float));
-	unsigned int vaoTorso = vertexArrayObject(character.torso.vertices, character.torso.vertices.size() * 4 * sizeof(float), character.torso.indices, character.torso.indices.size() * sizeof(unsigned int), character.torso.colours, character.torso.colours.size() * 4 * sizeof(float));
-	unsigned int vaoLeftArm = vertexArrayObject(character.leftArm.vertices, character.leftArm.vertices.size() * 4 * sizeof(float), character.leftArm.indices, character.leftArm.indices.size() * sizeof(unsigned int), character.leftArm.colours, character.leftArm.colours.size() * 4 * sizeof(float));
-	unsigned int vaoRightArm = vertexArrayObject(character.rightArm.vertices, character.rightArm.vertices.size() * 4 * sizeof(float), character.rightArm.indices, character.rightArm.indices.size() * sizeof(unsigned int), character.rightArm.colours, character.rightArm.colours.size() * 4 * sizeof(float));
-	unsigned int vaoLeftLeg = vertexArrayObject(character.leftLeg.vertices, character.leftLeg.vertices.size() * 4 * sizeof(float), character.leftLeg.indices, character.leftLeg.indices.size() * sizeof(unsigned int), character.leftLeg.colours, character.leftLeg.colours.size() * 4 * sizeof(float));
-	unsigned int vaoRightLeg = vertexArrayObject(character.rightLeg.vertices, character.rightLeg.vertices.size() * 4 * sizeof(float), character.rightLeg.indices, character.rightLeg.indices.size() * sizeof(unsigned int), character.rightLeg.colours, character.rightLeg.colours.size() * 4 * sizeof(float));
+	// Every buffer below is tracked, and deleted when the program ends
+	GpuResourceManager gpuResources;
+	// All meshes share one vertex and index buffer, so they can be drawn with a single multi-draw
+	GeometryArena geometryArena(gpuResources, 1 << 18, 1 << 20);
+	// Meshes are named in the cache, so the scene graph can be written to a scene file.
+	// A black and white board of 7x5 tiles of 20 units.
+	MeshCache meshCache(gpuResources, &geometryArena);
+	MeshVAO chessVAO = meshCache.get("chessboard:7:5:20");
+	// Steve's parts are merged into one skinned mesh, drawn by the skinned renderer rather than per node,
+	// so his nodes only carry the transformations of his bones
+	MinecraftCharacter steveParts = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+	GpuSkinnedMesh steveMesh;
+	uploadSkinnedMesh(mergeCharacterParts(steveParts), characterPartCount, gpuResources, steveMesh);
 
 	SceneNode* rootNode = createSceneNode();
-	SceneNode* headNode = createSceneNode();
-	SceneNode* torsoNode = createSceneNode();
-	SceneNode* leftArmNode = createSceneNode();
-	SceneNode* rightArmNode = createSceneNode();
-	SceneNode* leftLegNode = createSceneNode();
-	SceneNode* rightLegNode = createSceneNode();
+	CharacterNodes steve = createCharacterNodes(CharacterModel());
 	SceneNode* chessNode = createSceneNode();
-	addChild(torsoNode, headNode);
-	addChild(torsoNode, leftArmNode);
-	addChild(torsoNode, rightArmNode);
-	addChild(torsoNode, leftLegNode);
-	addChild(torsoNode, rightLegNode);
-	printNode(headNode);
-	printNode(torsoNode);
-	printNode(leftArmNode);
-	printNode(rightArmNode);
-	printNode(leftLegNode);
-	printNode(rightLegNode);
+	printNode(steve.head);
+	printNode(steve.torso);
+	printNode(steve.leftArm);
+	printNode(steve.rightArm);
+	printNode(steve.leftLeg);
+	printNode(steve.rightLeg);
 	printNode(chessNode);
-	addChild(rootNode, torsoNode);
+	addChild(rootNode, steve.torso);
 	addChild(rootNode, chessNode);
 	printNode(rootNode);
-	headNode->vertexArrayObjectID = vaoHead;
-	torsoNode->vertexArrayObjectID = vaoTorso;
-	leftArmNode->vertexArrayObjectID = vaoLeftArm;
-	rightArmNode->vertexArrayObjectID = vaoRightArm;
-	leftLegNode->vertexArrayObjectID = vaoLeftLeg;
-	rightLegNode->vertexArrayObjectID = vaoRightLeg;
-	chessNode->vertexArrayObjectID = vaoChess;
+	chessNode->vertexArrayObjectID = chessVAO.vertexArrayObjectID;
+	chessNode->arenaMeshID = chessVAO.arenaMeshID;
+	chessNode->VAOIndexCount = chessVAO.indexCount;
+	chessNode->boundsMin = chessVAO.boundsMin;
+	chessNode->boundsMax = chessVAO.boundsMax;
 	rootNode->vertexArrayObjectID = -1;
 
+	// mesh.vert compiled with the features each kind of draw needs, each variant on first use
+	ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+	// Every draw is lit, by the few point lights over the board below
+	GLuint shader = meshShaders.get(MESH_LIT);
+	GLuint instancedShader = meshShaders.get(MESH_INSTANCED | MESH_LIT);
+	GLuint indirectShader = meshShaders.get(MESH_INDIRECT | MESH_LIT);
+	GLuint skinnedShader = meshShaders.get(MESH_SKINNED | MESH_LIT);
+	printGLError();
+	glUseProgram(shader);
+
+	// Scene traversal is spread over the worker threads, draw calls are issued from this one
+	ThreadPool threadPool;
+	RenderQueue renderQueue(threadPool);
+	renderQueue.setInstancedVariant(shader, instancedShader);
+	renderQueue.setGeometryArena(&geometryArena);
+	renderQueue.setIndirectVariant(shader, indirectShader);
+	renderQueue.setLitProgram(shader);
+
+	// Two rows of coloured lights hanging over the board, with enough ambient light to see the rest of it
+	ClusterGridSettings clusterSettings;
+	clusterSettings.ambientLight = float3(0.4f, 0.4f, 0.4f);
+	ClusteredLighting lighting(threadPool, clusterSettings);
+	std::vector<PointLight> lights;
+	for (unsigned int i = 0; i < 6; i++) {
+		PointLight light;
+		light.position = float3(float(i % 3) * 60.0f, 15.0f, float(i / 3) * 80.0f);
+		light.radius = 60.0f;
+		light.colour = i % 2 == 0 ? float3(1.0f, 0.85f, 0.6f) : float3(0.6f, 0.75f, 1.0f);
+		light.intensity = 1.5f;
+		lights.push_back(light);
+	}
+	lighting.setLights(lights);
+
+	// The simulation runs on a thread of its own, on nodes of its own, which it mirrors into Steve's.
+	// It gets its own workers as well, since a pool can only be used by one thread.
+	ThreadPool simulationThreadPool(std::max(1u, std::thread::hardware_concurrency() / 2));
+	CharacterNodes simulatedSteve = createCharacterNodes(CharacterModel());
+
+	// Steve's limbs are driven by the walk cycle clip
+	Animator animator(simulationThreadPool);
+	unsigned int walkCycle = animator.addClip(createWalkCycleClip());
+	unsigned int steveAnimation = animator.addInstance(characterAnimationTargets(simulatedSteve));
+	animator.play(steveAnimation, walkCycle);
+
+	// The path file lists the tiles Steve visits, the way between them is found on the chessboard's tiles
+	TileGrid chessGrid(7, 5);
+	Pathfinder pathfinder(chessGrid, threadPool);
+	Path stops("./gloom/src/pathFiles/coordinates_0.txt");
+	std::vector<int2> route;
+	Path* pathChess = pathfinder.findRoute(stops.getWaypoints(), route) ? new Path(route) : new Path(stops);
+
+	// Steve walks along the path at 10 units per second, as one agent of a crowd
+	Crowd crowd(simulationThreadPool, 20.0f);
+	int chessPath = crowd.addPath(*pathChess);
+	if (chessPath != -1) {
+		crowd.addAgent(simulatedSteve.torso, unsigned(chessPath), 10.0f);
+	}
 
-	headNode->VAOIndexCount = character.head.indices.size();
-	torsoNode->VAOIndexCount = character.torso.indices.size();
-	leftArmNode->VAOIndexCount = character.leftArm.indices.size();
-	rightArmNode->VAOIndexCount = character.rightArm.indices.size();
-	leftLegNode->VAOIndexCount = character.leftLeg.indices.size();
-	rightLegNode->VAOIndexCount = character.rightLeg.indices.size();
-	chessNode->VAOIndexCount = chess.indices.size();
-	
-	headNode->referencePoint = float3(-4.0f, 24.0f, 0.0f);
-	torsoNode->referencePoint = float3(-4.0f, 24.0f, 0.0f);
-	leftArmNode->referencePoint = float3(0.0f, 24.0f, 0.0f);
-	rightArmNode->referencePoint = float3(-8.0f, 24.0f, 0.0f);
-	leftLegNode->referencePoint = float3(-2.0f, 12.0f, 0.0f);
-	rightLegNode->referencePoint = float3(-6.0f, 12.0f, 0.0f);
+	// Per-draw matrices are written straight into persistently mapped memory, triple buffered
+	TransformRing transformRing(1024);
+	renderQueue.setTransformRing(&transformRing);
 
-	Path* pathChess = new Path("./gloom/src/pathFiles/coordinates_0.txt");
+	// Keeps per-frame timings of the phases below; with a trace file, the first frames are also written out as a trace
+	FrameProfiler profiler;
+	if (!traceFile.empty()) {
+		profiler.startTrace(traceFrameCount);
+	}
 
-	Gloom::Shader shader;
-	shader.makeBasicShader("./gloom/shaders/simple.vert", "./gloom/shaders/simple.frag");
-	printGLError();
-	shader.activate();
+	// Every character is one instance of a single draw, with its bone matrices in a ring of its own
+	SkinnedRenderer skinnedRenderer(threadPool, steveMesh.vao);
+	skinnedRenderer.addInstance(characterAnimationTargets(steve));
+	TransformRing boneRing(64 * characterPartCount);
+	skinnedRenderer.setTransformRing(&boneRing);
+	skinnedRenderer.setLitProgram(skinnedShader);
+
+	// 60 simulation steps per second, whatever the frame rate
+	SimulationThread simulation(1.0f / 60.0f, [&](float stepSeconds) {
+		{
+			PROFILE_SCOPE("animation");
+			animator.update(stepSeconds);
+		}
+		{
+			PROFILE_SCOPE("path update");
+			crowd.update(stepSeconds);
+		}
+	});
+	simulation.addNodes(characterAnimationTargets(simulatedSteve), characterAnimationTargets(steve));
+	simulation.start();
+
+	std::unique_ptr<FrameCapture> frameCapture;
+	if (!capturePath.empty()) {
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		frameCapture.reset(new FrameCapture(capturePath, framebufferWidth, framebufferHeight));
+	}
 	
     // Rendering Loop
     while (!glfwWindowShouldClose(window))
@@ -208,9 +269,6 @@ void runProgram(GLFWwindow* window)
 		// Clear colour and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// identity Matrix
-		glm::mat4x4 identityMatrix = 0.01f * glm::mat4(1.0f);
-
 		// translation Matrix
 		glm::mat4x4 translation = glm::translate(glm::mat4(), glm::vec3(xCoordinate, yCoordinate, zCoordinate));
 
@@ -220,53 +278,97 @@ void runProgram(GLFWwindow* window)
 
 		glm::mat4 scalingMatrix = glm::scale(glm::vec3(0.5, 0.5f, 0.5f));
 
+		// The view is kept apart from the projection, since the lights are sorted into clusters in view space
+		glm::mat4x4 view = scalingMatrix * rotationYAxis * rotationXAxis * translation;
+
 		// final transformation Matrix
-		glm::mat4x4 transform = perspectiveTransform * scalingMatrix * rotationYAxis * rotationXAxis * translation * identityMatrix;
-
-		float timeSincePreviousFrame = 10*getTimeDeltaSeconds();
-		tCurrent += timeSincePreviousFrame;
-		//cout << "time : "; cout << getTimeDeltaSeconds(); cout << "\n";
-		if (3.1415926<std::fmod(tCurrent, 6.28318) || 6.28318 > std::fmod(tCurrent, 6.28318)) {
-			leftArmNode->rotation.x = 20.0f * sin(tCurrent);
-			rightArmNode->rotation.x = 20.0f * -sin(tCurrent);
-			leftLegNode->rotation.x = 20.0f * -sin(tCurrent);
-			rightLegNode->rotation.x = 20.0f * sin(tCurrent);
-		}
-		else if (3.1415926>std::fmod(tCurrent, 6.28318) || 0 < std::fmod(tCurrent, 6.28318)) {
-			leftArmNode->rotation.x = 20.0f * -sin(tCurrent);
-			rightArmNode->rotation.x = 20.0f * sin(tCurrent + 3.1415926);
-			leftLegNode->rotation.x = 20.0f * sin(tCurrent + 3.1415926);
-			rightLegNode->rotation.x = 20.0f * -sin(tCurrent);
+		glm::mat4x4 transform = perspectiveTransform * view;
+
+		{
+			int framebufferWidth, framebufferHeight;
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+			lighting.update(view, perspectiveTransform, framebufferWidth, framebufferHeight);
+			for (GLuint program : {shader, instancedShader, indirectShader, skinnedShader}) {
+				lighting.bind(program);
+			}
 		}
 
-		glm::vec2 position = glm::vec2(torsoNode->position.x, torsoNode->position.z);
-		float2 floatWaypoint = pathChess->getCurrentWaypoint(20.0f);
-		glm::vec2 waypoint = glm::vec2(floatWaypoint.x, floatWaypoint.y);
-		glm::vec2 deltaVector = waypoint - position;
-		deltaVector = glm::normalize(deltaVector);
-		torsoNode->rotation.y = -90 + glm::degrees(-std::atan2(deltaVector.y, deltaVector.x));
-		deltaVector *= timeSincePreviousFrame;
-		torsoNode->position.x += deltaVector.x;
-		torsoNode->position.z += deltaVector.y;
-
-		if(pathChess->hasWaypointBeenReached(float2(position.x, position.y), 20)) {
-			pathChess->advanceToNextWaypoint();
+		{
+			PROFILE_SCOPE("interpolation");
+			simulation.interpolate();
 		}
 	
 		// Draw your scene here
 		// in the case of GL_TRIANGLES, count should always be a multiple of 3
-		visitSceneNode(rootNode, transform);
-		printGLError();
+		{
+			PROFILE_SCOPE("scene traversal");
+			renderQueue.record(rootNode, transform, shader);
+			renderQueue.sort();
+		}
+		{
+			PROFILE_SCOPE("submit");
+			GpuProfileScope gpuScope(profiler, "draw");
+			renderQueue.submitInstanced();
+			skinnedRenderer.submit(skinnedShader);
+		}
+		if (frameCapture) {
+			frameCapture->capture();
+		}
 
         // Handle other events
         glfwPollEvents();
         handleKeyboardInput(window);
 
         // Flip buffers
-        glfwSwapBuffers(window);
+		{
+			PROFILE_SCOPE("swap");
+			glfwSwapBuffers(window);
+		}
+		profiler.endFrame();
+		endGLInstrumentationFrame();
     }
-	shader.deactivate();
-	shader.destroy();
+	simulation.stop();
+	SimulationStats simulationStats = simulation.getStats();
+	printf("Simulation: %llu steps of %.4f s, %llu skipped\n", (unsigned long long) simulationStats.stepCount,
+		simulation.getStepSeconds(), (unsigned long long) simulationStats.skippedStepCount);
+	profiler.printReport();
+	if (!traceFile.empty()) {
+		profiler.writeChromeTrace(traceFile);
+	}
+
+	TransformRingStats const &ringStats = transformRing.getStats();
+	if (ringStats.frameCount > 0) {
+		printf("Transform ring: %.1f bytes written per frame, %.4f ms average fence wait, %u of %u frames stalled\n",
+			double(ringStats.totalBytesWritten) / ringStats.frameCount,
+			ringStats.totalFenceWaitMilliseconds / ringStats.frameCount,
+			ringStats.stalledFrameCount, ringStats.frameCount);
+	}
+
+	if (frameCapture) {
+		// Writes out the frames still in flight before reporting
+		frameCapture->finish();
+		FrameCaptureStats captureStats = frameCapture->getStats();
+		frameCapture.reset();
+		printf("Capture: %u frames captured, %u dropped, %u written, %u failed; %.3f ms average and %.3f ms maximum per frame\n",
+			captureStats.capturedFrameCount, captureStats.droppedFrameCount,
+			captureStats.writtenFrameCount, captureStats.failedFrameCount,
+			captureStats.totalCaptureMilliseconds / std::max(captureStats.capturedFrameCount + captureStats.droppedFrameCount, 1u),
+			captureStats.maximumCaptureMilliseconds);
+	}
+
+	unsigned int glFrameCount = getGLInstrumentedFrameCount();
+	if (glFrameCount > 0) {
+		GLCallCounters glCalls = getGLTotalCounters();
+		printf("GL calls per frame: %.1f draws (%.1f indirect), %.0f triangles, %.0f bytes uploaded, "
+			"%.1f program, %.1f vertex array and %.1f buffer binds, %.1f uniform updates; %u errors, %u warnings\n",
+			double(glCalls.drawCalls) / glFrameCount, double(glCalls.indirectDrawCalls) / glFrameCount,
+			double(glCalls.triangles) / glFrameCount, double(glCalls.bufferBytesUploaded) / glFrameCount,
+			double(glCalls.programBinds) / glFrameCount, double(glCalls.vertexArrayBinds) / glFrameCount,
+			double(glCalls.bufferBinds) / glFrameCount, double(glCalls.uniformUpdates) / glFrameCount,
+			glCalls.debugErrors, glCalls.debugWarnings);
+	}
+
+	glUseProgram(0);
 }
 
 void handleKeyboardInput(GLFWwindow* window)
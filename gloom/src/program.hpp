@@ -7,10 +7,50 @@
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
 #include <string>
+#include <vector>
+#include "gpuResources.hpp"
+#include "mesh.hpp"
 
 
-// Main OpenGL program
-void runProgram(GLFWwindow* window);
+// Main OpenGL program. Given a trace file, the first traceFrameCount frames are profiled into it
+// as a Chrome trace (see FrameProfiler). Given a capture path, every frame is recorded to disk (see FrameCapture).
+const unsigned int traceFrameCount = 600;
+void runProgram(GLFWwindow* window, std::string const &traceFile = "", std::string const &capturePath = "");
+
+
+// A mesh which has been uploaded to the GPU, and the number of indices to draw it.
+// The mesh either has a VAO of its own, or lives in a GeometryArena (see geometryArena.hpp).
+struct MeshVAO {
+    int vertexArrayObjectID = -1;
+    int arenaMeshID = -1;
+    unsigned int indexCount = 0;
+    // The mesh's bounding box in model space. Empty (boundsMin above boundsMax) for meshes without vertices.
+    float3 boundsMin = float3(1.0f, 1.0f, 1.0f);
+    float3 boundsMax = float3(-1.0f, -1.0f, -1.0f);
+};
+
+
+// Sets the bounding box of vao to that of mesh's vertices
+void setMeshBounds(MeshVAO &vao, Mesh const &mesh);
+
+
+// A mesh uploaded with uploadMesh(), into buffers which are deleted along with the GpuMesh
+struct GpuMesh {
+	MeshVAO vao;
+	GpuVertexArray vertexArray;
+	GpuBuffer positions;
+	GpuBuffer colours;
+	GpuBuffer normals;
+	GpuBuffer textureCoordinates;
+	GpuBuffer indices;
+};
+
+
+// Uploads the mesh into buffers created by the resource manager, so its memory is tracked and can be freed:
+// vertex positions (attribute 1), colours (attribute 4), indices, and if the mesh has them,
+// normals (attribute 5) and texture coordinates (attribute 2).
+// Returns false, leaving gpuMesh empty, if the buffers do not fit into the manager's budgets.
+bool uploadMesh(Mesh const &mesh, GpuResourceManager &resources, GpuMesh &gpuMesh);
 
 
 // Function for handling keypresses
@@ -0,0 +1,150 @@
+#include "random.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RANDOM_USE_SSE 1
+#endif
+
+static std::atomic<uint64_t> masterSeed(defaultRandomSeed);
+
+// Counts the threads which have called randomUniformFloat(), so each takes the next stream.
+// Starts far from 0, so these never share a stream with the low ones which jobs usually use.
+static std::atomic<uint64_t> nextThreadStream(uint64_t(1) << 63);
+
+void setRandomSeed(uint64_t seed) {
+    masterSeed = seed;
+}
+
+uint64_t getRandomSeed() {
+    return masterSeed;
+}
+
+// SplitMix64, which turns any 64 bit value (even 0) into a well mixed one. xoshiro's authors recommend it for seeding.
+static uint64_t splitMix64(uint64_t &value) {
+    uint64_t z = (value += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotateLeft(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t stepXoshiro(uint64_t* state) {
+    uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotateLeft(state[3], 45);
+    return result;
+}
+
+Random::Random(uint64_t seed, uint64_t stream) {
+    // The stream is mixed on its own first, so neighbouring streams start from unrelated states
+    uint64_t mixedStream = stream;
+    uint64_t value = seed ^ splitMix64(mixedStream);
+    for (uint64_t &word : state) {
+        word = splitMix64(value);
+    }
+}
+
+uint64_t Random::nextUint64() {
+    return stepXoshiro(state);
+}
+
+uint32_t Random::nextBelow(uint32_t bound) {
+    uint64_t product = (nextUint64() >> 32) * bound;
+    uint32_t low = uint32_t(product);
+    if (low < bound) {
+        uint32_t threshold = uint32_t(-bound) % bound;
+        while (low < threshold) {
+            product = (nextUint64() >> 32) * bound;
+            low = uint32_t(product);
+        }
+    }
+    return uint32_t(product >> 32);
+}
+
+// The floats of one 64 bit number: the top 24 bits of its low half, then of its high half
+static void toFloats(uint64_t value, float* values) {
+    values[0] = float(uint32_t(value) >> 8) * (1.0f / 16777216.0f);
+    values[1] = float(uint32_t(value >> 32) >> 8) * (1.0f / 16777216.0f);
+}
+
+void Random::fillUniform(float* values, size_t count, float minimum, float maximum) {
+    // Two generators, stored word by word so that each word of both fits into one SSE register: lanes[w][g]
+    uint64_t lanes[4][2];
+    for (unsigned int generator = 0; generator < 2; generator++) {
+        uint64_t value = nextUint64();
+        for (unsigned int word = 0; word < 4; word++) {
+            lanes[word][generator] = splitMix64(value);
+        }
+    }
+    float range = maximum - minimum;
+    size_t i = 0;
+
+#ifdef RANDOM_USE_SSE
+    // stepXoshiro() on both generators at once. SSE2 has no 64 bit multiplication, but 5x and 9x are a shift and an add,
+    // and the rotations are two shifts.
+    __m128i s0 = _mm_loadu_si128((__m128i const*) lanes[0]);
+    __m128i s1 = _mm_loadu_si128((__m128i const*) lanes[1]);
+    __m128i s2 = _mm_loadu_si128((__m128i const*) lanes[2]);
+    __m128i s3 = _mm_loadu_si128((__m128i const*) lanes[3]);
+    __m128 unit = _mm_set1_ps(1.0f / 16777216.0f);
+    __m128 scale = _mm_set1_ps(range);
+    __m128 offset = _mm_set1_ps(minimum);
+    for (; i + 4 <= count; i += 4) {
+        __m128i times5 = _mm_add_epi64(_mm_slli_epi64(s1, 2), s1);
+        __m128i rotated = _mm_or_si128(_mm_slli_epi64(times5, 7), _mm_srli_epi64(times5, 57));
+        __m128i result = _mm_add_epi64(_mm_slli_epi64(rotated, 3), rotated);
+
+        __m128i t = _mm_slli_epi64(s1, 17);
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi64(s3, 45), _mm_srli_epi64(s3, 19));
+
+        // The 32 bit halves in memory order are the low and high half of the first generator's number, then the second's,
+        // the same order toFloats() puts them in. Scaled in the same steps too, so the results match to the bit.
+        __m128 floats = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), unit);
+        _mm_storeu_ps(values + i, _mm_add_ps(offset, _mm_mul_ps(floats, scale)));
+    }
+    _mm_storeu_si128((__m128i*) lanes[0], s0);
+    _mm_storeu_si128((__m128i*) lanes[1], s1);
+    _mm_storeu_si128((__m128i*) lanes[2], s2);
+    _mm_storeu_si128((__m128i*) lanes[3], s3);
+#endif
+
+    // The same, one step of both generators at a time, for the last few values (or all of them without SSE)
+    while (i < count) {
+        float step[4];
+        for (unsigned int generator = 0; generator < 2; generator++) {
+            uint64_t word[4] = {lanes[0][generator], lanes[1][generator], lanes[2][generator], lanes[3][generator]};
+            toFloats(stepXoshiro(word), step + 2 * generator);
+            for (unsigned int w = 0; w < 4; w++) {
+                lanes[w][generator] = word[w];
+            }
+        }
+        for (unsigned int j = 0; j < 4 && i < count; j++, i++) {
+            values[i] = minimum + step[j] * range;
+        }
+    }
+}
+
+Random randomStream(uint64_t stream) {
+    return Random(masterSeed, stream);
+}
+
+float randomUniformFloat() {
+    static thread_local Random generator = randomStream(nextThreadStream++);
+    return generator.nextFloat();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The seed every generator is derived from unless setRandomSeed() picks another, so runs repeat themselves
+const uint64_t defaultRandomSeed = 0x676c6f6f6dULL;
+
+// Sets the master seed which randomUniformFloat() and generators made with randomStream() derive from.
+// Only affects generators created afterwards, so it belongs at startup.
+void setRandomSeed(uint64_t seed);
+uint64_t getRandomSeed();
+
+// A xoshiro256** generator (Blackman and Vigna): four 64 bit words of state, a period of 2^256 - 1,
+// and a handful of shifts, rotations and additions per number, instead of rand()'s lock and global state.
+//
+// Not safe to share between threads; give every thread or job a stream of its own instead. Generators with
+// the same seed and stream always produce the same numbers, on any platform, with or without SSE.
+class Random {
+public:
+    // The stream picks one of 2^64 generators for the same seed, such as one per job of a parallelFor(),
+    // which is how parallel work stays deterministic however its jobs are spread over threads.
+    explicit Random(uint64_t seed, uint64_t stream = 0);
+
+    uint64_t nextUint64();
+
+    // Uniform in [0, 1), in steps of 2^-24
+    float nextFloat() { return float(nextUint64() >> 40) * (1.0f / 16777216.0f); }
+    float nextFloat(float minimum, float maximum) { return minimum + (maximum - minimum) * nextFloat(); }
+
+    // Uniform in [0, bound), for bounds above 0, without the bias of a modulo (Lemire's method)
+    uint32_t nextBelow(uint32_t bound);
+
+    // Fills count floats uniform in [minimum, maximum). Runs two generators side by side, seeded from this one,
+    // four floats a step with SSE2, so it is several times faster than calling nextFloat() count times.
+    // It also produces other numbers than nextFloat() would, but always the same ones for the same state.
+    void fillUniform(float* values, size_t count, float minimum = 0.0f, float maximum = 1.0f);
+
+private:
+    uint64_t state[4];
+};
+
+// A generator for one stream of the master seed. The same stream index gives the same numbers every run.
+Random randomStream(uint64_t stream);
+
+// Returns a random float between 0 and 1, from a generator of its own for each thread calling it.
+// The threads take the master seed's streams in the order they first call this, so it only repeats itself
+// from run to run when called from one thread. Parallel code should use a Random per job instead.
+float randomUniformFloat();
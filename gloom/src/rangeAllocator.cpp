@@ -0,0 +1,57 @@
+#include "rangeAllocator.hpp"
+#include <cassert>
+
+RangeAllocator::RangeAllocator(size_t capacity) : capacity(capacity) {
+    if (capacity > 0) {
+        freeRanges[0] = capacity;
+    }
+}
+
+bool RangeAllocator::allocate(size_t size, size_t &offset) {
+    if (size == 0) {
+        offset = 0;
+        return true;
+    }
+
+    for (std::map<size_t, size_t>::iterator range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+        if (range->second < size) {
+            continue;
+        }
+
+        offset = range->first;
+        size_t remaining = range->second - size;
+        freeRanges.erase(range);
+        if (remaining > 0) {
+            freeRanges[offset + size] = remaining;
+        }
+        used += size;
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    assert(offset + size <= capacity && used >= size);
+    used -= size;
+
+    // Merge with the free range directly after this one
+    std::map<size_t, size_t>::iterator next = freeRanges.find(offset + size);
+    if (next != freeRanges.end()) {
+        size += next->second;
+        freeRanges.erase(next);
+    }
+
+    // And with the one directly before it
+    std::map<size_t, size_t>::iterator inserted = freeRanges.insert(std::make_pair(offset, size)).first;
+    if (inserted != freeRanges.begin()) {
+        std::map<size_t, size_t>::iterator previous = inserted;
+        --previous;
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            freeRanges.erase(inserted);
+        }
+    }
+}
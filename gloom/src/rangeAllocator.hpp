@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+// Hands out sub-ranges of a fixed-size linear resource, such as the elements of a large GPU buffer.
+// Free space is kept as a sorted list of ranges. Allocation is first-fit, and freed ranges are merged
+// with free neighbours so that the space does not fragment into unusably small pieces over time.
+class RangeAllocator {
+public:
+    explicit RangeAllocator(size_t capacity);
+
+    // Finds room for size elements. Returns false (leaving offset untouched) if no free range is large enough.
+    bool allocate(size_t size, size_t &offset);
+
+    // Returns a range previously handed out by allocate()
+    void free(size_t offset, size_t size);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+
+private:
+    // Maps the start of every free range to its length
+    std::map<size_t, size_t> freeRanges;
+    size_t capacity;
+    size_t used = 0;
+};
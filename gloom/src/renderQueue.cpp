@@ -0,0 +1,440 @@
+#include "renderQueue.hpp"
+#include "geometryArena.hpp"
+#include "occlusionCuller.hpp"
+#include "transformRing.hpp"
+#include "transform.hpp"
+#include "profiler.hpp"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cassert>
+
+static const unsigned int depthBits = 24;
+static const uint32_t depthMask = (1u << depthBits) - 1;
+
+uint64_t makeSortKey(unsigned int program, unsigned int vertexArray, float depth, float farPlane, bool isTransparent) {
+    assert(program < 256 && vertexArray < 65536);
+
+    // Objects behind the camera or beyond the far plane end up at either end of the range
+    float normalisedDepth = std::min(std::max(depth / farPlane, 0.0f), 1.0f);
+    uint64_t quantisedDepth = uint64_t(normalisedDepth * float(depthMask)) & depthMask;
+
+    if (isTransparent) {
+        uint64_t invertedDepth = depthMask - quantisedDepth;
+        return (uint64_t(1) << 63) | (invertedDepth << 39) | (uint64_t(program) << 31) | (uint64_t(vertexArray) << 15);
+    }
+    return (uint64_t(program) << 55) | (uint64_t(vertexArray) << 39) | (quantisedDepth << 15);
+}
+
+// Fills in the program and VAO slots of a key made with slots 0
+static uint64_t setSortKeySlots(uint64_t key, unsigned int program, unsigned int vertexArray) {
+    if (sortKeyIsTransparent(key)) {
+        return key | (uint64_t(program) << 31) | (uint64_t(vertexArray) << 15);
+    }
+    return key | (uint64_t(program) << 55) | (uint64_t(vertexArray) << 39);
+}
+
+// The slot of name, giving it the next free one below slotCount if it has none yet
+static unsigned int findSlot(std::unordered_map<GLuint, unsigned int> &slots, GLuint name, unsigned int slotCount) {
+    std::unordered_map<GLuint, unsigned int>::const_iterator slot = slots.find(name);
+    if (slot != slots.end()) {
+        return slot->second;
+    }
+    unsigned int newSlot = std::min(unsigned(slots.size()), slotCount - 1);
+    slots[name] = newSlot;
+    return newSlot;
+}
+
+bool sortKeyIsTransparent(uint64_t key) {
+    return (key >> 63) != 0;
+}
+
+unsigned int sortKeyProgram(uint64_t key) {
+    return unsigned(sortKeyIsTransparent(key) ? (key >> 31) & 0xFF : (key >> 55) & 0xFF);
+}
+
+unsigned int sortKeyVertexArray(uint64_t key) {
+    return unsigned(sortKeyIsTransparent(key) ? (key >> 15) & 0xFFFF : (key >> 39) & 0xFFFF);
+}
+
+void radixSortPackets(std::vector<DrawPacket> &packets, std::vector<DrawPacket> &scratch) {
+    const unsigned int passCount = sizeof(uint64_t);
+    size_t histograms[passCount][256] = {};
+
+    // One read over the keys builds the histograms for all passes at once
+    for (DrawPacket const &packet : packets) {
+        for (unsigned int pass = 0; pass < passCount; pass++) {
+            histograms[pass][(packet.key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    scratch.resize(packets.size());
+    std::vector<DrawPacket>* source = &packets;
+    std::vector<DrawPacket>* destination = &scratch;
+
+    for (unsigned int pass = 0; pass < passCount; pass++) {
+        size_t* histogram = histograms[pass];
+        unsigned int shift = pass * 8;
+
+        // If every key shares this digit, the pass would not change the order
+        if (histogram[(packets.front().key >> shift) & 0xFF] == packets.size()) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (unsigned int digit = 0; digit < 256; digit++) {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+
+        for (DrawPacket const &packet : *source) {
+            (*destination)[histogram[(packet.key >> shift) & 0xFF]++] = packet;
+        }
+        std::swap(source, destination);
+    }
+
+    if (source != &packets) {
+        packets.swap(scratch);
+    }
+}
+
+// Normal matrices are worked out by the thread pool in chunks of this many packets
+static const size_t packetsPerJob = 1024;
+
+RenderQueue::RenderQueue(ThreadPool &pool, float farPlane) : pool(pool), farPlane(farPlane) {
+    threadBuffers.resize(pool.threadCount());
+}
+
+RenderQueue::~RenderQueue() {
+    if (instanceBuffer != 0) {
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+    if (objectSpaceBuffer != 0) {
+        glDeleteBuffers(1, &objectSpaceBuffer);
+    }
+}
+
+void RenderQueue::recordNode(SceneNode* node, ThreadBuffer &buffer, GLuint defaultProgram) {
+    bool isInArena = node->arenaMeshID != -1 && geometryArena != nullptr;
+    if (node->vertexArrayObjectID == -1 && !isInArena) {
+        return;
+    }
+
+    glm::mat4 const &matrix = node->currentTransformationMatrix;
+
+    // The w component of the clip space position of the node's reference point is its distance along the view axis
+    float depth = matrix[0][3] * node->referencePoint.x
+                + matrix[1][3] * node->referencePoint.y
+                + matrix[2][3] * node->referencePoint.z
+                + matrix[3][3];
+
+    unsigned int program = node->shaderProgramID == -1 ? defaultProgram : unsigned(node->shaderProgramID);
+    unsigned int vertexArray = isInArena ? geometryArena->getVertexArray() : unsigned(node->vertexArrayObjectID);
+
+    // The slots are filled in by record(), since assigning them here would need a lock
+    DrawPacket packet;
+    packet.key = makeSortKey(0, 0, depth, farPlane, node->isTransparent);
+    packet.program = program;
+    packet.vertexArray = vertexArray;
+    packet.matrixIndex = unsigned(buffer.matrices.size());
+    packet.indexCount = node->VAOIndexCount;
+    packet.arenaMeshID = isInArena ? node->arenaMeshID : -1;
+
+    buffer.matrices.push_back(matrix);
+    if (!litPrograms.empty()) {
+        buffer.models.push_back(node->currentModelMatrix);
+    }
+    buffer.packets.push_back(packet);
+}
+
+// Model matrices are only needed by lit programs, so they cost nothing without any
+void RenderQueue::updateTransform(SceneNode* node, glm::mat4 const &transformationThusFar, glm::mat4 const &modelThusFar) const {
+    if (litPrograms.empty()) {
+        updateNodeTransform(node, transformationThusFar);
+    } else {
+        updateNodeTransform(node, transformationThusFar, modelThusFar);
+    }
+}
+
+void RenderQueue::recordSubtree(SceneNode* node, glm::mat4 const &transformationThusFar, glm::mat4 const &modelThusFar,
+                                ThreadBuffer &buffer, GLuint defaultProgram) {
+    updateTransform(node, transformationThusFar, modelThusFar);
+    if (occlusionCuller == nullptr) {
+        recordNode(node, buffer, defaultProgram);
+    } else if (node->vertexArrayObjectID != -1 || node->arenaMeshID != -1) {
+        buffer.nodes.push_back(node);
+    }
+
+    for (SceneNode* child : node->children) {
+        recordSubtree(child, node->currentTransformationMatrix, node->currentModelMatrix, buffer, defaultProgram);
+    }
+}
+
+void RenderQueue::record(SceneNode* rootNode, glm::mat4 const &transform, GLuint defaultProgram) {
+    for (ThreadBuffer &buffer : threadBuffers) {
+        buffer.packets.clear();
+        buffer.matrices.clear();
+        buffer.models.clear();
+        buffer.nodes.clear();
+        buffer.occludedCount = 0;
+    }
+
+    updateTransform(rootNode, transform, glm::mat4(1.0f));
+    if (occlusionCuller == nullptr) {
+        recordNode(rootNode, threadBuffers.at(0), defaultProgram);
+    } else if (rootNode->vertexArrayObjectID != -1 || rootNode->arenaMeshID != -1) {
+        threadBuffers.at(0).nodes.push_back(rootNode);
+    }
+
+    std::vector<SceneNode*> const &subtrees = rootNode->children;
+    glm::mat4 const &rootTransform = rootNode->currentTransformationMatrix;
+    glm::mat4 const &rootModel = rootNode->currentModelMatrix;
+    pool.parallelFor(subtrees.size(), [&](size_t index, unsigned int threadIndex) {
+        PROFILE_SCOPE("recordSubtree");
+        recordSubtree(subtrees.at(index), rootTransform, rootModel, threadBuffers.at(threadIndex), defaultProgram);
+    });
+
+    occludedNodeCount = 0;
+    if (occlusionCuller != nullptr) {
+        occlusionCuller->beginFrame();
+        for (ThreadBuffer const &buffer : threadBuffers) {
+            for (SceneNode* node : buffer.nodes) {
+                if (node->isOccluder) {
+                    occlusionCuller->addOccluder(node->currentTransformationMatrix, node->boundsMin, node->boundsMax);
+                }
+            }
+        }
+        occlusionCuller->rasterize();
+
+        // Each thread's nodes are tested and recorded into that thread's own buffer
+        pool.parallelFor(threadBuffers.size(), [&](size_t index, unsigned int) {
+            PROFILE_SCOPE("recordVisibleNodes");
+            ThreadBuffer &buffer = threadBuffers.at(index);
+            for (SceneNode* node : buffer.nodes) {
+                if (occlusionCuller->isOccluded(node->currentTransformationMatrix, node->boundsMin, node->boundsMax)) {
+                    buffer.occludedCount++;
+                } else {
+                    recordNode(node, buffer, defaultProgram);
+                }
+            }
+        });
+        for (ThreadBuffer const &buffer : threadBuffers) {
+            occludedNodeCount += buffer.occludedCount;
+        }
+    }
+
+    // Concatenate the per-thread buffers. Matrix indices are relative to their thread's buffer until now.
+    // Neighbouring packets mostly share their program and VAO, so their slots are only looked up when they change.
+    packets.clear();
+    matrices.clear();
+    models.clear();
+    GLuint lastProgram = 0;
+    GLuint lastVertexArray = 0;
+    unsigned int programSlot = 0;
+    unsigned int vertexArraySlot = 0;
+    for (ThreadBuffer const &buffer : threadBuffers) {
+        unsigned int matrixBase = unsigned(matrices.size());
+        matrices.insert(matrices.end(), buffer.matrices.begin(), buffer.matrices.end());
+        models.insert(models.end(), buffer.models.begin(), buffer.models.end());
+        for (DrawPacket packet : buffer.packets) {
+            if (packet.program != lastProgram) {
+                programSlot = findSlot(programSlots, packet.program, 256);
+                lastProgram = packet.program;
+            }
+            if (packet.vertexArray != lastVertexArray) {
+                vertexArraySlot = findSlot(vertexArraySlots, packet.vertexArray, 65536);
+                lastVertexArray = packet.vertexArray;
+            }
+            packet.key = setSortKeySlots(packet.key, programSlot, vertexArraySlot);
+            packet.matrixIndex += matrixBase;
+            packets.push_back(packet);
+        }
+    }
+}
+
+void RenderQueue::sort() {
+    if (packets.size() > 1) {
+        radixSortPackets(packets, scratchPackets);
+    }
+}
+
+void RenderQueue::beginSubmission() {
+    stats = RenderQueueStats();
+    stats.packetCount = unsigned(packets.size());
+    stats.occludedNodeCount = occludedNodeCount;
+
+    // 0 is never a valid program or VAO for a drawable node, so it doubles as "nothing bound yet"
+    boundProgram = 0;
+    boundVertexArray = 0;
+    isDepthWriteDisabled = false;
+}
+
+void RenderQueue::bindState(DrawPacket const &packet, unsigned int program) {
+    // Transparent geometry should still be hidden by opaque geometry, but not hide each other
+    if (sortKeyIsTransparent(packet.key) && !isDepthWriteDisabled) {
+        glDepthMask(GL_FALSE);
+        isDepthWriteDisabled = true;
+    }
+
+    if (program != boundProgram) {
+        glUseProgram(program);
+        boundProgram = program;
+        stats.programBinds++;
+    }
+
+    unsigned int vertexArray = packet.vertexArray;
+    if (vertexArray != boundVertexArray) {
+        glBindVertexArray(vertexArray);
+        boundVertexArray = vertexArray;
+        stats.vertexArrayBinds++;
+    }
+}
+
+void RenderQueue::endSubmission() {
+    if (isDepthWriteDisabled) {
+        glDepthMask(GL_TRUE);
+    }
+}
+
+void RenderQueue::submit() {
+    beginSubmission();
+
+    for (DrawPacket const &packet : packets) {
+        drawSeparately(packet, packet.program, matrices.at(packet.matrixIndex));
+    }
+
+    endSubmission();
+}
+
+void RenderQueue::drawSeparately(DrawPacket const &packet, unsigned int program, glm::mat4 const &matrix) {
+    bindState(packet, program);
+    glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(matrix));
+    if (litPrograms.count(packet.program) != 0) {
+        glm::mat4 const &model = models.at(packet.matrixIndex);
+        glUniformMatrix4fv(31, 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(32, 1, GL_FALSE, glm::value_ptr(normalMatrix(model)));
+    }
+    if (packet.arenaMeshID != -1) {
+        geometryArena->draw(packet.arenaMeshID);
+    } else {
+        glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, 0);
+    }
+    stats.drawCalls++;
+}
+
+void RenderQueue::setGeometryArena(GeometryArena* arena) {
+    geometryArena = arena;
+}
+
+void RenderQueue::setIndirectVariant(GLuint program, GLuint indirectProgram) {
+    indirectVariants[program] = indirectProgram;
+}
+
+void RenderQueue::setOcclusionCuller(OcclusionCuller* culler) {
+    occlusionCuller = culler;
+}
+
+void RenderQueue::setLitProgram(GLuint program) {
+    litPrograms.insert(program);
+}
+
+void RenderQueue::setInstancedVariant(GLuint program, GLuint instancedProgram) {
+    instancedVariants[program] = instancedProgram;
+}
+
+void RenderQueue::setTransformRing(TransformRing* ring) {
+    transformRing = ring;
+}
+
+void RenderQueue::submitInstanced() {
+    beginSubmission();
+    if (packets.empty()) {
+        return;
+    }
+
+    // Instance i of the frame uses the matrix of packet i
+    instanceMatrices.clear();
+    for (DrawPacket const &packet : packets) {
+        instanceMatrices.push_back(matrices.at(packet.matrixIndex));
+    }
+
+    if (transformRing != nullptr) {
+        transformRing->write(instanceMatrices);
+        transformRing->bind(0);
+    } else {
+        if (instanceBuffer == 0) {
+            glGenBuffers(1, &instanceBuffer);
+        }
+        // Respecifying the whole buffer lets the driver hand us fresh memory while the GPU still reads last frame's
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instanceMatrices.size() * sizeof(glm::mat4), instanceMatrices.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+    }
+
+    if (!litPrograms.empty()) {
+        // Packets of other programs leave their entries unset, since nothing reads them
+        instanceObjectSpaces.resize(2 * packets.size());
+        size_t jobCount = (packets.size() + packetsPerJob - 1) / packetsPerJob;
+        pool.parallelFor(jobCount, [this](size_t job, unsigned int) {
+            size_t end = std::min((job + 1) * packetsPerJob, packets.size());
+            for (size_t i = job * packetsPerJob; i < end; i++) {
+                if (litPrograms.count(packets[i].program) != 0) {
+                    glm::mat4 const &model = models.at(packets[i].matrixIndex);
+                    instanceObjectSpaces[2 * i] = model;
+                    instanceObjectSpaces[2 * i + 1] = normalMatrix(model);
+                }
+            }
+        });
+        if (objectSpaceBuffer == 0) {
+            glGenBuffers(1, &objectSpaceBuffer);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSpaceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instanceObjectSpaces.size() * sizeof(glm::mat4), instanceObjectSpaces.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, objectSpaceBuffer);
+    }
+
+    size_t batchStart = 0;
+    while (batchStart < packets.size()) {
+        DrawPacket const &first = packets.at(batchStart);
+        unsigned int program = first.program;
+        unsigned int vertexArray = first.vertexArray;
+
+        // Arena packets only need to share the program to be drawn together, the mesh may differ
+        bool isArenaBatch = first.arenaMeshID != -1;
+
+        size_t batchEnd = batchStart + 1;
+        while (batchEnd < packets.size()
+               && packets.at(batchEnd).program == program
+               && packets.at(batchEnd).vertexArray == vertexArray
+               && sortKeyIsTransparent(packets.at(batchEnd).key) == sortKeyIsTransparent(first.key)
+               && (isArenaBatch || packets.at(batchEnd).indexCount == first.indexCount)) {
+            batchEnd++;
+        }
+
+        std::unordered_map<unsigned int, unsigned int> const &variants = isArenaBatch ? indirectVariants : instancedVariants;
+        std::unordered_map<unsigned int, unsigned int>::const_iterator variant = variants.find(program);
+        if (variant == variants.end()) {
+            for (size_t i = batchStart; i < batchEnd; i++) {
+                drawSeparately(packets.at(i), program, instanceMatrices.at(i));
+            }
+        } else if (isArenaBatch) {
+            bindState(first, variant->second);
+            geometryArena->multiDraw(&packets.at(batchStart), batchEnd - batchStart, unsigned(batchStart));
+            stats.drawCalls++;
+            stats.multiDrawCalls++;
+        } else {
+            bindState(first, variant->second);
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, first.indexCount, GL_UNSIGNED_INT, 0,
+                                                GLsizei(batchEnd - batchStart), GLuint(batchStart));
+            stats.drawCalls++;
+            stats.instancedDrawCalls++;
+        }
+
+        batchStart = batchEnd;
+    }
+
+    if (transformRing != nullptr) {
+        transformRing->endFrame();
+    }
+    endSubmission();
+}
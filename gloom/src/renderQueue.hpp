@@ -0,0 +1,184 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "sceneGraph.hpp"
+#include "threadPool.hpp"
+
+class GeometryArena;
+class OcclusionCuller;
+class TransformRing;
+
+// Everything the render thread needs to know to issue one draw call.
+// The packet itself is kept small so that sorting moves as little memory as possible;
+// the (much larger) transformation matrix lives in a separate array and is referenced by index.
+struct DrawPacket {
+    uint64_t key;
+    // The GL names to bind. The key only holds small slots standing in for them, see RenderQueue::record().
+    GLuint program;
+    GLuint vertexArray;
+    unsigned int matrixIndex;
+    unsigned int indexCount;
+    // The mesh to draw for packets whose VAO is the geometry arena's, -1 otherwise
+    int arenaMeshID;
+};
+
+// Counters describing the most recently submitted frame.
+struct RenderQueueStats {
+    unsigned int packetCount = 0;
+    unsigned int drawCalls = 0;
+    unsigned int instancedDrawCalls = 0;
+    unsigned int multiDrawCalls = 0;
+    unsigned int programBinds = 0;
+    unsigned int vertexArrayBinds = 0;
+    // Nodes with a mesh which the occlusion culler hid in the last record(), so no packet was emitted for them
+    unsigned int occludedNodeCount = 0;
+};
+
+// Layout of the 64-bit sort key, from the most significant bit down:
+//
+//   opaque:      [63] 0 | [62..55] program | [54..39] VAO | [38..15] depth (front to back)
+//   transparent: [63] 1 | [62..39] depth (back to front) | [38..31] program | [30..15] VAO
+//
+// Sorting on the key therefore draws all opaque geometry first, grouped by program and then by VAO
+// to keep state changes down, with closer objects first within each group so the depth test
+// rejects as many hidden fragments as possible. Transparent geometry follows, strictly
+// back to front, since blending is only correct in that order.
+//
+// program and vertexArray are slots below 256 and 65536, not GL names, which can be far larger.
+uint64_t makeSortKey(unsigned int program, unsigned int vertexArray, float depth, float farPlane, bool isTransparent);
+unsigned int sortKeyProgram(uint64_t key);
+unsigned int sortKeyVertexArray(uint64_t key);
+bool sortKeyIsTransparent(uint64_t key);
+
+// Stable LSD radix sort of the packets on their key, 8 bits per pass.
+// Passes in which every key has the same digit are skipped. scratch is resized as needed.
+void radixSortPackets(std::vector<DrawPacket> &packets, std::vector<DrawPacket> &scratch);
+
+// Decouples traversing the scene graph from issuing GL commands.
+// Each frame the graph is recorded into draw packets (in parallel, one subtree of the root per job),
+// the packets are sorted, and then submitted from the render thread.
+class RenderQueue {
+public:
+    RenderQueue(ThreadPool &pool, float farPlane = 100.0f);
+    ~RenderQueue();
+
+    // Walks the scene graph below rootNode, updating every node's currentTransformationMatrix
+    // and emitting a packet for each node with a VAO or arena mesh. Nodes without a shader program use defaultProgram.
+    // Every program and VAO gets a slot for the sort key the first time it is seen, in the order they are seen.
+    // Beyond the 256th program or 65536th VAO they share the last slot, which only makes sorting group them less well.
+    void record(SceneNode* rootNode, glm::mat4 const &transform, GLuint defaultProgram);
+
+    // Sorts the recorded packets. See makeSortKey() for the resulting draw order.
+    void sort();
+
+    // Issues the draw calls for the sorted packets, only changing programs and VAOs when needed.
+    // Expects the transformation matrix uniform at location 5, like mesh.vert without features.
+    void submit();
+
+    // Registers a variant of program which reads its transformation matrix from the storage buffer
+    // at binding 0, at index gl_BaseInstance + gl_InstanceID (like mesh.vert with MESH_INSTANCED), instead of the uniform at location 5.
+    void setInstancedVariant(GLuint program, GLuint instancedProgram);
+
+    // Writes the frame's matrices into this persistently mapped ring buffer in submitInstanced(),
+    // instead of respecifying a buffer every frame.
+    void setTransformRing(TransformRing* ring);
+
+    // Nodes with an arenaMeshID are drawn from this arena. All of them share its VAO,
+    // so they are sorted next to each other and can be drawn together.
+    void setGeometryArena(GeometryArena* arena);
+
+    // Registers a variant of program which fetches its transformation matrix from the storage buffer
+    // at binding 0 using gl_DrawID (like mesh.vert with MESH_INDIRECT), for multi-draws from the geometry arena.
+    void setIndirectVariant(GLuint program, GLuint indirectProgram);
+
+    // Marks program and its variants as lit (like mesh.vert with MESH_LIT). record() then also updates every node's
+    // currentModelMatrix, and draws with these programs get their model and normal matrix: in the uniforms at
+    // locations 31 and 32 when drawn one by one, and otherwise in the storage buffer at binding 8, at the same index
+    // as their transformation.
+    void setLitProgram(GLuint program);
+
+    // Culls nodes hidden behind occluders before recording their packets. record() then works in two passes:
+    // the first updates the transformations and collects the nodes, after which every node flagged as an occluder
+    // is offered to the culler and rasterized, and the second emits packets for the nodes which are not hidden.
+    // Nodes without bounds are always drawn.
+    void setOcclusionCuller(OcclusionCuller* culler);
+
+    // Like submit(), but consecutive packets which draw the same VAO with the same program are merged
+    // into a single glDrawElementsInstancedBaseInstance() call. The matrices of all packets are uploaded
+    // into one storage buffer per frame, in sorted order, so each batch is a contiguous range of it
+    // starting at its base instance. No uniforms are set per draw.
+    // Consecutive packets drawing different meshes from the geometry arena are merged into a single
+    // glMultiDrawElementsIndirect() call instead, reading the same matrices.
+    // Packets whose program has no suitable variant are drawn one by one, as in submit().
+    void submitInstanced();
+
+    RenderQueueStats const &getStats() const { return stats; }
+    std::vector<DrawPacket> const &getPackets() const { return packets; }
+    std::vector<glm::mat4> const &getMatrices() const { return matrices; }
+
+private:
+    // Packets and matrices are recorded into one of these per thread, so no locking is needed
+    struct ThreadBuffer {
+        std::vector<DrawPacket> packets;
+        std::vector<glm::mat4> matrices;
+        // With lit programs, each packet's model matrix, at the same index as its transformation
+        std::vector<glm::mat4> models;
+        // With an occlusion culler, the nodes with a mesh found while traversing, and how many of them were hidden
+        std::vector<SceneNode*> nodes;
+        unsigned int occludedCount = 0;
+    };
+
+    void beginSubmission();
+    void bindState(DrawPacket const &packet, unsigned int program);
+    void endSubmission();
+    void drawSeparately(DrawPacket const &packet, unsigned int program, glm::mat4 const &matrix);
+
+    void recordNode(SceneNode* node, ThreadBuffer &buffer, GLuint defaultProgram);
+    void recordSubtree(SceneNode* node, glm::mat4 const &transformationThusFar, glm::mat4 const &modelThusFar,
+                       ThreadBuffer &buffer, GLuint defaultProgram);
+    void updateTransform(SceneNode* node, glm::mat4 const &transformationThusFar, glm::mat4 const &modelThusFar) const;
+
+    ThreadPool &pool;
+    float farPlane;
+
+    std::vector<ThreadBuffer> threadBuffers;
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> scratchPackets;
+    std::vector<glm::mat4> matrices;
+    std::vector<glm::mat4> models;
+
+    // The sort key slots of the programs and VAOs seen so far
+    std::unordered_map<GLuint, unsigned int> programSlots;
+    std::unordered_map<GLuint, unsigned int> vertexArraySlots;
+
+    // State tracked while submitting, to skip redundant binds
+    unsigned int boundProgram = 0;
+    unsigned int boundVertexArray = 0;
+    bool isDepthWriteDisabled = false;
+
+    // Instancing support. The matrices go into the transform ring if there is one,
+    // and into instanceBuffer (created on first use) otherwise.
+    GLuint instanceBuffer = 0;
+    TransformRing* transformRing = nullptr;
+    std::vector<glm::mat4> instanceMatrices;
+    std::unordered_map<unsigned int, unsigned int> instancedVariants;
+
+    // Lit programs' model and normal matrices, two matrices per instance, in objectSpaceBuffer (created on first use)
+    std::unordered_set<unsigned int> litPrograms;
+    GLuint objectSpaceBuffer = 0;
+    std::vector<glm::mat4> instanceObjectSpaces;
+
+    GeometryArena* geometryArena = nullptr;
+    std::unordered_map<unsigned int, unsigned int> indirectVariants;
+
+    OcclusionCuller* occlusionCuller = nullptr;
+    unsigned int occludedNodeCount = 0;
+
+    RenderQueueStats stats;
+};
@@ -0,0 +1,329 @@
+#include "benchmarks.hpp"
+#include "gloom/gloom.hpp"
+#include "gloom/shader.hpp"
+#include "shaderVariants.hpp"
+#include "glInstrumentation.hpp"
+#include "animation.hpp"
+#include "character.hpp"
+#include "crowd.hpp"
+#include "frameCapture.hpp"
+#include "headless.hpp"
+#include "pathfinder.hpp"
+#include "profiler.hpp"
+#include "renderQueue.hpp"
+#include "simulation.hpp"
+#include "skinnedMesh.hpp"
+#include "terrain.hpp"
+#include "threadPool.hpp"
+#include "toolbox.hpp"
+#include "transformRing.hpp"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const float tileWidth = 20.0f;
+static const float stepSeconds = 1.0f / 60.0f;
+// Frames drawn before measuring starts, to get shader compilation and buffer growth out of the way
+static const unsigned int warmupFrameCount = 30;
+// The characters share this many routes, each visiting a few random tiles of the board
+static const unsigned int routeCount = 32;
+static const unsigned int stopsPerRoute = 4;
+
+static float boardExtent(BenchmarkOptions const &options) {
+    return float(std::max(options.boardWidth, options.boardHeight)) * tileWidth;
+}
+
+static glm::vec3 boardCentre(BenchmarkOptions const &options) {
+    return glm::vec3(0.5f * float(options.boardWidth) * tileWidth, 0.0f, 0.5f * float(options.boardHeight) * tileWidth);
+}
+
+// One full circle around the board over the measured frames
+static glm::vec3 orbitCameraPosition(BenchmarkOptions const &options, unsigned int frame) {
+    float extent = boardExtent(options);
+    float angle = 2.0f * 3.1415926f * float(frame) / float(options.frameCount);
+    return boardCentre(options) + glm::vec3(0.9f * extent * std::cos(angle), 0.6f * extent, 0.9f * extent * std::sin(angle));
+}
+
+// Looking down at the board's centre from the given position
+static glm::mat4 orbitCameraTransform(BenchmarkOptions const &options, glm::vec3 const &eye, float aspectRatio) {
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspectRatio, 1.0f, 10.0f * boardExtent(options));
+    return projection * glm::lookAt(eye, boardCentre(options), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// The value below which the given fraction of the sorted values lie (nearest rank)
+static double percentile(std::vector<double> const &sortedValues, double fraction) {
+    size_t rank = size_t(std::ceil(fraction * double(sortedValues.size())));
+    return sortedValues[std::min(std::max(rank, size_t(1)), sortedValues.size()) - 1];
+}
+
+int runSceneBenchmark(GLFWwindow* window, BenchmarkOptions const &options) {
+    // Headless contexts render at the window's size too
+    float aspectRatio = float(windowWidth) / float(windowHeight);
+
+    ShaderVariants meshShaders({"./gloom/shaders/mesh.vert", "./gloom/shaders/simple.frag"}, meshShaderFeatureNames());
+    GLuint shader = meshShaders.get(0);
+    Gloom::Shader terrainShader;
+    terrainShader.makeBasicShader("./gloom/shaders/terrain.vert", "./gloom/shaders/terrain.frag");
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.3f, 0.5f, 0.8f, 1.0f);
+    if (window != nullptr) {
+        glfwSwapInterval(0);
+    }
+
+    // The board is streamed in as terrain chunks, the characters are drawn as instances of one skinned draw
+    SceneNode* rootNode = createSceneNode();
+    MinecraftCharacter character = loadMinecraftCharacterModel("./gloom/src/steve.obj");
+    GpuResourceManager resources;
+    GpuSkinnedMesh characterMesh;
+    uploadSkinnedMesh(mergeCharacterParts(character), characterPartCount, resources, characterMesh);
+
+    ThreadPool threadPool;
+    TerrainSettings terrainSettings;
+    terrainSettings.boardWidth = options.boardWidth;
+    terrainSettings.boardHeight = options.boardHeight;
+    terrainSettings.tileWidth = tileWidth;
+    // The camera stays outside the board, so every chunk is in range
+    terrainSettings.loadRadius = 2.0f * boardExtent(options);
+    terrainSettings.lodDistance = float(terrainSettings.chunkTiles) * tileWidth;
+    Terrain terrain(threadPool, terrainSettings);
+    // Streaming happens before measuring starts, so every run measures the same frames
+    do {
+        terrain.update(orbitCameraPosition(options, 0));
+    } while (terrain.getStats().loadedChunkCount > 0);
+
+    ThreadPool simulationThreadPool(std::max(1u, std::thread::hardware_concurrency() / 2));
+    RenderQueue renderQueue(threadPool, 20.0f * std::max(options.boardWidth, options.boardHeight) * tileWidth);
+    renderQueue.setInstancedVariant(shader, meshShaders.get(MESH_INSTANCED));
+    TransformRing transformRing(1024);
+    renderQueue.setTransformRing(&transformRing);
+
+    SkinnedRenderer skinnedRenderer(threadPool, characterMesh.vao);
+    GLuint skinnedShader = meshShaders.get(MESH_SKINNED);
+    TransformRing boneRing(options.characterCount * characterPartCount);
+    skinnedRenderer.setTransformRing(&boneRing);
+
+    // Routes are found on the board's tiles, from stops picked with a fixed seed, so every run is the same
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> tileX(0, int(options.boardWidth) - 1);
+    std::uniform_int_distribution<int> tileY(0, int(options.boardHeight) - 1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    TileGrid grid(options.boardWidth, options.boardHeight);
+    Pathfinder pathfinder(grid, simulationThreadPool);
+    Animator animator(simulationThreadPool);
+    Crowd crowd(simulationThreadPool, tileWidth);
+    AnimationClip walkCycleClip = createWalkCycleClip();
+    unsigned int walkCycle = animator.addClip(walkCycleClip);
+
+    std::vector<Path> routes;
+    for (unsigned int route = 0; route < routeCount; route++) {
+        std::vector<int2> stops(stopsPerRoute);
+        for (int2 &stop : stops) {
+            stop.x = tileX(generator);
+            stop.y = tileY(generator);
+        }
+        std::vector<int2> waypoints;
+        if (pathfinder.findRoute(stops, waypoints)) {
+            crowd.addPath(Path(waypoints));
+            routes.push_back(Path(waypoints));
+        }
+    }
+    if (routes.empty()) {
+        fprintf(stderr, "scene: no routes could be found on the board\n");
+        terrainShader.destroy();
+        return EXIT_FAILURE;
+    }
+
+    SimulationThread simulation(stepSeconds, [&](float seconds) {
+        {
+            PROFILE_SCOPE("animation");
+            animator.update(seconds);
+        }
+        {
+            PROFILE_SCOPE("path update");
+            crowd.update(seconds);
+        }
+    });
+
+    std::vector<SceneNode*> simulatedNodes;
+    std::vector<SceneNode*> renderedNodes;
+    for (unsigned int i = 0; i < options.characterCount; i++) {
+        CharacterNodes rendered = createCharacterNodes(CharacterModel());
+        CharacterNodes simulated = createCharacterNodes(CharacterModel());
+        addChild(rootNode, rendered.torso);
+
+        // Characters start spread out along their route, each at its own point in the walk cycle
+        unsigned int route = i % unsigned(routes.size());
+        std::vector<int2> const &waypoints = routes[route].getWaypoints();
+        unsigned int startWaypoint = (i / unsigned(routes.size())) % unsigned(waypoints.size());
+        simulated.torso->position = float3(float(waypoints[startWaypoint].x) * tileWidth, 0.0f,
+                                           float(waypoints[startWaypoint].y) * tileWidth);
+
+        unsigned int instance = animator.addInstance(characterAnimationTargets(simulated));
+        animator.play(instance, walkCycle, unit(generator) * walkCycleClip.getDuration());
+        crowd.addAgent(simulated.torso, route, 8.0f + 4.0f * unit(generator), startWaypoint);
+        skinnedRenderer.addInstance(characterAnimationTargets(rendered));
+
+        std::vector<SceneNode*> simulatedParts = characterAnimationTargets(simulated);
+        std::vector<SceneNode*> renderedParts = characterAnimationTargets(rendered);
+        simulatedNodes.insert(simulatedNodes.end(), simulatedParts.begin(), simulatedParts.end());
+        renderedNodes.insert(renderedNodes.end(), renderedParts.begin(), renderedParts.end());
+    }
+    simulation.addNodes(simulatedNodes, renderedNodes);
+
+    std::unique_ptr<FrameCapture> frameCapture;
+    if (!options.capturePath.empty()) {
+        frameCapture.reset(new FrameCapture(options.capturePath, windowWidth, windowHeight));
+    }
+
+    // Made again once the warmup frames are over, so only the measured frames feed its statistics
+    std::unique_ptr<FrameProfiler> profiler(new FrameProfiler(options.frameCount));
+    std::vector<double> frameMilliseconds;
+    frameMilliseconds.reserve(options.frameCount);
+
+    for (unsigned int frame = 0; frame < warmupFrameCount + options.frameCount; frame++) {
+        if (frame == warmupFrameCount) {
+            // The old profiler goes first, since only one may exist at a time
+            profiler.reset();
+            profiler.reset(new FrameProfiler(options.frameCount));
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // The simulation is stepped on this thread, exactly once per frame, for reproducible frames
+        {
+            PROFILE_SCOPE("simulation");
+            simulation.advance(1);
+            simulation.interpolate();
+        }
+
+        unsigned int cameraFrame = frame < warmupFrameCount ? 0 : frame - warmupFrameCount;
+        glm::vec3 eye = orbitCameraPosition(options, cameraFrame);
+        glm::mat4 transform = orbitCameraTransform(options, eye, aspectRatio);
+        {
+            PROFILE_SCOPE("scene traversal");
+            terrain.update(eye);
+            renderQueue.record(rootNode, transform, shader);
+            renderQueue.sort();
+        }
+        {
+            PROFILE_SCOPE("submit");
+            GpuProfileScope gpuScope(*profiler, "draw");
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            terrain.draw(terrainShader.get(), transform);
+            renderQueue.submitInstanced();
+            skinnedRenderer.submit(skinnedShader);
+        }
+        // Only measured frames are captured, so the first file shows the first frame of the orbit
+        if (frameCapture && frame >= warmupFrameCount) {
+            frameCapture->capture(window == nullptr ? getHeadlessFramebuffer() : 0);
+        }
+        if (window != nullptr) {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        {
+            // Waiting for the GPU makes each frame's time include its rendering
+            PROFILE_SCOPE("finish");
+            glFinish();
+        }
+
+        if (frame >= warmupFrameCount) {
+            frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        profiler->endFrame();
+        endGLInstrumentationFrame();
+    }
+    // Picks up the GPU times of the last frames
+    profiler->endFrame();
+    if (frameCapture) {
+        frameCapture->finish();
+    }
+
+    std::vector<double> sortedMilliseconds = frameMilliseconds;
+    std::sort(sortedMilliseconds.begin(), sortedMilliseconds.end());
+    double totalMilliseconds = 0.0;
+    for (double milliseconds : frameMilliseconds) {
+        totalMilliseconds += milliseconds;
+    }
+
+    std::vector<FILE*> outputs(1, stdout);
+    if (!options.outputFile.empty()) {
+        FILE* file = fopen(options.outputFile.c_str(), "w");
+        if (file == nullptr) {
+            fprintf(stderr, "Could not open \"%s\" to write the results\n", options.outputFile.c_str());
+        } else {
+            outputs.push_back(file);
+        }
+    }
+
+    for (FILE* output : outputs) {
+        fprintf(output, "{\n");
+        fprintf(output, "  \"benchmark\": \"scene\",\n");
+        // Driver strings are free text, and may hold quotes
+        fprintf(output, "  \"renderer\": ");
+        char const* renderer = reinterpret_cast<char const*>(glGetString(GL_RENDERER));
+        writeJsonString(output, renderer != nullptr ? renderer : "");
+        fprintf(output, ",\n");
+        fprintf(output, "  \"headless\": %s,\n", window == nullptr ? "true" : "false");
+        fprintf(output, "  \"characters\": %u,\n", options.characterCount);
+        fprintf(output, "  \"boardWidth\": %u,\n", options.boardWidth);
+        fprintf(output, "  \"boardHeight\": %u,\n", options.boardHeight);
+        fprintf(output, "  \"frames\": %u,\n", options.frameCount);
+        fprintf(output, "  \"stepSeconds\": %.6f,\n", stepSeconds);
+        fprintf(output, "  \"frameMilliseconds\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+                totalMilliseconds / double(frameMilliseconds.size()), percentile(sortedMilliseconds, 0.50),
+                percentile(sortedMilliseconds, 0.95), percentile(sortedMilliseconds, 0.99), sortedMilliseconds.back());
+        if (getGLInstrumentedFrameCount() > 0) {
+            // Every measured frame submits the same work, so the last one stands for all of them
+            GLCallCounters glCalls = getGLFrameCounters();
+            fprintf(output, "  \"glCallsPerFrame\": {\"draws\": %u, \"indirectDraws\": %u, \"triangles\": %llu, \"bytesUploaded\": %llu, "
+                    "\"programBinds\": %u, \"vertexArrayBinds\": %u, \"bufferBinds\": %u, \"uniformUpdates\": %u},\n",
+                    glCalls.drawCalls, glCalls.indirectDrawCalls, (unsigned long long) glCalls.triangles,
+                    (unsigned long long) glCalls.bufferBytesUploaded, glCalls.programBinds, glCalls.vertexArrayBinds,
+                    glCalls.bufferBinds, glCalls.uniformUpdates);
+        }
+        TerrainStats const &terrainStats = terrain.getStats();
+        fprintf(output, "  \"terrain\": {\"residentChunks\": %u, \"residentBytes\": %llu, \"deferredChunks\": %u, "
+                "\"drawnChunks\": %u, \"drawnTriangles\": %llu},\n",
+                terrainStats.residentChunkCount, (unsigned long long) terrainStats.residentBytes, terrainStats.deferredChunkCount,
+                terrainStats.drawnChunkCount, (unsigned long long) terrainStats.drawnTriangleCount);
+        if (frameCapture) {
+            FrameCaptureStats captureStats = frameCapture->getStats();
+            fprintf(output, "  \"capture\": {\"captured\": %u, \"dropped\": %u, \"written\": %u, \"failed\": %u, "
+                    "\"meanMilliseconds\": %.4f, \"maxMilliseconds\": %.4f},\n",
+                    captureStats.capturedFrameCount, captureStats.droppedFrameCount, captureStats.writtenFrameCount,
+                    captureStats.failedFrameCount, captureStats.totalCaptureMilliseconds / double(options.frameCount),
+                    captureStats.maximumCaptureMilliseconds);
+        }
+        fprintf(output, "  \"phases\": [");
+        std::vector<ProfileScopeStats> phases = profiler->getStats();
+        for (size_t i = 0; i < phases.size(); i++) {
+            fprintf(output, "%s\n    {\"name\": ", i == 0 ? "" : ",");
+            writeJsonString(output, phases[i].name);
+            fprintf(output, ", \"type\": \"%s\", \"meanMilliseconds\": %.4f, \"maxMilliseconds\": %.4f}",
+                    phases[i].isGpu ? "gpu" : "cpu", phases[i].averageMilliseconds, phases[i].maximumMilliseconds);
+        }
+        fprintf(output, "\n  ]\n}\n");
+    }
+    for (size_t i = 1; i < outputs.size(); i++) {
+        fclose(outputs[i]);
+    }
+
+    simulation.stop();
+    terrainShader.destroy();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+#include "sceneFile.hpp"
+#include "mappedFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <utility>
+
+static const char sceneFileMagic[4] = { 'G', 'S', 'C', 'N' };
+
+bool writeSceneFile(std::string const &filePath, SceneNode* rootNode, MeshCache const &meshCache) {
+    std::vector<SceneFileNode> nodes;
+    std::vector<SceneFileMesh> meshes;
+    std::string strings;
+    std::unordered_map<std::string, int32_t> meshIndices;
+
+    // Pre-order traversal with an explicit stack, since scene graphs can be deeper than the call stack
+    std::vector<std::pair<SceneNode*, int32_t>> stack;
+    stack.push_back(std::make_pair(rootNode, -1));
+    while (!stack.empty()) {
+        SceneNode* node = stack.back().first;
+        int32_t parent = stack.back().second;
+        stack.pop_back();
+
+        SceneFileNode fileNode;
+        fileNode.parent = parent;
+        fileNode.mesh = -1;
+        fileNode.flags = (node->isTransparent ? sceneFileNodeTransparent : 0) | (node->isOccluder ? sceneFileNodeOccluder : 0);
+        fileNode.position[0] = node->position.x;
+        fileNode.position[1] = node->position.y;
+        fileNode.position[2] = node->position.z;
+        fileNode.rotation[0] = node->rotation.x;
+        fileNode.rotation[1] = node->rotation.y;
+        fileNode.rotation[2] = node->rotation.z;
+        fileNode.scale[0] = node->scale.x;
+        fileNode.scale[1] = node->scale.y;
+        fileNode.scale[2] = node->scale.z;
+        fileNode.referencePoint[0] = node->referencePoint.x;
+        fileNode.referencePoint[1] = node->referencePoint.y;
+        fileNode.referencePoint[2] = node->referencePoint.z;
+
+        std::string const* reference = meshCache.findReference(node);
+        if (reference != nullptr) {
+            std::unordered_map<std::string, int32_t>::const_iterator known = meshIndices.find(*reference);
+            if (known == meshIndices.end()) {
+                SceneFileMesh mesh;
+                mesh.nameOffset = uint32_t(strings.size());
+                mesh.nameLength = uint32_t(reference->size());
+                strings += *reference;
+                known = meshIndices.insert(std::make_pair(*reference, int32_t(meshes.size()))).first;
+                meshes.push_back(mesh);
+            }
+            fileNode.mesh = known->second;
+        } else if (node->vertexArrayObjectID != -1 || node->arenaMeshID != -1) {
+            fprintf(stderr, "Scene node with VAO %i / arena mesh %i has no mesh reference, writing it without a mesh\n",
+                    node->vertexArrayObjectID, node->arenaMeshID);
+        }
+
+        int32_t index = int32_t(nodes.size());
+        nodes.push_back(fileNode);
+
+        // Pushed in reverse so children are written in their original order
+        for (size_t i = node->children.size(); i > 0; i--) {
+            stack.push_back(std::make_pair(node->children[i - 1], index));
+        }
+    }
+
+    // Pad the string table so a file can be appended to later without breaking alignment
+    while (strings.size() % 4 != 0) {
+        strings.push_back('\0');
+    }
+
+    SceneFileHeader header;
+    std::memcpy(header.magic, sceneFileMagic, sizeof(header.magic));
+    header.version = sceneFileVersion;
+    header.nodeCount = uint32_t(nodes.size());
+    header.meshCount = uint32_t(meshes.size());
+    header.stringBytes = uint32_t(strings.size());
+    header.reserved = 0;
+
+    std::ofstream outputFile(filePath, std::ios::binary | std::ios::trunc);
+    if (!outputFile) {
+        fprintf(stderr, "Could not open \"%s\" for writing\n", filePath.c_str());
+        return false;
+    }
+    outputFile.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    outputFile.write(reinterpret_cast<char const*>(nodes.data()), nodes.size() * sizeof(SceneFileNode));
+    outputFile.write(reinterpret_cast<char const*>(meshes.data()), meshes.size() * sizeof(SceneFileMesh));
+    outputFile.write(strings.data(), strings.size());
+    return bool(outputFile);
+}
+
+bool loadSceneFile(std::string const &filePath, MeshCache &meshCache, LoadedScene &scene) {
+    MappedFile file;
+    if (!file.open(filePath)) {
+        fprintf(stderr, "Could not open scene file \"%s\"\n", filePath.c_str());
+        return false;
+    }
+
+    // Validate everything before touching the contents, so a truncated or corrupt file can't crash us
+    SceneFileHeader const* header = reinterpret_cast<SceneFileHeader const*>(file.data());
+    if (file.size() < sizeof(SceneFileHeader)
+            || std::memcmp(header->magic, sceneFileMagic, sizeof(header->magic)) != 0
+            || header->version != sceneFileVersion) {
+        fprintf(stderr, "\"%s\" is not a version %u scene file\n", filePath.c_str(), sceneFileVersion);
+        return false;
+    }
+    uint64_t expectedSize = sizeof(SceneFileHeader)
+                          + uint64_t(header->nodeCount) * sizeof(SceneFileNode)
+                          + uint64_t(header->meshCount) * sizeof(SceneFileMesh)
+                          + header->stringBytes;
+    if (file.size() < expectedSize || header->nodeCount == 0) {
+        fprintf(stderr, "Scene file \"%s\" is truncated\n", filePath.c_str());
+        return false;
+    }
+
+    SceneFileNode const* fileNodes = reinterpret_cast<SceneFileNode const*>(file.data() + sizeof(SceneFileHeader));
+    SceneFileMesh const* fileMeshes = reinterpret_cast<SceneFileMesh const*>(fileNodes + header->nodeCount);
+    char const* strings = reinterpret_cast<char const*>(fileMeshes + header->meshCount);
+
+    // The mesh table is small (one entry per distinct mesh), so resolving it up front is cheap
+    std::vector<MeshVAO> meshes(header->meshCount);
+    for (uint32_t i = 0; i < header->meshCount; i++) {
+        if (uint64_t(fileMeshes[i].nameOffset) + fileMeshes[i].nameLength > header->stringBytes) {
+            fprintf(stderr, "Scene file \"%s\" has a mesh reference outside its string table\n", filePath.c_str());
+            return false;
+        }
+        meshes[i] = meshCache.get(std::string(strings + fileMeshes[i].nameOffset, fileMeshes[i].nameLength));
+    }
+
+    // Count children first, so each children list is allocated exactly once
+    std::vector<uint32_t> childCounts(header->nodeCount, 0);
+    for (uint32_t i = 0; i < header->nodeCount; i++) {
+        int32_t parent = fileNodes[i].parent;
+        bool isParentValid = i == 0 ? parent == -1 : parent >= 0 && uint32_t(parent) < i;
+        if (!isParentValid || fileNodes[i].mesh >= int32_t(header->meshCount)) {
+            fprintf(stderr, "Scene file \"%s\" has an invalid node %u\n", filePath.c_str(), i);
+            return false;
+        }
+        if (i > 0) {
+            childCounts[parent]++;
+        }
+    }
+
+    scene.nodes.clear();
+    scene.nodes.resize(header->nodeCount);
+    for (uint32_t i = 0; i < header->nodeCount; i++) {
+        SceneFileNode const &fileNode = fileNodes[i];
+        SceneNode &node = scene.nodes[i];
+
+        node.position = float3(fileNode.position[0], fileNode.position[1], fileNode.position[2]);
+        node.rotation = float3(fileNode.rotation[0], fileNode.rotation[1], fileNode.rotation[2]);
+        node.scale = float3(fileNode.scale[0], fileNode.scale[1], fileNode.scale[2]);
+        node.referencePoint = float3(fileNode.referencePoint[0], fileNode.referencePoint[1], fileNode.referencePoint[2]);
+        node.isTransparent = (fileNode.flags & sceneFileNodeTransparent) != 0;
+        node.isOccluder = (fileNode.flags & sceneFileNodeOccluder) != 0;
+        if (fileNode.mesh >= 0) {
+            MeshVAO const &mesh = meshes[fileNode.mesh];
+            node.vertexArrayObjectID = mesh.vertexArrayObjectID;
+            node.arenaMeshID = mesh.arenaMeshID;
+            node.VAOIndexCount = mesh.indexCount;
+            node.boundsMin = mesh.boundsMin;
+            node.boundsMax = mesh.boundsMax;
+        }
+        if (childCounts[i] > 0) {
+            node.children.reserve(childCounts[i]);
+        }
+        if (i > 0) {
+            scene.nodes[fileNode.parent].children.push_back(&node);
+        }
+    }
+    return true;
+}
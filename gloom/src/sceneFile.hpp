@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "meshCache.hpp"
+#include "sceneGraph.hpp"
+
+// Binary scene files store a scene graph as flat arrays, so that loading is a single mmap followed by
+// one pass over the nodes. All values are little-endian and every section starts 4-byte aligned:
+//
+//     SceneFileHeader
+//     SceneFileNode[nodeCount]    in pre-order, so every parent comes before its children
+//     SceneFileMesh[meshCount]
+//     char[stringBytes]           mesh references (see MeshCache), not null-terminated
+//
+// Node 0 is the root.
+const uint32_t sceneFileVersion = 2;
+
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t meshCount;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+const uint32_t sceneFileNodeTransparent = 1;
+const uint32_t sceneFileNodeOccluder = 2;
+
+struct SceneFileNode {
+    int32_t parent;     // Index of the parent node, -1 for the root
+    int32_t mesh;       // Index into the mesh table, -1 if the node draws nothing
+    uint32_t flags;     // sceneFileNode* flags
+    float position[3];
+    float rotation[3];
+    float scale[3];
+    float referencePoint[3];
+};
+
+struct SceneFileMesh {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+// The nodes of a loaded scene live in one contiguous block; nodes[0] is the root.
+// The children of each node point into the same block, so it must not be resized afterwards.
+struct LoadedScene {
+    std::vector<SceneNode> nodes;
+
+    SceneNode* root() { return nodes.empty() ? nullptr : &nodes.front(); }
+};
+
+// Writes the graph below rootNode to a scene file. Meshes are stored as the references
+// meshCache knows them by; nodes drawing a mesh the cache does not know are written without one.
+bool writeSceneFile(std::string const &filePath, SceneNode* rootNode, MeshCache const &meshCache);
+
+// Loads a scene file into scene, resolving its mesh references through meshCache.
+// Apart from the block of nodes and the children lists, nothing is allocated per node.
+bool loadSceneFile(std::string const &filePath, MeshCache &meshCache, LoadedScene &scene);
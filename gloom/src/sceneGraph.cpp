@@ -1,4 +1,5 @@
 #include "sceneGraph.hpp"
+#include "transform.hpp"
 #include <iostream>
 
 // --- Matrix Stack related functions ---
@@ -49,6 +50,20 @@ void addChild(SceneNode* parent, SceneNode* child) {
 	parent->children.push_back(child);
 }
 
+// Scales and rotates the node around its reference point, then moves it to its position relative to its parent.
+// The rotation is applied around X, then Y, then Z. Building it as a quaternion and a 3x4 affine matrix
+// takes a fraction of the work of multiplying out the equivalent seven 4x4 matrices.
+void updateNodeTransform(SceneNode* node, glm::mat4 const &transformationThusFar) {
+	Affine3x4 localTransform = composeAffine(node->position, quaternionFromEulerDegrees(node->rotation), node->referencePoint, node->scale);
+	node->currentTransformationMatrix = multiplyMatrixAffine(transformationThusFar, localTransform);
+}
+
+void updateNodeTransform(SceneNode* node, glm::mat4 const &transformationThusFar, glm::mat4 const &modelThusFar) {
+	Affine3x4 localTransform = composeAffine(node->position, quaternionFromEulerDegrees(node->rotation), node->referencePoint, node->scale);
+	node->currentTransformationMatrix = multiplyMatrixAffine(transformationThusFar, localTransform);
+	node->currentModelMatrix = multiplyMatrixAffine(modelThusFar, localTransform);
+}
+
 // Pretty prints the current values of a SceneNode instance to stdout
 void printNode(SceneNode* node) {
 	printf(
@@ -31,10 +31,17 @@ typedef struct SceneNode {
 	SceneNode() {
 		position = float3(0, 0, 0);
 		rotation = float3(0, 0, 0);
+		scale = float3(1, 1, 1);
 
         referencePoint = float3(0, 0, 0);
         vertexArrayObjectID = -1;
         VAOIndexCount = 0;
+        arenaMeshID = -1;
+        shaderProgramID = -1;
+        isTransparent = false;
+        boundsMin = float3(1, 1, 1);
+        boundsMax = float3(-1, -1, -1);
+        isOccluder = false;
 	}
 
 	// A list of all children that belong to this node.
@@ -44,16 +51,40 @@ typedef struct SceneNode {
 	// The node's position and rotation relative to its parent
 	float3 position;
 	float3 rotation;
+	// Scale along the node's own axes, applied around the reference point before rotating
+	float3 scale;
 
 	// A transformation matrix representing the transformation of the node's location relative to its parent. This matrix is updated every frame.
 	glm::mat4 currentTransformationMatrix;
 
+	// The node's transformation into world space, without the view and projection in currentTransformationMatrix.
+	// Only kept up to date by the overload of updateNodeTransform() which takes it, for lit programs.
+	glm::mat4 currentModelMatrix;
+
 	// The location of the node's reference point
 	float3 referencePoint;
 
 	// The ID of the VAO containing the "appearance" of this SceneNode.
 	int vertexArrayObjectID;
 	unsigned int VAOIndexCount;
+
+	// Alternatively, the ID of the node's mesh in the renderer's GeometryArena (-1 if it has none)
+	int arenaMeshID;
+
+	// The shader program used to draw this node. -1 means the renderer's default program.
+	int shaderProgramID;
+
+	// Transparent nodes are drawn after all opaque ones, sorted back to front, so blending works.
+	bool isTransparent;
+
+	// The bounding box of the node's mesh in model space, empty (boundsMin above boundsMax) if unknown.
+	// Nodes with an empty box are never culled.
+	float3 boundsMin;
+	float3 boundsMax;
+
+	// Occluders are rasterized into the occlusion culler's depth buffer, to hide the nodes behind them.
+	// Only set this for nodes whose mesh fills its bounding box.
+	bool isOccluder;
 } SceneNode;
 
 // Struct for keeping track of 2D coordinates
@@ -63,5 +94,12 @@ SceneNode* createSceneNode();
 void addChild(SceneNode* parent, SceneNode* child);
 void printNode(SceneNode* node);
 
+// Recomputes node->currentTransformationMatrix from the node's position, rotation, scale and reference point,
+// given the accumulated transformation of its parent.
+void updateNodeTransform(SceneNode* node, glm::mat4 const &transformationThusFar);
+
+// Like the above, but also recomputes node->currentModelMatrix, given its parent's
+void updateNodeTransform(SceneNode* node, glm::mat4 const &transformationThusFar, glm::mat4 const &modelThusFar);
+
 
 // For more details, see SceneGraph.cpp.
\ No newline at end of file
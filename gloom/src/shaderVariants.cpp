@@ -0,0 +1,41 @@
+#include "shaderVariants.hpp"
+#include "gloom/shader.hpp"
+#include "profiler.hpp"
+
+#include <cstdio>
+
+std::vector<std::string> meshShaderFeatureNames() {
+    return {"INSTANCED", "INDIRECT", "SKINNED", "LIT", "TEXTURED"};
+}
+
+ShaderVariants::ShaderVariants(std::vector<std::string> const &files, std::vector<std::string> const &featureNames)
+    : files(files), featureNames(featureNames) {
+    if (featureNames.size() > 32) {
+        fprintf(stderr, "A shader can have at most 32 features, the last %u are ignored\n", unsigned(featureNames.size() - 32));
+        this->featureNames.resize(32);
+    }
+}
+
+GLuint ShaderVariants::get(unsigned int variant) {
+    auto existing = programs.find(variant);
+    if (existing != programs.end()) {
+        return existing->second.get();
+    }
+
+    PROFILE_SCOPE("compile shader variant");
+    std::string defines;
+    for (size_t i = 0; i < featureNames.size(); i++) {
+        if ((variant >> i) & 1) {
+            defines += "#define " + featureNames[i] + " 1\n";
+        }
+    }
+    Gloom::Shader shader;
+    for (std::string const &file : files) {
+        shader.attach(file, defines);
+    }
+    shader.link();
+
+    GLuint program = shader.get();
+    programs.emplace(variant, GpuProgram(program));
+    return program;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gpuResources.hpp"
+
+// The features of mesh.vert, as bits of a variant. Without any, the transformation comes from the uniform at location 5.
+enum MeshShaderFeature : unsigned int {
+    // Per instance transformations from the buffer at binding 0, for RenderQueue::submitInstanced()
+    MESH_INSTANCED = 1 << 0,
+    // Per draw transformations from the buffer at binding 0, for multi-draws from the geometry arena
+    MESH_INDIRECT = 1 << 1,
+    // Per bone transformations from the palette at binding 1, for SkinnedRenderer
+    MESH_SKINNED = 1 << 2,
+    // Lit by ClusteredLighting, using the normals in attribute 5. Combines with any of the above.
+    MESH_LIT = 1 << 3,
+    // Coloured by the texture bound to unit 0, at the texture coordinates in attribute 2. Combines with any of the above.
+    MESH_TEXTURED = 1 << 4,
+};
+
+// The #defines turning on each MeshShaderFeature, in bit order
+std::vector<std::string> meshShaderFeatureNames();
+
+// Every combination of a set of features of one set of shader files, each compiled into its own program.
+//
+// A variant is a bitmask: bit i defines the i-th feature name in every file before compiling, so code
+// for features a variant does not use is removed by the preprocessor rather than skipped at runtime.
+// Variants are compiled the first time they are asked for and kept until the ShaderVariants is destroyed,
+// so only combinations which are actually drawn with are ever compiled.
+class ShaderVariants {
+public:
+    // The files are attached together, e.g. {"mesh.vert", "simple.frag"}. At most 32 features.
+    ShaderVariants(std::vector<std::string> const &files, std::vector<std::string> const &featureNames);
+    // The programs are deleted along with the ShaderVariants, so the GL context has to be current
+
+    // The program of the given variant, compiling it if this is the first time it is used
+    GLuint get(unsigned int variant);
+
+    size_t getCompiledCount() const { return programs.size(); }
+
+private:
+    std::vector<std::string> files;
+    std::vector<std::string> featureNames;
+    std::unordered_map<unsigned int, GpuProgram> programs;
+
+    ShaderVariants(ShaderVariants const &) = delete;
+    ShaderVariants & operator =(ShaderVariants const &) = delete;
+};
@@ -0,0 +1,177 @@
+#include "simulation.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// If the simulation falls further behind than this many steps (say, while the window is being dragged),
+// it skips ahead instead of trying to catch up, which would only make it fall further behind
+static const uint64_t maximumCatchUpSteps = 5;
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static NodeState captureState(SceneNode const* node) {
+    NodeState state;
+    state.position = node->position;
+    state.rotation = node->rotation;
+    state.scale = node->scale;
+    return state;
+}
+
+static float3 lerp(float3 a, float3 b, float t) {
+    return float3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+// Rotations are in degrees and may wrap around (headings jump from 180 to -180), so blend along the shorter way
+static float lerpDegrees(float a, float b, float t) {
+    float difference = b - a;
+    difference -= 360.0f * std::round(difference / 360.0f);
+    return a + difference * t;
+}
+
+SimulationThread::SimulationThread(float stepSeconds, std::function<void(float)> const &step)
+    : stepSeconds(stepSeconds), stepFunction(step), sharedSlot(2), isStopping(false), clockOriginNanoseconds(0),
+      publishedStepCount(0), skippedStepCount(0), stepNanoseconds(0) {}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::addNodes(std::vector<SceneNode*> const &simulated, std::vector<SceneNode*> const &rendered) {
+    if (isRunning()) {
+        fprintf(stderr, "SimulationThread: nodes cannot be added while the simulation is running\n");
+        return;
+    }
+    if (simulated.size() != rendered.size()) {
+        fprintf(stderr, "SimulationThread: %zu simulated nodes given for %zu rendered ones\n", simulated.size(), rendered.size());
+        return;
+    }
+
+    simulatedNodes.insert(simulatedNodes.end(), simulated.begin(), simulated.end());
+    renderedNodes.insert(renderedNodes.end(), rendered.begin(), rendered.end());
+    for (SceneNode* node : simulated) {
+        lastStates.push_back(captureState(node));
+    }
+
+    // Until the first step, every slot shows the nodes as they are now.
+    // Nothing else is running, so the slots can be written directly.
+    for (Snapshot &snapshot : slots) {
+        snapshot.previous = lastStates;
+        snapshot.current = lastStates;
+    }
+}
+
+void SimulationThread::step() {
+    int64_t start = nowNanoseconds();
+
+    Snapshot &snapshot = slots[writeSlot];
+    snapshot.previous = lastStates;
+    stepFunction(stepSeconds);
+
+    snapshot.current.resize(simulatedNodes.size());
+    for (size_t i = 0; i < simulatedNodes.size(); i++) {
+        snapshot.current[i] = captureState(simulatedNodes[i]);
+    }
+    lastStates = snapshot.current;
+    stepCount++;
+    snapshot.stepIndex = stepCount;
+
+    // Publish the snapshot and take whichever slot the renderer is not using in exchange
+    writeSlot = sharedSlot.exchange(writeSlot | freshSnapshotBit, std::memory_order_acq_rel) & ~freshSnapshotBit;
+
+    publishedStepCount.store(stepCount, std::memory_order_relaxed);
+    stepNanoseconds.store(nowNanoseconds() - start, std::memory_order_relaxed);
+}
+
+void SimulationThread::advance(unsigned int steps) {
+    if (isRunning()) {
+        fprintf(stderr, "SimulationThread: cannot advance the simulation by hand while its thread is running\n");
+        return;
+    }
+    for (unsigned int i = 0; i < steps; i++) {
+        step();
+    }
+}
+
+void SimulationThread::start() {
+    if (isRunning()) {
+        return;
+    }
+    int64_t stepLength = int64_t(double(stepSeconds) * 1e9);
+    // Pick the clock so the renderer, trailing by a step, starts out at the latest state, and the next step is due now
+    clockOriginNanoseconds.store(nowNanoseconds() - int64_t(stepCount + 1) * stepLength);
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (!isRunning()) {
+        return;
+    }
+    isStopping.store(true);
+    thread.join();
+    isStopping.store(false);
+}
+
+void SimulationThread::run() {
+    setProfilerThreadName("simulation");
+    int64_t stepLength = int64_t(double(stepSeconds) * 1e9);
+
+    while (!isStopping.load(std::memory_order_relaxed)) {
+        int64_t origin = clockOriginNanoseconds.load(std::memory_order_relaxed);
+        uint64_t dueStepCount = uint64_t(std::max(nowNanoseconds() - origin, int64_t(0)) / stepLength);
+
+        if (dueStepCount > stepCount + maximumCatchUpSteps) {
+            uint64_t skippedSteps = dueStepCount - stepCount - 1;
+            origin += int64_t(skippedSteps) * stepLength;
+            clockOriginNanoseconds.store(origin, std::memory_order_relaxed);
+            skippedStepCount.fetch_add(skippedSteps, std::memory_order_relaxed);
+            dueStepCount = stepCount + 1;
+        }
+
+        while (stepCount < dueStepCount && !isStopping.load(std::memory_order_relaxed)) {
+            PROFILE_SCOPE("simulation step");
+            step();
+        }
+
+        std::chrono::nanoseconds nextStepTime(origin + int64_t(stepCount + 1) * stepLength);
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(nextStepTime)));
+    }
+}
+
+void SimulationThread::interpolate() {
+    if (sharedSlot.load(std::memory_order_relaxed) & freshSnapshotBit) {
+        readSlot = sharedSlot.exchange(readSlot, std::memory_order_acq_rel) & ~freshSnapshotBit;
+    }
+    Snapshot const &snapshot = slots[readSlot];
+
+    // Rendering trails the simulation by one step: previous is the state at step - 1, current the one at step
+    float blend = 1.0f;
+    if (isRunning()) {
+        double stepLength = double(stepSeconds) * 1e9;
+        double renderStep = double(nowNanoseconds() - clockOriginNanoseconds.load(std::memory_order_relaxed)) / stepLength - 1.0;
+        blend = float(std::min(std::max(renderStep - (double(snapshot.stepIndex) - 1.0), 0.0), 1.0));
+    }
+
+    for (size_t i = 0; i < renderedNodes.size(); i++) {
+        NodeState const &previous = snapshot.previous[i];
+        NodeState const &current = snapshot.current[i];
+        SceneNode* node = renderedNodes[i];
+        node->position = lerp(previous.position, current.position, blend);
+        node->rotation = float3(lerpDegrees(previous.rotation.x, current.rotation.x, blend),
+                                lerpDegrees(previous.rotation.y, current.rotation.y, blend),
+                                lerpDegrees(previous.rotation.z, current.rotation.z, blend));
+        node->scale = lerp(previous.scale, current.scale, blend);
+    }
+}
+
+SimulationStats SimulationThread::getStats() const {
+    SimulationStats stats;
+    stats.stepCount = publishedStepCount.load(std::memory_order_relaxed);
+    stats.skippedStepCount = skippedStepCount.load(std::memory_order_relaxed);
+    stats.stepMilliseconds = double(stepNanoseconds.load(std::memory_order_relaxed)) / 1e6;
+    return stats;
+}
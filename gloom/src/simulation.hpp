@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "floats.hpp"
+#include "sceneGraph.hpp"
+
+// The part of a scene node the simulation changes
+struct NodeState {
+    float3 position;
+    float3 rotation;
+    float3 scale;
+};
+
+struct SimulationStats {
+    uint64_t stepCount = 0;
+    // Steps dropped because the simulation fell too far behind to catch up
+    uint64_t skippedStepCount = 0;
+    double stepMilliseconds = 0.0;
+};
+
+// Runs the simulation (animation, path following, ...) on a thread of its own, in fixed steps,
+// while the render thread draws the state it last published.
+//
+// The simulation works on scene nodes of its own, which are not part of the rendered scene graph.
+// After every step it copies their states into a snapshot, holding both the previous and the new state.
+// Snapshots are passed to the renderer through a triple buffer, so neither side ever waits for the other.
+// Each frame, interpolate() blends the latest snapshot's two states for the current time and writes the
+// result into the rendered nodes. Rendering trails the simulation by one step, so there is always a
+// pair of states to blend between and motion stays smooth whatever the frame rate.
+//
+// With a fixed step size, the simulated states depend only on the number of steps taken,
+// not on how fast frames happen to be drawn.
+class SimulationThread {
+public:
+    // step(stepSeconds) advances the simulated nodes by one step. It runs on the simulation thread,
+    // so anything it uses (including thread pools) must not be used by the render thread.
+    SimulationThread(float stepSeconds, std::function<void(float)> const &step);
+    ~SimulationThread();
+
+    // Mirrors the state of each simulated node into the rendered node at the same index.
+    // Nodes can only be added before the thread is started.
+    void addNodes(std::vector<SceneNode*> const &simulated, std::vector<SceneNode*> const &rendered);
+
+    void start();
+    void stop();
+    bool isRunning() const { return thread.joinable(); }
+
+    // Takes stepCount steps on the calling thread, as fast as possible. Only while the thread is not running.
+    void advance(unsigned int stepCount);
+
+    // Writes the simulated state at the current time into the rendered nodes. Call from the render thread,
+    // before traversing the scene. Without the thread running, the latest state is used as is.
+    void interpolate();
+
+    float getStepSeconds() const { return stepSeconds; }
+    SimulationStats getStats() const;
+
+private:
+    struct Snapshot {
+        std::vector<NodeState> previous;
+        std::vector<NodeState> current;
+        uint64_t stepIndex = 0;
+    };
+
+    void run();
+    void step();
+
+    float stepSeconds;
+    std::function<void(float)> stepFunction;
+
+    std::vector<SceneNode*> simulatedNodes;
+    std::vector<SceneNode*> renderedNodes;
+    std::vector<NodeState> lastStates;
+
+    // The triple buffer. The simulation writes writeSlot, the renderer reads readSlot, and sharedSlot holds
+    // the third one, with freshSnapshotBit set when it holds a snapshot the renderer has not seen yet.
+    static const unsigned int freshSnapshotBit = 4;
+    Snapshot slots[3];
+    unsigned int writeSlot = 0;
+    unsigned int readSlot = 1;
+    std::atomic<unsigned int> sharedSlot;
+
+    std::thread thread;
+    std::atomic<bool> isStopping;
+    // Step n of the running thread is due at clockOrigin + n steps, in steady_clock nanoseconds
+    std::atomic<int64_t> clockOriginNanoseconds;
+
+    uint64_t stepCount = 0;
+    std::atomic<uint64_t> publishedStepCount;
+    std::atomic<uint64_t> skippedStepCount;
+    std::atomic<int64_t> stepNanoseconds;
+
+    SimulationThread(SimulationThread const &) = delete;
+    SimulationThread & operator =(SimulationThread const &) = delete;
+};
@@ -0,0 +1,143 @@
+#include "skinnedMesh.hpp"
+#include "transform.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+// Palette matrices are gathered by the thread pool in chunks of this many instances
+static const size_t instancesPerJob = 512;
+
+bool uploadSkinnedMesh(Mesh const &mesh, unsigned int boneCount, GpuResourceManager &resources, GpuSkinnedMesh &skinnedMesh) {
+    skinnedMesh = GpuSkinnedMesh();
+    if (mesh.boneIndices.size() != mesh.vertices.size()) {
+        fprintf(stderr, "Mesh \"%s\" has %zu bone indices for %zu vertices, not uploading it as a skinned mesh\n",
+                mesh.name.c_str(), mesh.boneIndices.size(), mesh.vertices.size());
+        return false;
+    }
+
+    skinnedMesh.vertexArray = resources.createVertexArray();
+    glBindVertexArray(skinnedMesh.vertexArray.get());
+
+    skinnedMesh.positions = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.vertices.size() * sizeof(float4), mesh.vertices.data());
+    if (!skinnedMesh.positions.isEmpty()) {
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+        glEnableVertexAttribArray(1);
+        skinnedMesh.colours = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.colours.size() * sizeof(float4), mesh.colours.data());
+    }
+    if (!skinnedMesh.colours.isEmpty()) {
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+        glEnableVertexAttribArray(4);
+        skinnedMesh.boneIndices = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.boneIndices.size() * sizeof(unsigned int), mesh.boneIndices.data());
+    }
+    if (!skinnedMesh.boneIndices.isEmpty()) {
+        // Integer attributes need the I variant, or the shader would see the index converted to a float
+        glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, 0, (void*) 0);
+        glEnableVertexAttribArray(6);
+        // Bound while the VAO is, so the VAO remembers it
+        skinnedMesh.indices = resources.createBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMemoryIndices, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data());
+    }
+    if (skinnedMesh.indices.isEmpty()) {
+        glBindVertexArray(0);
+        skinnedMesh = GpuSkinnedMesh();
+        return false;
+    }
+
+    // For lit programs. Without normals, attribute 5 reads as zero and the faces' normals are used instead.
+    if (mesh.normals.size() == mesh.vertices.size()) {
+        skinnedMesh.normals = resources.createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, mesh.normals.size() * sizeof(float3), mesh.normals.data());
+        if (!skinnedMesh.normals.isEmpty()) {
+            glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+            glEnableVertexAttribArray(5);
+        }
+    }
+
+    glBindVertexArray(0);
+
+    skinnedMesh.vao.vertexArrayObjectID = int(skinnedMesh.vertexArray.get());
+    skinnedMesh.vao.indexCount = unsigned(mesh.indices.size());
+    skinnedMesh.vao.boneCount = boneCount;
+    return true;
+}
+
+SkinnedRenderer::SkinnedRenderer(ThreadPool &pool, SkinnedMeshVAO const &mesh) : pool(pool), mesh(mesh) {}
+
+SkinnedRenderer::~SkinnedRenderer() {
+    if (paletteBuffer != 0) {
+        glDeleteBuffers(1, &paletteBuffer);
+    }
+    if (objectSpaceBuffer != 0) {
+        glDeleteBuffers(1, &objectSpaceBuffer);
+    }
+}
+
+int SkinnedRenderer::addInstance(std::vector<SceneNode*> const &instanceBones) {
+    if (mesh.boneCount == 0 || instanceBones.size() != mesh.boneCount) {
+        fprintf(stderr, "Skinned instance has %zu bones, but its mesh has %u\n", instanceBones.size(), mesh.boneCount);
+        return -1;
+    }
+    bones.insert(bones.end(), instanceBones.begin(), instanceBones.end());
+    return int(getInstanceCount() - 1);
+}
+
+void SkinnedRenderer::setTransformRing(TransformRing* ring) {
+    transformRing = ring;
+}
+
+void SkinnedRenderer::setLitProgram(GLuint program) {
+    litProgram = program;
+}
+
+void SkinnedRenderer::submit(GLuint program) {
+    if (bones.empty() || mesh.vertexArrayObjectID == -1) {
+        return;
+    }
+
+    bool lit = program == litProgram;
+    palette.resize(bones.size());
+    if (lit) {
+        objectSpaces.resize(2 * bones.size());
+    }
+    size_t instanceCount = getInstanceCount();
+    size_t jobCount = (instanceCount + instancesPerJob - 1) / instancesPerJob;
+    pool.parallelFor(jobCount, [this, lit](size_t job, unsigned int) {
+        size_t first = job * instancesPerJob * mesh.boneCount;
+        size_t end = std::min(first + instancesPerJob * mesh.boneCount, bones.size());
+        for (size_t i = first; i < end; i++) {
+            palette[i] = bones[i]->currentTransformationMatrix;
+            if (lit) {
+                objectSpaces[2 * i] = bones[i]->currentModelMatrix;
+                objectSpaces[2 * i + 1] = normalMatrix(bones[i]->currentModelMatrix);
+            }
+        }
+    });
+
+    if (lit) {
+        if (objectSpaceBuffer == 0) {
+            glGenBuffers(1, &objectSpaceBuffer);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSpaceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, objectSpaces.size() * sizeof(glm::mat4), objectSpaces.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, objectSpaceBuffer);
+    }
+
+    if (transformRing != nullptr) {
+        transformRing->write(palette);
+        transformRing->bind(1);
+    } else {
+        if (paletteBuffer == 0) {
+            glGenBuffers(1, &paletteBuffer);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, paletteBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, palette.size() * sizeof(glm::mat4), palette.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, paletteBuffer);
+    }
+
+    glUseProgram(program);
+    glUniform1ui(11, mesh.boneCount);
+    glBindVertexArray(GLuint(mesh.vertexArrayObjectID));
+    glDrawElementsInstanced(GL_TRIANGLES, GLsizei(mesh.indexCount), GL_UNSIGNED_INT, 0, GLsizei(instanceCount));
+
+    if (transformRing != nullptr) {
+        transformRing->endFrame();
+    }
+}
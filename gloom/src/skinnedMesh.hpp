@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include "gpuResources.hpp"
+#include "mesh.hpp"
+#include "sceneGraph.hpp"
+#include "threadPool.hpp"
+#include "transformRing.hpp"
+
+// A mesh made of rigid parts, each following one scene node (its "bone"), uploaded as a single VAO.
+struct SkinnedMeshVAO {
+    int vertexArrayObjectID = -1;
+    unsigned int indexCount = 0;
+    unsigned int boneCount = 0;
+};
+
+// A skinned mesh uploaded into buffers which are deleted along with the GpuSkinnedMesh, like a GpuMesh
+struct GpuSkinnedMesh {
+    SkinnedMeshVAO vao;
+    GpuVertexArray vertexArray;
+    GpuBuffer positions;
+    GpuBuffer colours;
+    GpuBuffer boneIndices;
+    GpuBuffer normals;
+    GpuBuffer indices;
+};
+
+// Uploads a mesh with Mesh::boneIndices filled in, into buffers created by the resource manager.
+// The bone index goes to attribute 6, next to the position (1) and colour (4) used by every other mesh.
+// Returns false, leaving skinnedMesh empty, if the mesh has no bone index for some vertex
+// or the buffers do not fit into the manager's budgets.
+bool uploadSkinnedMesh(Mesh const &mesh, unsigned int boneCount, GpuResourceManager &resources, GpuSkinnedMesh &skinnedMesh);
+
+// Draws any number of copies of a skinned mesh with a single instanced draw call.
+// Every frame the current transformation matrices of each instance's bones are gathered into
+// a palette buffer at binding 1, from which mesh.vert with MESH_SKINNED picks each vertex's matrix.
+// Since the matrices are those the scene graph computed, the result looks exactly like
+// drawing each part with its own node.
+class SkinnedRenderer {
+public:
+    SkinnedRenderer(ThreadPool &pool, SkinnedMeshVAO const &mesh);
+    ~SkinnedRenderer();
+
+    // Adds an instance following the given nodes, one per bone in bone index order.
+    // Returns the instance's index, or -1 if the number of nodes does not match the mesh.
+    int addInstance(std::vector<SceneNode*> const &bones);
+
+    // Writes the palette into this persistently mapped ring buffer instead of respecifying a buffer every frame.
+    // The ring must not be shared with a RenderQueue, since each ring takes one write per frame.
+    void setTransformRing(TransformRing* ring);
+
+    // Marks program as lit (mesh.vert with MESH_SKINNED and MESH_LIT). Submitting with it also gathers the bones'
+    // model and normal matrices into the storage buffer at binding 8, at the same index as in the palette.
+    // The bones' currentModelMatrix must then be kept up to date too, e.g. by a RenderQueue with a lit program.
+    void setLitProgram(GLuint program);
+
+    // Draws all instances. The bones' currentTransformationMatrix must be up to date,
+    // so call this after RenderQueue::record() (or updateNodeTransform()) for the frame.
+    void submit(GLuint program);
+
+    // 0 for a renderer of an empty SkinnedMeshVAO, which has no bones
+    unsigned int getInstanceCount() const { return mesh.boneCount == 0 ? 0 : unsigned(bones.size() / mesh.boneCount); }
+
+private:
+    ThreadPool &pool;
+    SkinnedMeshVAO mesh;
+    std::vector<SceneNode*> bones;
+    std::vector<glm::mat4> palette;
+
+    GLuint paletteBuffer = 0;
+
+    GLuint litProgram = 0;
+    std::vector<glm::mat4> objectSpaces;
+    GLuint objectSpaceBuffer = 0;
+
+    TransformRing* transformRing = nullptr;
+
+    SkinnedRenderer(SkinnedRenderer const &) = delete;
+    SkinnedRenderer & operator =(SkinnedRenderer const &) = delete;
+};
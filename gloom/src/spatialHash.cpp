@@ -0,0 +1,265 @@
+#include "spatialHash.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+// Fewer points than this are not worth another job of build()
+static const unsigned int minimumPointsPerJob = 4096;
+
+SpatialHash::SpatialHash(ThreadPool &pool, float2 minimum, float2 maximum, float cellSize)
+    : pool(pool), minimum(minimum), cellSize(cellSize) {
+    if (!(cellSize > 0.0f)) {
+        fprintf(stderr, "SpatialHash: a cell size of %f is not positive, using 1 instead\n", cellSize);
+        this->cellSize = 1.0f;
+    }
+    inverseCellSize = 1.0f / this->cellSize;
+    cellsX = unsigned(std::max(1.0f, std::ceil((maximum.x - minimum.x) * inverseCellSize)));
+    cellsZ = unsigned(std::max(1.0f, std::ceil((maximum.y - minimum.y) * inverseCellSize)));
+    cellStarts.assign(getCellCount() + 1, 0);
+}
+
+int SpatialHash::cellCoordinate(float position, float minimum, unsigned int cellCount) const {
+    // Clamped before converting, since huge positions would not fit into an int
+    float cell = std::floor((position - minimum) * inverseCellSize);
+    return int(std::min(std::max(cell, 0.0f), float(cellCount - 1)));
+}
+
+unsigned int SpatialHash::cellIndex(float x, float z) const {
+    return unsigned(cellCoordinate(z, minimum.y, cellsZ)) * cellsX + unsigned(cellCoordinate(x, minimum.x, cellsX));
+}
+
+void SpatialHash::build(float const* x, float const* z, unsigned int count) {
+    PROFILE_SCOPE("build spatial hash");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    unsigned int cellCount = getCellCount();
+    unsigned int jobCount = std::max(1u, std::min(pool.threadCount(), (count + minimumPointsPerJob - 1) / minimumPointsPerJob));
+    unsigned int pointsPerJob = (count + jobCount - 1) / jobCount;
+    pointCells.resize(count);
+    sortedPoints.resize(count);
+    jobCellCounts.resize(jobCount);
+
+    // Count the points of each job per cell
+    pool.parallelFor(jobCount, [&](size_t job, unsigned int) {
+        std::vector<unsigned int> &counts = jobCellCounts[job];
+        counts.assign(cellCount, 0);
+        unsigned int end = std::min(count, unsigned(job + 1) * pointsPerJob);
+        for (unsigned int i = unsigned(job) * pointsPerJob; i < end; i++) {
+            unsigned int cell = cellIndex(x[i], z[i]);
+            pointCells[i] = cell;
+            counts[cell]++;
+        }
+    });
+
+    // Sum the counts of each band of cells, then turn every count into where its job writes its first point of that cell.
+    // Within a cell the jobs' points follow each other in order, so the points of every cell stay sorted by index.
+    unsigned int cellsPerBand = (cellCount + jobCount - 1) / jobCount;
+    std::vector<unsigned int> bandStarts(jobCount + 1, 0);
+    pool.parallelFor(jobCount, [&](size_t band, unsigned int) {
+        unsigned int end = std::min(cellCount, unsigned(band + 1) * cellsPerBand);
+        unsigned int total = 0;
+        for (unsigned int cell = unsigned(band) * cellsPerBand; cell < end; cell++) {
+            for (unsigned int job = 0; job < jobCount; job++) {
+                total += jobCellCounts[job][cell];
+            }
+        }
+        bandStarts[band + 1] = total;
+    });
+    for (unsigned int band = 0; band < jobCount; band++) {
+        bandStarts[band + 1] += bandStarts[band];
+    }
+    std::vector<unsigned int> bandOccupiedCounts(jobCount, 0);
+    std::vector<unsigned int> bandLargestCounts(jobCount, 0);
+    pool.parallelFor(jobCount, [&](size_t band, unsigned int) {
+        unsigned int end = std::min(cellCount, unsigned(band + 1) * cellsPerBand);
+        unsigned int next = bandStarts[band];
+        for (unsigned int cell = unsigned(band) * cellsPerBand; cell < end; cell++) {
+            cellStarts[cell] = next;
+            for (unsigned int job = 0; job < jobCount; job++) {
+                unsigned int jobPointCount = jobCellCounts[job][cell];
+                jobCellCounts[job][cell] = next;
+                next += jobPointCount;
+            }
+            unsigned int pointCount = next - cellStarts[cell];
+            bandOccupiedCounts[band] += pointCount != 0 ? 1 : 0;
+            bandLargestCounts[band] = std::max(bandLargestCounts[band], pointCount);
+        }
+    });
+    cellStarts[cellCount] = count;
+
+    // Every job writes its points to their places
+    pool.parallelFor(jobCount, [&](size_t job, unsigned int) {
+        std::vector<unsigned int> &nextSlots = jobCellCounts[job];
+        unsigned int end = std::min(count, unsigned(job + 1) * pointsPerJob);
+        for (unsigned int i = unsigned(job) * pointsPerJob; i < end; i++) {
+            Point &point = sortedPoints[nextSlots[pointCells[i]]++];
+            point.x = x[i];
+            point.z = z[i];
+            point.index = i;
+        }
+    });
+
+    stats = SpatialHashStats();
+    stats.pointCount = count;
+    for (unsigned int band = 0; band < jobCount; band++) {
+        stats.occupiedCellCount += bandOccupiedCounts[band];
+        stats.largestCellCount = std::max(stats.largestCellCount, bandLargestCounts[band]);
+    }
+    stats.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SpatialHash::queryRadius(float2 center, float radius, std::vector<unsigned int> &results) const {
+    int firstX = cellCoordinate(center.x - radius, minimum.x, cellsX);
+    int lastX = cellCoordinate(center.x + radius, minimum.x, cellsX);
+    int firstZ = cellCoordinate(center.y - radius, minimum.y, cellsZ);
+    int lastZ = cellCoordinate(center.y + radius, minimum.y, cellsZ);
+    float radiusSquared = radius * radius;
+
+    for (int cellZ = firstZ; cellZ <= lastZ; cellZ++) {
+        // The cells of a row are next to each other, and so are their points
+        unsigned int row = unsigned(cellZ) * cellsX;
+        unsigned int end = cellStarts[row + unsigned(lastX) + 1];
+        for (unsigned int i = cellStarts[row + unsigned(firstX)]; i < end; i++) {
+            float dx = sortedPoints[i].x - center.x;
+            float dz = sortedPoints[i].z - center.y;
+            if (dx * dx + dz * dz <= radiusSquared) {
+                results.push_back(sortedPoints[i].index);
+            }
+        }
+    }
+}
+
+void SpatialHash::queryNearest(float2 center, unsigned int k, float maximumRadius, std::vector<unsigned int> &results) const {
+    results.clear();
+    if (k == 0 || sortedPoints.empty()) {
+        return;
+    }
+
+    // The k nearest points so far, as a heap with the furthest of them on top
+    std::vector<std::pair<float, unsigned int>> nearest;
+    float maximumRadiusSquared = maximumRadius * maximumRadius;
+    int centerX = cellCoordinate(center.x, minimum.x, cellsX);
+    int centerZ = cellCoordinate(center.y, minimum.y, cellsZ);
+
+    // Look at rings of cells further and further around the center's cell
+    for (int ring = 0; ; ring++) {
+        int firstX = centerX - ring;
+        int lastX = centerX + ring;
+        int firstZ = centerZ - ring;
+        int lastZ = centerZ + ring;
+        for (int cellZ = std::max(firstZ, 0); cellZ <= std::min(lastZ, int(cellsZ) - 1); cellZ++) {
+            bool isEdgeRow = cellZ == firstZ || cellZ == lastZ;
+            for (int cellX = std::max(firstX, 0); cellX <= std::min(lastX, int(cellsX) - 1); cellX++) {
+                if (!isEdgeRow && cellX != firstX && cellX != lastX) {
+                    // Inside the ring, looked at already
+                    cellX = lastX - 1;
+                    continue;
+                }
+                unsigned int cell = unsigned(cellZ) * cellsX + unsigned(cellX);
+                for (unsigned int i = cellStarts[cell]; i < cellStarts[cell + 1]; i++) {
+                    float dx = sortedPoints[i].x - center.x;
+                    float dz = sortedPoints[i].z - center.y;
+                    float distanceSquared = dx * dx + dz * dz;
+                    if (distanceSquared > maximumRadiusSquared) {
+                        continue;
+                    }
+                    std::pair<float, unsigned int> candidate(distanceSquared, sortedPoints[i].index);
+                    if (nearest.size() < k) {
+                        nearest.push_back(candidate);
+                        std::push_heap(nearest.begin(), nearest.end());
+                    } else if (candidate < nearest.front()) {
+                        std::pop_heap(nearest.begin(), nearest.end());
+                        nearest.back() = candidate;
+                        std::push_heap(nearest.begin(), nearest.end());
+                    }
+                }
+            }
+        }
+
+        // Points in cells not looked at yet lie beyond the edges of the square of rings so far, except on the
+        // sides where it reached the edge of the plane: the cells there also hold everything beyond it.
+        float unseenDistance = maximumRadius;
+        bool isEverythingSeen = true;
+        if (firstX > 0) {
+            unseenDistance = std::min(unseenDistance, center.x - (minimum.x + float(firstX) * cellSize));
+            isEverythingSeen = false;
+        }
+        if (lastX < int(cellsX) - 1) {
+            unseenDistance = std::min(unseenDistance, minimum.x + float(lastX + 1) * cellSize - center.x);
+            isEverythingSeen = false;
+        }
+        if (firstZ > 0) {
+            unseenDistance = std::min(unseenDistance, center.y - (minimum.y + float(firstZ) * cellSize));
+            isEverythingSeen = false;
+        }
+        if (lastZ < int(cellsZ) - 1) {
+            unseenDistance = std::min(unseenDistance, minimum.y + float(lastZ + 1) * cellSize - center.y);
+            isEverythingSeen = false;
+        }
+        if (isEverythingSeen || unseenDistance >= maximumRadius ||
+            (nearest.size() == k && unseenDistance > 0.0f && nearest.front().first <= unseenDistance * unseenDistance)) {
+            break;
+        }
+    }
+
+    std::sort_heap(nearest.begin(), nearest.end());
+    for (std::pair<float, unsigned int> const &point : nearest) {
+        results.push_back(point.second);
+    }
+}
+
+void SpatialHash::findOverlaps(float distance, std::vector<std::pair<unsigned int, unsigned int>> &pairs) {
+    PROFILE_SCOPE("find overlaps");
+    pairs.clear();
+    // How many cells away a point closer than distance can be
+    int reach = std::max(1, int(std::ceil(distance * inverseCellSize)));
+    float distanceSquared = distance * distance;
+
+    // Bands of rows, a few per thread, since some are much more crowded than others
+    unsigned int bandCount = std::min(cellsZ, pool.threadCount() * 4);
+    unsigned int rowsPerBand = (cellsZ + bandCount - 1) / bandCount;
+    jobPairs.resize(bandCount);
+    pool.parallelFor(bandCount, [&](size_t band, unsigned int) {
+        std::vector<std::pair<unsigned int, unsigned int>> &found = jobPairs[band];
+        found.clear();
+        int endZ = int(std::min(cellsZ, unsigned(band + 1) * rowsPerBand));
+        for (int cellZ = int(band * rowsPerBand); cellZ < endZ; cellZ++) {
+            for (int cellX = 0; cellX < int(cellsX); cellX++) {
+                unsigned int cell = unsigned(cellZ) * cellsX + unsigned(cellX);
+                unsigned int cellEnd = cellStarts[cell + 1];
+                if (cellStarts[cell] == cellEnd) {
+                    continue;
+                }
+
+                // Each pair of cells is looked at once, from the one earlier in memory: the rest of its own row,
+                // and the rows after it. The cells of a row are next to each other, so each row is one range of points.
+                for (int rowZ = cellZ; rowZ <= std::min(cellZ + reach, int(cellsZ) - 1); rowZ++) {
+                    int firstX = rowZ == cellZ ? cellX : std::max(cellX - reach, 0);
+                    int lastX = std::min(cellX + reach, int(cellsX) - 1);
+                    unsigned int row = unsigned(rowZ) * cellsX;
+                    unsigned int otherEnd = cellStarts[row + unsigned(lastX) + 1];
+                    for (unsigned int i = cellStarts[cell]; i < cellEnd; i++) {
+                        Point const &point = sortedPoints[i];
+                        // Within its own cell, every point only pairs with the ones after it
+                        unsigned int otherStart = rowZ == cellZ ? i + 1 : cellStarts[row + unsigned(firstX)];
+                        for (unsigned int j = otherStart; j < otherEnd; j++) {
+                            float dx = sortedPoints[j].x - point.x;
+                            float dz = sortedPoints[j].z - point.z;
+                            if (dx * dx + dz * dz < distanceSquared) {
+                                unsigned int other = sortedPoints[j].index;
+                                found.push_back(std::make_pair(std::min(point.index, other), std::max(point.index, other)));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    for (std::vector<std::pair<unsigned int, unsigned int>> const &found : jobPairs) {
+        pairs.insert(pairs.end(), found.begin(), found.end());
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include "floats.hpp"
+#include "threadPool.hpp"
+
+// Counters describing the last build()
+struct SpatialHashStats {
+    unsigned int pointCount = 0;
+    // Cells holding at least one point, and the most points any cell holds
+    unsigned int occupiedCellCount = 0;
+    unsigned int largestCellCount = 0;
+    double buildMilliseconds = 0.0;
+};
+
+// Finds points near each other in the XZ plane, such as the agents of a Crowd, without comparing every pair.
+//
+// The plane between minimum and maximum is cut into square cells, and build() sorts the points by the cell
+// they lie in with a counting sort: each thread counts the points of its share per cell, the counts are summed
+// into where each cell's points start, and each thread then writes its points straight to their place. That is
+// linear in the number of points plus cells, and keeps the points of a cell next to each other in memory.
+// Points outside the plane are put into the nearest cell at its edge, so they are still found, only more slowly.
+//
+// Queries only look at the cells their circle touches, so a cell size around the distance usually asked about
+// (such as the diameter of a character) works best. They only read, so any number of threads can query at once.
+class SpatialHash {
+public:
+    SpatialHash(ThreadPool &pool, float2 minimum, float2 maximum, float cellSize);
+
+    // Sorts count points, point i lying at (x[i], z[i]), into the cells. Forgets the points of the last build().
+    void build(float const* x, float const* z, unsigned int count);
+
+    // Appends every point within radius of center to results, in no particular order
+    void queryRadius(float2 center, float radius, std::vector<unsigned int> &results) const;
+
+    // Replaces results with the k points nearest to center, nearest first. Points further away than
+    // maximumRadius are left out, so there may be fewer than k.
+    void queryNearest(float2 center, unsigned int k, float maximumRadius, std::vector<unsigned int> &results) const;
+
+    // Replaces pairs with every pair of points closer to each other than distance, the lower index first,
+    // in no particular order. The cells are split among the threads of the pool.
+    void findOverlaps(float distance, std::vector<std::pair<unsigned int, unsigned int>> &pairs);
+
+    unsigned int getPointCount() const { return unsigned(sortedPoints.size()); }
+    unsigned int getCellCount() const { return cellsX * cellsZ; }
+    SpatialHashStats const &getStats() const { return stats; }
+
+private:
+    struct Point {
+        float x;
+        float z;
+        unsigned int index;
+    };
+
+    int cellCoordinate(float position, float minimum, unsigned int cellCount) const;
+    unsigned int cellIndex(float x, float z) const;
+
+    ThreadPool &pool;
+    float2 minimum;
+    float cellSize;
+    float inverseCellSize;
+    unsigned int cellsX;
+    unsigned int cellsZ;
+
+    // The points of cell c are sortedPoints[cellStarts[c]] up to sortedPoints[cellStarts[c + 1]]
+    std::vector<unsigned int> cellStarts;
+    std::vector<Point> sortedPoints;
+
+    // Scratch space for build(): the cell of every point, and the number of points per cell of each job,
+    // which the scatter turns into where the job writes its next point of that cell
+    std::vector<unsigned int> pointCells;
+    std::vector<std::vector<unsigned int>> jobCellCounts;
+    std::vector<std::vector<std::pair<unsigned int, unsigned int>>> jobPairs;
+
+    SpatialHashStats stats;
+
+    SpatialHash(SpatialHash const &) = delete;
+    SpatialHash & operator =(SpatialHash const &) = delete;
+};
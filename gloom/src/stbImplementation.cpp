@@ -0,0 +1,7 @@
+// The stb libraries' implementations, compiled here once. Every other file only includes their declarations.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
@@ -0,0 +1,421 @@
+#include "terrain.hpp"
+#include "profiler.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <stb_image.h>
+
+// Chunk edges, in the order of the bits of a neighbour mask. A set bit means the neighbour is one level coarser.
+enum ChunkEdge { edgeNegativeZ = 0, edgePositiveX = 1, edgePositiveZ = 2, edgeNegativeX = 3 };
+static const unsigned int neighbourMaskCount = 16;
+// The chunk across each edge, as an offset in chunks
+static const int neighbourOffsets[4][2] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+
+// A vertex on the strip along one edge of the chunk, given its distance along the edge and inwards from it
+static int2 edgeVertex(unsigned int edge, int along, int inwards, int size) {
+    int2 vertex;
+    switch (edge) {
+        case edgeNegativeZ: vertex.x = along; vertex.y = inwards; break;
+        case edgePositiveX: vertex.x = size - inwards; vertex.y = along; break;
+        case edgePositiveZ: vertex.x = along; vertex.y = size - inwards; break;
+        default: vertex.x = inwards; vertex.y = along; break;
+    }
+    return vertex;
+}
+
+// Adds a triangle between grid vertices, wound like generateChessboard()'s so it faces up
+static void addTriangle(std::vector<unsigned short> &indices, int verticesPerSide, int2 a, int2 b, int2 c) {
+    int winding = (b.y - a.y) * (c.x - a.x) - (b.x - a.x) * (c.y - a.y);
+    if (winding == 0) {
+        return;
+    }
+    if (winding < 0) {
+        std::swap(b, c);
+    }
+    indices.push_back((unsigned short) (a.y * verticesPerSide + a.x));
+    indices.push_back((unsigned short) (b.y * verticesPerSide + b.x));
+    indices.push_back((unsigned short) (c.y * verticesPerSide + c.x));
+}
+
+// The triangles of one level of detail, in which every step-th vertex is used.
+// The outermost ring of quads is replaced by four strips, one per edge, which connect the edge's vertices
+// to the ring of vertices one step inwards. Along edges with a coarser neighbour, the strip only uses
+// the vertices that neighbour has, so both sides of the edge are the same line.
+static void addLevelOfDetail(std::vector<unsigned short> &indices, int size, int step, unsigned int coarserNeighbours) {
+    int verticesPerSide = size + 1;
+    for (int z = step; z < size - step; z += step) {
+        for (int x = step; x < size - step; x += step) {
+            int2 corner00 = {x, z};
+            int2 corner10 = {x + step, z};
+            int2 corner01 = {x, z + step};
+            int2 corner11 = {x + step, z + step};
+            addTriangle(indices, verticesPerSide, corner00, corner11, corner10);
+            addTriangle(indices, verticesPerSide, corner00, corner01, corner11);
+        }
+    }
+
+    for (unsigned int edge = 0; edge < 4; edge++) {
+        int outerStep = (coarserNeighbours & (1u << edge)) != 0 ? 2 * step : step;
+        std::vector<int> outer;
+        std::vector<int> inner;
+        for (int along = 0; along <= size; along += outerStep) {
+            outer.push_back(along);
+        }
+        for (int along = step; along <= size - step; along += step) {
+            inner.push_back(along);
+        }
+
+        // Zips the two rows together, always advancing along the row whose next vertex comes first
+        size_t i = 0;
+        size_t j = 0;
+        while (i + 1 < outer.size() || j + 1 < inner.size()) {
+            bool advanceOuter = j + 1 == inner.size() || (i + 1 < outer.size() && outer[i + 1] <= inner[j + 1]);
+            if (advanceOuter) {
+                addTriangle(indices, verticesPerSide, edgeVertex(edge, outer[i], 0, size),
+                            edgeVertex(edge, outer[i + 1], 0, size), edgeVertex(edge, inner[j], step, size));
+                i++;
+            } else {
+                addTriangle(indices, verticesPerSide, edgeVertex(edge, outer[i], 0, size),
+                            edgeVertex(edge, inner[j + 1], step, size), edgeVertex(edge, inner[j], step, size));
+                j++;
+            }
+        }
+    }
+}
+
+static bool isPowerOfTwo(unsigned int value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+Terrain::Terrain(ThreadPool &pool, TerrainSettings const &terrainSettings, GpuResourceManager* resourceManager)
+    : pool(pool), settings(terrainSettings), resources(resourceManager != nullptr ? resourceManager : &ownResources) {
+    if (!isPowerOfTwo(settings.chunkTiles) || settings.chunkTiles < 2 || settings.chunkTiles > 128) {
+        fprintf(stderr, "Terrain chunks of %u tiles are not supported, using 64 instead\n", settings.chunkTiles);
+        settings.chunkTiles = 64;
+    }
+    chunksX = (std::max(settings.boardWidth, 1u) + settings.chunkTiles - 1) / settings.chunkTiles;
+    chunksZ = (std::max(settings.boardHeight, 1u) + settings.chunkTiles - 1) / settings.chunkTiles;
+    verticesPerSide = settings.chunkTiles + 1;
+    chunkBytes = size_t(verticesPerSide) * verticesPerSide * sizeof(float);
+    chunks.resize(size_t(chunksX) * chunksZ);
+
+    // The coarsest level still has a vertex in the middle of the chunk
+    lodCount = 0;
+    while ((2u << lodCount) <= settings.chunkTiles) {
+        lodCount++;
+    }
+    createIndexBuffer();
+    evictorID = resources->addEvictor([this](GpuMemoryCategory category, size_t bytesNeeded) {
+        return category == gpuMemoryVertices ? evictOutOfRange(bytesNeeded) : 0;
+    });
+}
+
+Terrain::~Terrain() {
+    resources->removeEvictor(evictorID);
+    for (Chunk &chunk : chunks) {
+        evict(chunk);
+    }
+    indexBuffer.reset();
+}
+
+void Terrain::createIndexBuffer() {
+    std::vector<unsigned short> indices;
+    indexRanges.resize(lodCount * neighbourMaskCount);
+    for (unsigned int lod = 0; lod < lodCount; lod++) {
+        for (unsigned int mask = 0; mask < neighbourMaskCount; mask++) {
+            IndexRange &range = indexRanges.at(lod * neighbourMaskCount + mask);
+            range.offset = indices.size() * sizeof(unsigned short);
+            addLevelOfDetail(indices, int(settings.chunkTiles), 1 << lod, mask);
+            range.count = unsigned(indices.size() - range.offset / sizeof(unsigned short));
+        }
+    }
+
+    glBindVertexArray(0);
+    indexBuffer = resources->createBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMemoryIndices, indices.size() * sizeof(unsigned short), indices.data());
+    if (indexBuffer.isEmpty()) {
+        fprintf(stderr, "The terrain's index buffer does not fit into the GPU memory budget, no chunks will be loaded\n");
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+bool Terrain::loadHeightmap(std::string const &file, float scale) {
+    int width, height, channels;
+    stbi_us* pixels = stbi_load_16(file.c_str(), &width, &height, &channels, 1);
+    if (pixels == nullptr) {
+        fprintf(stderr, "Could not load the heightmap \"%s\": %s\n", file.c_str(), stbi_failure_reason());
+        return false;
+    }
+
+    heightmap.resize(size_t(width) * height);
+    for (size_t i = 0; i < heightmap.size(); i++) {
+        heightmap[i] = float(pixels[i]) / 65535.0f;
+    }
+    stbi_image_free(pixels);
+    heightmapWidth = unsigned(width);
+    heightmapHeight = unsigned(height);
+    heightScale = scale;
+
+    for (Chunk &chunk : chunks) {
+        evict(chunk);
+    }
+    return true;
+}
+
+// Bilinearly filtered height at the given point of the board, both coordinates running from 0 to 1
+float Terrain::sampleHeightmap(float u, float v) const {
+    float x = u * float(heightmapWidth - 1);
+    float y = v * float(heightmapHeight - 1);
+    unsigned int x0 = std::min(unsigned(x), heightmapWidth - 1);
+    unsigned int y0 = std::min(unsigned(y), heightmapHeight - 1);
+    unsigned int x1 = std::min(x0 + 1, heightmapWidth - 1);
+    unsigned int y1 = std::min(y0 + 1, heightmapHeight - 1);
+    float fractionX = x - float(x0);
+    float fractionY = y - float(y0);
+
+    float top = heightmap[y0 * heightmapWidth + x0] * (1.0f - fractionX) + heightmap[y0 * heightmapWidth + x1] * fractionX;
+    float bottom = heightmap[y1 * heightmapWidth + x0] * (1.0f - fractionX) + heightmap[y1 * heightmapWidth + x1] * fractionX;
+    return (top * (1.0f - fractionY) + bottom * fractionY) * heightScale;
+}
+
+// Runs on the thread pool, so it may only read the terrain
+std::vector<float> Terrain::generateHeights(unsigned int chunkX, unsigned int chunkZ) const {
+    std::vector<float> heights(size_t(verticesPerSide) * verticesPerSide, 0.0f);
+    if (heightmap.empty()) {
+        return heights;
+    }
+
+    for (unsigned int z = 0; z < verticesPerSide; z++) {
+        // Vertices past the end of the board are moved onto its edge by the vertex shader, their height follows
+        unsigned int boardZ = std::min(chunkZ * settings.chunkTiles + z, settings.boardHeight);
+        for (unsigned int x = 0; x < verticesPerSide; x++) {
+            unsigned int boardX = std::min(chunkX * settings.chunkTiles + x, settings.boardWidth);
+            heights[z * verticesPerSide + x] = sampleHeightmap(float(boardX) / float(std::max(settings.boardWidth, 1u)),
+                                                               float(boardZ) / float(std::max(settings.boardHeight, 1u)));
+        }
+    }
+    return heights;
+}
+
+bool Terrain::upload(Chunk &chunk, std::vector<float> const &heights) {
+    if (indexBuffer.isEmpty()) {
+        return false;
+    }
+    chunk.heightBuffer = resources->createBuffer(GL_ARRAY_BUFFER, gpuMemoryVertices, heights.size() * sizeof(float), heights.data());
+    if (chunk.heightBuffer.isEmpty()) {
+        return false;
+    }
+
+    chunk.vertexArray = resources->createVertexArray();
+    glBindVertexArray(chunk.vertexArray.get());
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.heightBuffer.get());
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+    glEnableVertexAttribArray(1);
+
+    // Every chunk draws from the shared index buffer
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.get());
+    glBindVertexArray(0);
+
+    chunk.isResident = true;
+    stats.residentChunkCount++;
+    stats.residentBytes += chunkBytes;
+    stats.loadedChunkCount++;
+    stats.totalLoadedChunkCount++;
+    return true;
+}
+
+void Terrain::evict(Chunk &chunk) {
+    if (!chunk.isResident) {
+        return;
+    }
+    chunk.vertexArray.reset();
+    chunk.heightBuffer.reset();
+    chunk.isResident = false;
+
+    stats.residentChunkCount--;
+    stats.residentBytes -= chunkBytes;
+    stats.evictedChunkCount++;
+    stats.totalEvictedChunkCount++;
+}
+
+// Evicts chunks which are only still resident because they have not moved far enough away yet, furthest first,
+// until bytesNeeded bytes are freed. Distances are those of the last update().
+size_t Terrain::evictOutOfRange(size_t bytesNeeded) {
+    std::vector<Chunk*> outOfRange;
+    for (Chunk &chunk : chunks) {
+        if (chunk.isResident && chunk.distance > settings.loadRadius) {
+            outOfRange.push_back(&chunk);
+        }
+    }
+    std::sort(outOfRange.begin(), outOfRange.end(), [](Chunk const* a, Chunk const* b) { return a->distance > b->distance; });
+
+    size_t freedBytes = 0;
+    for (Chunk* chunk : outOfRange) {
+        if (freedBytes >= bytesNeeded) {
+            break;
+        }
+        freedBytes += chunk->heightBuffer.getSize();
+        evict(*chunk);
+    }
+    return freedBytes;
+}
+
+void Terrain::update(glm::vec3 const &cameraPosition) {
+    PROFILE_SCOPE("terrain update");
+    stats.loadedChunkCount = 0;
+    stats.evictedChunkCount = 0;
+    stats.deferredChunkCount = 0;
+
+    float boardMaximumX = (float(settings.boardWidth) - 0.5f) * settings.tileWidth;
+    float boardMaximumZ = (float(settings.boardHeight) - 0.5f) * settings.tileWidth;
+    std::vector<unsigned int> wanted;
+    std::vector<unsigned int> resident;
+    for (unsigned int chunkZ = 0; chunkZ < chunksZ; chunkZ++) {
+        for (unsigned int chunkX = 0; chunkX < chunksX; chunkX++) {
+            unsigned int index = chunkZ * chunksX + chunkX;
+            Chunk &chunk = chunks[index];
+
+            // Distance to the chunk's bounding box
+            float minimumX = (float(chunkX * settings.chunkTiles) - 0.5f) * settings.tileWidth;
+            float minimumZ = (float(chunkZ * settings.chunkTiles) - 0.5f) * settings.tileWidth;
+            float maximumX = std::min(minimumX + float(settings.chunkTiles) * settings.tileWidth, boardMaximumX);
+            float maximumZ = std::min(minimumZ + float(settings.chunkTiles) * settings.tileWidth, boardMaximumZ);
+            float dx = std::max(std::max(minimumX - cameraPosition.x, 0.0f), cameraPosition.x - maximumX);
+            float dy = std::max(std::max(-cameraPosition.y, 0.0f), cameraPosition.y - heightScale);
+            float dz = std::max(std::max(minimumZ - cameraPosition.z, 0.0f), cameraPosition.z - maximumZ);
+            chunk.distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+            if (chunk.isResident && chunk.distance > 1.5f * settings.loadRadius) {
+                evict(chunk);
+            } else if (chunk.isResident) {
+                resident.push_back(index);
+            } else if (chunk.distance <= settings.loadRadius) {
+                wanted.push_back(index);
+            }
+        }
+    }
+
+    std::sort(wanted.begin(), wanted.end(), [this](unsigned int a, unsigned int b) {
+        return chunks[a].distance < chunks[b].distance;
+    });
+    std::sort(resident.begin(), resident.end(), [this](unsigned int a, unsigned int b) {
+        return chunks[a].distance > chunks[b].distance;
+    });
+
+    // Nearest chunks first. Once over budget, a chunk can only take the place of one further away than itself.
+    std::vector<unsigned int> loading;
+    size_t budgetedBytes = stats.residentBytes;
+    size_t nextVictim = 0;
+    for (unsigned int index : wanted) {
+        if (loading.size() == settings.maximumChunksPerUpdate) {
+            break;
+        }
+        while (budgetedBytes + chunkBytes > settings.memoryBudgetBytes && nextVictim < resident.size()
+               && chunks[resident[nextVictim]].distance > chunks[index].distance) {
+            evict(chunks[resident[nextVictim++]]);
+            budgetedBytes -= chunkBytes;
+        }
+        if (budgetedBytes + chunkBytes > settings.memoryBudgetBytes) {
+            break;
+        }
+        loading.push_back(index);
+        budgetedBytes += chunkBytes;
+    }
+    stats.deferredChunkCount = unsigned(wanted.size() - loading.size());
+
+    std::vector<std::vector<float>> heights(loading.size());
+    pool.parallelFor(loading.size(), [&](size_t i, unsigned int) {
+        heights[i] = generateHeights(loading[i] % chunksX, loading[i] / chunksX);
+    });
+    for (size_t i = 0; i < loading.size(); i++) {
+        if (!upload(chunks[loading[i]], heights[i])) {
+            stats.deferredChunkCount++;
+        }
+    }
+
+    selectLevelsOfDetail();
+}
+
+Terrain::Chunk const* Terrain::neighbour(unsigned int chunkX, unsigned int chunkZ, int offsetX, int offsetZ) const {
+    int x = int(chunkX) + offsetX;
+    int z = int(chunkZ) + offsetZ;
+    if (x < 0 || z < 0 || x >= int(chunksX) || z >= int(chunksZ)) {
+        return nullptr;
+    }
+    Chunk const &chunk = chunks[size_t(z) * chunksX + size_t(x)];
+    return chunk.isResident ? &chunk : nullptr;
+}
+
+void Terrain::selectLevelsOfDetail() {
+    for (Chunk &chunk : chunks) {
+        if (chunk.isResident) {
+            float levels = chunk.distance < settings.lodDistance ? 0.0f : 1.0f + std::log2(chunk.distance / settings.lodDistance);
+            chunk.lod = std::min(unsigned(levels), lodCount - 1);
+        }
+    }
+
+    // Stitching covers neighbours one level apart, so refine chunks until no neighbour is finer by more than that.
+    // Refining only ever lowers levels, so this ends after at most lodCount passes.
+    bool hasChanged = true;
+    while (hasChanged) {
+        hasChanged = false;
+        for (unsigned int chunkZ = 0; chunkZ < chunksZ; chunkZ++) {
+            for (unsigned int chunkX = 0; chunkX < chunksX; chunkX++) {
+                Chunk &chunk = chunks[chunkZ * chunksX + chunkX];
+                if (!chunk.isResident) {
+                    continue;
+                }
+                for (unsigned int edge = 0; edge < 4; edge++) {
+                    Chunk const* adjacent = neighbour(chunkX, chunkZ, neighbourOffsets[edge][0], neighbourOffsets[edge][1]);
+                    if (adjacent != nullptr && chunk.lod > adjacent->lod + 1) {
+                        chunk.lod = adjacent->lod + 1;
+                        hasChanged = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Terrain::draw(GLuint program, glm::mat4 const &viewProjection) {
+    PROFILE_SCOPE("terrain draw");
+    stats.drawnChunkCount = 0;
+    stats.drawnTriangleCount = 0;
+
+    glUseProgram(program);
+    glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform1i(13, int(verticesPerSide));
+    glUniform1f(14, settings.tileWidth);
+    glUniform2i(15, int(settings.boardWidth), int(settings.boardHeight));
+    glUniform4f(16, settings.tileColour1.x, settings.tileColour1.y, settings.tileColour1.z, settings.tileColour1.w);
+    glUniform4f(17, settings.tileColour2.x, settings.tileColour2.y, settings.tileColour2.z, settings.tileColour2.w);
+
+    for (unsigned int chunkZ = 0; chunkZ < chunksZ; chunkZ++) {
+        for (unsigned int chunkX = 0; chunkX < chunksX; chunkX++) {
+            Chunk const &chunk = chunks[chunkZ * chunksX + chunkX];
+            if (!chunk.isResident) {
+                continue;
+            }
+
+            unsigned int coarserNeighbours = 0;
+            for (unsigned int edge = 0; edge < 4; edge++) {
+                Chunk const* adjacent = neighbour(chunkX, chunkZ, neighbourOffsets[edge][0], neighbourOffsets[edge][1]);
+                if (adjacent != nullptr && adjacent->lod > chunk.lod) {
+                    coarserNeighbours |= 1u << edge;
+                }
+            }
+            IndexRange const &range = indexRanges[chunk.lod * neighbourMaskCount + coarserNeighbours];
+
+            glUniform2i(12, int(chunkX * settings.chunkTiles), int(chunkZ * settings.chunkTiles));
+            glBindVertexArray(chunk.vertexArray.get());
+            glDrawElements(GL_TRIANGLES, GLsizei(range.count), GL_UNSIGNED_SHORT, (void*) range.offset);
+
+            stats.drawnChunkCount++;
+            stats.drawnTriangleCount += range.count / 3;
+        }
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "floats.hpp"
+#include "gpuResources.hpp"
+#include "threadPool.hpp"
+
+// How the board is laid out and streamed. The tile layout matches generateChessboard():
+// tile (x, y) is centred on (x * tileWidth, 0, y * tileWidth).
+struct TerrainSettings {
+    unsigned int boardWidth = 32;
+    unsigned int boardHeight = 32;
+    float tileWidth = 20.0f;
+    float4 tileColour1 = float4(0.0f, 0.0f, 0.0f, 1.0f);
+    float4 tileColour2 = float4(1.0f, 1.0f, 1.0f, 1.0f);
+
+    // Tiles along each side of a chunk. A power of two of at most 128, so a chunk's vertices fit 16 bit indices.
+    unsigned int chunkTiles = 64;
+    // Chunks closer to the camera than this are loaded, and chunks 1.5 times as far are evicted
+    float loadRadius = 4000.0f;
+    // Chunks closer than this are drawn at full detail, every doubling of the distance halves the detail
+    float lodDistance = 1000.0f;
+    // The most vertex memory the loaded chunks may take. When full, the furthest chunks make room for nearer ones.
+    // Chunks also count against the vertex budget of the resource manager, if the terrain was given one.
+    size_t memoryBudgetBytes = size_t(64) << 20;
+    // Loading is spread over frames, nearest chunks first, so moving the camera does not cause a spike
+    unsigned int maximumChunksPerUpdate = 16;
+};
+
+// Counters describing the last update() and draw(), and totals since the terrain was created
+struct TerrainStats {
+    unsigned int residentChunkCount = 0;
+    size_t residentBytes = 0;
+    unsigned int loadedChunkCount = 0;
+    unsigned int evictedChunkCount = 0;
+    // Chunks which were in range but not loaded, because of the per-update limit or the memory budgets
+    unsigned int deferredChunkCount = 0;
+    unsigned int drawnChunkCount = 0;
+    size_t drawnTriangleCount = 0;
+
+    unsigned int totalLoadedChunkCount = 0;
+    unsigned int totalEvictedChunkCount = 0;
+};
+
+// A board too large to hold in memory as one mesh, split into square chunks which are generated
+// on the thread pool as the camera approaches them, and evicted again once it moves away.
+//
+// A chunk only stores the height of each tile corner (4 bytes per vertex); the vertex shader
+// (terrain.vert) places the vertex from its index, and the fragment shader (terrain.frag) colours the tiles,
+// so tile colours survive any level of detail.
+//
+// Distant chunks are drawn with geomipmapping: at level of detail L, every 2^L-th vertex of the chunk is used.
+// Neighbouring chunks are kept within one level of each other, and the edge of the finer chunk skips
+// every other vertex where it meets a coarser one, so the two edges line up and leave no cracks.
+// All chunks share one index buffer, holding the triangles of every level with every combination of coarser neighbours.
+//
+// Given a resource manager, the terrain's buffers are created by it. Chunks which are out of range but not yet evicted
+// are given up whenever it needs room for other buffers, and chunks which do not fit into its budget wait for a later update().
+class Terrain {
+public:
+    Terrain(ThreadPool &pool, TerrainSettings const &settings, GpuResourceManager* resources = nullptr);
+    ~Terrain();
+
+    // Stretches an 8 or 16 bit greyscale image over the board, black at height 0 and white at heightScale.
+    // Loaded chunks are dropped, and stream back in with the new heights. Returns false if the image can't be read.
+    bool loadHeightmap(std::string const &file, float heightScale);
+
+    // Loads and evicts chunks around the camera, and picks every loaded chunk's level of detail
+    void update(glm::vec3 const &cameraPosition);
+
+    // Draws the loaded chunks with the given program, which should be made from terrain.vert and terrain.frag
+    void draw(GLuint program, glm::mat4 const &viewProjection);
+
+    TerrainStats const &getStats() const { return stats; }
+
+private:
+    struct Chunk {
+        GpuVertexArray vertexArray;
+        GpuBuffer heightBuffer;
+        bool isResident = false;
+        float distance = 0.0f;
+        unsigned int lod = 0;
+    };
+
+    // Where the indices of one level of detail with one combination of coarser neighbours lie in the index buffer
+    struct IndexRange {
+        size_t offset;
+        unsigned int count;
+    };
+
+    void createIndexBuffer();
+    std::vector<float> generateHeights(unsigned int chunkX, unsigned int chunkZ) const;
+    float sampleHeightmap(float u, float v) const;
+    bool upload(Chunk &chunk, std::vector<float> const &heights);
+    void evict(Chunk &chunk);
+    size_t evictOutOfRange(size_t bytesNeeded);
+    void selectLevelsOfDetail();
+    Chunk const* neighbour(unsigned int chunkX, unsigned int chunkZ, int offsetX, int offsetZ) const;
+
+    ThreadPool &pool;
+    TerrainSettings settings;
+    // The given resource manager, or ownResources without one
+    GpuResourceManager ownResources;
+    GpuResourceManager* resources;
+    unsigned int evictorID;
+    unsigned int chunksX;
+    unsigned int chunksZ;
+    unsigned int verticesPerSide;
+    size_t chunkBytes;
+    unsigned int lodCount;
+    std::vector<Chunk> chunks;
+
+    GpuBuffer indexBuffer;
+    std::vector<IndexRange> indexRanges;
+
+    std::vector<float> heightmap;
+    unsigned int heightmapWidth = 0;
+    unsigned int heightmapHeight = 0;
+    float heightScale = 0.0f;
+
+    TerrainStats stats;
+
+    Terrain(Terrain const &) = delete;
+    Terrain & operator =(Terrain const &) = delete;
+};
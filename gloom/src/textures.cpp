@@ -0,0 +1,575 @@
+#include "textures.hpp"
+#include "mappedFile.hpp"
+#include "mesh.hpp"
+#include "profiler.hpp"
+
+#include <stb_image.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURES_USE_SSE 1
+#endif
+
+static const double pi = 3.14159265358979323846;
+
+// Half the width of the Kaiser filter in texels of the smaller level, and how quickly its window falls off
+static const double kaiserWidth = 3.0;
+static const double kaiserAlpha = 4.0;
+
+// Cache files are larger than any texture a GPU takes if either side is above this, so they must be damaged
+static const uint32_t maximumCachedSize = 1u << 16;
+
+// The start of every cache file, followed by the texels of each level in turn
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    // The image's size and modification time, to notice when it changes
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint32_t filter;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+};
+
+static const char textureCacheMagic[4] = {'G', 'T', 'E', 'X'};
+static const uint32_t textureCacheVersion = 1;
+
+unsigned int fullMipmapLevelCount(unsigned int width, unsigned int height) {
+    unsigned int levelCount = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        levelCount++;
+    }
+    return levelCount;
+}
+
+// Averages every 2x2 block of the source into one target texel, rounded to the nearest value.
+// The last row or column of a source with an odd size is left out.
+static void reduceBox(uint8_t const* source, unsigned int sourceWidth, unsigned int sourceHeight,
+                      uint8_t* target, unsigned int targetWidth, unsigned int targetHeight) {
+    for (unsigned int y = 0; y < targetHeight; y++) {
+        uint8_t const* row0 = source + size_t(std::min(2 * y, sourceHeight - 1)) * sourceWidth * 4;
+        uint8_t const* row1 = source + size_t(std::min(2 * y + 1, sourceHeight - 1)) * sourceWidth * 4;
+        uint8_t* targetRow = target + size_t(y) * targetWidth * 4;
+        unsigned int x = 0;
+
+#ifdef TEXTURES_USE_SSE
+        // Four target texels at a time, out of eight texels of each source row, summed in 16 bits
+        if (sourceWidth >= 2) {
+            __m128i zero = _mm_setzero_si128();
+            __m128i two = _mm_set1_epi16(2);
+            for (; x + 4 <= targetWidth; x += 4) {
+                __m128 a0 = _mm_castsi128_ps(_mm_loadu_si128((__m128i const*) (row0 + 8 * x)));
+                __m128 b0 = _mm_castsi128_ps(_mm_loadu_si128((__m128i const*) (row0 + 8 * x + 16)));
+                __m128 a1 = _mm_castsi128_ps(_mm_loadu_si128((__m128i const*) (row1 + 8 * x)));
+                __m128 b1 = _mm_castsi128_ps(_mm_loadu_si128((__m128i const*) (row1 + 8 * x + 16)));
+                // The left and the right texel of every block, each lined up with the others
+                __m128i left0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+                __m128i right0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+                __m128i left1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+                __m128i right1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+                __m128i low = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(left0, zero), _mm_unpacklo_epi8(right0, zero)),
+                                            _mm_add_epi16(_mm_unpacklo_epi8(left1, zero), _mm_unpacklo_epi8(right1, zero)));
+                __m128i high = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(left0, zero), _mm_unpackhi_epi8(right0, zero)),
+                                             _mm_add_epi16(_mm_unpackhi_epi8(left1, zero), _mm_unpackhi_epi8(right1, zero)));
+                low = _mm_srli_epi16(_mm_add_epi16(low, two), 2);
+                high = _mm_srli_epi16(_mm_add_epi16(high, two), 2);
+                _mm_storeu_si128((__m128i*) (targetRow + 4 * x), _mm_packus_epi16(low, high));
+            }
+        }
+#endif
+
+        // The same, one texel at a time, for the last few texels (or all of them without SSE)
+        for (; x < targetWidth; x++) {
+            unsigned int left = std::min(2 * x, sourceWidth - 1) * 4;
+            unsigned int right = std::min(2 * x + 1, sourceWidth - 1) * 4;
+            for (unsigned int channel = 0; channel < 4; channel++) {
+                targetRow[4 * x + channel] = uint8_t((row0[left + channel] + row0[right + channel] +
+                                                      row1[left + channel] + row1[right + channel] + 2) >> 2);
+            }
+        }
+    }
+}
+
+// The modified Bessel function of the first kind and order zero, from its power series,
+// which converges quickly for the arguments a Kaiser window needs
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50 && term > 1e-12 * sum; k++) {
+        double factor = x / (2.0 * k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+// The filter's weight at a distance of x texels of the smaller level
+static double kaiserSinc(double x) {
+    if (std::fabs(x) >= kaiserWidth) {
+        return 0.0;
+    }
+    double t = x / kaiserWidth;
+    double window = besselI0(kaiserAlpha * std::sqrt(1.0 - t * t)) / besselI0(kaiserAlpha);
+    double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+    return sinc * window;
+}
+
+// The source texels one target texel is made of along one axis, and their weights
+struct FilterTaps {
+    unsigned int first;
+    std::vector<float> weights;
+};
+
+static std::vector<FilterTaps> kaiserTaps(unsigned int sourceSize, unsigned int targetSize) {
+    double scale = double(sourceSize) / double(targetSize);
+    double support = kaiserWidth * scale;
+    std::vector<FilterTaps> taps(targetSize);
+    for (unsigned int target = 0; target < targetSize; target++) {
+        double centre = (target + 0.5) * scale;
+        int begin = int(std::floor(centre - support));
+        int end = int(std::ceil(centre + support));
+        int first = std::max(begin, 0);
+        int last = std::min(end, int(sourceSize) - 1);
+
+        FilterTaps &targetTaps = taps[target];
+        targetTaps.first = unsigned(first);
+        targetTaps.weights.assign(size_t(last - first + 1), 0.0f);
+        double sum = 0.0;
+        for (int source = begin; source <= end; source++) {
+            double weight = kaiserSinc((source + 0.5 - centre) / scale);
+            // Texels beyond the edges repeat the edge texels
+            targetTaps.weights[size_t(std::min(std::max(source, first), last) - first)] += float(weight);
+            sum += weight;
+        }
+        for (float &weight : targetTaps.weights) {
+            weight = float(weight / sum);
+        }
+    }
+    return taps;
+}
+
+// Filters a level of four floats per texel down to the next, first along the rows into rows, then along the columns
+static void reduceKaiser(std::vector<float> const &source, unsigned int sourceWidth, unsigned int sourceHeight,
+                         std::vector<float> &target, unsigned int targetWidth, unsigned int targetHeight, std::vector<float> &rows) {
+    std::vector<FilterTaps> columnTaps = kaiserTaps(sourceWidth, targetWidth);
+    std::vector<FilterTaps> rowTaps = kaiserTaps(sourceHeight, targetHeight);
+
+    rows.resize(size_t(targetWidth) * sourceHeight * 4);
+    for (unsigned int y = 0; y < sourceHeight; y++) {
+        float const* sourceRow = source.data() + size_t(y) * sourceWidth * 4;
+        float* row = rows.data() + size_t(y) * targetWidth * 4;
+        for (unsigned int x = 0; x < targetWidth; x++) {
+            FilterTaps const &taps = columnTaps[x];
+            float const* texel = sourceRow + size_t(taps.first) * 4;
+#ifdef TEXTURES_USE_SSE
+            __m128 sum = _mm_setzero_ps();
+            for (size_t tap = 0; tap < taps.weights.size(); tap++) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps.weights[tap]), _mm_loadu_ps(texel + 4 * tap)));
+            }
+            _mm_storeu_ps(row + 4 * x, sum);
+#else
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (size_t tap = 0; tap < taps.weights.size(); tap++) {
+                for (unsigned int channel = 0; channel < 4; channel++) {
+                    sum[channel] += taps.weights[tap] * texel[4 * tap + channel];
+                }
+            }
+            std::copy(sum, sum + 4, row + 4 * x);
+#endif
+        }
+    }
+
+    size_t rowValueCount = size_t(targetWidth) * 4;
+    target.assign(rowValueCount * targetHeight, 0.0f);
+    for (unsigned int y = 0; y < targetHeight; y++) {
+        FilterTaps const &taps = rowTaps[y];
+        float* targetRow = target.data() + y * rowValueCount;
+        for (size_t tap = 0; tap < taps.weights.size(); tap++) {
+            float const* row = rows.data() + (taps.first + tap) * rowValueCount;
+            float weight = taps.weights[tap];
+#ifdef TEXTURES_USE_SSE
+            __m128 weights = _mm_set1_ps(weight);
+            for (size_t i = 0; i < rowValueCount; i += 4) {
+                _mm_storeu_ps(targetRow + i, _mm_add_ps(_mm_loadu_ps(targetRow + i), _mm_mul_ps(weights, _mm_loadu_ps(row + i))));
+            }
+#else
+            for (size_t i = 0; i < rowValueCount; i++) {
+                targetRow[i] += weight * row[i];
+            }
+#endif
+        }
+    }
+}
+
+// Rounds filtered values back to 8 bits. The sinc's negative lobes can overshoot, so they are clamped to 0 to 255.
+static void quantize(float const* values, size_t valueCount, uint8_t* target) {
+    size_t i = 0;
+#ifdef TEXTURES_USE_SSE
+    // Sixteen values at a time, whose conversions saturate on their way down to 8 bits
+    for (; i + 16 <= valueCount; i += 16) {
+        __m128i a = _mm_cvtps_epi32(_mm_loadu_ps(values + i));
+        __m128i b = _mm_cvtps_epi32(_mm_loadu_ps(values + i + 4));
+        __m128i c = _mm_cvtps_epi32(_mm_loadu_ps(values + i + 8));
+        __m128i d = _mm_cvtps_epi32(_mm_loadu_ps(values + i + 12));
+        _mm_storeu_si128((__m128i*) (target + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+#endif
+    for (; i < valueCount; i++) {
+        target[i] = uint8_t(std::min(std::max(values[i], 0.0f), 255.0f) + 0.5f);
+    }
+}
+
+void generateMipmaps(TextureImage &image, MipmapFilter filter) {
+    unsigned int levelCount = fullMipmapLevelCount(image.width, image.height);
+    image.levels.resize(levelCount);
+    for (unsigned int level = 1; level < levelCount; level++) {
+        image.levels[level].resize(size_t(image.levelWidth(level)) * image.levelHeight(level) * 4);
+    }
+
+    if (filter == mipmapFilterBox) {
+        for (unsigned int level = 1; level < levelCount; level++) {
+            reduceBox(image.levels[level - 1].data(), image.levelWidth(level - 1), image.levelHeight(level - 1),
+                      image.levels[level].data(), image.levelWidth(level), image.levelHeight(level));
+        }
+        return;
+    }
+
+    // Each level is filtered from the unrounded values of the one before, so rounding errors do not add up
+    std::vector<float> current(image.levels[0].begin(), image.levels[0].end());
+    std::vector<float> next;
+    std::vector<float> rows;
+    for (unsigned int level = 1; level < levelCount; level++) {
+        reduceKaiser(current, image.levelWidth(level - 1), image.levelHeight(level - 1),
+                     next, image.levelWidth(level), image.levelHeight(level), rows);
+        quantize(next.data(), next.size(), image.levels[level].data());
+        current.swap(next);
+    }
+}
+
+// Copies a level of an image into an atlas page, with the padded rectangle's bottom left corner at x, y.
+// The image's edge texels are repeated padding times around it.
+static void copyPadded(uint8_t const* source, unsigned int sourceWidth, unsigned int sourceHeight,
+                       uint8_t* page, unsigned int pageWidth, unsigned int x, unsigned int y, unsigned int padding) {
+    size_t rowBytes = size_t(sourceWidth) * 4;
+    for (unsigned int row = 0; row < sourceHeight + 2 * padding; row++) {
+        unsigned int sourceRow = std::min(std::max(row, padding) - padding, sourceHeight - 1);
+        uint8_t const* sourceTexels = source + sourceRow * rowBytes;
+        uint8_t* target = page + (size_t(y + row) * pageWidth + x) * 4;
+        for (unsigned int i = 0; i < padding; i++) {
+            std::memcpy(target + 4 * i, sourceTexels, 4);
+            std::memcpy(target + 4 * (padding + sourceWidth + i), sourceTexels + rowBytes - 4, 4);
+        }
+        std::memcpy(target + 4 * padding, sourceTexels, rowBytes);
+    }
+}
+
+TextureLoader::TextureLoader(ThreadPool &pool, GpuResourceManager &resources, TextureLoaderSettings const &settings)
+    : pool(pool), resources(resources), settings(settings), atlasLevelCount(1) {
+    // The smallest level of an atlas page keeps one texel of padding around every image
+    unsigned int padding = 1;
+    while (padding < settings.atlasPadding) {
+        padding *= 2;
+        atlasLevelCount++;
+    }
+    this->settings.atlasPadding = padding;
+    this->settings.atlasSize = (settings.atlasSize + padding - 1) / padding * padding;
+}
+
+std::string TextureLoader::getCachePath(std::string const &file) const {
+    if (settings.cacheDirectory.empty()) {
+        return std::string();
+    }
+    // Named after a hash (FNV-1a) of the image's path, so images of the same name in different directories get files of their own
+    uint64_t hash = 14695981039346656037ull;
+    for (char character : file) {
+        hash ^= uint8_t(character);
+        hash *= 1099511628211ull;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.gtex", (unsigned long long) hash);
+    return settings.cacheDirectory + "/" + name;
+}
+
+TextureLoader::LoadResult TextureLoader::loadImage(std::string const &file, TextureImage &image) const {
+    struct stat source;
+    if (stat(file.c_str(), &source) != 0) {
+        fprintf(stderr, "Could not find the texture \"%s\"\n", file.c_str());
+        return loadFailed;
+    }
+    uint64_t sourceSize = uint64_t(source.st_size);
+    int64_t sourceModified = int64_t(source.st_mtime);
+    std::string cachePath = getCachePath(file);
+    if (!cachePath.empty() && readCache(cachePath, sourceSize, sourceModified, image)) {
+        return loadCached;
+    }
+
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(file.c_str(), &width, &height, &channels, 4);
+    if (pixels == nullptr) {
+        fprintf(stderr, "Could not load the texture \"%s\": %s\n", file.c_str(), stbi_failure_reason());
+        return loadFailed;
+    }
+    image.width = unsigned(width);
+    image.height = unsigned(height);
+    image.levels.assign(1, std::vector<uint8_t>(size_t(width) * height * 4));
+    // stb_image starts with the top row, OpenGL with the bottom one
+    size_t rowBytes = size_t(width) * 4;
+    for (int y = 0; y < height; y++) {
+        std::memcpy(image.levels[0].data() + size_t(height - 1 - y) * rowBytes, pixels + size_t(y) * rowBytes, rowBytes);
+    }
+    stbi_image_free(pixels);
+
+    generateMipmaps(image, settings.filter);
+    if (!cachePath.empty()) {
+        writeCache(cachePath, sourceSize, sourceModified, image);
+    }
+    return loadDecoded;
+}
+
+bool TextureLoader::readCache(std::string const &cachePath, uint64_t sourceSize, int64_t sourceModified, TextureImage &image) const {
+    MappedFile file;
+    if (!file.open(cachePath) || file.size() < sizeof(TextureCacheHeader)) {
+        return false;
+    }
+    TextureCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, textureCacheMagic, sizeof(textureCacheMagic)) != 0 || header.version != textureCacheVersion ||
+        header.sourceSize != sourceSize || header.sourceModified != sourceModified || header.filter != uint32_t(settings.filter) ||
+        header.width == 0 || header.height == 0 || header.width > maximumCachedSize || header.height > maximumCachedSize ||
+        header.levelCount != fullMipmapLevelCount(header.width, header.height)) {
+        return false;
+    }
+
+    TextureImage cached;
+    cached.width = header.width;
+    cached.height = header.height;
+    cached.levels.resize(header.levelCount);
+    size_t offset = sizeof(header);
+    for (unsigned int level = 0; level < header.levelCount; level++) {
+        size_t bytes = size_t(cached.levelWidth(level)) * cached.levelHeight(level) * 4;
+        if (offset + bytes > file.size()) {
+            return false;
+        }
+        cached.levels[level].assign(file.data() + offset, file.data() + offset + bytes);
+        offset += bytes;
+    }
+    if (offset != file.size()) {
+        return false;
+    }
+    image = std::move(cached);
+    return true;
+}
+
+void TextureLoader::writeCache(std::string const &cachePath, uint64_t sourceSize, int64_t sourceModified, TextureImage const &image) const {
+    TextureCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, textureCacheMagic, sizeof(textureCacheMagic));
+    header.version = textureCacheVersion;
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified;
+    header.filter = uint32_t(settings.filter);
+    header.width = image.width;
+    header.height = image.height;
+    header.levelCount = uint32_t(image.levels.size());
+
+    // Written under another name first, so a launch which is cut short never leaves half a file for the next one to read
+    std::string temporaryPath = cachePath + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not write the texture cache file \"%s\"\n", temporaryPath.c_str());
+        return;
+    }
+    bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (std::vector<uint8_t> const &level : image.levels) {
+        isWritten = isWritten && fwrite(level.data(), 1, level.size(), file) == level.size();
+    }
+    isWritten = fclose(file) == 0 && isWritten;
+
+    std::remove(cachePath.c_str());
+    if (!isWritten || std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+        fprintf(stderr, "Could not write the texture cache file \"%s\"\n", cachePath.c_str());
+        std::remove(temporaryPath.c_str());
+    }
+}
+
+bool TextureLoader::isAtlasable(TextureImage const &image) const {
+    unsigned int padding = settings.atlasPadding;
+    return !image.levels.empty() && image.width <= settings.maximumAtlasedSize && image.height <= settings.maximumAtlasedSize &&
+           image.width + 2 * padding <= settings.atlasSize && image.height + 2 * padding <= settings.atlasSize &&
+           image.width % padding == 0 && image.height % padding == 0;
+}
+
+std::vector<TextureRegion> TextureLoader::load(std::vector<std::string> const &files) {
+    PROFILE_SCOPE("load textures");
+    stats = TextureLoaderStats();
+
+    // Each file is loaded once, however often it is asked for
+    std::unordered_map<std::string, size_t> uniqueIndices;
+    std::vector<size_t> fileIndices(files.size());
+    std::vector<std::string const*> uniqueFiles;
+    for (size_t i = 0; i < files.size(); i++) {
+        auto inserted = uniqueIndices.emplace(files[i], uniqueFiles.size());
+        if (inserted.second) {
+            uniqueFiles.push_back(&files[i]);
+        }
+        fileIndices[i] = inserted.first->second;
+    }
+
+    std::vector<TextureImage> images(uniqueFiles.size());
+    std::vector<LoadResult> results(uniqueFiles.size(), loadFailed);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.parallelFor(uniqueFiles.size(), [&](size_t index, unsigned int) {
+        results[index] = loadImage(*uniqueFiles[index], images[index]);
+    });
+    stats.decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (LoadResult result : results) {
+        stats.decodedCount += result == loadDecoded ? 1 : 0;
+        stats.cachedCount += result == loadCached ? 1 : 0;
+        stats.failedCount += result == loadFailed ? 1 : 0;
+    }
+
+    std::vector<TextureRegion> uniqueRegions(images.size());
+    packAtlases(images, uniqueRegions);
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!images[i].levels.empty() && !uniqueRegions[i].isAtlased) {
+            uniqueRegions[i].texture = upload(images[i], unsigned(images[i].levels.size()), GL_REPEAT);
+            stats.separateTextureCount += uniqueRegions[i].texture != 0 ? 1 : 0;
+        }
+    }
+
+    std::vector<TextureRegion> regions(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        regions[i] = uniqueRegions[fileIndices[i]];
+    }
+    return regions;
+}
+
+void TextureLoader::packAtlases(std::vector<TextureImage> const &images, std::vector<TextureRegion> &regions) {
+    std::vector<size_t> atlased;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (isAtlasable(images[i])) {
+            atlased.push_back(i);
+        }
+    }
+    if (atlased.empty()) {
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Tallest first, and placed next to each other in rows (shelves) as high as the first image in them,
+    // so each shelf is filled with images of about the same height. Every position and size is a multiple of
+    // the padding, which keeps the images' levels lined up with the pages' levels.
+    std::sort(atlased.begin(), atlased.end(), [&images](size_t a, size_t b) {
+        return images[a].height != images[b].height ? images[a].height > images[b].height : images[a].width > images[b].width;
+    });
+    struct Placement {
+        unsigned int page;
+        unsigned int x;
+        unsigned int y;
+    };
+    std::vector<Placement> placements(images.size());
+    std::vector<unsigned int> pageHeights(1, 0);
+    unsigned int padding = settings.atlasPadding;
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int shelfHeight = 0;
+    for (size_t index : atlased) {
+        unsigned int width = images[index].width + 2 * padding;
+        unsigned int height = images[index].height + 2 * padding;
+        if (x + width > settings.atlasSize) {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        if (y + height > settings.atlasSize) {
+            pageHeights.push_back(0);
+            x = 0;
+            y = 0;
+            shelfHeight = 0;
+        }
+        placements[index] = {unsigned(pageHeights.size() - 1), x, y};
+        x += width;
+        shelfHeight = std::max(shelfHeight, height);
+        pageHeights.back() = std::max(pageHeights.back(), y + height);
+    }
+
+    // The last page is only as high as the shelves on it
+    std::vector<TextureImage> pages(pageHeights.size());
+    for (size_t page = 0; page < pages.size(); page++) {
+        pages[page].width = settings.atlasSize;
+        pages[page].height = pageHeights[page];
+        pages[page].levels.resize(atlasLevelCount);
+        for (unsigned int level = 0; level < atlasLevelCount; level++) {
+            pages[page].levels[level].assign(size_t(pages[page].levelWidth(level)) * pages[page].levelHeight(level) * 4, 0);
+        }
+    }
+    pool.parallelFor(atlased.size(), [&](size_t i, unsigned int) {
+        TextureImage const &image = images[atlased[i]];
+        Placement const &placement = placements[atlased[i]];
+        TextureImage &page = pages[placement.page];
+        for (unsigned int level = 0; level < atlasLevelCount; level++) {
+            copyPadded(image.levels[level].data(), image.levelWidth(level), image.levelHeight(level),
+                       page.levels[level].data(), page.levelWidth(level), placement.x >> level, placement.y >> level, padding >> level);
+        }
+    });
+    stats.packMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<GLuint> pageTextures(pages.size());
+    for (size_t page = 0; page < pages.size(); page++) {
+        pageTextures[page] = upload(pages[page], atlasLevelCount, GL_CLAMP_TO_EDGE);
+        stats.atlasPageCount += pageTextures[page] != 0 ? 1 : 0;
+    }
+    for (size_t index : atlased) {
+        Placement const &placement = placements[index];
+        float pageWidth = float(pages[placement.page].width);
+        float pageHeight = float(pages[placement.page].height);
+        TextureRegion &region = regions[index];
+        region.texture = pageTextures[placement.page];
+        region.offset = float2(float(placement.x + padding) / pageWidth, float(placement.y + padding) / pageHeight);
+        region.scale = float2(float(images[index].width) / pageWidth, float(images[index].height) / pageHeight);
+        region.isAtlased = true;
+    }
+    stats.atlasedCount = unsigned(atlased.size());
+}
+
+GLuint TextureLoader::upload(TextureImage const &image, unsigned int levelCount, GLint wrap) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GpuTexture texture = resources.createTexture(GL_RGBA8, 4, image.width, image.height, levelCount);
+    if (texture.isEmpty()) {
+        return 0;
+    }
+    for (unsigned int level = 0; level < levelCount; level++) {
+        glTexSubImage2D(GL_TEXTURE_2D, GLint(level), 0, 0, GLsizei(image.levelWidth(level)), GLsizei(image.levelHeight(level)),
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.levels[level].data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+    GLuint name = texture.get();
+    textures.push_back(std::move(texture));
+    stats.uploadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return name;
+}
+
+void mapTextureCoordinates(Mesh &mesh, TextureRegion const &region) {
+    for (float2 &coordinate : mesh.textureCoordinates) {
+        // An atlased image can't repeat, since its neighbours lie beyond its edges
+        if (region.isAtlased) {
+            coordinate = float2(std::min(std::max(coordinate.x, 0.0f), 1.0f), std::min(std::max(coordinate.y, 0.0f), 1.0f));
+        }
+        coordinate = region.offset + region.scale * coordinate;
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "floats.hpp"
+#include "gpuResources.hpp"
+#include "threadPool.hpp"
+
+class Mesh;
+
+// How each mip level is made from the one above it
+enum MipmapFilter {
+    // The average of every 2x2 block. Fast, but blurry, and lets fine patterns alias into the smaller levels.
+    mipmapFilterBox,
+    // A sinc windowed by a Kaiser window, reaching three texels of the smaller level to either side.
+    // Keeps the smaller levels sharper and with less aliasing, at many times the cost of the box filter.
+    mipmapFilterKaiser
+};
+
+// An image with four 8 bit channels (RGBA), bottom row first like OpenGL expects them, and its mip levels
+struct TextureImage {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    // Level 0 is the image itself. Every level after it is half as wide and high as the one before,
+    // rounded down, but at least 1.
+    std::vector<std::vector<uint8_t>> levels;
+
+    unsigned int levelWidth(unsigned int level) const { return std::max(width >> level, 1u); }
+    unsigned int levelHeight(unsigned int level) const { return std::max(height >> level, 1u); }
+};
+
+// The number of levels from an image of the given size down to 1x1
+unsigned int fullMipmapLevelCount(unsigned int width, unsigned int height);
+
+// Replaces every level of the image but the first with the complete chain down to 1x1, each made from the one before
+void generateMipmaps(TextureImage &image, MipmapFilter filter);
+
+struct TextureLoaderSettings {
+    MipmapFilter filter = mipmapFilterBox;
+    // An existing directory where decoded images and their mip levels are kept, so the next launch
+    // does not have to decode them again. Empty turns the cache off.
+    std::string cacheDirectory;
+    // Images no larger than this on either side go into atlas pages of atlasSize x atlasSize texels,
+    // if both their sides are multiples of atlasPadding
+    unsigned int maximumAtlasedSize = 256;
+    unsigned int atlasSize = 2048;
+    // Texels around every image in an atlas, repeating its edges so filtering does not bleed into its neighbours.
+    // A power of two (or rounded up to one), which also limits the atlas pages' mip levels: the smallest keeps one texel of padding.
+    unsigned int atlasPadding = 8;
+};
+
+// Where a loaded image ended up. A texture coordinate of the image itself is offset + scale * coordinate in the texture.
+struct TextureRegion {
+    // 0 if the image could not be loaded, or did not fit into the textures budget
+    GLuint texture = 0;
+    float2 offset = float2(0.0f, 0.0f);
+    float2 scale = float2(1.0f, 1.0f);
+    // Atlased images are clamped to their edges, while those with textures of their own repeat
+    bool isAtlased = false;
+};
+
+// Counters describing the last load()
+struct TextureLoaderStats {
+    unsigned int decodedCount = 0;
+    unsigned int cachedCount = 0;
+    unsigned int failedCount = 0;
+    unsigned int atlasedCount = 0;
+    unsigned int atlasPageCount = 0;
+    unsigned int separateTextureCount = 0;
+    // Decoding (or reading the cache), generating mipmaps and writing the cache, on all threads at once
+    double decodeMilliseconds = 0.0;
+    // Copying the atlased images into their pages
+    double packMilliseconds = 0.0;
+    double uploadMilliseconds = 0.0;
+};
+
+// Loads images into textures with mip levels.
+//
+// Files are decoded by stb_image on the thread pool, each by one thread, which also generates its mip levels.
+// With a cache directory, the result is written to a file of its own there, which later loads read
+// instead of the image, as long as the image's size and modification time have not changed.
+//
+// Small images are packed into atlas pages, so objects using different ones can be drawn without binding
+// another texture in between. Their texture coordinates have to be moved into their region with mapTextureCoordinates().
+class TextureLoader {
+public:
+    TextureLoader(ThreadPool &pool, GpuResourceManager &resources, TextureLoaderSettings const &settings = TextureLoaderSettings());
+
+    // Loads every file, and returns where each ended up, in the same order.
+    // The textures live as long as the loader.
+    std::vector<TextureRegion> load(std::vector<std::string> const &files);
+
+    // The file the cache keeps the given image in, or an empty string without a cache directory
+    std::string getCachePath(std::string const &file) const;
+
+    TextureLoaderStats const &getStats() const { return stats; }
+
+private:
+    enum LoadResult {
+        loadFailed,
+        loadDecoded,
+        loadCached
+    };
+
+    // Safe to call from any number of threads at once
+    LoadResult loadImage(std::string const &file, TextureImage &image) const;
+    bool readCache(std::string const &cachePath, uint64_t sourceSize, int64_t sourceModified, TextureImage &image) const;
+    void writeCache(std::string const &cachePath, uint64_t sourceSize, int64_t sourceModified, TextureImage const &image) const;
+
+    bool isAtlasable(TextureImage const &image) const;
+    void packAtlases(std::vector<TextureImage> const &images, std::vector<TextureRegion> &regions);
+    GLuint upload(TextureImage const &image, unsigned int levelCount, GLint wrap);
+
+    ThreadPool &pool;
+    GpuResourceManager &resources;
+    TextureLoaderSettings settings;
+    unsigned int atlasLevelCount;
+
+    std::vector<GpuTexture> textures;
+    TextureLoaderStats stats;
+
+    TextureLoader(TextureLoader const &) = delete;
+    TextureLoader & operator =(TextureLoader const &) = delete;
+};
+
+// Moves the mesh's texture coordinates into the region of the image they were made for
+void mapTextureCoordinates(Mesh &mesh, TextureRegion const &region);
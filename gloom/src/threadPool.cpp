@@ -0,0 +1,92 @@
+#include "threadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned int workerCount) {
+    if (workerCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    // Thread index 0 is reserved for the thread which calls parallelFor()
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        isShuttingDown = true;
+    }
+    tasksAvailable.notify_all();
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop(unsigned int threadIndex) {
+    while (true) {
+        std::function<void(unsigned int)> task;
+        {
+            std::unique_lock<std::mutex> lock(tasksMutex);
+            tasksAvailable.wait(lock, [this] { return isShuttingDown || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task(threadIndex);
+    }
+}
+
+// Grabs indices one at a time until none are left. Jobs are usually uneven in size
+// (a character subtree next to a chessboard), so handing out single indices balances better
+// than splitting the range up front.
+void ThreadPool::runParallelFor(ParallelForState &state, unsigned int threadIndex) {
+    size_t index;
+    while ((index = state.nextIndex.fetch_add(1)) < state.count) {
+        state.job(index, threadIndex);
+        state.completedCount.fetch_add(1);
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, std::function<void(size_t, unsigned int)> const &job) {
+    if (count == 0) {
+        return;
+    }
+
+    // Not worth waking anyone up for a single item
+    if (count == 1 || workers.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            job(i, 0);
+        }
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->job = job;
+    state->count = count;
+    state->nextIndex = 0;
+    state->completedCount = 0;
+
+    size_t helperCount = std::min(count - 1, workers.size());
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        for (size_t i = 0; i < helperCount; i++) {
+            tasks.push_back([this, state](unsigned int threadIndex) {
+                runParallelFor(*state, threadIndex);
+                if (state->completedCount.load() == state->count) {
+                    std::lock_guard<std::mutex> completedLock(tasksMutex);
+                    tasksCompleted.notify_all();
+                }
+            });
+        }
+    }
+    tasksAvailable.notify_all();
+
+    runParallelFor(*state, 0);
+
+    std::unique_lock<std::mutex> lock(tasksMutex);
+    tasksCompleted.wait(lock, [&state] { return state->completedCount.load() == state->count; });
+}
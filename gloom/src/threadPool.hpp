@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small pool of worker threads which is created once at startup and reused every frame.
+// Starting threads is expensive, so subsystems which want to spread work over several cores
+// share one of these instead of spawning their own.
+class ThreadPool {
+public:
+    // Creates the pool. A worker count of 0 picks one worker per hardware thread,
+    // minus one for the thread which owns the pool (it helps out in parallelFor()).
+    explicit ThreadPool(unsigned int workerCount = 0);
+    ~ThreadPool();
+
+    // The number of threads which can execute a parallelFor() job at the same time,
+    // including the calling thread. Per-thread buffers should be sized using this value.
+    unsigned int threadCount() const { return unsigned(workers.size()) + 1; }
+
+    // Calls job(index, threadIndex) once for every index in [0, count).
+    // threadIndex lies in [0, threadCount()) and is unique among the threads running concurrently,
+    // which allows jobs to write into per-thread buffers without locking.
+    // The calling thread takes part in the work, and the function returns once all indices are done.
+    // Only the thread which owns the pool may call this; jobs must not call it recursively.
+    void parallelFor(size_t count, std::function<void(size_t, unsigned int)> const &job);
+
+private:
+    // Shared between the caller of parallelFor() and the helper tasks it queues.
+    // Helpers which start after all work is done must still find valid memory, hence the shared_ptr.
+    struct ParallelForState {
+        std::function<void(size_t, unsigned int)> job;
+        size_t count;
+        std::atomic<size_t> nextIndex;
+        std::atomic<size_t> completedCount;
+    };
+
+    static void runParallelFor(ParallelForState &state, unsigned int threadIndex);
+    void workerLoop(unsigned int threadIndex);
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void(unsigned int)>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+    std::condition_variable tasksCompleted;
+    bool isShuttingDown = false;
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator =(ThreadPool const &) = delete;
+};
@@ -65,21 +65,6 @@ Mesh generateChessboard(
     return mesh;
 }
 
-// The standard library's random number generator needs to be seeded in order to produce
-// different results every time the program is run. This should only happen once, so
-// we keep track here with a global variable whether this has happened previously.
-bool isRandomInitialised = false;
-
-float randomUniformFloat() {
-    if (!isRandomInitialised) {
-        // Initialise the random number generator using the current time as a seed
-        srand(static_cast <unsigned> (time(0)));
-        isRandomInitialised = true;
-    }
-    // rand() produces a random integer between 0 and RAND_MAX. This normalises it to a number between 0 and 1.
-    return static_cast <float> (rand()) / static_cast <float>(RAND_MAX);
-}
-
 // In order to be able to calculate when the getTimeDeltaSeconds() function was last called, we need to know the point in time when that happened. This requires us to keep hold of that point in time.
 // We initialise this value to the time at the start of the program.
 static std::chrono::steady_clock::time_point _previousTimePoint = std::chrono::steady_clock::now();
@@ -143,6 +128,8 @@ Path::Path(std::string const &coordinatesFile) {
     waypoints = readCoordinatesFile(coordinatesFile);
 }
 
+Path::Path(std::vector<int2> const &waypoints) : waypoints(waypoints) {}
+
 float2 Path::getCurrentWaypoint(float tileWidth) {
     int2 intWaypoint = waypoints.at(currentWaypoint);
     return float2(intWaypoint.x, intWaypoint.y) * tileWidth;
@@ -6,9 +6,6 @@
 // Generates a mesh containing a 3D object which looks like a chessboard.
 Mesh generateChessboard(unsigned int width, unsigned int height, float tileWidth, float4 tileColour1, float4 tileColour2);
 
-// Returns a random float between 0 and 1
-float randomUniformFloat();
-
 // Return the amount of time elapsed since the LAST TIME this function was called, in seconds.
 double getTimeDeltaSeconds();
 
@@ -29,6 +26,9 @@ public:
     // Constructor. Requires loading a coordinates text file from a specified path.
     Path(std::string const &coordinatesFile);
 
+    // Constructor for a path which was computed rather than loaded, for instance by a Pathfinder.
+    explicit Path(std::vector<int2> const &waypoints);
+
     // Returns the coordinates of the current waypoint, scaled to the coordinate space
     // of the terrain.
     float2 getCurrentWaypoint(float tileWidth);
@@ -40,4 +40,7 @@ public:
     // If the end has been reached, it resets to the first waypoint.
     // Should be called if hasWaypointBeenReached() evaluates to true.
     void advanceToNextWaypoint();
+
+    // All waypoints of the path, in tile coordinates
+    std::vector<int2> const &getWaypoints() const { return waypoints; }
 };
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "transform.hpp"
+#include "toolbox.hpp"
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/matrix.hpp>
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_USE_SSE 1
+#endif
+
+Quaternion multiplyQuaternions(Quaternion const &a, Quaternion const &b) {
+    Quaternion result;
+    result.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+    result.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+    result.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+    result.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+    return result;
+}
+
+Quaternion quaternionFromEulerDegrees(float3 const &degrees) {
+    float halfX = 0.5f * toRadians(degrees.x);
+    float halfY = 0.5f * toRadians(degrees.y);
+    float halfZ = 0.5f * toRadians(degrees.z);
+    float cx = std::cos(halfX), sx = std::sin(halfX);
+    float cy = std::cos(halfY), sy = std::sin(halfY);
+    float cz = std::cos(halfZ), sz = std::sin(halfZ);
+
+    // qz * qy * qx, multiplied out
+    Quaternion result;
+    result.w = cz * cy * cx + sz * sy * sx;
+    result.x = cz * cy * sx - sz * sy * cx;
+    result.y = cz * sy * cx + sz * cy * sx;
+    result.z = sz * cy * cx - cz * sy * sx;
+    return result;
+}
+
+Affine3x4 composeAffine(float3 const &translation, Quaternion const &rotation, float3 const &pivot, float3 const &scale) {
+    float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+
+    // Rotation matrix of the quaternion, with the scale folded into its columns
+    float linear[3][3] = {
+        { (1.0f - 2.0f * (y * y + z * z)) * scale.x, 2.0f * (x * y - w * z) * scale.y,          2.0f * (x * z + w * y) * scale.z },
+        { 2.0f * (x * y + w * z) * scale.x,          (1.0f - 2.0f * (x * x + z * z)) * scale.y, 2.0f * (y * z - w * x) * scale.z },
+        { 2.0f * (x * z - w * y) * scale.x,          2.0f * (y * z + w * x) * scale.y,          (1.0f - 2.0f * (x * x + y * y)) * scale.z },
+    };
+
+    // Rotating around the pivot rather than the origin only changes the translation part:
+    // translation + pivot - linear * pivot
+    Affine3x4 result;
+    for (int row = 0; row < 3; row++) {
+        result.rows[row][0] = linear[row][0];
+        result.rows[row][1] = linear[row][1];
+        result.rows[row][2] = linear[row][2];
+    }
+    result.rows[0][3] = translation.x + pivot.x - (linear[0][0] * pivot.x + linear[0][1] * pivot.y + linear[0][2] * pivot.z);
+    result.rows[1][3] = translation.y + pivot.y - (linear[1][0] * pivot.x + linear[1][1] * pivot.y + linear[1][2] * pivot.z);
+    result.rows[2][3] = translation.z + pivot.z - (linear[2][0] * pivot.x + linear[2][1] * pivot.y + linear[2][2] * pivot.z);
+    return result;
+}
+
+Affine3x4 multiplyAffine(Affine3x4 const &a, Affine3x4 const &b) {
+    Affine3x4 result;
+#ifdef TRANSFORM_USE_SSE
+    __m128 b0 = _mm_load_ps(b.rows[0]);
+    __m128 b1 = _mm_load_ps(b.rows[1]);
+    __m128 b2 = _mm_load_ps(b.rows[2]);
+    // The implicit bottom row of b only contributes to the translation column
+    __m128 b3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (int row = 0; row < 3; row++) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(a.rows[row][0]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a.rows[row][1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a.rows[row][2]), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a.rows[row][3]), b3));
+        _mm_store_ps(result.rows[row], sum);
+    }
+#else
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            result.rows[row][column] = a.rows[row][0] * b.rows[0][column]
+                                     + a.rows[row][1] * b.rows[1][column]
+                                     + a.rows[row][2] * b.rows[2][column];
+        }
+        result.rows[row][3] += a.rows[row][3];
+    }
+#endif
+    return result;
+}
+
+glm::mat4 multiplyMatrixAffine(glm::mat4 const &parent, Affine3x4 const &local) {
+    // glm matrices are column-major. Column j of the result is the sum of the parent's columns
+    // weighted by column j of local, plus the parent's last column for the translation.
+    glm::mat4 result;
+    float const* p = glm::value_ptr(parent);
+    float* r = glm::value_ptr(result);
+#ifdef TRANSFORM_USE_SSE
+    __m128 p0 = _mm_loadu_ps(p + 0);
+    __m128 p1 = _mm_loadu_ps(p + 4);
+    __m128 p2 = _mm_loadu_ps(p + 8);
+    __m128 p3 = _mm_loadu_ps(p + 12);
+
+    for (int column = 0; column < 4; column++) {
+        __m128 sum = _mm_mul_ps(p0, _mm_set1_ps(local.rows[0][column]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(p1, _mm_set1_ps(local.rows[1][column])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(p2, _mm_set1_ps(local.rows[2][column])));
+        if (column == 3) {
+            sum = _mm_add_ps(sum, p3);
+        }
+        _mm_storeu_ps(r + 4 * column, sum);
+    }
+#else
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            r[4 * column + row] = p[row] * local.rows[0][column]
+                                + p[4 + row] * local.rows[1][column]
+                                + p[8 + row] * local.rows[2][column]
+                                + (column == 3 ? p[12 + row] : 0.0f);
+        }
+    }
+#endif
+    return result;
+}
+
+glm::mat4 affineToMatrix(Affine3x4 const &affine) {
+    glm::mat4 result(1.0f);
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            result[column][row] = affine.rows[row][column];
+        }
+    }
+    return result;
+}
+
+glm::mat4 normalMatrix(glm::mat4 const &model) {
+    return glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+}
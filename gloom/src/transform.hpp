@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include "floats.hpp"
+
+// A rotation, stored as a unit quaternion
+struct Quaternion {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    float w = 1.0f;
+};
+
+// An affine transformation stored as the top three rows of a 4x4 matrix (row-major).
+// The bottom row of a rigid transformation is always (0, 0, 0, 1), so it is left out.
+// Each row is 16-byte aligned so it can be loaded into one SIMD register.
+struct Affine3x4 {
+    alignas(16) float rows[3][4];
+};
+
+// Hamilton product: the rotation b followed by the rotation a
+Quaternion multiplyQuaternions(Quaternion const &a, Quaternion const &b);
+
+// The rotation around the X, then the Y, then the Z axis, by angles given in degrees.
+// Matches rotate(z) * rotate(y) * rotate(x) as used by the scene graph.
+Quaternion quaternionFromEulerDegrees(float3 const &degrees);
+
+// Builds the transformation which scales, then rotates around pivot, then moves by translation:
+// T(translation) * T(pivot) * R(rotation) * S(scale) * T(-pivot)
+Affine3x4 composeAffine(float3 const &translation, Quaternion const &rotation, float3 const &pivot, float3 const &scale = float3(1.0f, 1.0f, 1.0f));
+
+// a * b, using SSE when available
+Affine3x4 multiplyAffine(Affine3x4 const &a, Affine3x4 const &b);
+
+// parent * local, where parent may be any 4x4 matrix (including a projection). Uses SSE when available.
+glm::mat4 multiplyMatrixAffine(glm::mat4 const &parent, Affine3x4 const &local);
+
+// Expands an affine transformation into a full 4x4 matrix
+glm::mat4 affineToMatrix(Affine3x4 const &affine);
+
+// The inverse transpose of the model matrix's upper 3x3, which keeps normals perpendicular to their surface
+// under non-uniform scaling. Returned in a 4x4 matrix, the form storage buffers hold it in (see mesh.vert).
+glm::mat4 normalMatrix(glm::mat4 const &model);
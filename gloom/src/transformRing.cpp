@@ -0,0 +1,101 @@
+#include "transformRing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+TransformRing::TransformRing(size_t matricesPerFrame, unsigned int regionCount)
+    : regionCount(regionCount), fences(regionCount, nullptr) {
+    allocate(std::max(matricesPerFrame, size_t(1)));
+}
+
+TransformRing::~TransformRing() {
+    release();
+}
+
+void TransformRing::allocate(size_t matricesPerFrame) {
+    // Every region has to start at an offset glBindBufferRange() accepts
+    GLint alignment = 1;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    regionCapacity = matricesPerFrame;
+    regionSize = matricesPerFrame * sizeof(glm::mat4);
+    regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, regionSize * regionCount, nullptr, flags);
+    mappedMemory = static_cast<unsigned char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, regionSize * regionCount, flags));
+}
+
+void TransformRing::release() {
+    for (GLsync &fence : fences) {
+        waitForFence(fence);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    mappedMemory = nullptr;
+}
+
+// Returns the time spent blocking, in milliseconds
+double TransformRing::waitForFence(GLsync &fence) {
+    if (fence == nullptr) {
+        return 0.0;
+    }
+
+    double waitedMilliseconds = 0.0;
+    // Polling first avoids the cost of reading the clock in the common case where the fence has already signalled
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        waitedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+    return waitedMilliseconds;
+}
+
+void TransformRing::write(std::vector<glm::mat4> const &matrices) {
+    if (matrices.size() > regionCapacity) {
+        // Growing means creating a new buffer, so all regions have to be drained first (release() does that)
+        release();
+        size_t newCapacity = regionCapacity * 2;
+        while (newCapacity < matrices.size()) {
+            newCapacity *= 2;
+        }
+        allocate(newCapacity);
+        currentRegion = 0;
+    }
+
+    currentRegion = (currentRegion + 1) % regionCount;
+
+    stats.fenceWaitMilliseconds = waitForFence(fences.at(currentRegion));
+    stats.bytesWritten = matrices.size() * sizeof(glm::mat4);
+    std::memcpy(mappedMemory + currentRegion * regionSize, matrices.data(), stats.bytesWritten);
+
+    stats.totalFenceWaitMilliseconds += stats.fenceWaitMilliseconds;
+    stats.totalBytesWritten += stats.bytesWritten;
+    stats.frameCount++;
+    if (stats.fenceWaitMilliseconds > 0.0) {
+        stats.stalledFrameCount++;
+    }
+}
+
+void TransformRing::bind(GLuint binding) {
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, GLintptr(currentRegion * regionSize), GLsizeiptr(regionSize));
+}
+
+void TransformRing::endFrame() {
+    GLsync &fence = fences.at(currentRegion);
+    if (fence != nullptr) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
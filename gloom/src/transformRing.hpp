@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Counters describing how the ring buffer behaved
+struct TransformRingStats {
+    // Time the CPU spent blocked on the fence of the region it wanted to write, for the last frame
+    double fenceWaitMilliseconds = 0.0;
+    size_t bytesWritten = 0;
+
+    // Totals since the ring was created
+    double totalFenceWaitMilliseconds = 0.0;
+    size_t totalBytesWritten = 0;
+    unsigned int frameCount = 0;
+    unsigned int stalledFrameCount = 0;
+};
+
+// A shader storage buffer holding the transformation matrices of every draw in a frame,
+// which stays mapped for the lifetime of the program (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT).
+// Writing the matrices is a plain memcpy, with no GL call per draw or per frame.
+//
+// The buffer is split into regions (three by default). Each frame writes the next region and places
+// a fence behind the draws that read it. By the time the ring wraps around to a region again,
+// the GPU is normally long done with it, so waiting on its fence returns immediately.
+class TransformRing {
+public:
+    explicit TransformRing(size_t matricesPerFrame, unsigned int regionCount = 3);
+    ~TransformRing();
+
+    // Copies the frame's matrices into the next region, waiting for the GPU to finish reading it first
+    // if needed. The region grows (after draining the GPU) if the frame has more matrices than fit.
+    void write(std::vector<glm::mat4> const &matrices);
+
+    // Binds the region written by the last write() to the given shader storage buffer binding
+    void bind(GLuint binding);
+
+    // Places the fence protecting the current region. Call after the last draw using it has been issued.
+    void endFrame();
+
+    TransformRingStats const &getStats() const { return stats; }
+
+private:
+    void allocate(size_t matricesPerFrame);
+    void release();
+    double waitForFence(GLsync &fence);
+
+    GLuint buffer = 0;
+    unsigned char* mappedMemory = nullptr;
+    size_t regionSize = 0;
+    size_t regionCapacity = 0;
+    unsigned int regionCount;
+    unsigned int currentRegion = 0;
+    std::vector<GLsync> fences;
+
+    TransformRingStats stats;
+
+    TransformRing(TransformRing const &) = delete;
+    TransformRing & operator =(TransformRing const &) = delete;
+};